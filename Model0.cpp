@@ -15,6 +15,8 @@
 *   - OP[5] Coefficient of variation (= std/mean)
 *   - OP[6] Skewness
 *   - OP[7] Kurtosis
+*   - OP[8..11] 10th, 25th, 75th and 90th percentiles
+*   - OP[12] Interquartile range (= P75 - P25)
 *
 * @note TAC is sorted in **time order**, not dynamic-component order. This
 *       convention is used throughout the DEMP framework (see in-file note).
@@ -32,23 +34,59 @@
 *
 * @section deps Dependencies
 * Relies on framework utilities/macros and globals (non-exhaustive):
-*   GetStartEndInx, PR_MakeRelativeArr, funcSigToConc, PR_GetArrMinMax,
-*   VA_CreateVol, VA_VolCalcRoiInfo, FindMinVal, FindMaxVal, Write,
-*   PR_FrameDelete, AllocMem, pf_free, xz, NumTms, AbsTarr, ParmReq.
+*   GetStartEndInx, PR_MakeRelativeArr, funcSigToConc, Write, AllocMem,
+*   pf_free, xz, NumTms, AbsTarr, ParmReq; the statistics are those of
+*   VA_VolCalcRoiInfo(), from the lane kernels of TacKernels.h.
 *
 * @section ts Thread-safety
-* Not thread-safe: uses statics/globals (@c gStart, @c gEnd, @c Tarr).
+* Reentrant: the active segment and the relative time array live in an
+* @c M0_STATE object created by @c M0_ModelInit() and released by
+* @c M0_ModelClose(). The evaluation functions only read it, so several maps
+* may run at once and one map may be evaluated from many threads.
 *
 * @section mem Memory
-* Allocates a transient TAC buffer and an internal volume for ROI statistics;
-* both are released before return. A relative time array (@c Tarr) is created
-* at init and freed in @c M0_ModelClose().
+* The per-voxel TAC buffer and the copy the median and percentiles are
+* selected in come from the caller's scratch arena, sized at init (@c M0_ModelScratch()). The model state, including a relative time array
+* (@c Tarr), is created at init and freed in @c M0_ModelClose().
 *
+* @section window Window table
+* With a prefix table of the study (@c WindowTable.h), @c M0_ModelFuncWindow()
+* answers OP[3..7] for a new Start Index/Length in O(1) per voxel, so a
+* window can be swept without going back to the TACs.
 *
+* @c M0_ModelFuncMoving() gives the same outputs for every window of L
+* frames sliding over the TAC (a time series per voxel, e.g. a moving mean
+* and StdDev for drift and stability checks), updating the power sums of
+* the window by the entering and the leaving frame at each step.
+*
+* @section frames Frame streaming
+* @c M0_ModelFuncFrame() accumulates the max, spread and moment outputs
+* (OP[0,1,3..7]) one frame at a time, so a study can be mapped without ever
+* holding its TACs.
+*
+* @section defs Statistic definitions
+* The outputs follow the definitions of the framework's ROI statistics
+* (@c VA_VolCalcRoiInfo()), over the n samples x of the segment:
+*   - StdDev is the sample standard deviation, sqrt( sum (x-mean)^2 / (n-1) ),
+*     and 0 for n = 1; CV is StdDev/Mean (0 for a zero mean).
+*   - Skewness m3/m2^1.5 and kurtosis m4/m2^2 - 3 (excess) use the population
+*     central moments mk = sum (x-mean)^k / n; both are 0 for m2 = 0.
+*   - The median is the middle value, or the mean of the two middle values
+*     for an even n.
+*   - The percentiles (not part of the ROI statistics) interpolate between
+*     order statistics at (n-1)*P, so that P50 is that median.
+*
+* @warning These definitions are those of the headless framework shim
+*   (headless/Framework.cpp), which stands in for the application's ROI
+*   statistics. They have not been checked against values captured from
+*   the real @c VA_VolCalcRoiInfo(); if FireVoxel uses the population StdDev
+*   or plain kurtosis, OP[4], OP[5] and OP[7] differ from its own.
 *
 */
 
 #include	"stdafx.h"
+#include	"ModelTable.h"
+#include	"TacKernels.h"
 
 
 char	M0_IFpanelName[]	= "";
@@ -65,7 +103,7 @@ int	 M0_OptimNiter	= 0;
 
 const int	M0_NumIfuncs	= 0;
 const int	M0_NumFreeParms	= 2;
-const int	M0_NumOutParms	= 8;
+const int	M0_NumOutParms	= 13;
 
 BOOL	M0_UseNoise		= FALSE;
 BOOL	M0_UseGlobalTac	= FALSE;
@@ -91,10 +129,16 @@ static char	OPName4[] = "Value StdDev";
 static char OPName5[] = "CoeffOfVariation";
 static char OPName6[] = "Skewness";
 static char OPName7[] = "Kurtosis";
+static char OPName8[] = "P10 value";
+static char OPName9[] = "P25 value";
+static char OPName10[] = "P75 value";
+static char OPName11[] = "P90 value";
+static char OPName12[] = "Interquartile range";
 
 
 
-PSTR	M0_OPName[M0_NumOutParms] = { OPName0,OPName1,OPName2,OPName3,OPName4,OPName5,OPName6,OPName7 };
+PSTR	M0_OPName[M0_NumOutParms] = { OPName0,OPName1,OPName2,OPName3,OPName4,OPName5,OPName6,OPName7,
+					OPName8,OPName9,OPName10,OPName11,OPName12 };
 
 static char	OPUnits0[] = "";
 static char	OPUnits1[] = "";
@@ -104,61 +148,180 @@ static char	OPUnits4[] = "";
 static char OPUnits5[] = "";
 static char OPUnits6[] = "";
 static char OPUnits7[] = "";
+static char OPUnits8[] = "";
+static char OPUnits9[] = "";
+static char OPUnits10[] = "";
+static char OPUnits11[] = "";
+static char OPUnits12[] = "";
+
+PSTR	M0_OPUnits[M0_NumOutParms] = { OPUnits0,OPUnits1,OPUnits2,OPUnits3,OPUnits4,OPUnits5,OPUnits6,OPUnits7,
+					OPUnits8,OPUnits9,OPUnits10,OPUnits11,OPUnits12 };
+
+
+PR_CLRMAP	M0_ClrScheme[M0_NumOutParms] = { PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,
+	PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW  };
+
+
+// Statistics kernels of one TK_* stage set, in double and in float
+typedef void	(*PM0_STATSFUNC)( const double* X,int N,PDOUBLE Work,TK_STATS* St );
+typedef void	(*PM0_STATSFUNCF)( const float* X,int N,float* Work,TK_STATS* St );
+
+
+// Per-map state created by M0_ModelInit()
+struct M0_STATE {
+	int		Start,			// active segment from the free parameters
+			End;
+	PDOUBLE	Tarr;				// relative time array
+	INT64		ScratchSize;		// per-thread arena doubles (M0_ModelScratch)
+	unsigned	Need;				// TK_* stages of the outputs requested in ParmReq[]
+	PM0_STATSFUNC	Stats;			// kernels instantiated for Need
+	PM0_STATSFUNCF	StatsF;
+};
+
+typedef M0_STATE*	PM0_STATE;
+
+void	M0_ModelClose( PVOID ModelState );
+
+
+// TK_* stages output i depends on
+static unsigned	M0_OutNeed( int i )
+{
+static const unsigned	Need[M0_NumOutParms] = {
+	TK_MINMAX,		// Max value
+	TK_MINMAX,		// Value spread
+	TK_MEDIAN,		// Median value
+	TK_MEAN,		// Mean value
+	TK_STDDEV,		// Value StdDev
+	TK_STDDEV,		// CoeffOfVariation
+	TK_SHAPE,		// Skewness
+	TK_SHAPE,		// Kurtosis
+	TK_QUANTILE,	// P10 value
+	TK_QUANTILE,	// P25 value
+	TK_QUANTILE,	// P75 value
+	TK_QUANTILE,	// P90 value
+	TK_QUANTILE };	// Interquartile range
+
+	return TK_StatsClosure( Need[i] );
+}
+
+
+// Kernels of every stage set, indexed by the TK_* mask (only closures are selected)
+#define	M0_STATS4(n)	TK_Stats<n,double>,TK_Stats<n+1,double>,TK_Stats<n+2,double>,TK_Stats<n+3,double>
+#define	M0_STATSF4(n)	TK_Stats<n,float>,TK_Stats<n+1,float>,TK_Stats<n+2,float>,TK_Stats<n+3,float>
+
+static const PM0_STATSFUNC	M0_StatsFunc[TK_ALLSTATS+1] = {
+	M0_STATS4(0),M0_STATS4(4),M0_STATS4(8),M0_STATS4(12),
+	M0_STATS4(16),M0_STATS4(20),M0_STATS4(24),M0_STATS4(28),
+	M0_STATS4(32),M0_STATS4(36),M0_STATS4(40),M0_STATS4(44),
+	M0_STATS4(48),M0_STATS4(52),M0_STATS4(56),M0_STATS4(60) };
 
-PSTR	M0_OPUnits[M0_NumOutParms] = { OPUnits0,OPUnits1,OPUnits2,OPUnits3,OPUnits4,OPUnits5,OPUnits6,OPUnits7 };
+static const PM0_STATSFUNCF	M0_StatsFuncF[TK_ALLSTATS+1] = {
+	M0_STATSF4(0),M0_STATSF4(4),M0_STATSF4(8),M0_STATSF4(12),
+	M0_STATSF4(16),M0_STATSF4(20),M0_STATSF4(24),M0_STATSF4(28),
+	M0_STATSF4(32),M0_STATSF4(36),M0_STATSF4(40),M0_STATSF4(44),
+	M0_STATSF4(48),M0_STATSF4(52),M0_STATSF4(56),M0_STATSF4(60) };
 
+#undef	M0_STATS4
+#undef	M0_STATSF4
 
-PR_CLRMAP	M0_ClrScheme[M0_NumOutParms] = { PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW  };
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Stage set of a block: the one chosen at init, widened if the block asks for more outputs
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static unsigned	M0_BlockNeed(
+		PM0_STATE		S,
+		PMODEL_BATCH	B )
+{
+unsigned	Need = S->Need;
 
-static int		gStart,
-			gEnd;
+	for ( int i=0; i<M0_NumOutParms; i++ )
+		if ( B->OutPlane[i].Data ) Need |= M0_OutNeed( i );
+	return Need;
+}
 
 
-static PDOUBLE	Tarr = NULL;
+// Outputs in OP order from the statistics
+static void	M0_Outputs(
+		const TK_STATS*	St,
+		PDOUBLE		Val )
+{
+	Val[0]	= St->Max;						// "Max value"
+	Val[1]	= St->Max-St->Min;				// "Signal Spread"
+	Val[2]	= St->Median;					// Median signal
+	Val[3]	= St->Mean;						// "Mean Signal"
+	Val[4]	= St->StdDev;					// "Signal StdDev"
+	Val[5]	= St->Mean!=ZERO ? St->StdDev/St->Mean : ZERO;
+	Val[6]	= St->Skewness;
+	Val[7]	= St->Kurtosis;
+	Val[8]	= St->P10;
+	Val[9]	= St->P25;
+	Val[10]	= St->P75;
+	Val[11]	= St->P90;
+	Val[12]	= St->P75-St->P25;
+}
+
 
 /**
 * @brief Initialize Model 0 ("Basic measurements") for the current TAC.
 *
-* Computes the effective [start, end] indices from the free parameters and
-* builds a relative time array used by downstream code.
+* Allocates the model state, computes the effective [start, end] indices from
+* the free parameters and builds a relative time array used by downstream code.
 *
 * @param[out] pModelState
-*   Opaque per-voxel/per-call state pointer used by the framework.
-*   This model does not maintain a state object and sets it to @c NULL.
+*   Receives the new @c M0_STATE object (or @c NULL on failure). It is passed
+*   to @c M0_ModelFunc()/@c M0_ModelFuncBatch() and released by
+*   @c M0_ModelClose().
 *
 * @return bool
 *   @c true on success; @c false on failure.
 *
 * @pre
 *   - @c M0_FreeParm[0] ("Start Index") and @c M0_FreeParm[1] ("Length") are set.
+*   - @c ParmReq[] lists the outputs the map will request.
 *   - Globals @c NumTms and @c AbsTarr are valid.
 *
 * @post
-*   - @c gStart and @c gEnd hold the active segment (0-based, inclusive/exclusive inferred by usage).
-*   - @c Tarr points to a newly created relative time array; freed in @c M0_ModelClose().
-*
-* @note
-*   The current implementation returns @c true unconditionally at the end;
-*   if you want error propagation from @c PR_MakeRelativeArr() via @c xz,
-*   consider returning the local @c res instead.
+*   - @c Start and @c End of the state hold the active segment (0-based, inclusive).
+*   - @c Tarr of the state points to a newly created relative time array.
+*   - @c ScratchSize holds the per-thread arena size (two TAC buffers: the
+*     converted TAC and the copy the median and percentiles are selected in).
+*   - @c Stats/@c StatsF are the kernels instantiated for the statistics the
+*     outputs in @c ParmReq[] need (e.g. a mean-only map neither selects nor
+*     accumulates higher moments).
 *
-* @thread_safety Not thread-safe (writes globals @c gStart, @c gEnd, @c Tarr).
+* @thread_safety Reentrant; touches no module statics.
 */
 
 bool	M0_ModelInit( PVOID* pModelState )
 {
-bool	res	= false;
+PM0_STATE	S	= NULL;
+bool		res	= false;
 
-	GetStartEndInx( iround(M0_FreeParm[0]),iround(M0_FreeParm[1]),&gStart,&gEnd );
+	*pModelState = NULL;
 
-	xz( Tarr = PR_MakeRelativeArr( AbsTarr,NumTms ));
+	xz( AllocMem<M0_STATE >(S,1 ));
+	S->Tarr = NULL;
 
-	*pModelState = NULL;
+	GetStartEndInx( iround(M0_FreeParm[0]),iround(M0_FreeParm[1]),&S->Start,&S->End );
+
+	xz( S->Tarr = PR_MakeRelativeArr( AbsTarr,NumTms ));
+
+	S->ScratchSize = 2*SA_Need( NumTms );
+
+	S->Need = 0;
+	for ( int i=0; i<M0_NumOutParms; i++ )
+		if ( ParmReq[i] ) S->Need |= M0_OutNeed( i );
+	S->Stats	= M0_StatsFunc[S->Need];
+	S->StatsF	= M0_StatsFuncF[S->Need];
+
+	*pModelState = S;
 
 	res	= true;
 func_exit:
-	return true;
+	if ( !res ) M0_ModelClose( S );
+	return res;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -168,118 +331,478 @@ func_exit:
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 void	M0_ModelClose( PVOID ModelState )
 {
-	pf_free(&Tarr);
+PM0_STATE	S = (PM0_STATE)ModelState;
+	if ( !S ) return;
+
+	pf_free(&S->Tarr);
+	pf_free(&S);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Doubles of per-thread scratch arena needed by M0_ModelFuncBatch()
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+INT64	M0_ModelScratch( PVOID ModelState )
+{
+	return ((PM0_STATE)ModelState)->ScratchSize;
 }
 
 
 /**
-* @brief Compute summary statistics over the selected TAC segment.
+* @brief Compute summary statistics for a block of TACs.
 *
-* Converts the input @p Signal to concentration, selects the [start, end]
-* window defined by @c gStart/@c gEnd (or the full TAC if both are zero),
-* and computes:
-*   - max, min (for spread), median, mean, std dev, coefficient of variation,
-*     skewness, and kurtosis.
-* Only the outputs requested via @c ParmReq[] are written in order to @p OutParm.
+* Batch counterpart of @c M0_ModelFunc(); see @c ModelBatch.h for the block
+* layout. Each TAC is converted to concentration into a buffer taken from
+* @c B->Scratch and reset for every voxel (without an arena one is created
+* for the whole block); an already converted block (@c B->IsConc) is used
+* in place.
 *
-* @param[in]  Signal
-*   Pointer to TAC samples (length @c NumTms) in time order. The function
-*   calls @c funcSigToConc(Signal, NumTms, Tac, 1, NULL) before analysis.
+* The statistics of the segment [Start, End] (the whole TAC if both are zero)
+* come from the kernel chosen at init for the outputs in @c ParmReq[]; a
+* block with planes beyond those gets the kernel of the wider stage set.
+* The kernel (@c TK_Stats()) reads the TAC straight from the block, with
+* the sums split over @c TK_LANES partial sums; each output is computed the
+* same way in every stage set (the mean is always the lane sum, the central
+* moments always deviations from it), so every map is the same whichever
+* outputs are requested with it. The median and the percentiles are order
+* statistics selected in one copy of the segment (@c TK_Quantiles()), in
+* linear time instead of a sort.
 *
-* @param[out] OutParm
-*   Framework-managed output writer. Values are appended in the fixed order:
-*   OP[0]=Max value, OP[1]=Value spread, OP[2]=Median, OP[3]=Mean,
-*   OP[4]=StdDev, OP[5]=CoeffOfVariation, OP[6]=Skewness, OP[7]=Kurtosis.
+* @param[in]     ModelState  State from @c M0_ModelInit().
+* @param[in,out] B  Voxel block: @c NumVox voxel-major TACs and the output
+*                   planes for OP[0..12] (@c NULL planes are skipped).
 *
 * @return bool
-*   @c true on success; @c false if a framework allocation/guard fails.
+*   @c true on success; @c false if the scratch arena is missing or too small.
 *
-* @pre
-*   - @c M0_ModelInit() was called and completed successfully.
-*   - @c Signal has @c NumTms elements.
+* @pre  @c M0_ModelInit() was called and completed successfully.
 *
-* @post
-*   - Transient allocations (TAC buffer, ROI volume) are released before return.
-*
-* @details
-*   After conversion to concentration, the function slices the TAC to
-*   [Start, End], then:
-*     1) Finds min/max for the slice via @c PR_GetArrMinMax().
-*     2) Wraps the slice in a temporary volume (@c VA_CreateVol) to reuse
-*        the framework's ROI statistics functions (@c VA_VolCalcRoiInfo).
-*     3) Emits only the requested outputs, in order, using @c Write().
+* @complexity
+*   O(NumVox*N) time and O(NumTms) scratch memory for N selected frames.
+*/
+
+bool	M0_ModelFuncBatch(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
+{
+PM0_STATE	S	= (PM0_STATE)ModelState;
+const bool	All	= S->Start==0 && S->End==0;
+const int	Start	= All ? 0 : S->Start,
+		NT	= (All ? NumTms-1 : S->End)-Start+1;
+const unsigned	Need	= M0_BlockNeed( S,B );
+const PM0_STATSFUNC	Stats	= Need==S->Need ? S->Stats : M0_StatsFunc[Need];
+SCRATCH_ARENA	Local;
+PSCRATCH_ARENA	A;
+bool		res	= false;
+
+	xz( A = MB_BlockArena( B,&Local,S->ScratchSize ));
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		SA_Reset( A );
+
+		PDOUBLE	Tac,Work;
+		xz( Tac = MB_ConcTac( B,v,A,NULL ));
+		xz( Work = SA_Alloc( A,NT ));
+
+		TK_STATS	St;
+		{
+			MP_SCOPE( MP_KERNEL );
+			Stats( Tac+Start,NT,Work,&St );
+		}
+
+		double	Val[M0_NumOutParms];
+		M0_Outputs( &St,Val );
+		MB_StoreVoxel( B,v,Val,M0_NumOutParms,true );
+	}
+
+	res	= true;
+func_exit:
+	SA_Free(&Local);
+	return res;
+}
+
+
+/**
+* @brief Float32 compute mode of @c M0_ModelFuncBatch().
 *
-* @warning
-*   Bounds are derived from free parameters; ensure they are within [0, NumTms).
+* Same outputs from the float TACs of @c B->SignalF (already converted),
+* through the float instantiation of the same stage set: median and
+* percentiles selected in a float copy taken from @c B->Scratch, sum and
+* central moments accumulated in double (@c TK_Stats()).
 *
-* @complexity
-*   O(N) time and O(N) scratch memory for N = number of selected frames.
+* @return bool
+*   @c false if the block carries no converted float TACs or the scratch
+*   arena is missing or too small.
 */
 
-bool	M0_ModelFunc(
-	PDOUBLE	Signal,
-	PIVAL		OutParm )
+bool	M0_ModelFuncBatchF(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
 {
-PDOUBLE	Tac	= NULL;
-PFRAME	V	= NULL;
+PM0_STATE	S	= (PM0_STATE)ModelState;
+const bool	All	= S->Start==0 && S->End==0;
+const int	Start	= All ? 0 : S->Start,
+		NT	= (All ? NumTms-1 : S->End)-Start+1;
+const unsigned	Need	= M0_BlockNeed( S,B );
+const PM0_STATSFUNCF	StatsF	= Need==S->Need ? S->StatsF : M0_StatsFuncF[Need];
+SCRATCH_ARENA	Local;
+PSCRATCH_ARENA	A;
 bool		res	= false;
 
-	xz( AllocMem<double >(Tac,NumTms ));
-	funcSigToConc( Signal,NumTms,Tac,1,NULL );
+	xz( A = MB_BlockArena( B,&Local,S->ScratchSize ));
 
+	for ( int v=0; v<B->NumVox; v++ ) {
+		SA_Reset( A );
 
-int	Start,End;
-	if ((gStart==0) && (gEnd==0))	{ Start = 0; End = NumTms-1; }
-	else					{ Start = gStart; End = gEnd; }
+		const float*	Tac;
+		float*		Work;
+		xz( Tac = MB_TacF( B,v,false ));
+		xz( Work = (float*)SA_Alloc( A,(NT+1)/2 ));
 
+		TK_STATS	St;
+		{
+			MP_SCOPE( MP_KERNEL );
+			StatsF( Tac+Start,NT,Work,&St );
+		}
 
-const PDOUBLE	TP = Tac+Start;
-const int		NT = End-Start+1;
+		double	Val[M0_NumOutParms];
+		M0_Outputs( &St,Val );
+		MB_StoreVoxel( B,v,Val,M0_NumOutParms,true );
+	}
 
-	
-double MinSi,MaxSi;
-	PR_GetArrMinMax( TP,NT,&MinSi,&MaxSi );
+	res	= true;
+func_exit:
+	SA_Free(&Local);
+	return res;
+}
 
-	
-	// Calculate Entropy
-double MaxVal,MeanSi,StdDev,CoeffOfVariation,Median,Skew,Kurtosis;
 
-	{
-	DIM3D Dim( NT,1,1,1 );
-	xz( V = VA_CreateVol( TP,64,&Dim ));
+/**
+* @brief Moment outputs of the segment [Start, End] from a window table.
+*
+* Table counterpart of @c M0_ModelFuncBatch() (see @c WindowTable.h): the
+* mean, standard deviation, coefficient of variation, skewness and kurtosis
+* of the segment come from the prefix power sums of the table rows
+* @c B->V0 .. @c B->V0+B->NumVox-1 in O(1) per voxel, whatever the segment
+* length. @c B->Signal is not read.
+*
+* @return bool
+*   @c false if the block requests the max, spread, median or percentiles
+*   (order statistics need the TACs) or the table holds no @c WT_MOMENTS.
+*/
 
-	double	Vmin = FindMinVal( TP,NT,NULL ),
-			Vmax = FindMaxVal( TP,NT,NULL );
+bool	M0_ModelFuncWindow(
+	PVOID			ModelState,
+	const WT_TABLE*	T,
+	PMODEL_BATCH	B )
+{
+PM0_STATE	S	= (PM0_STATE)ModelState;
+const bool	All	= S->Start==0 && S->End==0;
+const int	Start	= All ? 0 : S->Start,
+		End	= All ? NumTms-1 : S->End;
+const unsigned	Need	= M0_BlockNeed( S,B );
+
+	if ( (Need & (TK_MINMAX|TK_MEDIAN|TK_QUANTILE)) || !(T->Parts & WT_MOMENTS) ) return false;
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		TK_STATS	St;
+		{
+			MP_SCOPE( MP_KERNEL );
+			WT_Stats( T,B->V0+v,Start,End,Need,&St );
+		}
+
+		double	Val[M0_NumOutParms];
+		M0_Outputs( &St,Val );
+		MB_StoreVoxel( B,v,Val,M0_NumOutParms,true );
+	}
+	return true;
+}
+
+
+/**
+* @brief Moment outputs of every window of L frames sliding over the TACs of a block.
+*
+* Window w covers frames w .. w+L-1 of the whole TAC (the Start Index and
+* Length free parameters are not used), for w = 0 .. NumTms-L; its outputs
+* go to the planes @c B->OutPlane[w*M0_NumOutParms+i] (see
+* @c MODEL_ENTRY::FuncMoving). The sums of d, d^2, d^3 and d^4 of a window
+* are moved one frame at a time by adding the powers of the entering frame
+* and subtracting those of the leaving one, so a step costs O(1) whatever L;
+* every L steps they are summed afresh, with d the deviation from the mean
+* of that window, which bounds the rounding carried by the updates (O(1)
+* amortized). @c WT_SumStats() turns them into the mean, StdDev, CV,
+* skewness and kurtosis as @c TK_Stats() defines them.
+*
+* @param[in]     ModelState  State from @c M0_ModelInit().
+* @param[in]     L  Frames per window (1 .. NumTms).
+* @param[in,out] B  Voxel block; @c NumTms-L+1 sets of output planes.
+*
+* @return bool
+*   @c false if the block requests the max, spread, median or percentiles
+*   (order statistics of a sliding window are not kept), L is out of range
+*   or the scratch arena is too small.
+*
+* @complexity O(NumVox*NumTms) time, O(NumTms) scratch memory.
+*/
 
-	VA_ROIINFO RoiInfo;
-	xz( VA_VolCalcRoiInfo( false,V,0,NULL,0,Vmin,Vmax,false,VOIDVAL,0,&RoiInfo ));
+bool	M0_ModelFuncMoving(
+	PVOID		ModelState,
+	int		L,
+	PMODEL_BATCH	B )
+{
+PM0_STATE	S	= (PM0_STATE)ModelState;
+const int	K	= NumTms-L+1;				// windows
+const unsigned	Need	= M0_BlockNeed( S,B );
+SCRATCH_ARENA	Local;
+PSCRATCH_ARENA	A;
+bool		res	= false;
 
-	MaxVal	= RoiInfo.RoiMaxVox;
-	MeanSi	= RoiInfo.AvgSi;
-	StdDev	= RoiInfo.StdDev;
-	CoeffOfVariation = RoiInfo.CoeffOfVariation();
-	Median	= RoiInfo.Median;
-	Skew		= RoiInfo.Skewness;
-	Kurtosis	= RoiInfo.Kurtosis;
+	SA_Init( &Local );
+	if ( (Need & (TK_MINMAX|TK_MEDIAN|TK_QUANTILE)) || L<1 || K<1 ) goto func_exit;
+
+	xz( A = MB_BlockArena( B,&Local,S->ScratchSize ));
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		SA_Reset( A );
+
+		PDOUBLE	Tac;
+		xz( Tac = MB_ConcTac( B,v,A,NULL ));
+
+		MP_SCOPE( MP_KERNEL );
+
+		double	Shift = ZERO,
+			Sum[WT_NUMPOW] = { ZERO };
+
+		for ( int w=0; w<K; w++ ) {
+			TK_STATS	St;
+			double	Val[M0_NumOutParms];
+
+			// every L steps the sums restart from the window itself, about its own mean:
+			// no rounding is carried further, and d stays small where the TAC levels off
+			if ( w%L==0 ) {
+				Shift = TK_ArrSum( Tac+w,L,1 )/L;
+				std::fill( Sum,Sum+WT_NUMPOW,ZERO );
+				for ( int t=w; t<w+L; t++ ) {
+					const double	d = Tac[t]-Shift, d2 = d*d;
+					Sum[0] += d; Sum[1] += d2; Sum[2] += d2*d; Sum[3] += d2*d2;
+				}
+			}
+
+			WT_SumStats( Shift,L,Sum,Need,&St );
+			M0_Outputs( &St,Val );
+			if ( w==0 )	MB_StoreVoxel( B,v,Val,M0_NumOutParms,true );
+			else		MB_StoreWindow( B,w,v,Val,M0_NumOutParms );
+
+			if ( w+1<K && (w+1)%L ) {
+				const double	a = Tac[w+L]-Shift, a2 = a*a,	// entering
+						r = Tac[w]-Shift,   r2 = r*r;		// leaving
+				Sum[0] += a-r;
+				Sum[1] += a2-r2;
+				Sum[2] += a2*a-r2*r;
+				Sum[3] += a2*a2-r2*r2;
+			}
+		}
 	}
-	
-
-	if ( ParmReq[0] ) Write( OutParm,MaxVal );			// "Signal Spread"
-	if ( ParmReq[1] )	Write( OutParm,MaxSi-MinSi );			// "Signal Spread"
-	if ( ParmReq[2] )	Write( OutParm,Median );			// Median signal
-	if ( ParmReq[3] )	Write( OutParm,MeanSi );			// "Mean Signal"	
-	if ( ParmReq[4] ) Write( OutParm,StdDev );			// "Signal StdDev"
-	if ( ParmReq[5] ) Write( OutParm,CoeffOfVariation );		// "Signal StdDev"
-	if ( ParmReq[6] ) Write( OutParm,Skew );				
-	if ( ParmReq[7] ) Write( OutParm,Kurtosis );
-	
+
 	res	= true;
 func_exit:
-	PR_FrameDelete(&V);
-	pf_free(&Tac);
+	SA_Free(&Local);
 	return res;
 }
 
 
+// Accumulator doubles per voxel of M0_ModelFuncFrame() for the stage set Need: the shift, the
+// power sums the stages read, then min and max
+static int	M0_FramePow( unsigned Need )
+{
+	return (Need & TK_SHAPE) ? 4 : (Need & TK_STDDEV) ? 2 : (Need & TK_MEAN) ? 1 : 0;
+}
 
+static INT64	M0_ModelFrameAcc( PVOID ModelState )
+{
+const unsigned	Need = ((PM0_STATE)ModelState)->Need;
 
+	return 1+M0_FramePow( Need )+((Need & TK_MINMAX) ? 2 : 0);
+}
+
+
+// Fold sample x of the segment into the accumulators A of one voxel: NP power sums, min/max if MM
+template<int NP,bool MM>
+static void	M0_FrameAdd(
+		PDOUBLE		A,
+		int			NA,
+		const double*	X,
+		int			N,
+		bool			First )
+{
+	for ( int v=0; v<N; v++, A+=NA ) {
+		const double	x = X[v];
+
+		if ( First ) {
+			A[0] = x;
+			if ( MM ) A[NP+1] = A[NP+2] = x;
+		}
+		const double	d = x-A[0], d2 = d*d;
+		if ( NP>=1 ) A[1] += d;
+		if ( NP>=2 ) A[2] += d2;
+		if ( NP>=4 ) { A[3] += d2*d; A[4] += d2*d2; }
+		if ( MM ) {
+			if ( x<A[NP+1] ) A[NP+1] = x;
+			if ( x>A[NP+2] ) A[NP+2] = x;
+		}
+	}
+}
+
+
+/**
+* @brief Frame-streaming form of @c M0_ModelFuncBatch() (see @c MODEL_ENTRY::FuncFrame).
+*
+* Each frame of the segment [Start, End] adds to the power sums of d, d^2,
+* d^3 and d^4 of every voxel, with d the deviation from the first sample of
+* the segment (so that the central sums do not cancel when the TAC sits far
+* from zero), and to its min and max; only the sums and extremes the stage
+* set of the state needs are kept. @c WT_SumStats() turns them into the
+* mean, StdDev, CV, skewness and kurtosis as @c TK_Stats() defines them,
+* equal to the batch outputs to rounding. After the first t frames of an
+* acquisition the outputs are those of the part of the segment received
+* (void if none of it is).
+*
+* @param[in]     ModelState  State from @c M0_ModelInit().
+* @param[in]     t  Frame of @c B->Signal, or with @c B->Signal @c NULL the
+*                   number of frames folded.
+* @param[in,out] B  Voxel block of one frame; @c B->Acc holds
+*                   @c M0_ModelFrameAcc() doubles per voxel.
+*
+* @return bool
+*   @c false if the state asks for the median or percentiles (order
+*   statistics need the whole TAC).
+*/
+
+bool	M0_ModelFuncFrame(
+	PVOID		ModelState,
+	int		t,
+	PMODEL_BATCH	B )
+{
+PM0_STATE	S	= (PM0_STATE)ModelState;
+const bool	All	= S->Start==0 && S->End==0;
+const int	Start	= All ? 0 : S->Start,
+		End	= All ? NumTms-1 : S->End,
+		NP	= M0_FramePow( S->Need ),
+		NA	= (int)M0_ModelFrameAcc( S );
+const bool	MM	= (S->Need & TK_MINMAX)!=0;
+
+	if ( S->Need & (TK_MEDIAN|TK_QUANTILE) ) return false;
+
+	if ( B->Signal ) {
+		if ( t<Start || t>End ) return true;
+
+		MP_SCOPE_BLOCK( MP_KERNEL,B->NumVox );
+		switch ( NP*2+MM ) {
+		case 0:		M0_FrameAdd<0,false>( B->Acc,NA,B->Signal,B->NumVox,t==Start );	break;
+		case 1:		M0_FrameAdd<0,true >( B->Acc,NA,B->Signal,B->NumVox,t==Start );	break;
+		case 2:		M0_FrameAdd<1,false>( B->Acc,NA,B->Signal,B->NumVox,t==Start );	break;
+		case 3:		M0_FrameAdd<1,true >( B->Acc,NA,B->Signal,B->NumVox,t==Start );	break;
+		case 4:		M0_FrameAdd<2,false>( B->Acc,NA,B->Signal,B->NumVox,t==Start );	break;
+		case 5:		M0_FrameAdd<2,true >( B->Acc,NA,B->Signal,B->NumVox,t==Start );	break;
+		case 8:		M0_FrameAdd<4,false>( B->Acc,NA,B->Signal,B->NumVox,t==Start );	break;
+		default:	M0_FrameAdd<4,true >( B->Acc,NA,B->Signal,B->NumVox,t==Start );	break;
+		}
+		return true;
+	}
+
+	// frames of the segment folded so far
+	const int	N = min( End,t-1 )-Start+1;
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		const double*	A = B->Acc+(INT64)v*NA;
+		double		Sum[WT_NUMPOW] = { ZERO,ZERO,ZERO,ZERO };
+		TK_STATS		St;
+
+		if ( N<1 ) {
+			MB_StoreVoxel( B,v,NULL,M0_NumOutParms,false );
+			continue;
+		}
+		std::copy( A+1,A+1+NP,Sum );
+		WT_SumStats( A[0],N,Sum,S->Need,&St );
+		if ( MM ) {
+			St.Min = A[NP+1];
+			St.Max = A[NP+2];
+		}
+
+		double	Val[M0_NumOutParms];
+		M0_Outputs( &St,Val );
+		MB_StoreVoxel( B,v,Val,M0_NumOutParms,true );
+	}
+	return true;
+}
+
+
+/**
+* @brief Compute summary statistics over the selected TAC segment of one voxel.
+*
+* Thin wrapper over @c M0_ModelFuncBatch() for a block of one voxel. Only the
+* outputs requested via @c ParmReq[] are written, in OP order, to @p OutParm:
+* OP[0]=Max value, OP[1]=Value spread, OP[2]=Median, OP[3]=Mean,
+* OP[4]=StdDev, OP[5]=CoeffOfVariation, OP[6]=Skewness, OP[7]=Kurtosis,
+* OP[8..11]=P10, P25, P75, P90, OP[12]=Interquartile range.
+*
+* @param[in]  ModelState  State from @c M0_ModelInit().
+* @param[in]  Signal   TAC samples (length @c NumTms) in time order.
+* @param[out] OutParm  Framework-managed output writer.
+*
+* @return bool
+*   @c true on success; @c false if a framework allocation/guard fails.
+*/
+
+bool	M0_ModelFunc(
+	PVOID		ModelState,
+	PDOUBLE	Signal,
+	PIVAL		OutParm )
+{
+	return MB_ModelFuncVoxel( M0_ModelFuncBatch,ModelState,Signal,OutParm,M0_NumOutParms );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Driver table entry (see ModelTable.h)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	M0_EntryInit(
+		PVOID*	pModelState,
+		PINPUTFUNC	/*IFarr*/,
+		int		/*NumIF*/ )
+{
+	return M0_ModelInit( pModelState );
+}
+
+MODEL_ENTRY	M0_ModelEntry( void )
+{
+MODEL_ENTRY	E = {};
+
+	E.Number	= 0;
+	E.Name		= M0_ModelName;
+	E.NumFreeParms	= M0_NumFreeParms;
+	E.FreeParm	= M0_FreeParm;
+	E.FPName	= M0_FPName;
+	E.NumOutParms	= M0_NumOutParms;
+	E.OPName	= M0_OPName;
+	E.NumIfuncs	= M0_NumIfuncs;
+	E.Init		= M0_EntryInit;
+	E.Close		= M0_ModelClose;
+	E.Func		= M0_ModelFunc;
+	E.FuncBatch	= M0_ModelFuncBatch;
+	E.ScratchSize	= M0_ModelScratch;
+	E.FuncBatchF	= M0_ModelFuncBatchF;
+	E.FuncWindow	= M0_ModelFuncWindow;
+	E.WindowParts	= WT_MOMENTS;
+	E.WindowOut	= BM(3)|BM(4)|BM(5)|BM(6)|BM(7);
+	E.FuncMoving	= M0_ModelFuncMoving;
+	E.FuncFrame	= M0_ModelFuncFrame;
+	E.FrameAcc	= M0_ModelFrameAcc;
+	E.FrameOut	= BM(0)|BM(1)|BM(3)|BM(4)|BM(5)|BM(6)|BM(7);
+	E.LiveOut	= BM(0)|BM(1)|BM(3)|BM(4)|BM(5)|BM(6)|BM(7);
+
+	return E;
+}
@@ -8,6 +8,8 @@
 * via free parameters, and computes the integral of the TAC over absolute
 * time for that window. The single output is:
 *   - OP[0] Curve integral by time (AUC)
+* and, on request, a series of AUCs of the same window up to several times
+* (see @ref series).
 *
 * @section params Free Parameters
 *   - FP[0] "Start Index" (int): zero-based index of the first frame in the segment.
@@ -16,8 +18,10 @@
 *
 * @section io Inputs/Outputs
 *   - Input: @c Signal (double[NumTms]) — TAC samples in time order.
-*            The function internally calls @c funcSigToConc() to convert
-*            signal to concentration before integration.
+*            A raw TAC that comes with the linear form of its conversion
+*            (@c MODEL_BATCH::ConcOffset, @c ConcScale) is integrated raw and
+*            the form applied to the integral; any other raw TAC is
+*            converted by @c funcSigToConc() before integration.
 *   - Time base: @c AbsTarr (double[NumTms]) — absolute frame times used as the
 *                integration variable.
 *   - Output: @c OutParm — framework writer used by @c Write() to emit OP[0]
@@ -25,14 +29,39 @@
 *
 * @section deps Dependencies
 * Uses framework utilities/globals (non‑exhaustive):
-*   GetStartEndInx, iround, funcSigToConc, PR_CalculateIntegral,
+*   GetStartEndInx, iround, funcSigToConc, TK_Gemv,
 *   AllocMem, pf_free, Write, ParmReq, AbsTarr, NumTms.
 *
 * @section ts Thread-safety
-* Not thread‑safe: writes/reads global indices @c gStart and @c gEnd.
+* Reentrant: the window indices live in an @c M1_STATE object created by
+* @c M1_ModelInit(); evaluation only reads it.
 *
 * @section mem Memory
-* Allocates a temporary TAC buffer; released before return.
+* The weight vectors (at most NumTms doubles each) belong to the state. The
+* TAC buffer of a converted voxel comes from the caller's scratch arena,
+* sized at init (@c M1_ModelScratch()).
+*
+* @section window Window table
+* With a prefix table of the study (@c WindowTable.h), @c M1_ModelFuncWindow()
+* answers a new Start Index/Length in O(1) per voxel.
+*
+* @section series Series
+* With @c M1_NumSeries set before init, the same pass also evaluates the
+* AUC from the Start Index frame up to @c M1_SeriesTime[k] seconds after it
+* (clamped to the window, the TAC interpolated linearly inside a frame), or
+* up to every frame with @c MB_SERIESFRAMES: the cumulative AUC curve, zero
+* before the window and constant after it. Point k goes to
+* @c MODEL_BATCH::SeriesPlane[k]. All points are read off one running
+* trapezoid integral over the window, so the series costs one integration
+* whatever the number of points.
+*
+* @section frames Frame streaming
+* @c M1_ModelFuncFrame() adds each frame of the window, times its weight,
+* to a per-voxel accumulator, so the AUC map can be built one frame at a
+* time; raw frames are integrated raw and the conversion descriptor of the
+* final block applied to the sum, as in the batch kernel.
+* From concentration frames it also gives the AUC of the part of the
+* window received so far, for maps updated during the acquisition.
 *
 * @section units Units
 * AUC units are [concentration units of @c funcSigToConc()] ×
@@ -43,6 +72,8 @@
 */
 
 #include	"stdafx.h"
+#include	"ModelTable.h"
+#include	"TacKernels.h"
 
 char	M1_IFpanelName[]	= "";
 
@@ -82,44 +113,133 @@ PSTR	M1_OPUnits[M1_NumOutParms] = { OPUnits0 };
 
 PR_CLRMAP	M1_ClrScheme[M1_NumOutParms] = { PR_CLRMAP_RAINBOW };
 
+char	M1_SeriesName[]	= "Cumulative integral by time";
+
+double	M1_SeriesTime[DEF_MAXNUMTMS];		// series points, seconds after the Start Index frame
+int	M1_NumSeries	= 0;				// points set in M1_SeriesTime; 0 = none, MB_SERIESFRAMES = every frame
+
+
+enum {
+	M1_CHUNK	= 64				// voxels integrated by one TK_Gemv() call
+};
 
 
-static int	gStart,gEnd;
+// Series point: the running integral up to frame j plus the part of segment [j,j+1] up to the point
+struct M1_POINT {
+	int		j;				// last whole frame, Start <= j <= End
+	double	A,B;				// the part of the segment: A*c[j]+B*c[j+1]
+	double	Dur;				// integration time (the offset term of a raw TAC)
+};
+
+
+// Per-map state created by M1_ModelInit()
+struct M1_STATE {
+	int	Start,End;				// inclusive integration window
+	PDOUBLE	W;				// W[t-Start]: trapezoid weight of frame t of the window
+	double	WSum;				// sum of W: the integration time, times the offset of a raw TAC
+	int	NumPt;				// series points (0 = none)
+	M1_POINT*	Pt;
+	INT64	ScratchSize;			// per-thread arena doubles (M1_ModelScratch)
+};
+
+typedef M1_STATE*	PM1_STATE;
+
+void	M1_ModelClose( PVOID ModelState );
 
 
 /**
 * @brief Initialize Model 1 (AUC) for the current TAC.
 *
-* Computes the active [start, end] indices from the free parameters and stores
-* them in the module globals.
+* Allocates the model state and computes the active [start, end] indices from
+* the free parameters.
 *
 * @param[out] pModelState
-*   Opaque per‑call state pointer used by the framework. This model does not
-*   maintain state and sets it to @c NULL.
+*   Receives the new @c M1_STATE object (or @c NULL on failure); released by
+*   @c M1_ModelClose().
 *
 * @return bool
-*   Always @c true (initialization succeeds unconditionally in this model).
+*   @c true on success; @c false if the state cannot be allocated.
 *
 * @pre
 *   - @c M1_FreeParm[0] ("Start Index") and @c M1_FreeParm[1] ("Length") are set.
 *   - @c NumTms and @c AbsTarr are valid for the current TAC.
 *
 * @post
-*   - @c gStart and @c gEnd contain the selected inclusive indices.
+*   - @c Start and @c End of the state contain the selected inclusive indices.
+*   - @c ScratchSize holds the per-thread arena size (one TAC buffer).
+*   - @c W holds the trapezoid weights of the window, @c WSum their sum.
+*   - @c Pt holds the series points of @c M1_SeriesTime / @c M1_NumSeries.
 *
 * @details
-*   Index calculation is delegated to @c GetStartEndInx(iround(FP0), iround(FP1), &gStart, &gEnd).
+*   Index calculation is delegated to @c GetStartEndInx(iround(FP0), iround(FP1), &Start, &End).
+*
+*   The trapezoid AUC over [Start, End] is the dot product of the TAC with
+*   w[t] = (AbsTarr[t+1]-AbsTarr[t-1])/2, the terms outside the window
+*   dropped at its ends. For a raw TAC whose conversion is linear,
+*   c = (S-Offset)*Scale, the AUC is (w·S - Offset*sum(w))*Scale; the driver
+*   supplies Offset and Scale (@c funcSigToConcLinear()), so the model
+*   knows nothing of the conversion types.
 *
-* @thread_safety Not thread‑safe (updates globals @c gStart/@c gEnd).
+* @thread_safety Reentrant; touches no module statics.
 */
 
 bool	M1_ModelInit( PVOID* pModelState )
 {
+PM1_STATE	S	= NULL;
+bool		res	= false;
+
 	*pModelState = NULL;
 
-	GetStartEndInx( iround(M1_FreeParm[0]),iround(M1_FreeParm[1]),&gStart,&gEnd );
+	xz( AllocMem<M1_STATE >(S,1 ));
+	S->W		= NULL;
+	S->Pt	= NULL;
+	S->NumPt	= 0;
 
-	return true;
+	GetStartEndInx( iround(M1_FreeParm[0]),iround(M1_FreeParm[1]),&S->Start,&S->End );
+
+	{
+		const int	Lng = S->End-S->Start+1;
+
+		xz( AllocMem<double >(S->W,Lng ));
+		S->WSum = ZERO;
+		for ( int i=0; i<Lng; i++ ) {
+			const int	t = S->Start+i;
+			S->W[i]	= ((i+1<Lng ? AbsTarr[t+1] : AbsTarr[t])-(i>0 ? AbsTarr[t-1] : AbsTarr[t]))*0.5;
+			S->WSum	+= S->W[i];
+		}
+	}
+
+	if ( M1_NumSeries ) {
+		const bool		Frames = M1_NumSeries==MB_SERIESFRAMES;
+		const double	t0 = AbsTarr[S->Start],
+				t1 = AbsTarr[S->End];
+
+		S->NumPt = Frames ? NumTms : min( max( M1_NumSeries,0 ),(int)DEF_MAXNUMTMS );
+		xz( AllocMem<M1_POINT >(S->Pt,S->NumPt ));
+
+		for ( int k=0; k<S->NumPt; k++ ) {
+			M1_POINT&	p = S->Pt[k];
+			const double	E = min( max( Frames ? AbsTarr[k] : t0+M1_SeriesTime[k],t0 ),t1 );
+
+			for ( p.j=S->Start; p.j<S->End && AbsTarr[p.j+1]<=E; p.j++ );
+
+			// TAC linear over the segment: c(E) = c[j]+f*(c[j+1]-c[j])
+			const double	d = E-AbsTarr[p.j],
+					f = d>ZERO ? d/(AbsTarr[p.j+1]-AbsTarr[p.j]) : ZERO;
+			p.A	= d*(1-f*0.5);
+			p.B	= d*f*0.5;
+			p.Dur	= E-t0;
+		}
+	}
+
+	S->ScratchSize = SA_Need( NumTms )+(S->NumPt ? SA_Need( S->End-S->Start+1 ) : 0);
+
+	*pModelState = S;
+
+	res	= true;
+func_exit:
+	if ( !res ) M1_ModelClose( S );
+	return res;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -129,69 +249,414 @@ bool	M1_ModelInit( PVOID* pModelState )
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 void	M1_ModelClose( PVOID ModelState )
 {
+PM1_STATE	S = (PM1_STATE)ModelState;
+	if ( !S ) return;
+
+	pf_free(&S->W);
+	pf_free(&S->Pt);
+	pf_free(&S);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Doubles of per-thread scratch arena needed by M1_ModelFuncBatch()
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+INT64	M1_ModelScratch( PVOID ModelState )
+{
+	return ((PM1_STATE)ModelState)->ScratchSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Series points of voxel v of B from its TAC: one running trapezoid integral over the window (in P,
+// End-Start+1 doubles), read at every point. A raw TAC gets its conversion (Sig-Offset)*Scale applied
+// to the integrals; a concentration TAC has Offset 0 and Scale 1.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+static void	M1_StoreSeries(
+		const M1_STATE*	S,
+		PMODEL_BATCH	B,
+		int			v,
+		const T*		Tac,
+		double		Offset,
+		double		Scale,
+		PDOUBLE		P )
+{
+const int	Start = S->Start;
+
+	P[0] = ZERO;
+	for ( int t=Start+1; t<=S->End; t++ )
+		P[t-Start] = P[t-Start-1]+(AbsTarr[t]-AbsTarr[t-1])*(double)(Tac[t]+Tac[t-1]);
+
+	for ( int k=0; k<S->NumPt; k++ ) {
+		if ( !B->SeriesPlane[k].Data ) continue;
+
+		const M1_POINT&	p = S->Pt[k];
+		const double	x = P[p.j-Start]*0.5+p.A*Tac[p.j]+p.B*Tac[min( p.j+1,S->End )];
+
+		MB_StoreValue( B->SeriesPlane+k,B->V0+v,(x-Offset*p.Dur)*Scale );
+	}
 }
 
 
 /**
-* @brief Compute AUC over the selected TAC segment and emit OP[0] if requested.
+* @brief Compute AUC over the selected TAC segment for a block of voxels.
 *
-* Converts @p Signal to concentration, slices the TAC to the inclusive window
-* [@c gStart, @c gEnd], then integrates that slice with respect to absolute
-* time using @c PR_CalculateIntegral().
+* Batch counterpart of @c M1_ModelFunc(); see @c ModelBatch.h for the block
+* layout. The TAC of every voxel is integrated over the inclusive window
+* [@c Start, @c End] of the state with respect to absolute time, as
+*     @code
+*     AUC = PR_CalculateIntegral(Tac + Start, AbsTarr + Start, N);
+*     @endcode
+* does with N = (@c End - @c Start + 1): the trapezoid weights of the state
+* are applied to @c M1_CHUNK TACs at a time as one matrix-vector product
+* (@c TK_Gemv()), a single stream over the block. A raw block
+* (@c B->IsConc false) with a conversion descriptor goes through the same
+* weights, and the linear form of each TAC's conversion is applied to its
+* integral; without a descriptor its TACs are converted one by one.
+* The result goes to @c B->OutPlane[0], the series points of the state (if
+* any, and if the block has @c SeriesPlane) to @c B->SeriesPlane[k].
 *
-* @param[in]  Signal
-*   Pointer to TAC samples (length @c NumTms) in time order.
-*   The function calls @c funcSigToConc(Signal, NumTms, Tac, 1, NULL).
-*
-* @param[out] OutParm
-*   Framework-managed writer. When @c ParmReq[0] is nonzero, writes:
-*   - OP[0] = "Curve integral by time" (AUC over the selected window).
+* @param[in]     ModelState  State from @c M1_ModelInit().
+* @param[in,out] B  Voxel block; @c OutPlane[0] receives OP[0] when non-NULL.
 *
 * @return bool
-*   @c true on success; @c false if an allocation/guarded call fails (as
-*   enforced by the framework's @c xz macro and related checks).
+*   @c true on success; @c false if the scratch arena is missing or too small.
 *
 * @pre
 *   - @c M1_ModelInit() completed successfully.
-*   - 0 ≤ @c gStart ≤ @c gEnd < @c NumTms.
-*   - @c AbsTarr is monotonic over [@c gStart, @c gEnd].
-*
-* @post
-*   - Temporary TAC buffer is freed before return.
-*
-* @details
-*   Let N = (@c gEnd - @c gStart + 1). Integration is performed as:
-*     @code
-*     AUC = PR_CalculateIntegral(Tac + gStart, AbsTarr + gStart, N);
-*     @endcode
-*   Only OP[0] is produced by this model; additional outputs are ignored.
+*   - 0 ≤ @c Start ≤ @c End < @c NumTms.
+*   - @c AbsTarr is monotonic over [@c Start, @c End].
 *
 * @warning
 *   The function assumes valid bounds and a nonempty window (N ≥ 1).
 *
 * @complexity
-*   O(N) time and O(N) temporary memory where N = number of frames in the window.
+*   O(NumVox*(N+NumPt)) time; one TAC buffer of scratch for a raw block
+*   without a descriptor, one window buffer for the series.
 */
 
-bool	M1_ModelFunc(
-	PDOUBLE	Signal,
-	PIVAL		OutParm )
+bool	M1_ModelFuncBatch(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
 {
-PDOUBLE	Tac = NULL;
+const PM1_STATE	S	= (PM1_STATE)ModelState;
+const int		Start	= S->Start,
+			Lng	= S->End-S->Start+1;
+const bool		Series	= S->NumPt && B->SeriesPlane,
+			Convert	= !B->IsConc && !B->ConcOffset;	// raw TACs without a conversion descriptor
+SCRATCH_ARENA	Local;
+PSCRATCH_ARENA	A = NULL;
+PDOUBLE		P = NULL;				// running integral of the series
 bool		res = false;
 
-	xz( AllocMem<double >(Tac,NumTms ));
-	funcSigToConc( Signal,NumTms,Tac,1,NULL );
+	SA_Init( &Local );
+	if ( Series || Convert ) xz( A = MB_BlockArena( B,&Local,S->ScratchSize ));
+
+	if ( Convert ) {
+		for ( int v=0; v<B->NumVox; v++ ) {
+			SA_Reset( A );
+
+			PDOUBLE	Tac;
+			xz( Tac = MB_ConcTac( B,v,A,NULL ));
+			if ( Series ) xz( P = SA_Alloc( A,Lng ));
 
-int	Lng = gEnd-gStart+1;
+			double	AUC;
+			{
+				MP_SCOPE( MP_INTEGRATE );
+				TK_Gemv( Tac+Start,NumTms,1,S->W,Lng,&AUC );
+				if ( Series ) M1_StoreSeries( S,B,v,Tac,ZERO,ONE,P );
+			}
 
-double	AUC	= PR_CalculateIntegral( Tac+gStart,AbsTarr+gStart,Lng );
+			MB_StoreVoxel( B,v,&AUC,M1_NumOutParms,true );
+		}
+	}
+	else {
+		if ( Series ) {
+			SA_Reset( A );
+			xz( P = SA_Alloc( A,Lng ));
+		}
 
-	if ( ParmReq[0] ) Write( OutParm,AUC );
+		for ( int v0=0; v0<B->NumVox; v0+=M1_CHUNK ) {
+			const int		n   = min( B->NumVox-v0,(int)M1_CHUNK );
+			const double*	Sig = B->Signal+(INT64)v0*NumTms;
+			double		AUC[M1_CHUNK];
+			{
+				MP_SCOPE_BLOCK( MP_INTEGRATE,n );
+				TK_Gemv( Sig+Start,NumTms,n,S->W,Lng,AUC );
+
+				// raw TACs: the linear form of their conversion, (w.S - Offset*sum(w))*Scale
+				if ( !B->IsConc )
+					for ( int i=0; i<n; i++ )
+						AUC[i] = (AUC[i]-B->ConcOffset[v0+i]*S->WSum)*B->ConcScale[v0+i];
+			}
+
+			for ( int i=0; i<n; i++ ) {
+				if ( Series ) {
+					MP_SCOPE( MP_INTEGRATE );
+					M1_StoreSeries( S,B,v0+i,Sig+(INT64)i*NumTms,
+							B->IsConc ? ZERO : B->ConcOffset[v0+i],B->IsConc ? ONE : B->ConcScale[v0+i],P );
+				}
+				MB_StoreVoxel( B,v0+i,AUC+i,M1_NumOutParms,true );
+			}
+		}
+	}
 
 	res	= true;
 func_exit:
-	pf_free(&Tac);
+	SA_Free(&Local);
 	return res;
 }
 
+
+/**
+* @brief Float32 compute mode of @c M1_ModelFuncBatch().
+*
+* Integrates the float TACs of @c B->SignalF (already converted) with the
+* trapezoid weights of the state, @c M1_CHUNK TACs per @c TK_Gemv() call:
+* the samples are widened to double as they are read. The series points
+* come from a running integral of the float TAC, accumulated in double.
+*
+* @return bool @c false if the block carries no converted float TACs.
+*/
+
+bool	M1_ModelFuncBatchF(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
+{
+const PM1_STATE	S	= (PM1_STATE)ModelState;
+const int		Start	= S->Start,
+			Lng	= S->End-S->Start+1;
+const bool		Series	= S->NumPt && B->SeriesPlane;
+SCRATCH_ARENA	Local;
+PSCRATCH_ARENA	A;
+PDOUBLE		P = NULL;				// running integral of the series
+bool		res = false;
+
+	SA_Init( &Local );
+	if ( Series ) {
+		xz( A = MB_BlockArena( B,&Local,S->ScratchSize ));
+		SA_Reset( A );
+		xz( P = SA_Alloc( A,Lng ));
+	}
+
+	for ( int v0=0; v0<B->NumVox; v0+=M1_CHUNK ) {
+		const int	n = min( B->NumVox-v0,(int)M1_CHUNK );
+		const float*	Tac;
+		xz( Tac = MB_TacF( B,v0,false ));
+
+		double	AUC[M1_CHUNK];
+		{
+			MP_SCOPE_BLOCK( MP_INTEGRATE,n );
+			TK_Gemv( Tac+Start,NumTms,n,S->W,Lng,AUC );
+		}
+		for ( int i=0; i<n; i++ ) {
+			if ( Series ) {
+				MP_SCOPE( MP_INTEGRATE );
+				M1_StoreSeries( S,B,v0+i,Tac+(INT64)i*NumTms,ZERO,ONE,P );
+			}
+			MB_StoreVoxel( B,v0+i,AUC+i,M1_NumOutParms,true );
+		}
+	}
+
+	res	= true;
+func_exit:
+	SA_Free(&Local);
+	return res;
+}
+
+
+/**
+* @brief AUC over the selected window from a window table.
+*
+* Table counterpart of @c M1_ModelFuncBatch() (see @c WindowTable.h): the
+* integral over [@c Start, @c End] is the difference of two rows of the
+* cumulative trapezoid integral, O(1) per voxel. @c B->Signal is not read.
+*
+* @return bool @c false if the table holds no @c WT_AUC.
+*/
+
+bool	M1_ModelFuncWindow(
+	PVOID			ModelState,
+	const WT_TABLE*	T,
+	PMODEL_BATCH	B )
+{
+const PM1_STATE	S = (PM1_STATE)ModelState;
+
+	if ( !(T->Parts & WT_AUC) ) return false;
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		double	AUC;
+		{
+			MP_SCOPE( MP_INTEGRATE );
+			AUC	= WT_Integral( T,B->V0+v,S->Start,S->End );
+		}
+		MB_StoreVoxel( B,v,&AUC,M1_NumOutParms,true );
+	}
+	return true;
+}
+
+
+// Accumulator doubles per voxel of M1_ModelFuncFrame(): the weighted sum, then the last sample of
+// the window (concentration frames)
+static INT64	M1_ModelFrameAcc( PVOID /*ModelState*/ )
+{
+	return 2;
+}
+
+
+/**
+* @brief Frame-streaming form of @c M1_ModelFuncBatch() (see @c MODEL_ENTRY::FuncFrame).
+*
+* The AUC is a weighted sum of the frames: frame t adds @c W[t-Start] times
+* its samples to the accumulators of the block. On a raw block
+* (@c B->IsConc false) the samples are raw, and the final call applies the
+* conversion descriptor of the block to the sum, as the batch kernel does.
+* Equal to the batch outputs to rounding.
+*
+* After the first t frames of a concentration block the AUC is that of the
+* window up to frame e = t-1: the weight of frame e counts the segment after
+* it as well, so half of that segment times the last sample is taken off.
+*
+* @param[in]     ModelState  State from @c M1_ModelInit().
+* @param[in]     t  Frame of @c B->Signal, or with @c B->Signal @c NULL the
+*                   number of frames folded.
+* @param[in,out] B  Voxel block of one frame; @c B->Acc holds
+*                   @c M1_ModelFrameAcc() doubles per voxel.
+*
+* @return bool
+*   @c false for a final raw block without a conversion descriptor, or one
+*   that ends before the window does.
+*/
+
+bool	M1_ModelFuncFrame(
+	PVOID		ModelState,
+	int		t,
+	PMODEL_BATCH	B )
+{
+const PM1_STATE	S	= (PM1_STATE)ModelState;
+const bool		Raw	= !B->IsConc;
+const int		NA	= (int)M1_ModelFrameAcc( S );
+
+	if ( B->Signal ) {
+		PDOUBLE	Acc = B->Acc;
+
+		if ( t<S->Start || t>S->End ) return true;
+
+		const double	w = S->W[t-S->Start];
+
+		MP_SCOPE_BLOCK( MP_INTEGRATE,B->NumVox );
+		for ( int v=0; v<B->NumVox; v++, Acc+=NA ) {
+			Acc[0] += w*B->Signal[v];
+			Acc[1]  = B->Signal[v];
+		}
+		return true;
+	}
+
+	// part of the window received: up to frame e, less the half segment after it (void if none)
+	const int	e    = min( S->End,t-1 );
+	const bool	Cut  = e>=S->Start && e<S->End;
+	const double	Tail = Cut ? (AbsTarr[e+1]-AbsTarr[e])*0.5 : ZERO;
+
+	if ( Raw && (!B->ConcOffset || t<=S->End) ) return false;
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		const double*	Acc = B->Acc+(INT64)v*NA;
+		double		AUC = Acc[0];
+
+		if ( e<S->Start ) {
+			MB_StoreVoxel( B,v,NULL,M1_NumOutParms,false );
+			continue;
+		}
+		if ( Cut ) AUC -= Tail*Acc[1];
+
+		if ( Raw ) AUC = (AUC-B->ConcOffset[v]*S->WSum)*B->ConcScale[v];
+		MB_StoreVoxel( B,v,&AUC,M1_NumOutParms,true );
+	}
+	return true;
+}
+
+
+/**
+* @brief Compute AUC over the selected TAC segment and emit OP[0] if requested.
+*
+* Thin wrapper over @c M1_ModelFuncBatch() for a block of one voxel.
+*
+* @param[in]  ModelState
+*   State from @c M1_ModelInit().
+*
+* @param[in]  Signal
+*   Pointer to TAC samples (length @c NumTms) in time order.
+*
+* @param[out] OutParm
+*   Framework-managed writer. When @c ParmReq[0] is nonzero, writes:
+*   - OP[0] = "Curve integral by time" (AUC over the selected window).
+*
+* @return bool
+*   @c true on success; @c false if an allocation/guarded call fails (as
+*   enforced by the framework's @c xz macro and related checks).
+*/
+
+bool	M1_ModelFunc(
+	PVOID		ModelState,
+	PDOUBLE	Signal,
+	PIVAL		OutParm )
+{
+	return MB_ModelFuncVoxel( M1_ModelFuncBatch,ModelState,Signal,OutParm,M1_NumOutParms );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Driver table entry (see ModelTable.h)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Raw blocks with a conversion descriptor go through the trapezoid weights as they are
+static bool	M1_FoldConc( PVOID /*ModelState*/ )
+{
+	return true;
+}
+
+static bool	M1_EntryInit(
+		PVOID*	pModelState,
+		PINPUTFUNC	/*IFarr*/,
+		int		/*NumIF*/ )
+{
+	return M1_ModelInit( pModelState );
+}
+
+MODEL_ENTRY	M1_ModelEntry( void )
+{
+MODEL_ENTRY	E = {};
+
+	E.Number	= 1;
+	E.Name		= M1_ModelName;
+	E.NumFreeParms	= M1_NumFreeParms;
+	E.FreeParm	= M1_FreeParm;
+	E.FPName	= M1_FPName;
+	E.NumOutParms	= M1_NumOutParms;
+	E.OPName	= M1_OPName;
+	E.NumIfuncs	= M1_NumIfuncs;
+	E.Init		= M1_EntryInit;
+	E.Close		= M1_ModelClose;
+	E.Func		= M1_ModelFunc;
+	E.FuncBatch	= M1_ModelFuncBatch;
+	E.ScratchSize	= M1_ModelScratch;
+	E.FuncBatchF	= M1_ModelFuncBatchF;
+	E.FuncWindow	= M1_ModelFuncWindow;
+	E.WindowParts	= WT_AUC;
+	E.WindowOut	= BM(0);
+	E.FoldConc	= M1_FoldConc;
+	E.SeriesName	= M1_SeriesName;
+	E.SeriesTime	= M1_SeriesTime;
+	E.NumSeries	= &M1_NumSeries;
+	E.FuncFrame	= M1_ModelFuncFrame;
+	E.FrameAcc	= M1_ModelFrameAcc;
+	E.FrameOut	= BM(0);
+	E.LiveOut	= BM(0);
+
+	return E;
+}
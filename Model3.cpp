@@ -1,30 +1,63 @@
 ﻿/**
-* @brief Initialize Model 3 (interleaved odd/even statistics).
+* @file Model3.cpp
+* @brief Model 3 — Interleaved multi‑state profile.
 *
-* Sets the per‑call model state pointer to @c NULL. Input functions and their
-* count are accepted but not used by this model.
+* @details
+* Implements "3. Interleaved multi-state profile". The TAC, converted to
+* concentration, is read as K interleaved states: state s (1‑based) holds
+* frames s, s+K, s+2K, … (1‑based frame numbers), e.g. the phases of cyclic
+* gating or the echoes of a multi‑echo series. For each state s = 1 .. K the
+* model reports:
+*   - OP[2s-2] mean of the frames of state s
+*   - OP[2s-1] stdev of the frames of state s
+* With K = 2 these are the odd and the even frames, and states 1 and 2 keep
+* those output names.
 *
-* @param[out] pModelState Opaque per‑call state pointer (set to @c NULL).
-* @param[in]  IFarr       Array of input functions (unused).
-* @param[in]  NumIF       Number of input functions (unused).
+* @section params Free Parameters
+*   - FP[0] "Interleaved states" (int): K, 1 .. @c M3_MAXSTATES (8); default 2.
 *
-* @return bool @c true on success (initialization is trivial and unconditional).
+* @section io Inputs/Outputs
+*   - Input: @c Signal (double[NumTms]) — TAC samples in time order, converted
+*            by @c funcSigToConc() unless the block already holds
+*            concentrations.
+*   - Output: @c M3_NumOutParms = 2*@c M3_MAXSTATES slots, fixed at compile
+*            time like every @c M*_NumOutParms. Only the first 2K are computed;
+*            the slots of states above K are @c VOIDVOX. @c MODEL_ENTRY::OutUsed
+*            (@c M3_ModelOutUsed()) tells a host which slots the map (or, before
+*            @c M3_ModelInit(), the current FP0) computes; the headless tools
+*            consult it, a host that lists every slot shows the others void.
 *
-* @pre  @c NumTms is valid for the current TAC.
-* @post No resources retained; model state remains @c NULL.
+* @warning In a host that lists all @c M3_NumOutParms outputs (the
+*          FireVoxel model panel does), the default K = 2 now shows 16 maps
+*          where the odd/even model showed 4: the 4 it had, under the same
+*          names, and 12 that are always @c VOIDVOX. That host does not read
+*          @c MODEL_ENTRY::OutUsed.
 *
-* @thread_safety Not thread‑safe (relies on framework globals elsewhere).
+* @section ts Thread-safety
+* Reentrant: K and the scratch size live in an @c M3_STATE object created by
+* @c M3_ModelInit() and released by @c M3_ModelClose(); evaluation only
+* reads it.
+*
+* @section mem Memory
+* One TAC buffer per thread from the scratch arena; the states are read in
+* place, without copying a subseries.
 */
 
 #include	"stdafx.h"
+#include	"ModelTable.h"
+#include	"TacKernels.h"
 
 char	M3_IFpanelName[]	= "";
-char	M3_ModelName[]	= "3. Interleaved 2-state profile";
+char	M3_ModelName[]	= "3. Interleaved multi-state profile";
 
 int	M3_NumIfuncs = 0;
 
-const int	M3_NumFreeParms	= 0;
-const int	M3_NumOutParms	= 4;
+enum {
+	M3_MAXSTATES	= 8				// interleaved states (FP0) at most, with 2 outputs each
+};
+
+const int	M3_NumFreeParms	= 1;
+const int	M3_NumOutParms	= 2*M3_MAXSTATES;
 
 BOOL	M3_UseNoise		= FALSE;
 BOOL	M3_UseGlobalTac	= FALSE;
@@ -41,53 +74,93 @@ UINT32 M3_Modality	= MCLASS_MSK_ALL;
 UINT32 M3_DynDim		= DYNDIM_MSK_ALL;
 UINT32 M3_ConcConv	= BM(CONCTYPE_NOCONV);
 
-double M3_FreeParm[1];
-double M3_FreeParmDefault[1];
+double M3_FreeParmDefault[M3_NumFreeParms] = { 2 };
+double M3_FreeParm[M3_NumFreeParms]	= { 2 };
 
-PSTR	M3_FPName[1];
+static char	FPNAME0[]	= "Interleaved states";
+PSTR	M3_FPName[M3_NumFreeParms] = { FPNAME0 };
 
+// States 1 and 2 keep the names of the odd and even frames of 2 states
 static char	OPName0[] =  "mean of odd frames";
 static char	OPName1[] =  "stdev of odd frames";
 static char	OPName2[] =  "mean of even frames";
 static char	OPName3[] =  "stdev of even frames";
-PSTR	M3_OPName[M3_NumOutParms] = { OPName0,OPName1,OPName2,OPName3 };
+static char	OPName4[] =  "mean of state 3 frames";
+static char	OPName5[] =  "stdev of state 3 frames";
+static char	OPName6[] =  "mean of state 4 frames";
+static char	OPName7[] =  "stdev of state 4 frames";
+static char	OPName8[] =  "mean of state 5 frames";
+static char	OPName9[] =  "stdev of state 5 frames";
+static char	OPName10[] = "mean of state 6 frames";
+static char	OPName11[] = "stdev of state 6 frames";
+static char	OPName12[] = "mean of state 7 frames";
+static char	OPName13[] = "stdev of state 7 frames";
+static char	OPName14[] = "mean of state 8 frames";
+static char	OPName15[] = "stdev of state 8 frames";
+PSTR	M3_OPName[M3_NumOutParms] = { OPName0,OPName1,OPName2,OPName3,OPName4,OPName5,OPName6,OPName7,
+					OPName8,OPName9,OPName10,OPName11,OPName12,OPName13,OPName14,OPName15 };
 
 static char	OPUnits0[] = "";
-static char	OPUnits1[] = "";
-static char	OPUnits2[] = "";
-static char	OPUnits3[] = "";
-PSTR	M3_OPUnits[M3_NumOutParms] = { OPUnits0,OPUnits1,OPUnits2,OPUnits3 };
+PSTR	M3_OPUnits[M3_NumOutParms] = { OPUnits0,OPUnits0,OPUnits0,OPUnits0,OPUnits0,OPUnits0,OPUnits0,OPUnits0,
+					OPUnits0,OPUnits0,OPUnits0,OPUnits0,OPUnits0,OPUnits0,OPUnits0,OPUnits0 };
+
+PR_CLRMAP	M3_ClrScheme[M3_NumOutParms] = { PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,
+					PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,
+					PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,
+					PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW };
 
-PR_CLRMAP	M3_ClrScheme[M3_NumOutParms] = { PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW };
+
+// Per-map state created by M3_ModelInit()
+struct M3_STATE {
+	int		K;				// interleaved states (FP0)
+	INT64		ScratchSize;		// per-thread arena doubles (M3_ModelScratch)
+};
+
+typedef M3_STATE*	PM3_STATE;
 
 
 /**
-* @brief Initialize Model 3 (interleaved odd/even statistics).
+* @brief Initialize Model 3 (interleaved multi-state statistics).
 *
-* Sets the per‑call model state pointer to @c NULL. Input functions and their
-* count are accepted but not used by this model.
+* Allocates the model state, which records the number of interleaved states
+* K (@c M3_FreeParm[0], "Interleaved states") and the per‑thread scratch
+* size for the current @c NumTms. Input functions and their count are
+* accepted but not used by this model.
 *
-* @param[out] pModelState Opaque per‑call state pointer (set to @c NULL).
+* @param[out] pModelState Receives the new @c M3_STATE object (or @c NULL on
+*                         failure); released by @c M3_ModelClose().
 * @param[in]  IFarr       Array of input functions (unused).
 * @param[in]  NumIF       Number of input functions (unused).
 *
-* @return bool @c true on success (initialization is trivial and unconditional).
+* @return bool @c true on success; @c false if K is not 1 .. @c M3_MAXSTATES
+*              or the state cannot be allocated.
 *
 * @pre  @c NumTms is valid for the current TAC.
-* @post No resources retained; model state remains @c NULL.
 *
-* @thread_safety Not thread‑safe (relies on framework globals elsewhere).
+* @thread_safety Reentrant; reads @c M3_FreeParm only.
 */
 
 bool	M3_ModelInit(
 	PVOID*	pModelState,
-	PINPUTFUNC	IFarr,
-	int		NumIF )
+	PINPUTFUNC	/*IFarr*/,
+	int		/*NumIF*/ )
 {
-bool	res	= false;
+PM3_STATE	S	= NULL;
+const int	K	= iround(M3_FreeParm[0]);
+bool		res	= false;
 
 	*pModelState = NULL;
 
+	if ( !in_interval( K,1,(int)M3_MAXSTATES )) xmsg( "The number of interleaved states must be 1 to 8" );
+
+	xz( AllocMem<M3_STATE >(S,1 ));
+	S->K = K;
+
+	// TAC buffer; the states are read in place
+	S->ScratchSize = SA_Need( NumTms );
+
+	*pModelState = S;
+
 	res	= true;
 func_exit:
 	return res;
@@ -100,106 +173,357 @@ func_exit:
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 void	M3_ModelClose( PVOID ModelState )
 {
+PM3_STATE	S = (PM3_STATE)ModelState;
+
+	pf_free(&S);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Doubles of per-thread scratch arena needed by M3_ModelFuncBatch()
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+INT64	M3_ModelScratch( PVOID ModelState )
+{
+	return ((PM3_STATE)ModelState)->ScratchSize;
 }
 
 
 
-static int	ExtractEven(
-		PDOUBLE	Tac,
-		int		N,
-		PDOUBLE	Arr )
+// Samples of state k of K among the first N frames
+static inline int	M3_Count(
+		int	N,
+		int	K,
+		int	k )
 {
-int	NE = (N+1)/2;
-	for ( int i=0; i<NE; i++ )
-		Arr[i] = Tac[i*2];
-	return NE;
+	return (N-k+K-1)/K;
 }
 
-static int	ExtractOdd(
-		PDOUBLE	Tac,
+// Sample standard deviation from the sum of squared deviations M2 of n samples
+static inline double	M3_Stdev(
+		double	M2,
+		int		n )
+{
+	return n>1 ? sqrt( M2/(n-1) ) : ZERO;
+}
+
+// Val[2k], Val[2k+1] of the states k >= K, which the map does not have, and of the states with no
+// sample among the first N frames (k >= N, live maps of fewer than K frames)
+static inline void	M3_VoidStates(
 		int		N,
-		PDOUBLE	Arr )
+		int		K,
+		PDOUBLE	Val )
+{
+	std::fill( Val+2*min( max( N,0 ),K ),Val+M3_NumOutParms,VOIDVOX );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Mean and stdev of each of the K states interleaved in Tac[0..N-1] into Val[2k], Val[2k+1], with the
+// recurrence of PR_ArrStats() on the subseries of state k. The states are updated in lockstep, one
+// group of K consecutive frames at a time, and no subseries is copied: the frames of a group hold one
+// sample of each state and share the count i+1, so one division per group gives the reciprocal all K
+// updates multiply by (PR_ArrStats() divides, so the two agree to rounding). KC = 2 or 4 fixes K at
+// compile time and unrolls the state loop; GCC -O3 runs the 4 recurrences of KC = 4 in two SSE2
+// registers (one AVX register with PARMMAP_NATIVE) but keeps the 2 of KC = 2 scalar. KC = 0 takes K
+// at run time.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<int KC>
+static inline void	M3_States(
+		const double*	Tac,
+		int			N,
+		int			K,
+		PDOUBLE		Val )
 {
-int	ND = N/2;
-	for ( int i=0; i<ND; i++ )
-		Arr[i] = Tac[i*2+1];
-	return ND;
+	if ( KC ) K = KC;
+
+double	Mean[M3_MAXSTATES] = { 0 },
+		M2[M3_MAXSTATES] = { 0 };
+const int	NG = N/K;						// whole groups
+
+	for ( int i=0; i<NG; i++, Tac+=K ) {
+		const double	r = ONE/(i+1);				// 1/count of every state of the group
+		for ( int k=0; k<K; k++ ) {
+			const double	d = Tac[k]-Mean[k];
+			Mean[k]	+= d*r;
+			M2[k]		+= d*(Tac[k]-Mean[k]);
+		}
+	}
+	{
+		const double	r = ONE/(NG+1);
+		for ( int k=0; k<N-NG*K; k++ ) {			// the first states have one sample more
+			const double	d = Tac[k]-Mean[k];
+			Mean[k]	+= d*r;
+			M2[k]		+= d*(Tac[k]-Mean[k]);
+		}
+	}
+
+	for ( int k=0; k<K; k++ ) {
+		Val[k*2]	= Mean[k];
+		Val[k*2+1]	= M3_Stdev( M2[k],M3_Count( N,K,k ));
+	}
+	M3_VoidStates( N,K,Val );
 }
 
 
 /**
-* @brief Compute odd/even frame means and standard deviations and emit them.
+* @brief Compute the mean and standard deviation of every interleaved state for a block of voxels.
 *
-* Converts @p Sig to concentration units, splits the TAC into two interleaved
-* subseries using the 1‑based frame convention (odd: frames 1,3,5,…; even:
-* frames 2,4,6,…), computes mean and stdev for each via @c PR_ArrStats(), and
-* writes requested outputs in this fixed order:
-*   OP[0] = mean(odd‑numbered frames)
-*   OP[1] = stdev(odd‑numbered frames)
-*   OP[2] = mean(even‑numbered frames)
-*   OP[3] = stdev(even‑numbered frames)
+* Batch counterpart of @c M3_ModelFunc(); see @c ModelBatch.h for the block
+* layout. Each TAC is converted to concentration units (unless @c B->IsConc
+* says the block already is) and read as K interleaved states, K =
+* @c M3_FreeParm[0], using the 1‑based frame convention: state s (1‑based)
+* holds frames s, s+K, s+2K, … (K = 2: the odd, then the even frames). The
+* statistics of state s are computed by @c M3_States(), in place, and stored
+* into the planes:
+*   OP[2s-2] = mean(frames of state s)
+*   OP[2s-1] = stdev(frames of state s)
+* The outputs of states above K are @c VOIDVOX.
 *
-* @param[in]  Sig     Pointer to TAC samples (length @c NumTms) in time order.
-*                     Internally converted with
-*                     @code funcSigToConc(Sig, NumTms, Tac, 1, NULL); @endcode
-* @param[out] OutParm Framework‑managed writer used by @c Write().
+* @param[in]     ModelState  State from @c M3_ModelInit().
+* @param[in,out] B  Voxel block; @c NULL planes are skipped.
 *
 * @return bool @c true on success; @c false if an allocation or guarded call
 *              fails (as enforced by framework macros).
 *
 * @pre
-*   - @c NumTms > 0 and @c Sig has @c NumTms elements.
+*   - @c NumTms > 0 and every TAC has @c NumTms elements.
 *   - TAC is sorted by increasing acquisition time.
 *
 * @post
-*   - Temporary buffers (@c Tac and work array) are freed before return.
+*   - The work buffer (@c Tac) comes from @c B->Scratch and is reset for
+*     every voxel.
 *
 * @details
-*   The implementation selects odd‑numbered frames (1‑based) by copying
-*   0‑based even indices via @c ExtractEven(), then selects even‑numbered
-*   frames (1‑based) via @c ExtractOdd(). Means and stdevs are computed with
-*   @c PR_ArrStats(). Outputs are gated by @c ParmReq[0..3].
+*   The states are not extracted: one pass over the TAC updates the running
+*   mean and squared deviations of all K states with the recurrence of
+*   @c PR_ArrStats(), so the results equal those of @c PR_ArrStats() on each
+*   extracted subseries to rounding (the updates multiply by the reciprocal
+*   of the count, computed once per group of K frames). K = 2 and K = 4 have
+*   their own unrolled instances; the 4 states of K = 4 are updated in
+*   vector registers.
 *
 * @warning
 *   Ensure the indexing convention matches your downstream expectations:
-*   odd/even refers to **frame numbers** (1‑based), not array indices. :contentReference[oaicite:2]{index=2}
+*   odd/even refers to **frame numbers** (1‑based), not array indices.
 *
 * @complexity
-*   O(N) time and O(N) temporary memory where N = @c NumTms.
+*   O(NumVox*N) time and O(N) scratch memory, where N = @c NumTms.
 */
 
-bool	M3_ModelFunc(
-	PDOUBLE	Sig,			//Signal
-	PIVAL		OutParm )
+bool	M3_ModelFuncBatch(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
 {
-PDOUBLE	Tac	= NULL;
-PDOUBLE	Arr	= NULL;
+const PM3_STATE	S	= (PM3_STATE)ModelState;
+SCRATCH_ARENA	Local;
+PSCRATCH_ARENA	A;
 bool		res	= false;
 
 
-	xz( AllocMem<double >(Tac,NumTms ));
-	funcSigToConc( Sig,NumTms,Tac,1,NULL );
+	xz( A = MB_BlockArena( B,&Local,S->ScratchSize ));
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		SA_Reset( A );
+
+		PDOUBLE	Tac;
+		xz( Tac = MB_ConcTac( B,v,A,NULL ));
+
+		double	Val[M3_NumOutParms];				// mean, stdev of state 1, state 2, ...
+		{
+			MP_SCOPE( MP_KERNEL );
+
+			switch ( S->K ) {
+			case 2:	M3_States<2>( Tac,NumTms,2,Val );		break;
+			case 4:	M3_States<4>( Tac,NumTms,4,Val );		break;
+			default:	M3_States<0>( Tac,NumTms,S->K,Val );	break;
+			}
+		}
+		MB_StoreVoxel( B,v,Val,M3_NumOutParms,true );
+	}
+
+	res	= true;
+func_exit:
+	SA_Free(&Local);
+	return res;
+}
 
-	xz( AllocMem<double >(Arr,(NumTms+1)/2 ));
 
-	// Process ODD timepoints
-	// We need to select even because of the Tstart=1
-int	N = ExtractEven( Tac,NumTms,Arr );
-double	EvenStdev,
-		EvenMean = PR_ArrStats( Arr,N,&EvenStdev );
+/**
+* @brief Float32 compute mode of @c M3_ModelFuncBatch().
+*
+* The K states of each float TAC in @c B->SignalF are read in place by
+* @c TK_StateStats(), in two passes (the sums, then the squared deviations)
+* over the whole TAC; means and deviations are accumulated in double.
+*
+* @return bool @c false if the block carries no converted float TACs.
+*/
 
-	N = ExtractOdd( Tac,NumTms,Arr );
-double	OddStdev,
-		OddMean = PR_ArrStats( Arr,N,&OddStdev );
+bool	M3_ModelFuncBatchF(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
+{
+const PM3_STATE	S	= (PM3_STATE)ModelState;
+const int		K	= S->K;
+bool		res	= false;
 
-	if ( ParmReq[0] )	Write( OutParm,EvenMean );
-	if ( ParmReq[1] )	Write( OutParm,EvenStdev );				
-	if ( ParmReq[2] )	Write( OutParm,OddMean );
-	if ( ParmReq[3] ) Write( OutParm,OddStdev );
+	for ( int v=0; v<B->NumVox; v++ ) {
+		const float*	Tac;
+		xz( Tac = MB_TacF( B,v,false ));
+
+		double	Val[M3_NumOutParms];				// mean, stdev of state 1, state 2, ...
+		{
+			MP_SCOPE( MP_KERNEL );
+
+			double	Mean[M3_MAXSTATES],
+					Stdev[M3_MAXSTATES];
+			switch ( K ) {
+			case 2:	TK_StateStats<2>( Tac,NumTms,2,Mean,Stdev );	break;
+			case 4:	TK_StateStats<4>( Tac,NumTms,4,Mean,Stdev );	break;
+			default:	TK_StateStats<0>( Tac,NumTms,K,Mean,Stdev );	break;
+			}
+			for ( int k=0; k<K; k++ ) {
+				Val[k*2]	= Mean[k];
+				Val[k*2+1]	= Stdev[k];
+			}
+			M3_VoidStates( NumTms,K,Val );
+		}
+		MB_StoreVoxel( B,v,Val,M3_NumOutParms,true );
+	}
 
 	res	= true;
 func_exit:
-	pf_free(&Tac);
-	pf_free(&Arr);
 	return res;
 }
+
+
+/**
+* @brief Frame-streaming form of @c M3_ModelFuncBatch() (see @c MODEL_ENTRY::FuncFrame).
+*
+* Each frame updates the running mean and sum of squared deviations of its
+* state (frame t, 0-based, is in state t%K) with the recurrence of
+* @c M3_States(), the same reciprocal of the count included, so the outputs
+* are those of the batch kernel exactly.
+* Accumulators per voxel: mean and M2 of each of the K states. After the
+* first t frames the outputs are those of the states of these frames; a
+* state with no frame yet (t < K) is VOIDVOX, as the states above K.
+*
+* @param[in]     ModelState  State from @c M3_ModelInit().
+* @param[in]     t  Frame of @c B->Signal, or with @c B->Signal @c NULL the
+*                   number of frames folded.
+* @param[in,out] B  Voxel block of one frame; @c B->Acc holds 2K doubles
+*                   per voxel.
+*
+* @return bool Always @c true.
+*/
+
+bool	M3_ModelFuncFrame(
+	PVOID		ModelState,
+	int		t,
+	PMODEL_BATCH	B )
+{
+const int	K = ((PM3_STATE)ModelState)->K;
+
+	if ( B->Signal ) {
+		const double	r	= ONE/(t/K+1);				// 1/count of the state of frame t
+		PDOUBLE		Acc	= B->Acc+(t%K)*2;
+
+		MP_SCOPE_BLOCK( MP_KERNEL,B->NumVox );
+		for ( int v=0; v<B->NumVox; v++, Acc+=2*K ) {
+			const double	x = B->Signal[v],
+					d = x-Acc[0];
+			Acc[0]	+= d*r;
+			Acc[1]	+= d*(x-Acc[0]);
+		}
+		return true;
+	}
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		const double*	Acc = B->Acc+(INT64)v*2*K;
+		double		Val[M3_NumOutParms];
+
+		for ( int k=0; k<K; k++ ) {
+			Val[k*2]	= Acc[k*2];
+			Val[k*2+1]	= M3_Stdev( Acc[k*2+1],M3_Count( t,K,k ));
+		}
+		M3_VoidStates( t,K,Val );
+		MB_StoreVoxel( B,v,Val,M3_NumOutParms,true );
+	}
+	return true;
+}
+
+
+// Accumulator doubles per voxel of M3_ModelFuncFrame(): mean and M2 of each state
+static INT64	M3_ModelFrameAcc( PVOID ModelState )
+{
+	return 2*((PM3_STATE)ModelState)->K;
+}
+
+
+// Outputs of the states of the map, or with no state of those M3_FreeParm[0] sets up (see MODEL_ENTRY::OutUsed)
+static UINT32	M3_ModelOutUsed( PVOID ModelState )
+{
+const int	K = ModelState ? ((PM3_STATE)ModelState)->K : iround(M3_FreeParm[0]);
+
+	return in_interval( K,1,(int)M3_MAXSTATES ) ? BM(2*K)-1 : BM(M3_NumOutParms)-1;
+}
+
+
+/**
+* @brief Compute the mean and standard deviation of every interleaved state and emit them.
+*
+* Thin wrapper over @c M3_ModelFuncBatch() for a block of one voxel; writes
+* the requested outputs in this fixed order, for states s = 1 .. K:
+*   OP[2s-2] = mean(frames of state s)
+*   OP[2s-1] = stdev(frames of state s)
+*
+* @param[in]  ModelState State from @c M3_ModelInit().
+* @param[in]  Sig     Pointer to TAC samples (length @c NumTms) in time order.
+* @param[out] OutParm Framework‑managed writer used by @c Write().
+*
+* @return bool @c true on success; @c false if an allocation or guarded call
+*              fails (as enforced by framework macros).
+*/
+
+bool	M3_ModelFunc(
+	PVOID		ModelState,
+	PDOUBLE	Sig,			//Signal
+	PIVAL		OutParm )
+{
+	return MB_ModelFuncVoxel( M3_ModelFuncBatch,ModelState,Sig,OutParm,M3_NumOutParms );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Driver table entry (see ModelTable.h)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+MODEL_ENTRY	M3_ModelEntry( void )
+{
+MODEL_ENTRY	E = {};
+
+	E.Number	= 3;
+	E.Name		= M3_ModelName;
+	E.NumFreeParms	= M3_NumFreeParms;
+	E.FreeParm	= M3_FreeParm;
+	E.FPName	= M3_FPName;
+	E.NumOutParms	= M3_NumOutParms;
+	E.OPName	= M3_OPName;
+	E.NumIfuncs	= M3_NumIfuncs;
+	E.Init		= M3_ModelInit;
+	E.Close		= M3_ModelClose;
+	E.Func		= M3_ModelFunc;
+	E.FuncBatch	= M3_ModelFuncBatch;
+	E.ScratchSize	= M3_ModelScratch;
+	E.FuncBatchF	= M3_ModelFuncBatchF;
+	E.FuncFrame	= M3_ModelFuncFrame;
+	E.FrameAcc	= M3_ModelFrameAcc;
+	E.FrameOut	= BM(M3_NumOutParms)-1;
+	E.LiveOut	= BM(M3_NumOutParms)-1;
+	E.OutUsed	= M3_ModelOutUsed;
+
+	return E;
+}
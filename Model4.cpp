@@ -41,12 +41,14 @@
 *   @c AllocMem, @c pf_free, @c Write, @c ParmReq, @c xz, @c xmsg.
 *
 * @section ts Thread-safety
-*   Not thread‑safe: uses module‑static globals (@c gLnorm, @c gIfunc, @c gTarr,
-*   @c gStr, @c gEnd, @c gLng).
+*   Reentrant: the L‑norm, prepared curves and frame window live in an
+*   @c M4_STATE object created by @c M4_ModelInit() and released by
+*   @c M4_ModelClose(); evaluation only reads it.
 *
 * @section mem Memory
-*   Allocates a temporary TAC buffer (@c Cnc) during evaluation; the prepared
-*   reference curve (@c gIfunc) and time array (@c gTarr) are created at init
+*   The per‑voxel TAC buffer (@c Cnc) comes from the caller's scratch arena,
+*   sized at init (@c M4_ModelScratch()); the prepared
+*   reference curve (@c Ifunc) and time array (@c Tarr) are created at init
 *   and freed in @c M4_ModelClose().
 *
 * @section config Model configuration
@@ -59,6 +61,8 @@
 */
 
 #include	"stdafx.h"
+#include	"ModelTable.h"
+#include	"TacKernels.h"
 
 char	M4_IFpanelName[]	= "Reference curve";
 
@@ -105,12 +109,27 @@ PSTR	M4_OPUnits[] = { OPUnits0,OPUnits1,OPUnits2 };
 
 PR_CLRMAP	M4_ClrScheme[] = { PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW };
 
-static int		gLnorm;
-static PDOUBLE	gIfunc	= NULL;
-static PDOUBLE	gTarr		= NULL;
-static int		gStr		= NULL;
-static int		gEnd		= NULL;
-static int		gLng		= NULL;
+// Per-map state created by M4_ModelInit()
+struct M4_STATE {
+	int		Lnorm;			// 1 or 2
+	PDOUBLE	Ifunc;			// reference curve on the Tarr time base
+	float*	IfuncF;			// the same in float (float32 compute mode)
+	PDOUBLE	Tarr;				// time base from PrepareAndCheckTimeArr()
+	int		Str,End,Lng;		// 0-based inclusive frame window
+	double	RefMean,RefSxx;		// mean and sum of squared deviations of the window of Ifunc
+	double	RefDev;			// sum of the deviations from RefMean (rounding residue)
+	INT64		ScratchSize;		// per-thread arena doubles (M4_ModelScratch)
+};
+
+typedef M4_STATE*	PM4_STATE;
+
+
+enum {
+	M4_FRAMEACC	= 6				// M4_ModelFuncFrame(): shift, sums of d, d^2 and (ref-RefMean)*d,
+						// previous sample, distance integral
+};
+
+void	M4_ModelClose( PVOID ModelState );
 
 /**
 * @brief Initialize Model 4 (reference curve distance & correlation).
@@ -120,7 +139,8 @@ static int		gLng		= NULL;
 * frame window.
 *
 * @param[out] pModelState
-*   Opaque per‑call state pointer (unused by this model; remains unchanged).
+*   Receives the new @c M4_STATE object (or @c NULL on failure); released by
+*   @c M4_ModelClose().
 * @param[in]  IFarr
 *   Array of input functions; @c IFarr[0] must be the reference curve with
 *   length equal to @c NumTms.
@@ -136,55 +156,85 @@ static int		gLng		= NULL;
 *     either 0 or valid 1‑based inclusive indices with Start ≤ End.
 *
 * @post
-*   - @c gLnorm ∈ {1,2}.
-*   - @c gTarr = PrepareAndCheckTimeArr(...); @c gIfunc = PR_PrepareInputFunc(...).
-*   - @c gStr, @c gEnd are 0‑based inclusive indices; @c gLng = gEnd−gStr+1.
+*   - @c Lnorm ∈ {1,2}.
+*   - @c Tarr = PrepareAndCheckTimeArr(...); @c Ifunc = PR_PrepareInputFunc(...).
+*   - @c Str, @c End are 0‑based inclusive indices; @c Lng = End−Str+1.
+*   - @c ScratchSize holds the per‑thread arena size (one TAC buffer).
+*   - @c RefMean, @c RefSxx, @c RefDev hold the moments of the reference
+*     over the window (@c M4_ModelFuncFrame()).
 *
 * @details
 *   If either Start or End is 0, the full [1..NumTms] range is selected.
 *   Indices are validated in 1‑based space, then converted to 0‑based. :contentReference[oaicite:2]{index=2}
 *
 * @thread_safety
-*   Writes module‑static globals; not thread‑safe.
+*   Reentrant; touches no module statics.
 */
 
 bool	M4_ModelInit(
 	PVOID*	pModelState,
 	PINPUTFUNC	IFarr,
-	int		NumIF )
+	int		/*NumIF*/ )
 {
-bool	res	= false;
+PM4_STATE	S	= NULL;
+bool		res	= false;
+
+	*pModelState = NULL;
 
 	if (	IFarr[0].n!=NumTms )		xmsg( msgIncorrectIfunc );
 
-	gLnorm = iround(M4_FreeParm[0]);
-	if ( !in_interval( gLnorm,1,2 ))	xmsg( msgSpecifyL1orL2metric );
+	xz( AllocMem<M4_STATE >(S,1 ));
+	S->Ifunc	= NULL;
+	S->IfuncF	= NULL;
+	S->Tarr	= NULL;
 
-	// Prepare the matching input function
-	xz( gTarr = PrepareAndCheckTimeArr( 3 ));
-	xz( gIfunc = PR_PrepareInputFunc( IFarr+0,gTarr,NumTms ));
+	S->Lnorm = iround(M4_FreeParm[0]);
+	if ( !in_interval( S->Lnorm,1,2 ))	xmsg( msgSpecifyL1orL2metric );
 
-int	Str = M4_FreeParm[1],
-	End = M4_FreeParm[2];
+	// Prepare the matching input function
+	xz( S->Tarr = PrepareAndCheckTimeArr( 3 ));
+	xz( S->Ifunc = PR_PrepareInputFunc( IFarr+0,S->Tarr,NumTms ));
+	xz( AllocMem<float >(S->IfuncF,NumTms ));
+	for ( int t=0; t<NumTms; t++ ) S->IfuncF[t] = (float)S->Ifunc[t];
+
+	{
+	int	Str = M4_FreeParm[1],
+		End = M4_FreeParm[2];
 	if ( !Str || !End ) {
-		gStr = 1;
-		gEnd = NumTms;
+		S->Str = 1;
+		S->End = NumTms;
 	}
 	else {
 		if (	!in_interval( Str,1,NumTms )	||
 			!in_interval( End,1,NumTms )	||
 			Str>End )	xmsg( msgInvalidTimeIndex );
 	
-		gStr = Str;
-		gEnd=  End;
+		S->Str = Str;
+		S->End=  End;
+	}
+	}
+
+	S->Str--;
+	S->End--;
+	S->Lng = S->End-S->Str+1;
+
+	// reference moments of the window, as PR_Correlation() takes them
+	S->RefMean = S->RefSxx = S->RefDev = ZERO;
+	for ( int t=S->Str; t<=S->End; t++ ) S->RefMean += S->Ifunc[t];
+	S->RefMean /= S->Lng;
+	for ( int t=S->Str; t<=S->End; t++ ) {
+		const double	d = S->Ifunc[t]-S->RefMean;
+		S->RefSxx	+= d*d;
+		S->RefDev	+= d;
 	}
 
-	gStr--;
-	gEnd--;
-	gLng = gEnd-gStr+1;
+	S->ScratchSize = SA_Need( NumTms );
+
+	*pModelState = S;
 
 	res	= true;
 func_exit:
+	if ( !res ) M4_ModelClose( S );
 	return res;
 }
 
@@ -195,29 +245,42 @@ func_exit:
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 void	M4_ModelClose( PVOID ModelState )
 {
-	pf_free(&gIfunc);
-	pf_free(&gTarr);
+PM4_STATE	S = (PM4_STATE)ModelState;
+	if ( !S ) return;
+
+	pf_free(&S->Ifunc);
+	pf_free(&S->IfuncF);
+	pf_free(&S->Tarr);
+	pf_free(&S);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Doubles of per-thread scratch arena needed by M4_ModelFuncBatch()
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+INT64	M4_ModelScratch( PVOID ModelState )
+{
+	return ((PM4_STATE)ModelState)->ScratchSize;
 }
 
 
 /**
-* @brief Compute distance and correlation to the reference curve over the window.
+* @brief Compute distance and correlation to the reference curve for a block of voxels.
 *
-* Steps:
-*   1) Convert @p Signal (TAC) to concentration via @c funcSigToConc().
-*   2) Slice both TAC and reference to [@c gStr, @c gEnd] (length @c gLng).
+* Batch counterpart of @c M4_ModelFunc(); see @c ModelBatch.h for the block
+* layout. For every voxel:
+*   1) Convert the TAC to concentration via @c funcSigToConc() (skipped when
+*      @c B->IsConc says the block already is).
+*   2) Slice both TAC and reference to [@c Str, @c End] (length @c Lng).
 *   3) Compute distance using the selected L‑norm over time (piecewise‑linear):
 *        - L1:  dist = PR_IntegrateDiffL1_PWL(...)
 *        - L2:  dist = sqrt( PR_IntegrateDiffL2_PWL(...) )
-*   4) Compute Pearson correlation: @c PR_Correlation(refSlice, tacSlice, gLng).
-*   5) Emit outputs conditionally:
-*        - OP[0] = @c dist      (when @c ParmReq[0])
-*        - OP[1] = @c corr      (when @c ParmReq[1])
+*   4) Compute Pearson correlation: @c PR_Correlation(refSlice, tacSlice, Lng).
+*   5) Store OP[0] = @c dist and OP[1] = @c corr into the non-NULL planes.
 *
-* @param[in]  Signal
-*   Pointer to TAC samples (length @c NumTms) in time order.
-* @param[out] OutParm
-*   Framework-managed writer used by @c Write().
+* @param[in]     ModelState  State from @c M4_ModelInit().
+* @param[in,out] B  Voxel block.
 *
 * @return bool
 *   @c true on success; @c false if a guarded allocation or call fails.
@@ -229,47 +292,249 @@ void	M4_ModelClose( PVOID ModelState )
 *
 * @pre
 *   - @c M4_ModelInit() completed successfully.
-*   - @c gIfunc and @c gTarr are prepared; @c gLng ≥ 1.
+*   - @c Ifunc and @c Tarr of the state are prepared; @c Lng ≥ 1.
 *
 * @post
-*   - Temporary buffer @c Cnc is freed before return.
+*   - Work buffer @c Cnc comes from @c B->Scratch and is reset for every voxel.
 *
 * @warning
 *   Frame indices in the UI are 1‑based; internal arrays are 0‑based. TAC is
-*   assumed to be in **time order**, not dynamic component order. :contentReference[oaicite:4]{index=4}
+*   assumed to be in **time order**, not dynamic component order.
 *
 * @complexity
-*   O(N) time and O(N) temporary memory, where N = @c gLng.
+*   O(NumVox*N) time and O(NumTms) scratch memory, where N = @c Lng.
 */
 
-bool	M4_ModelFunc(
-	PDOUBLE	Signal,
-	PIVAL		OutParm )
+bool	M4_ModelFuncBatch(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
 {
-PDOUBLE	Cnc	= NULL;
+const PM4_STATE	S	= (PM4_STATE)ModelState;
+const PDOUBLE	Ifunc	= S->Ifunc+S->Str,		// window of the reference curve
+			Tarr	= S->Tarr+S->Str;		// and of the time base
+const int		Lng	= S->Lng;
+
+SCRATCH_ARENA	Local;
+PSCRATCH_ARENA	A;
 bool		res	= false;
 
 PR_CONCCONVBASE ConvBase;
-	xz( AllocMem<double >(Cnc,NumTms ));
-	funcSigToConc( Signal,NumTms,Cnc,1,&ConvBase );
+	xz( A = MB_BlockArena( B,&Local,S->ScratchSize ));
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		SA_Reset( A );
+
+		PDOUBLE	Cnc;
+		xz( Cnc = MB_ConcTac( B,v,A,&ConvBase ));
+
+		const PDOUBLE	Tac = Cnc+S->Str;
+
+		double dist,corr;
+		{
+			MP_SCOPE( MP_INTEGRATE );
+			if ( S->Lnorm==2 ) {
+				dist	= sqrt(PR_IntegrateDiffL2_PWL( Tac,Ifunc,Tarr,Lng ));
+			}
+			else {
+				dist	= PR_IntegrateDiffL1_PWL( Tac,Ifunc,Tarr,Lng );
+			}
+		}
+		{
+			MP_SCOPE( MP_KERNEL );
+			corr = PR_Correlation( Ifunc,Tac,Lng );
+		}
+
+		double	Val[M4_NumOutParms] = { dist,corr };
+		MB_StoreVoxel( B,v,Val,M4_NumOutParms,true );
+	}
 
+	res	= true;
+func_exit:
+	SA_Free(&Local);
+	return res;
+}
 
-double dist;
-	if ( gLnorm==2 ) {
-		dist	= sqrt(PR_IntegrateDiffL2_PWL( Cnc+gStr,gIfunc+gStr,gTarr+gStr,gLng ));
-	}
-	else {
-		dist	= PR_IntegrateDiffL1_PWL( Cnc+gStr,gIfunc+gStr,gTarr+gStr,gLng );
-	}
 
+/**
+* @brief Float32 compute mode of @c M4_ModelFuncBatch().
+*
+* Same outputs from the float TACs of @c B->SignalF (already converted) and
+* the float reference curve: differences to the reference in float, the
+* distance integrals and correlation sums in double (@c TacKernels.h).
+*
+* @return bool @c false if the block carries no converted float TACs.
+*/
 
-double corr = PR_Correlation( gIfunc+gStr,Cnc+gStr,gLng );
+bool	M4_ModelFuncBatchF(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
+{
+const PM4_STATE	S	= (PM4_STATE)ModelState;
+const float*	Ifunc	= S->IfuncF+S->Str;
+const PDOUBLE	Tarr	= S->Tarr+S->Str;
+const int		Lng	= S->Lng;
+bool		res	= false;
 
-	if ( ParmReq[0] )	Write( OutParm,dist );
-	if ( ParmReq[1] )	Write( OutParm,corr );
+	for ( int v=0; v<B->NumVox; v++ ) {
+		const float*	Tac;
+		xz( Tac = MB_TacF( B,v,false ));
+		Tac += S->Str;
+
+		double	dist,corr;
+		{
+			MP_SCOPE( MP_INTEGRATE );
+			dist = S->Lnorm==2 ? sqrt( TK_IntegrateDiffL2( Tac,Ifunc,Tarr,Lng ))
+					   : TK_IntegrateDiffL1( Tac,Ifunc,Tarr,Lng );
+		}
+		{
+			MP_SCOPE( MP_KERNEL );
+			corr = TK_Correlation( Ifunc,Tac,Lng );
+		}
+
+		double	Val[M4_NumOutParms] = { dist,corr };
+		MB_StoreVoxel( B,v,Val,M4_NumOutParms,true );
+	}
 
 	res	= true;
 func_exit:
-	pf_free(&Cnc);
 	return res;
 }
+
+
+/**
+* @brief Frame-streaming form of @c M4_ModelFuncBatch() (see @c MODEL_ENTRY::FuncFrame).
+*
+* Both outputs are sums over the window. The distance integral takes the
+* segment ending at each frame, from the previous sample kept in the
+* accumulators, with the same per-segment terms as
+* @c PR_IntegrateDiffL1_PWL() / @c PR_IntegrateDiffL2_PWL(). The
+* correlation keeps the sums of d, d^2 and (ref-RefMean)*d, with d the
+* deviation from the first sample of the window (so that the central sums do
+* not cancel), and takes the reference moments from the state, which are
+* those of the whole window: there are no outputs before its last frame.
+*
+* @param[in]     ModelState  State from @c M4_ModelInit().
+* @param[in]     t  Frame of @c B->Signal, or with @c B->Signal @c NULL the
+*                   number of frames folded.
+* @param[in,out] B  Voxel block of one frame; @c B->Acc holds @c M4_FRAMEACC
+*                   doubles per voxel.
+*
+* @return bool @c false if the outputs are asked for before the window ends.
+*/
+
+bool	M4_ModelFuncFrame(
+	PVOID		ModelState,
+	int		t,
+	PMODEL_BATCH	B )
+{
+const PM4_STATE	S	= (PM4_STATE)ModelState;
+
+	if ( B->Signal ) {
+		if ( t<S->Str || t>S->End ) return true;
+
+		const double	r  = S->Ifunc[t],
+				dr = r-S->RefMean,
+				r0 = t>S->Str ? S->Ifunc[t-1] : ZERO,
+				h  = t>S->Str ? S->Tarr[t]-S->Tarr[t-1] : ZERO;
+		PDOUBLE		Acc = B->Acc;
+
+		MP_SCOPE_BLOCK( MP_INTEGRATE,B->NumVox );
+		for ( int v=0; v<B->NumVox; v++, Acc+=M4_FRAMEACC ) {
+			const double	c = B->Signal[v];
+
+			if ( t==S->Str ) Acc[0] = c;
+			else {
+				const double	d0 = Acc[4]-r0,
+						d1 = c-r;
+				if ( S->Lnorm==2 )	Acc[5] += h*(d0*d0+d0*d1+d1*d1)/3;
+				else if ( d0*d1>=ZERO )	Acc[5] += h*fabs( d0+d1 )*0.5;
+				else			Acc[5] += h*(d0*d0+d1*d1)/(fabs( d0 )+fabs( d1 ))*0.5;
+			}
+			const double	d = c-Acc[0];
+			Acc[1]	+= d;
+			Acc[2]	+= d*d;
+			Acc[3]	+= dr*d;
+			Acc[4]	= c;
+		}
+		return true;
+	}
+	if ( t<=S->End ) return false;
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		const double*	Acc = B->Acc+(INT64)v*M4_FRAMEACC;
+		const double	m   = Acc[1]/S->Lng,					// window mean of d
+				Syy = Acc[2]-m*Acc[1],
+				Sxy = Acc[3]-m*S->RefDev;
+
+		double	Val[M4_NumOutParms] = {
+				S->Lnorm==2 ? sqrt( Acc[5] ) : Acc[5],
+				(S->RefSxx>ZERO && Syy>ZERO) ? Sxy/sqrt( S->RefSxx*Syy ) : ZERO };
+		MB_StoreVoxel( B,v,Val,M4_NumOutParms,true );
+	}
+	return true;
+}
+
+
+// Accumulator doubles per voxel of M4_ModelFuncFrame()
+static INT64	M4_ModelFrameAcc( PVOID /*ModelState*/ )
+{
+	return M4_FRAMEACC;
+}
+
+
+/**
+* @brief Compute distance and correlation to the reference curve over the window.
+*
+* Thin wrapper over @c M4_ModelFuncBatch() for a block of one voxel. Emits:
+*   - OP[0] = distance      (when @c ParmReq[0])
+*   - OP[1] = correlation   (when @c ParmReq[1])
+*
+* @param[in]  ModelState
+*   State from @c M4_ModelInit().
+* @param[in]  Signal
+*   Pointer to TAC samples (length @c NumTms) in time order.
+* @param[out] OutParm
+*   Framework-managed writer used by @c Write().
+*
+* @return bool
+*   @c true on success; @c false if a guarded allocation or call fails.
+*/
+
+bool	M4_ModelFunc(
+	PVOID		ModelState,
+	PDOUBLE	Signal,
+	PIVAL		OutParm )
+{
+	return MB_ModelFuncVoxel( M4_ModelFuncBatch,ModelState,Signal,OutParm,M4_NumOutParms );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Driver table entry (see ModelTable.h)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+MODEL_ENTRY	M4_ModelEntry( void )
+{
+MODEL_ENTRY	E = {};
+
+	E.Number	= 4;
+	E.Name		= M4_ModelName;
+	E.NumFreeParms	= M4_NumFreeParms;
+	E.FreeParm	= M4_FreeParm;
+	E.FPName	= M4_FPName;
+	E.NumOutParms	= M4_NumOutParms;
+	E.OPName	= M4_OPName;
+	E.NumIfuncs	= M4_NumIfuncs;
+	E.Init		= M4_ModelInit;
+	E.Close		= M4_ModelClose;
+	E.Func		= M4_ModelFunc;
+	E.FuncBatch	= M4_ModelFuncBatch;
+	E.ScratchSize	= M4_ModelScratch;
+	E.FuncBatchF	= M4_ModelFuncBatchF;
+	E.FuncFrame	= M4_ModelFuncFrame;
+	E.FrameAcc	= M4_ModelFrameAcc;
+	E.FrameOut	= BM(0)|BM(1);
+
+	return E;
+}
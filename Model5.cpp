@@ -45,18 +45,39 @@
 *   - Allowed optimizations: @c VA_OPTIM_NONE. :contentReference[oaicite:5]{index=5}
 *
 * @section ts Thread‑safety
-*   Not thread‑safe: uses module‑static state (@c RISE_THRA, @c RISE_THRB,
-*   @c gTarr). :contentReference[oaicite:6]{index=6}
+*   Reentrant: thresholds and the relative time array live in an
+*   @c M5_STATE object created by @c M5_ModelInit(); evaluation only reads it.
 *
 * @section mem Memory
-*   Creates a relative time array at init and frees it at close; allocates a
-*   transient TAC buffer during evaluation. :contentReference[oaicite:7]{index=7}
+*   Creates a relative time array at init and frees it at close; the per‑voxel
+*   TAC buffer comes from the caller's scratch arena, sized at init
+*   (@c M5_ModelScratch()). :contentReference[oaicite:7]{index=7}
+*
+* @section frames Frame streaming
+*   @c M5_ModelFuncFrame() keeps the running peak of each voxel and the
+*   frames where its TAC first reaches the two thresholds, so TAR and slope
+*   can be read after any number of frames of an acquisition. A new peak
+*   raises both thresholds, and their first crossings can only move later:
+*   each is found by resuming the search where it stopped, O(1) amortized
+*   per frame. The search reads the samples received, which the model keeps
+*   in its accumulators (one TAC per voxel).
+*
+*   Only the samples from the earliest unresolved crossing on can still be
+*   read, but no bounded state holds those. While a TAC keeps rising, every
+*   new peak raises the low threshold, and its crossing can land on any
+*   frame since the previous one, interpolated between two samples that
+*   were received long before. A rise that goes on until the last frame
+*   thus needs every sample from its start. The accumulators are therefore
+*   NumTms+4 doubles per voxel, sized for the whole study. A host must
+*   budget for that: @c PM_FRAMEIO::Budget, @c --mem with
+*   @c parmmap @c --watch.
 *
 * @section license License
 *   (Add your project’s license or reference a LICENSE file.)
 */
 
 #include	"stdafx.h"
+#include	"ModelTable.h"
 
 char	M5_IFpanelName[]	= "";
 
@@ -102,10 +123,17 @@ PSTR	M5_OPUnits[] = { OPUnits0,OPUnits1 };
 PR_CLRMAP	M5_ClrScheme[] = { PR_CLRMAP_RAINBOW,PR_CLRMAP_RAINBOW };
 
 
-static double	RISE_THRA,
+// Per-map state created by M5_ModelInit()
+struct M5_STATE {
+	double	RISE_THRA,			// low/high threshold fractions of the peak
 			RISE_THRB;
+	PDOUBLE	Tarr;				// relative time array (seconds)
+	INT64		ScratchSize;		// per-thread arena doubles (M5_ModelScratch)
+};
+
+typedef M5_STATE*	PM5_STATE;
 
-static PDOUBLE	gTarr	= NULL;
+void	M5_ModelClose( PVOID ModelState );
 
 /**
 * @brief Initialize Model 5 (Time of active rise).
@@ -115,8 +143,8 @@ static PDOUBLE	gTarr	= NULL;
 * operations.
 *
 * @param[out] pModelState
-*   Opaque per‑call state pointer used by the framework. This model does not
-*   maintain state and leaves it unchanged (typically @c NULL).
+*   Receives the new @c M5_STATE object (or @c NULL on failure); released by
+*   @c M5_ModelClose().
 *
 * @return bool
 *   @c true on success; @c false if a guarded allocation fails.
@@ -127,26 +155,37 @@ static PDOUBLE	gTarr	= NULL;
 *   - @c AbsTarr and @c NumTms are valid for the current TAC.
 *
 * @post
-*   - @c RISE_THRA and @c RISE_THRB reflect the configured fractions.
-*   - @c gTarr points to a newly created relative time array (seconds) created
-*     by @c PR_MakeRelativeArr(); freed in @c M5_ModelClose().
+*   - @c RISE_THRA and @c RISE_THRB of the state reflect the configured fractions.
+*   - @c Tarr of the state points to a newly created relative time array
+*     (seconds) created by @c PR_MakeRelativeArr(); freed in @c M5_ModelClose().
+*   - @c ScratchSize holds the per‑thread arena size (one TAC buffer).
 *
-* @thread_safety Not thread‑safe (writes module‑static @c gTarr and thresholds).
+* @thread_safety Reentrant; touches no module statics.
 *
 * @see PR_MakeRelativeArr(). :contentReference[oaicite:8]{index=8}
 */
 
 bool	M5_ModelInit( PVOID* pModelState )
 {
-bool	res	= false;
+PM5_STATE	S	= NULL;
+bool		res	= false;
+
+	*pModelState = NULL;
+
+	xz( AllocMem<M5_STATE >(S,1 ));
 
-	RISE_THRA	= M5_FreeParm[0];
-	RISE_THRB	= M5_FreeParm[1];
+	S->RISE_THRA	= M5_FreeParm[0];
+	S->RISE_THRB	= M5_FreeParm[1];
 
-	xz( gTarr = PR_MakeRelativeArr( AbsTarr,NumTms ));
+	xz( S->Tarr = PR_MakeRelativeArr( AbsTarr,NumTms ));
+
+	S->ScratchSize = SA_Need( NumTms );
+
+	*pModelState = S;
 
 	res	= true;
 func_exit:
+	if ( !res ) M5_ModelClose( S );
 	return res;
 }
 
@@ -157,7 +196,41 @@ func_exit:
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 void	M5_ModelClose( PVOID ModelState )
 {
-	pf_free(&gTarr);
+PM5_STATE	S = (PM5_STATE)ModelState;
+	if ( !S ) return;
+
+	pf_free(&S->Tarr);
+	pf_free(&S);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Doubles of per-thread scratch arena needed by M5_ModelFuncBatch()
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+INT64	M5_ModelScratch( PVOID ModelState )
+{
+	return ((PM5_STATE)ModelState)->ScratchSize;
+}
+
+
+// TAR and slope from the times at which the thresholds ThrA and ThrB are crossed; VOIDVOX if undefined
+static bool	M5_Rise(
+		double	ta,
+		double	tb,
+		double	ThrA,
+		double	ThrB,
+		PDOUBLE	pTAR,
+		PDOUBLE	pSlope )
+{
+	if ( ta==VOIDVOX	|| tb==VOIDVOX ||	IsEqual(ta,tb)) {
+		*pTAR = *pSlope = VOIDVOX;
+		return false;
+	}
+
+	*pTAR = tb-ta;
+	*pSlope = (ThrB-ThrA)/(*pTAR);
+	return true;
 }
 
 
@@ -202,9 +275,6 @@ static bool	CalcTAR(
 		PDOUBLE	pTAR,
 		PDOUBLE	pSlope )
 {
-bool	res	= false;
-
-
 INT64	Tmax;
 const double MaxY = FindMaxVal( Y,N,&Tmax ),
 		 ThrA = MaxY*ThrKoffA,
@@ -215,76 +285,246 @@ const int	 RiseN = Tmax+1;
 double	ta = FindThresholdTime( Y,RiseN,ThrA,true,X ),
 		tb = FindThresholdTime( Y,RiseN,ThrB,true,X );
 
-
-	if ( ta==VOIDVOX	|| tb==VOIDVOX ||	IsEqual(ta,tb))	goto func_exit;
-
-	*pTAR = tb-ta;
-	*pSlope = (ThrB-ThrA)/(*pTAR);
-
-
-	res	= true;
-func_exit:
-	if ( !res ) *pTAR = *pSlope = VOIDVOX;
-	return res;
+	return M5_Rise( ta,tb,ThrA,ThrB,pTAR,pSlope );
 }
 
 
 /**
-* @brief Convert TAC to concentration, compute TAR & slope, and emit outputs.
+* @brief Convert a block of TACs to concentration and compute TAR & slope.
 *
-* Steps:
-*   1) Allocate a working buffer and convert @p Signal to concentration via
-*      @c funcSigToConc() (storing conversion base in @c PR_CONCCONVBASE).
-*   2) Call @c CalcTAR( Cnc, gTarr, NumTms, RISE_THRA, RISE_THRB, &TAR, &Slope ).
-*   3) Conditionally write outputs (guarded by @c ParmReq[]):
-*        - OP[0] = TAR (seconds)
-*        - OP[1] = Slope
+* Batch counterpart of @c M5_ModelFunc(); see @c ModelBatch.h for the block
+* layout. For every voxel:
+*   1) Convert the TAC to concentration via @c funcSigToConc() (storing the
+*      conversion base in @c PR_CONCCONVBASE), unless @c B->IsConc says the
+*      block already is.
+*   2) Call @c CalcTAR( Cnc, S->Tarr, NumTms, S->RISE_THRA, S->RISE_THRB, &TAR, &Slope ).
+*   3) Store OP[0] = TAR (seconds) and OP[1] = Slope into the non-NULL planes.
 *
-* @param[in]  Signal  Pointer to TAC samples (length @c NumTms) in time order.
-* @param[out] OutParm Framework‑managed writer used by @c Write().
+* @param[in]     ModelState  State from @c M5_ModelInit().
+* @param[in,out] B  Voxel block.
 *
 * @return bool
-*   @c true on success; @c false if an allocation or a guarded call fails. All
-*   transient allocations are released before return. :contentReference[oaicite:11]{index=11}
+*   @c true on success; @c false if the scratch arena is missing or too small. A
+*   voxel whose thresholds are not crossed gets @c VOIDVOX and
+*   @c VoxOk[v]=false.
 *
 * @pre
-*   - @c M5_ModelInit() completed successfully (valid @c gTarr and thresholds).
+*   - @c M5_ModelInit() completed successfully (valid @c Tarr and thresholds).
 *   - @c NumTms > 0.
 *
-* @post
-*   - Temporary buffer is freed before return.
-*
 * @warning
 *   The model inspects only the **rising phase** up to the global maximum.
 *   If thresholds are not crossed within that region (or are equal), outputs
-*   are set to @c VOIDVOX. TAC must be in **time order**. :contentReference[oaicite:12]{index=12}
+*   are set to @c VOIDVOX. TAC must be in **time order**.
 *
 * @complexity
-*   O(N) time and O(N) temporary memory, where N = @c NumTms.
+*   O(NumVox*N) time and O(N) scratch memory, where N = @c NumTms.
 */
 
-bool	M5_ModelFunc(
-	PDOUBLE	Signal,
-	PIVAL		OutParm )
+bool	M5_ModelFuncBatch(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
 {
-PDOUBLE	Cnc	= NULL;
+const PM5_STATE	S	= (PM5_STATE)ModelState;
+SCRATCH_ARENA	Local;
+PSCRATCH_ARENA	A;
 bool		res	= false;
 
 PR_CONCCONVBASE ConvBase;
-	xz( AllocMem<double >(Cnc,NumTms ));
-	funcSigToConc( Signal,NumTms,Cnc,1,&ConvBase );
+	xz( A = MB_BlockArena( B,&Local,S->ScratchSize ));
 
+	for ( int v=0; v<B->NumVox; v++ ) {
+		SA_Reset( A );
 
-double TAR,Slope;
-	xz( CalcTAR( Cnc,gTarr,NumTms,RISE_THRA,RISE_THRB,&TAR,&Slope ));
+		PDOUBLE	Cnc;
+		xz( Cnc = MB_ConcTac( B,v,A,&ConvBase ));
 
+		double	Val[M5_NumOutParms];
+		bool		Ok;
+		{
+			MP_SCOPE( MP_KERNEL );
+			Ok = CalcTAR( Cnc,S->Tarr,NumTms,S->RISE_THRA,S->RISE_THRB,Val+0,Val+1 );
+		}
 
-	if ( ParmReq[0])	Write( OutParm,TAR );
-	if ( ParmReq[1])	Write( OutParm,Slope );
+		MB_StoreVoxel( B,v,Val,M5_NumOutParms,Ok );
+	}
 
 	res	= true;
 func_exit:
-	pf_free(&Cnc);
+	SA_Free(&Local);
 	return res;
 }
 
+
+/**
+* @brief Convert TAC to concentration, compute TAR & slope, and emit outputs.
+*
+* Thin wrapper over @c M5_ModelFuncBatch() for a block of one voxel.
+* Conditionally writes outputs (guarded by @c ParmReq[]):
+*   - OP[0] = TAR (seconds)
+*   - OP[1] = Slope
+*
+* @param[in]  ModelState State from @c M5_ModelInit().
+* @param[in]  Signal  Pointer to TAC samples (length @c NumTms) in time order.
+* @param[out] OutParm Framework‑managed writer used by @c Write().
+*
+* @return bool
+*   @c true on success; @c false if an allocation fails or the thresholds are
+*   not crossed (nothing is written in that case).
+*/
+
+bool	M5_ModelFunc(
+	PVOID		ModelState,
+	PDOUBLE	Signal,
+	PIVAL		OutParm )
+{
+	return MB_ModelFuncVoxel( M5_ModelFuncBatch,ModelState,Signal,OutParm,M5_NumOutParms );
+}
+
+
+enum {
+	M5_FRAMEACC	= 4				// M5_ModelFuncFrame(): peak, its frame, the crossing frames of ThrA and ThrB
+};
+
+
+// Accumulator doubles per voxel of M5_ModelFuncFrame(): the running state, then the samples received.
+// That is the whole TAC in double, more than the study itself, so the entry answers live maps only
+// (LiveOut), a plain frame-by-frame pass refuses the model (FrameOut 0) and parmmap --watch takes it
+// only within a --mem budget (see the frames section of the file header).
+static INT64	M5_ModelFrameAcc( PVOID /*ModelState*/ )
+{
+	return M5_FRAMEACC+NumTms;
+}
+
+
+// First frame from i up to Tmax where Y reaches Thr, as FindThresholdTime() crosses it; Tmax+1 if none
+static int	M5_NextCross(
+		const double*	Y,
+		int			i,
+		int			Tmax,
+		double		Thr )
+{
+	while ( i<=Tmax && !(Y[i]>=Thr) ) i++;
+	return i;
+}
+
+
+// Crossing time of Thr at frame i of M5_NextCross(), interpolated on X as FindThresholdTime() does
+static double	M5_CrossTime(
+		const double*	Y,
+		const double*	X,
+		int			i,
+		int			Tmax,
+		double		Thr )
+{
+	if ( i>Tmax ) return VOIDVOX;
+	if ( i==0 ) return X[0];
+
+	double	w = (Thr-Y[i-1])/(Y[i]-Y[i-1]);
+	return X[i-1]+w*(X[i]-X[i-1]);
+}
+
+
+/**
+* @brief Frame-streaming form of @c M5_ModelFuncBatch() (see @c MODEL_ENTRY::FuncFrame).
+*
+* Frame t is appended to the samples of each voxel. If it is a new peak
+* (strictly above the running one, as @c FindMaxVal() keeps the first), the
+* thresholds are recomputed from it and the crossing frame of each is
+* searched from its previous one (from frame 0 for a negative fraction,
+* whose threshold falls instead), up to the new peak. The outputs of the
+* frames received so far are then those of @c CalcTAR() on them, exactly.
+*
+* @param[in]     ModelState  State from @c M5_ModelInit().
+* @param[in]     t  Frame of @c B->Signal, or with @c B->Signal @c NULL the
+*                   number of frames folded.
+* @param[in,out] B  Voxel block of one frame; @c B->Acc holds
+*                   @c M5_ModelFrameAcc() doubles per voxel.
+*
+* @return bool Always @c true.
+*/
+
+bool	M5_ModelFuncFrame(
+	PVOID		ModelState,
+	int		t,
+	PMODEL_BATCH	B )
+{
+const PM5_STATE	S	= (PM5_STATE)ModelState;
+const int		NA	= M5_FRAMEACC+NumTms;
+const double	Koff[2] = { S->RISE_THRA,S->RISE_THRB };
+
+	if ( B->Signal ) {
+		PDOUBLE	Acc = B->Acc;
+
+		MP_SCOPE_BLOCK( MP_KERNEL,B->NumVox );
+		for ( int v=0; v<B->NumVox; v++, Acc+=NA ) {
+			PDOUBLE		Y = Acc+M5_FRAMEACC;
+			const double	y = B->Signal[v];
+
+			Y[t] = y;
+			if ( t>0 && !(y>Acc[0]) ) continue;
+
+			Acc[0]	= y;
+			Acc[1]	= t;
+			for ( int k=0; k<2; k++ )
+				Acc[2+k] = M5_NextCross( Y,(t>0 && Koff[k]>=ZERO) ? (int)Acc[2+k] : 0,t,y*Koff[k] );
+		}
+		return true;
+	}
+
+	for ( int v=0; v<B->NumVox; v++ ) {
+		const double*	Acc  = B->Acc+(INT64)v*NA;
+		const double*	Y    = Acc+M5_FRAMEACC;
+		const int		Tmax = (int)Acc[1];
+		const double	ThrA = Acc[0]*Koff[0],
+				ThrB = Acc[0]*Koff[1];
+		double		Val[M5_NumOutParms];
+		bool			Ok;
+
+		{
+			MP_SCOPE( MP_KERNEL );
+			Ok = t>0 && M5_Rise( M5_CrossTime( Y,S->Tarr,(int)Acc[2],Tmax,ThrA ),
+					     M5_CrossTime( Y,S->Tarr,(int)Acc[3],Tmax,ThrB ),ThrA,ThrB,Val+0,Val+1 );
+		}
+		MB_StoreVoxel( B,v,Val,M5_NumOutParms,Ok );
+	}
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Driver table entry (see ModelTable.h)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	M5_EntryInit(
+		PVOID*	pModelState,
+		PINPUTFUNC	/*IFarr*/,
+		int		/*NumIF*/ )
+{
+	return M5_ModelInit( pModelState );
+}
+
+MODEL_ENTRY	M5_ModelEntry( void )
+{
+MODEL_ENTRY	E = {};
+
+	E.Number	= 5;
+	E.Name		= M5_ModelName;
+	E.NumFreeParms	= M5_NumFreeParms;
+	E.FreeParm	= M5_FreeParm;
+	E.FPName	= M5_FPName;
+	E.NumOutParms	= M5_NumOutParms;
+	E.OPName	= M5_OPName;
+	E.NumIfuncs	= M5_NumIfuncs;
+	E.Init		= M5_EntryInit;
+	E.Close		= M5_ModelClose;
+	E.Func		= M5_ModelFunc;
+	E.FuncBatch	= M5_ModelFuncBatch;
+	E.ScratchSize	= M5_ModelScratch;
+	E.FuncFrame	= M5_ModelFuncFrame;
+	E.FrameAcc	= M5_ModelFrameAcc;
+	E.LiveOut	= BM(0)|BM(1);
+
+	return E;
+}
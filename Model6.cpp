@@ -43,32 +43,41 @@
 *   @c RoiTacArr, @c NumRoiTac.
 *
 * @section units Units
-*   Before WM normalization, the integral has units of **time** (the units of
-*   @c Tarr). If normalization by a white‑matter ROI is applied, OP[0] becomes
-*   a **dimensionless ratio** (relative CBV).
+*   Without a white‑matter ROI, OP[0] is the integral in units of **time**
+*   (the units of @c Tarr). With one WM ROI it is normalized by the integral
+*   of that ROI and becomes a **dimensionless ratio** (relative CBV; 1 for a
+*   voxel whose integral equals that of the WM ROI).
 *
 * @section config Model configuration
 *   - @c M6_NumIfuncs = 0 ; @c M6_NumFreeParms = 2 ; @c M6_NumOutParms = 1
 *   - @c M6_UseNoise = TRUE ; @c M6_UseGlobalTac = TRUE ; optimizations disabled.
 *
 * @section ts Thread‑safety
-*   Not thread‑safe: uses module‑static globals (@c Tarr, @c AirThresh, @c SkipTimes,
-*   @c pre_N/@c post_N, @c WhiteMatterNorm).
+*   Reentrant: @c Tarr, @c AirThresh, @c SkipTimes, @c pre_N/@c post_N and
+*   @c WhiteMatterNorm live in an @c M6_STATE object created by
+*   @c M6_ModelInit() and released by @c M6_ModelClose(); evaluation only
+*   reads it.
 *
 * @section mem Memory
-*   Allocates a relative time array at init and frees it at close. Per‑voxel work
+*   Allocates the model state and a relative time array at init and frees them
+*   at close. Per‑voxel work
 *   uses stack buffers sized @c DEF_MAXNUMTMS.
 *
 * @section impl Implementation notes
-*   - The code intends to compute @c WhiteMatterNorm from a white‑matter ROI
-*     integral, but the call that would populate the local @c Integral is
-*     commented out; ensure this normalization is computed before use. :contentReference[oaicite:2]{index=2}
+*   - @c WhiteMatterNorm is 1 / integral of the white‑matter ROI TAC, evaluated
+*     at init by the same per‑voxel kernel with a unit norm.
+*   - Behavior change: the original source left the call that computes that
+*     integral commented out, so with one WM ROI the norm was 1 / an
+*     uninitialized value and OP[0] was undefined. It is now computed as
+*     intended, and OP[0] with one WM ROI is relative CBV instead of an
+*     integral in units of time. Without a WM ROI the norm is 1, as before.
 *
 * @section license License
 *   (Add your project’s license notice or reference a LICENSE file.)
 */
 
 #include	"stdafx.h"
+#include	"ModelTable.h"
 
 char	M6_IFpanelName[]	= "";
 
@@ -109,11 +118,6 @@ PSTR	M6_OPUnits[M6_NumOutParms] = { OPUnits0 };
 PR_CLRMAP	M6_ClrScheme[M6_NumOutParms] = { PR_CLRMAP_RAINBOW };
 
 
-static double	AirThresh;
-static double	WhiteMatterNorm;
-static int		SkipTimes;
-static int		wNumTms;
-
 const double	MAX_BASELINE_DEV = 0.05;
 const double	MAX_BASELINE_SPLIT = 0.2;
 
@@ -126,13 +130,25 @@ enum {
 
 
 
-static int	pre_N,
-		post_N;
-
 const double	PRE_N_THR	= 0.95,
 			POST_N_THR  = 0.95;
 
-static PDOUBLE	Tarr	= NULL;
+
+// Per-map state created by M6_ModelInit()
+struct M6_STATE {
+	double	AirThresh;			// IsAir_ByMin() threshold
+	double	WhiteMatterNorm;		// 1 / WM ROI integral (or 1)
+	int		SkipTimes;			// leading frames to skip
+	int		pre_N,			// pre/post baseline window lengths
+			post_N;
+	PDOUBLE	Tarr;				// relative time array
+};
+
+typedef M6_STATE*	PM6_STATE;
+
+void	M6_ModelClose( PVOID ModelState );
+
+static bool	M6_VoxelIntegral( PM6_STATE S,PDOUBLE Tac,PDOUBLE pIntg );
 
 /**
 * @brief Initialize Model 6 (CBV baseline integral).
@@ -141,7 +157,8 @@ static PDOUBLE	Tarr	= NULL;
 * global TAC, and prepares thresholds and normalization.
 *
 * @param[out] pModelState
-*   Opaque per‑call state pointer (unused by this model; left unchanged).
+*   Receives the new @c M6_STATE object (or @c NULL on failure); released by
+*   @c M6_ModelClose().
 *
 * @return bool
 *   @c true on success; @c false if a guarded allocation/validation fails.
@@ -152,35 +169,42 @@ static PDOUBLE	Tarr	= NULL;
 *     @c M6_FreeParm[1] (skip count) are set.
 *   - At most one white‑matter ROI is provided (@c NumRoiTac <= 1).
 *
-* @post
+* @post (fields of the state)
 *   - @c Tarr = PR_MakeRelativeArr(AbsTarr, NumTms).
 *   - @c AirThresh = M6_FreeParm[0] * demp_NoiseLevel.
 *   - @c SkipTimes set; working length @c wNumTms = NumTms - SkipTimes.
 *   - @c pre_N/@c post_N derived from @c GlobalTac (see code for details).
-*   - @c WhiteMatterNorm initialized (intended as 1 / WM integral; see note).
+*   - @c WhiteMatterNorm = 1 / WM integral, or 1 without a WM ROI.
 *
 * @details
 *   Baseline windows are derived using thresholds @c PRE_N_THR and @c POST_N_THR
 *   relative to the minimum of the (shifted) global TAC. If a single WM ROI is
-*   present, its TAC is checked (@c IsAir_ByMin) and intended to define a
-*   normalization factor @c WhiteMatterNorm = 1 / Integral(ROI). The current
-*   implementation leaves the integral uninitialized (commented code). :contentReference[oaicite:3]{index=3}
+*   present, its TAC is checked (@c IsAir_ByMin) and defines the
+*   normalization factor @c WhiteMatterNorm = 1 / Integral(ROI), where the
+*   integral comes from @c M6_VoxelIntegral() evaluated with a unit norm.
 *
-* @thread_safety Not thread‑safe: writes module‑static state.
+* @thread_safety Reentrant; touches no module statics.
 */
 
 bool	M6_ModelInit( PVOID* pModelState )
 {	
-bool	res	= false;
+PM6_STATE	S	= NULL;
+bool		res	= false;
+
+	*pModelState = NULL;
+
 	if ( NumRoiTac>1 ) xmsg( "This Model requires no more than one White Matter ROI" );
 
-	xz( Tarr = PR_MakeRelativeArr( AbsTarr,NumTms ));
+	xz( AllocMem<M6_STATE >(S,1 ));
+
+	xz( S->Tarr = PR_MakeRelativeArr( AbsTarr,NumTms ));
 
-	AirThresh = M6_FreeParm[0]*demp_NoiseLevel;
-	SkipTimes = (int)(M6_FreeParm[1]);
+	S->AirThresh = M6_FreeParm[0]*demp_NoiseLevel;
+	S->SkipTimes = (int)(M6_FreeParm[1]);
 
+	{
 	// Define working number of timepoints	
-	wNumTms = NumTms-SkipTimes;	
+int	wNumTms = NumTms-S->SkipTimes;	
 	
 	//............................................................................
 	// Define pre_N\post_N values
@@ -196,6 +220,7 @@ double MinSi = SA;
 
 
 	// Find pre_N
+int	pre_N,post_N;
 double Thr = (SA-MinSi)*PRE_N_THR;
 	for ( pre_N=1; pre_N<wNumTms; pre_N++ ) 
 		if ( wTac[pre_N]-MinSi<Thr ) break;
@@ -206,6 +231,10 @@ PDOUBLE wTacEnd = wTac+wNumTms-1;
 	for ( post_N=1; post_N<wNumTms; post_N++ )
 		if ( wTacEnd[-post_N]-MinSi<Thr ) break;
 
+	S->pre_N	= pre_N;
+	S->post_N	= post_N;
+	}
+
 	//...............................................................................
 	// Define the White Matter norm
 	//
@@ -217,18 +246,19 @@ PDOUBLE wTacEnd = wTac+wNumTms-1;
 	
 		if ( IsAir_ByMin( Tac,NumTms )) xmsg("White Matter ROI TAC is incorrect"); 
 
-		// Initialize White Matter Norm
-		WhiteMatterNorm = ONE;
+		// Initialize White Matter Norm (the original left this integral uninitialized; see the file notes)
+		S->WhiteMatterNorm = ONE;
 		double	Integral;
-		PDOUBLE p = &Integral;
-		//M6_ModelFunc( Tac,p );
-		WhiteMatterNorm = ONE/Integral;
+		if ( !M6_VoxelIntegral( S,Tac,&Integral )) xmsg("White Matter ROI TAC is incorrect");
+		S->WhiteMatterNorm = ONE/Integral;
 	}
-	else	WhiteMatterNorm = ONE;
+	else	S->WhiteMatterNorm = ONE;
 
+	*pModelState = S;
 
 	res	= true;
 func_exit:
+	if ( !res ) M6_ModelClose( S );
 	return res;
 }
 
@@ -239,7 +269,21 @@ func_exit:
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 void	M6_ModelClose( PVOID ModelState )
 {
-	pf_free(&Tarr);
+PM6_STATE	S = (PM6_STATE)ModelState;
+	if ( !S ) return;
+
+	pf_free(&S->Tarr);
+	pf_free(&S);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Model 6 keeps its per-voxel arrays on the stack (DEF_MAXNUMTMS) and needs no scratch arena
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+INT64	M6_ModelScratch( PVOID /*ModelState*/ )
+{
+	return 0;
 }
 
 
@@ -301,6 +345,7 @@ static bool	ArrayIsGreater(
 *     @f$wTac[t] > post\_bl - noise@f$ or a new downward excursion exceeds @f$noise@f$.
 * The end index is clamped to @c min(found-1, Last-1).
 *
+* @param[in]  S         Model state (@c pre_N, @c post_N).
 * @param[in]  wTac      Working TAC (after initial skips), length @p wNumTms.
 * @param[in]  wNumTms   Number of working time points.
 * @param[in]  noise     Noise estimate (e.g., stdev from pre‑baseline).
@@ -311,12 +356,13 @@ static bool	ArrayIsGreater(
 *
 * @complexity O(wNumTms).
 *
-* @pre @c pre_N and @c post_N must be initialized in @c M6_ModelInit().
+* @pre @c pre_N and @c post_N of the state are initialized in @c M6_ModelInit().
 *
 * @note Indices are with respect to @p wTac (i.e., after skipping initial frames). :contentReference[oaicite:6]{index=6}
 */
 
 static void	FindBolusPosition(
+		PM6_STATE	S,
 		PDOUBLE	wTac,
 		int		wNumTms,
 		double	noise,
@@ -338,7 +384,7 @@ int	 b_peak	= 0;
 	// Find start of bolus
 double cutoff = pre_bl - noise;
 int	 b_start;
-	for ( b_start=b_peak; b_start>pre_N; b_start-- ) 
+	for ( b_start=b_peak; b_start>S->pre_N; b_start-- ) 
 		if ( wTac[b_start-1]>cutoff ) break;
 
 
@@ -346,7 +392,7 @@ int	 b_start;
 	cutoff = post_bl - noise;		// Baseline
 int	b_end;
 double mx	= msd;
-int	 Last = wNumTms-post_N;
+int	 Last = wNumTms-S->post_N;
 
 	for ( b_end = b_peak+2; b_end<Last; b_end++ ) {
 		if ( wTac[b_end]>mx )	mx = wTac[b_end];
@@ -363,34 +409,31 @@ int	 Last = wNumTms-post_N;
 
 
 /**
-* @brief Compute the CBV baseline integral for a single TAC and emit OP[0].
+* @brief Compute the CBV baseline integral for a single raw TAC.
 *
 * Steps:
-*   1) Reject voxels classified as “air” by @c IsAir_ByMin(Tac, AirThresh).
+*   1) Reject voxels classified as “air” by @c IsAir_ByMin(Tac, S->AirThresh).
 *   2) Trim the TAC/time arrays by @c SkipTimes.
 *   3) Estimate pre/post baselines and noise using @c PR_ArrStats().
 *   4) Find bolus start/end via @c FindBolusPosition().
 *   5) Baseline‑correct the TAC with a linear trend between start/end.
 *   6) Convert to @f$\Delta R(t)=-\ln(S(t)/S_0)@f$ (with clamping).
 *   7) Integrate @f$\Delta R(t)@f$ over [start, end] using @c CalculateIntegral().
-*   8) Write @c Intg * WhiteMatterNorm to @p OutParm (OP[0]).
+*   8) Return @c Intg * WhiteMatterNorm in @p pIntg.
 *
-* @param[in]  Tac     Pointer to raw TAC samples (length @c NumTms) in time order.
-* @param[out] OutParm Framework‑managed writer used by @c Write().
+* @param[in]  S      Model state from @c M6_ModelInit().
+* @param[in]  Tac    Pointer to raw TAC samples (length @c NumTms) in time order.
+* @param[out] pIntg  Receives the (normalized) integral.
 *
 * @return bool
 *   @c true on success; @c false if a guarded check fails (e.g., air voxel,
 *   invalid bolus window).
 *
 * @pre
-*   - @c M6_ModelInit() completed successfully; @c Tarr, @c pre_N/@c post_N,
-*     and thresholds are set.
+*   - @c Tarr, @c pre_N/@c post_N and thresholds of @p S are set (the
+*     integral is also used by @c M6_ModelInit() for the WM norm).
 *   - @c NumTms > @c SkipTimes and TAC is time‑sorted.
 *
-* @post
-*   - OP[0] is emitted. (In this implementation, it is written unconditionally
-*     rather than being gated by @c ParmReq[0].)
-*
 * @units
 *   Integral units match the time units of @c Tarr (e.g., seconds). After
 *   white‑matter normalization, the result is dimensionless.
@@ -398,25 +441,28 @@ int	 Last = wNumTms-post_N;
 * @warning
 *   Frame indexing is 0‑based internally; any UI using 1‑based indices must
 *   be reconciled externally. This model operates on raw TACs for the air
-*   check; concentration conversion is handled internally afterward. :contentReference[oaicite:7]{index=7}
+*   check; concentration conversion is handled internally afterward.
 *
 * @complexity
 *   O(N) time and O(N) temporary memory, where N = @c NumTms.
 */
 
-bool	M6_ModelFunc(
-	PDOUBLE	Tac,
-	PIVAL		OutParm )
+static bool	M6_VoxelIntegral(
+		PM6_STATE	S,
+		PDOUBLE	Tac,
+		PDOUBLE	pIntg )
 {
 bool	res	= false;
 
 	// Set values for void voxels
-	xnz( IsAir_ByMin( Tac,AirThresh ));
-
+	xnz( IsAir_ByMin( Tac,S->AirThresh ));
 
-PDOUBLE	wTac		= Tac+SkipTimes;
-int		wNumTms	= NumTms-SkipTimes;
-PDOUBLE	wTarr		= Tarr+SkipTimes;
+	{
+const int	pre_N		= S->pre_N,
+		post_N	= S->post_N;
+PDOUBLE	wTac		= Tac+S->SkipTimes;
+int		wNumTms	= NumTms-S->SkipTimes;
+PDOUBLE	wTarr		= S->Tarr+S->SkipTimes;
 
 
 	//......................................................
@@ -427,7 +473,10 @@ double pre_bl = PR_ArrStats( wTac,pre_N,&noise ),
 	
 	// Find position of the Bolus
 int	b_start,b_end;
-	FindBolusPosition( wTac,wNumTms,noise,pre_bl,post_bl,&b_start,&b_end );
+	{
+	MP_SCOPE( MP_KERNEL );
+	FindBolusPosition( S,wTac,wNumTms,noise,pre_bl,post_bl,&b_start,&b_end );
+	}
 	xnz( b_start>=b_end );
 
 	// Perform baseline correction
@@ -451,9 +500,14 @@ double Cx[DEF_MAXNUMTMS];
  
 	//----------------------------------------------------------------
 	// R2 integral with BaseLine
-double Intg = CalculateIntegral( Cx+b_start,wTarr+b_start,b_end-b_start+1 );
+double Intg;
+	{
+	MP_SCOPE( MP_INTEGRATE );
+	Intg = CalculateIntegral( Cx+b_start,wTarr+b_start,b_end-b_start+1 );
+	}
 
-	Write( OutParm,Intg*WhiteMatterNorm );
+	*pIntg = Intg*S->WhiteMatterNorm;
+	}
 
 	res	= true;
 func_exit:
@@ -461,12 +515,113 @@ func_exit:
 }
 
 
+/**
+* @brief Compute the CBV baseline integral for a block of raw TACs.
+*
+* Batch counterpart of @c M6_ModelFunc(); see @c ModelBatch.h for the block
+* layout. The TACs are **raw signal** (no @c funcSigToConc()). Air voxels and
+* voxels without a valid bolus window get @c VOIDVOX and @c VoxOk[v]=false.
+*
+* @param[in]     ModelState  State from @c M6_ModelInit().
+* @param[in,out] B  Voxel block; OP[0] goes to @c OutPlane[0].
+*
+* @return bool @c true (the model needs no block-level resources).
+*/
 
+bool	M6_ModelFuncBatch(
+	PVOID		ModelState,
+	PMODEL_BATCH	B )
+{
+const PM6_STATE	S	= (PM6_STATE)ModelState;
 
+	for ( int v=0; v<B->NumVox; v++ ) {
+		double	Intg;
+		bool		Ok = M6_VoxelIntegral( S,B->Signal+(INT64)v*NumTms,&Intg );
 
+		MB_StoreVoxel( B,v,&Intg,M6_NumOutParms,Ok );
+	}
 
+	return true;
+}
 
 
+/**
+* @brief Compute the CBV baseline integral for a single TAC and emit OP[0].
+*
+* Thin wrapper over @c M6_ModelFuncBatch() for a block of one voxel.
+*
+* @param[in]  ModelState State from @c M6_ModelInit().
+* @param[in]  Tac     Pointer to raw TAC samples (length @c NumTms) in time order.
+* @param[out] OutParm Framework‑managed writer used by @c Write().
+*
+* @return bool
+*   @c true on success; @c false for air voxels or an invalid bolus window.
+*
+* @post
+*   - OP[0] is emitted. (In this implementation, it is written unconditionally
+*     rather than being gated by @c ParmReq[0].)
+*/
 
+bool	M6_ModelFunc(
+	PVOID		ModelState,
+	PDOUBLE	Tac,
+	PIVAL		OutParm )
+{
+double	Intg;
+MB_PLANE	Plane[M6_NumOutParms] = { { &Intg,MB_FLOAT64,ONE,ZERO } };
+bool		Ok = false;
+MODEL_BATCH	B = {};
+
+	B.Signal	= Tac;
+	B.NumVox	= 1;
+	B.OutPlane	= Plane;
+	B.VoxOk	= &Ok;
+	if ( !M6_ModelFuncBatch( ModelState,&B ) || !Ok ) return false;
+
+	Write( OutParm,Intg );
+
+	return true;
+}
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Driver table entry (see ModelTable.h)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	M6_EntryInit(
+		PVOID*	pModelState,
+		PINPUTFUNC	/*IFarr*/,
+		int		/*NumIF*/ )
+{
+	return M6_ModelInit( pModelState );
+}
+
+// IsAir_ByMin() threshold of the state, so the driver can skip air voxels before the model runs
+static double	M6_ModelAirThresh( PVOID ModelState )
+{
+	return ((M6_STATE*)ModelState)->AirThresh;
+}
+
+MODEL_ENTRY	M6_ModelEntry( void )
+{
+MODEL_ENTRY	E = {};
+
+	E.Number	= 6;
+	E.Name		= M6_ModelName;
+	E.NumFreeParms	= M6_NumFreeParms;
+	E.FreeParm	= M6_FreeParm;
+	E.FPName	= M6_FPName;
+	E.NumOutParms	= M6_NumOutParms;
+	E.OPName	= M6_OPName;
+	E.NumIfuncs	= M6_NumIfuncs;
+	E.RawSignal	= true;
+	E.Init		= M6_EntryInit;
+	E.Close		= M6_ModelClose;
+	E.Func		= M6_ModelFunc;
+	E.FuncBatch	= M6_ModelFuncBatch;
+	E.ScratchSize	= M6_ModelScratch;
+	E.AirThresh	= M6_ModelAirThresh;
+
+	return E;
+}
@@ -0,0 +1,303 @@
+/**
+* @file ModelBatch.h
+* @brief Voxel-block entry point shared by the @c M*_ModelFuncBatch() functions.
+*
+* @details
+* Every model exposes, next to its per-voxel @c M*_ModelFunc(), a batch
+* function that evaluates a block of voxels in one call:
+* @code
+*   bool  Mx_ModelFuncBatch( PVOID ModelState, PMODEL_BATCH B );
+* @endcode
+* @c ModelState is the object created by @c Mx_ModelInit(); the batch
+* function only reads it, so one state may serve many threads at once.
+* The block holds @c NumVox TACs in a contiguous **voxel-major** layout, i.e.
+* the TAC of voxel @c v occupies @c Signal[v*NumTms .. v*NumTms+NumTms-1] in
+* time order. Results are stored into typed output planes, one contiguous
+* plane per output parameter covering the whole map: OP[i] of voxel @c v goes
+* to sample @c V0+v of @c OutPlane[i], converted to the plane's type (double,
+* float, or int16 with a scale). A plane without @c Data means the output was
+* not requested and is not stored. The planes are fixed for a whole map run,
+* so blocks of any size, from any thread, store straight into them at their
+* voxel index with no output cursor.
+*
+* With @c IsConc set, @c Signal already holds concentration TACs (a fused
+* driver converted them once for several models) and the model skips its own
+* @c funcSigToConc(); see @c MB_ConcTac(). Models never modify @c Signal, so
+* one converted block can be handed to every model of a fused pass. Models
+* that work on raw signal (@c MODEL_ENTRY::RawSignal) always get raw TACs.
+* A model that folds a linear conversion into its kernel
+* (@c MODEL_ENTRY::FoldConc) may get a raw block with the conversion of each
+* TAC described instead, C = (S-@c ConcOffset[v])*@c ConcScale[v] (see
+* @c funcSigToConcLinear()); without the descriptor it converts the TACs.
+*
+* In float32 compute mode the driver also hands a float copy of the block
+* in @c SignalF (converted, like @c Signal, when @c IsConc) to the model's
+* @c M*_ModelFuncBatchF(), whose kernels keep per-sample arithmetic in float
+* and every sum, moment and integral in double (see @c TacKernels.h).
+*
+* Per-voxel work buffers come from @c Scratch, an arena owned by the calling
+* thread and sized from @c M*_ModelScratch() (see @c ScratchArena.h). A
+* @c NULL arena makes the batch function create a block-local one.
+*
+* A voxel the model cannot evaluate (air voxel, undefined threshold crossing,
+* ...) gets @c VOIDVOX in every requested plane and @c false in @c VoxOk[v].
+* The batch function itself returns @c false only when the whole block fails
+* (e.g. a framework allocation).
+*
+* A model with a series output (@c MODEL_ENTRY::SeriesName) stores the
+* value of point k into @c SeriesPlane[k] when the block has series planes.
+*
+* A frame-streaming block (@c MODEL_ENTRY::FuncFrame) holds one frame
+* instead of the TACs, @c Signal[v] for voxel @c v, and the accumulators of
+* its voxels in @c Acc, @c FrameAcc doubles per voxel, voxel-major.
+*
+* @c MB_StoreVoxel() and @c MB_ConcTac() carry the profiler hooks every
+* model shares (rejected voxels, the sampling tick, conversion time);
+* the models time their own kernels with @c MP_SCOPE() (see @c ModelProfile.h).
+*
+* The per-voxel @c M*_ModelFunc() is a thin wrapper that runs a block of one
+* voxel and emits the requested outputs through @c Write(); see
+* @c MB_ModelFuncVoxel().
+*/
+
+#pragma once
+
+#include	"ScratchArena.h"
+#include	"ModelProfile.h"
+
+#include	<algorithm>
+
+
+enum {
+	MB_MAXOUTPARMS	= 32			// upper bound of M*_NumOutParms for the voxel wrapper
+};
+
+
+// Sample type of an output plane
+enum MB_PLANETYPE {
+	MB_FLOAT64	= 0,
+	MB_FLOAT32,
+	MB_INT16					// value = sample*Scale+Offset; VOIDVOX stored as MB_VOID16
+};
+
+const short	MB_VOID16	= -32768;		// int16 sample of a VOIDVOX (or NaN) output
+
+
+// Output plane of one OP over the whole map
+struct MB_PLANE {
+	PVOID		Data;				// one sample per voxel; NULL = output not requested
+	int		Type;				// MB_PLANETYPE
+	double	Scale,Offset;		// MB_INT16 scaling (ignored for the float types)
+};
+
+typedef MB_PLANE*	PMB_PLANE;
+
+
+struct MODEL_BATCH {
+	PDOUBLE	Signal;				// NumVox TACs, voxel-major, NumTms samples each
+	int		NumVox;				// number of voxels in the block
+	const MB_PLANE*	OutPlane;		// OutPlane[op]: typed plane of output op
+	INT64		V0;				// plane index of the block's voxel 0
+	bool*		VoxOk;			// optional per-voxel success flags (may be NULL)
+	PSCRATCH_ARENA	Scratch;		// caller's per-thread arena (may be NULL)
+	bool		IsConc;			// Signal is already converted by funcSigToConc()
+	const float*	SignalF;			// float copy of Signal for M*_ModelFuncBatchF() (else NULL)
+	const MB_PLANE*	SeriesPlane;		// SeriesPlane[k]: plane of series point k (MODEL_ENTRY::SeriesName); NULL = none
+	PDOUBLE	Acc;				// FuncFrame: accumulators of the block's voxels (else NULL)
+	const double*	ConcOffset;		// raw block: conversion C = (S-ConcOffset[v])*ConcScale[v] of voxel v
+	const double*	ConcScale;			// for a FoldConc model (else NULL)
+};
+
+typedef MODEL_BATCH*	PMODEL_BATCH;
+
+typedef bool	(*PMODELFUNCBATCH)( PVOID ModelState,PMODEL_BATCH B );
+
+typedef INT64	(*PMODELSCRATCH)( PVOID ModelState );
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Arena for a block: the caller's one, or Local created with Size doubles (NULL on failure).
+// Local is always initialized, so SA_Free(Local) is safe afterwards.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+inline PSCRATCH_ARENA	MB_BlockArena(
+		PMODEL_BATCH	B,
+		PSCRATCH_ARENA	Local,
+		INT64			Size )
+{
+	SA_Init( Local );
+	if ( B->Scratch ) return B->Scratch;
+
+	return SA_Create( Local,Size ) ? Local : NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Concentration TAC of voxel v: the block itself when already converted, otherwise converted
+// into NumTms doubles from arena A. NULL if the arena is too small.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+inline PDOUBLE	MB_ConcTac(
+		PMODEL_BATCH		B,
+		int				v,
+		PSCRATCH_ARENA		A,
+		PR_CONCCONVBASE*		pConvBase )
+{
+PDOUBLE	Sig = B->Signal+(INT64)v*NumTms;
+
+	if ( B->IsConc ) return Sig;
+
+PDOUBLE	Tac = SA_Alloc( A,NumTms );
+	if ( Tac ) {
+		MP_SCOPE( MP_CONVERT );
+		funcSigToConc( Sig,NumTms,Tac,1,pConvBase );
+	}
+
+	return Tac;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Float32 TAC of voxel v for M*_ModelFuncBatchF(): the float block, which must already be in the
+// form the model takes (converted unless the model is RawSignal). NULL if there is none.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+inline const float*	MB_TacF(
+		PMODEL_BATCH	B,
+		int			v,
+		bool			RawSignal )
+{
+	if ( !B->SignalF || (!RawSignal && !B->IsConc) ) return NULL;
+
+	return B->SignalF+(INT64)v*NumTms;
+}
+
+
+// Bytes per sample of a plane of Type
+inline int	MB_PlaneBytes( int Type )
+{
+	return Type==MB_INT16 ? sizeof(short) : Type==MB_FLOAT32 ? sizeof(float) : sizeof(double);
+}
+
+
+// int16 sample of x: rounded to the plane's scale and clamped, VOIDVOX and NaN as MB_VOID16
+inline short	MB_Quantize16(
+		const MB_PLANE*	P,
+		double		x )
+{
+	if ( x==VOIDVOX || x!=x ) return MB_VOID16;
+
+double	q = floor( (x-P->Offset)/P->Scale+0.5 );
+	return (short)(q<-32767 ? -32767 : q>32767 ? 32767 : q);
+}
+
+
+// Store x as sample i of plane P
+inline void	MB_StoreValue(
+		const MB_PLANE*	P,
+		INT64			i,
+		double		x )
+{
+	switch ( P->Type ) {
+	case MB_FLOAT32:	((float*)P->Data)[i] = (float)x;		break;
+	case MB_INT16:	((short*)P->Data)[i] = MB_Quantize16( P,x );	break;
+	default:		((PDOUBLE)P->Data)[i] = x;			break;
+	}
+}
+
+
+// Set samples [V0, V0+N) of plane P to VOIDVOX
+inline void	MB_VoidRange(
+		const MB_PLANE*	P,
+		INT64			V0,
+		INT64			N )
+{
+	switch ( P->Type ) {
+	case MB_FLOAT32:	std::fill( (float*)P->Data+V0,(float*)P->Data+V0+N,(float)VOIDVOX );	break;
+	case MB_INT16:	std::fill( (short*)P->Data+V0,(short*)P->Data+V0+N,MB_VOID16 );	break;
+	default:		std::fill( (PDOUBLE)P->Data+V0,(PDOUBLE)P->Data+V0+N,VOIDVOX );	break;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Store the outputs of voxel v (or VOIDVOX if the voxel failed) into the requested planes.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+inline void	MB_StoreVoxel(
+		PMODEL_BATCH	B,
+		int			v,
+		const double*	Val,
+		int			NumOut,
+		bool			Ok )
+{
+	for ( int i=0; i<NumOut; i++ )
+		if ( B->OutPlane[i].Data ) MB_StoreValue( B->OutPlane+i,B->V0+v,Ok ? Val[i] : VOIDVOX );
+
+	if ( B->VoxOk ) B->VoxOk[v] = Ok;
+
+	if ( !Ok ) MP_COUNT( MP_REJECTED,1 );
+	MP_NEXTVOXEL();
+}
+
+
+// Store the outputs of voxel v into the planes of window w of a sliding-window block
+// (MODEL_ENTRY::FuncMoving); window 0 goes through MB_StoreVoxel()
+inline void	MB_StoreWindow(
+		PMODEL_BATCH	B,
+		int			w,
+		int			v,
+		const double*	Val,
+		int			NumOut )
+{
+const MB_PLANE*	P = B->OutPlane+(INT64)w*NumOut;
+
+	for ( int i=0; i<NumOut; i++ )
+		if ( P[i].Data ) MB_StoreValue( P+i,B->V0+v,Val[i] );
+}
+
+
+/**
+* @brief Per-voxel adapter over a batch function.
+*
+* Runs @p FuncBatch on a block of one voxel with planes for the outputs
+* requested in @c ParmReq[], then emits them in OP order through @c Write().
+*
+* @return bool @c false if the block failed or the voxel could not be evaluated
+*              (nothing is written in that case), @c true otherwise.
+*/
+inline bool	MB_ModelFuncVoxel(
+		PMODELFUNCBATCH	FuncBatch,
+		PVOID			ModelState,
+		PDOUBLE		Signal,
+		PIVAL			OutParm,
+		int			NumOut )
+{
+double	Val[MB_MAXOUTPARMS];
+MB_PLANE	Plane[MB_MAXOUTPARMS];
+bool		Ok = false;
+
+	for ( int i=0; i<NumOut; i++ ) {
+		Plane[i].Data	= ParmReq[i] ? Val+i : NULL;
+		Plane[i].Type	= MB_FLOAT64;
+		Plane[i].Scale	= ONE;
+		Plane[i].Offset	= ZERO;
+	}
+
+MODEL_BATCH	B = {};
+
+	B.Signal	= Signal;
+	B.NumVox	= 1;
+	B.OutPlane	= Plane;
+	B.VoxOk	= &Ok;
+	if ( !FuncBatch( ModelState,&B ) || !Ok ) return false;
+
+	for ( int i=0; i<NumOut; i++ )
+		if ( ParmReq[i] ) Write( OutParm,Val[i] );
+
+	return true;
+}
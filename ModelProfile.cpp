@@ -0,0 +1,164 @@
+/**
+* @file ModelProfile.cpp
+* @brief Clock, merging and JSON export of the stage profile (see @c ModelProfile.h).
+*/
+
+#include	"stdafx.h"
+#include	"ModelProfile.h"
+
+#include	<chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include	<x86intrin.h>
+#define	MP_TSC
+#elif defined(_M_X64) || defined(_M_IX86)
+#include	<intrin.h>
+#define	MP_TSC
+#endif
+
+
+#if defined(PARMMAP_PROFILE)
+thread_local MP_RECORD*	MP_Cur	= NULL;
+thread_local unsigned	MP_Tick	= 0;
+#endif
+
+
+// Clock ticks: the time-stamp counter where there is one, else nanoseconds
+INT64	MP_Now()
+{
+#if defined(MP_TSC)
+	return (INT64)__rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+}
+
+
+// Reset P for a run of NumReq requests and start the clock calibration
+void	MP_Begin(
+		PMP_PROFILE	P,
+		int		NumReq )
+{
+	P->Rec.assign( NumReq+1,MP_RECORD() );
+	P->Model.assign( NumReq,0 );
+	P->Name.assign( NumReq,std::string() );
+	P->Threads		= 0;
+	P->Seconds		= ZERO;
+	P->TicksPerSec	= ZERO;
+	P->Tick0		= MP_Now();
+}
+
+
+// Add the NumRec records of one thread to P->Rec[First..]
+void	MP_Merge(
+		PMP_PROFILE		P,
+		const MP_RECORD*	Rec,
+		int			First,
+		int			NumRec )
+{
+std::lock_guard<std::mutex>	Guard( P->Lock );
+
+	for ( int r=0; r<NumRec && First+r<(int)P->Rec.size(); r++ ) {
+		MP_RECORD&	D = P->Rec[First+r];
+		for ( int s=0; s<MP_NUMSTAGES; s++ ) {
+			D.Ticks[s]	+= Rec[r].Ticks[s];
+			D.Timed[s]	+= Rec[r].Timed[s];
+		}
+		for ( int c=0; c<MP_NUMCOUNTS; c++ ) D.Count[c] += Rec[r].Count[c];
+	}
+}
+
+
+// Close the run: wall time and ticks per second over it
+void	MP_End(
+		PMP_PROFILE	P,
+		double	Seconds )
+{
+	P->Seconds		= Seconds;
+	P->TicksPerSec	= Seconds>ZERO ? (MP_Now()-P->Tick0)/Seconds : ONE;
+}
+
+
+#if defined(PARMMAP_PROFILE)
+
+static const char*	MP_StageName[MP_NUMSTAGES] = { "gather","classify","convert","kernel","integrate","write" };
+static const char*	MP_CountName[MP_NUMCOUNTS] = { "voxels","rejected","skipped","bytes_in","bytes_out","sampled" };
+
+
+// s as a JSON string literal
+static void	MP_PutString(
+		const char*	s,
+		FILE*		f )
+{
+	fputc( '"',f );
+	for ( ; *s; s++ ) {
+		if		( *s=='"' || *s=='\\' )	fprintf( f,"\\%c",*s );
+		else if	( (unsigned char)*s<0x20 )	fprintf( f,"\\u%04x",(unsigned char)*s );
+		else						fputc( *s,f );
+	}
+	fputc( '"',f );
+}
+
+
+static void	MP_WriteRecord(
+		const MP_PROFILE*	P,
+		const MP_RECORD*	R,
+		FILE*			f )
+{
+// sampled voxels stand for all voxels of a model; driver records are timed in full
+const double	Scale = R->Count[MP_SAMPLED] ? (double)R->Count[MP_VOXELS]/R->Count[MP_SAMPLED] : ONE;
+
+	fprintf( f,"\"stages\": {" );
+	for ( int s=0, n=0; s<MP_NUMSTAGES; s++ ) {
+		if ( !R->Timed[s] ) continue;
+
+		fprintf( f,"%s\"%s\": { \"seconds\": %.6f, \"calls\": %.0f, \"timed\": %lld }",
+			n++ ? ", " : " ",MP_StageName[s],R->Ticks[s]/P->TicksPerSec*Scale,R->Timed[s]*Scale,(long long)R->Timed[s] );
+	}
+	fprintf( f," }" );
+
+	for ( int c=0; c<MP_NUMCOUNTS; c++ )
+		fprintf( f,", \"%s\": %lld",MP_CountName[c],(long long)R->Count[c] );
+}
+
+#endif
+
+
+/**
+* @brief Write the profile of a run as one JSON object.
+*
+* @code
+*   { "seconds": .., "threads": .., "compiled": true,
+*     "driver": { "stages": { "gather": { "seconds":.., "calls":.., "timed":.. }, .. }, "voxels": .., .. },
+*     "models": [ { "model": 0, "name": "..", "stages": { .. }, "voxels": .., "rejected": .., .. }, .. ] }
+* @endcode
+* Stage seconds are thread time summed over the workers; for the models they
+* and the calls are estimated from the sampled voxels. Without
+* @c PARMMAP_PROFILE the object has @c "compiled": false and no counts.
+*
+* @return bool @c false if the file could not be written.
+*/
+
+bool	MP_WriteJson(
+		const MP_PROFILE*	P,
+		FILE*			f )
+{
+const int	NumReq = (int)P->Model.size();
+
+#if defined(PARMMAP_PROFILE)
+	fprintf( f,"{ \"seconds\": %.6f, \"threads\": %d, \"compiled\": true,\n  \"driver\": { ",P->Seconds,P->Threads );
+	if ( (int)P->Rec.size()>NumReq ) MP_WriteRecord( P,&P->Rec[NumReq],f );
+	fprintf( f," },\n  \"models\": [" );
+	for ( int r=0; r<NumReq; r++ ) {
+		fprintf( f,"%s\n    { \"model\": %d, \"name\": ",r ? "," : "",P->Model[r] );
+		MP_PutString( P->Name[r].c_str(),f );
+		fprintf( f,", " );
+		MP_WriteRecord( P,&P->Rec[r],f );
+		fprintf( f," }" );
+	}
+	fprintf( f,"\n  ] }\n" );
+#else
+	fprintf( f,"{ \"seconds\": %.6f, \"compiled\": false, \"models\": %d }\n",P->Seconds,NumReq );
+#endif
+	return !ferror( f );
+}
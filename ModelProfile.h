@@ -0,0 +1,169 @@
+/**
+* @file ModelProfile.h
+* @brief Opt-in stage timers and counters of the map drivers and the models.
+*
+* @details
+* Built only with @c PARMMAP_PROFILE defined; otherwise every macro below
+* expands to an empty statement and the hot paths carry no trace of it.
+*
+* A map run with @c PM_OPTIONS::Profile set gives each worker thread one
+* @c MP_RECORD per map request plus one for the driver itself. While a
+* model's @c FuncBatch runs, the thread's current record (@c MP_Cur) is the
+* request's, so the hooks in the shared helpers (@c MB_ConcTac(),
+* @c MB_StoreVoxel()) and in the model kernels land in the right place
+* without any model knowing about the others. The records are summed when
+* the worker ends and exported with @c MP_WriteJson().
+*
+* Stages:
+*   - @c MP_GATHER    frame-major to voxel-major TAC transpose (driver, per tile).
+*   - @c MP_CLASSIFY  background pre-classification (driver, per tile).
+*   - @c MP_CONVERT   @c funcSigToConc() (driver per tile, or a model per TAC).
+*   - @c MP_KERNEL    the model's statistics / search kernel.
+*   - @c MP_INTEGRATE the model's integrals.
+*   - @c MP_WRITE     output slabs handed to the writer (out-of-core mode).
+*
+* Per-voxel stages cost two clock reads, which would be several percent of
+* the cheapest models, so they are timed on one voxel in @c MP_SAMPLE of
+* each thread only, and the time of the sampled voxels is scaled up to all
+* voxels of the request on export. The other voxels pay one thread-local
+* test per stage. Voxel and byte counts are added by the driver per span,
+* so the per-voxel path counts nothing but rejections and the sampling tick.
+* A kernel that handles a run of voxels at once (@c MP_SCOPE_BLOCK()) is
+* timed when the run holds a sampled voxel, and charged the share of the
+* sampled voxels, so it scales up the same way.
+* Driver stages are timed on every tile.
+*/
+
+#pragma once
+
+#include	<vector>
+#include	<string>
+#include	<mutex>
+#include	<stdio.h>
+
+
+enum MP_STAGE {
+	MP_GATHER	= 0,
+	MP_CLASSIFY,
+	MP_CONVERT,
+	MP_KERNEL,
+	MP_INTEGRATE,
+	MP_WRITE,
+	MP_NUMSTAGES
+};
+
+enum MP_COUNT {
+	MP_VOXELS	= 0,				// voxels evaluated by the model
+	MP_REJECTED,				// of which VOIDVOX (air, no bolus, no crossing, ...)
+	MP_SKIPPED,					// voxels set to VOIDVOX by the background pre-classifier
+	MP_BYTESIN,					// input sample bytes gathered
+	MP_BYTESOUT,				// output plane bytes stored or written
+	MP_SAMPLED,					// voxels whose stages were timed
+	MP_NUMCOUNTS
+};
+
+enum {
+	MP_SAMPLE	= 64				// per-voxel stages are timed on one voxel in MP_SAMPLE (power of 2)
+};
+
+
+// Timers and counters of one request (or of the driver) on one thread
+struct MP_RECORD {
+	INT64		Ticks[MP_NUMSTAGES];		// clock ticks of the timed calls
+	INT64		Timed[MP_NUMSTAGES];		// calls that were timed
+	INT64		Count[MP_NUMCOUNTS];
+};
+
+
+// Result of a profiled run, owned by the caller
+struct MP_PROFILE {
+	std::vector<MP_RECORD>	Rec;			// Rec[r] of request r, Rec[NumReq] of the driver
+	std::vector<int>		Model;		// model number of each request
+	std::vector<std::string>	Name;
+	int				Threads;		// most workers of a pass
+	double			Seconds;		// wall time of the run
+	double			TicksPerSec;	// clock calibration over the run
+	INT64				Tick0;
+	std::mutex			Lock;			// guards Rec while workers merge
+};
+
+typedef MP_PROFILE*	PMP_PROFILE;
+
+
+INT64	MP_Now();
+void	MP_Begin( PMP_PROFILE P,int NumReq );
+void	MP_Merge( PMP_PROFILE P,const MP_RECORD* Rec,int First,int NumRec );
+void	MP_End( PMP_PROFILE P,double Seconds );
+bool	MP_WriteJson( const MP_PROFILE* P,FILE* f );
+
+
+#if defined(PARMMAP_PROFILE)
+
+extern	thread_local MP_RECORD*	MP_Cur;			// record the hooks of this thread go to; NULL = off
+extern	thread_local unsigned	MP_Tick;			// voxel counter of the sampling
+
+// Times the enclosing scope as Stage of the current record: always, or on sampled voxels only
+struct MP_TIMER {
+	MP_RECORD*	R;
+	int		Stage;
+	INT64		t0;
+
+	MP_TIMER( int s,bool Always ) :
+		R( (Always || !(MP_Tick & (MP_SAMPLE-1))) ? MP_Cur : NULL ),Stage( s ),t0( R ? MP_Now() : 0 ) {}
+	~MP_TIMER()
+	{
+		if ( !R ) return;
+		R->Ticks[Stage] += MP_Now()-t0;
+		R->Timed[Stage]++;
+	}
+};
+
+// Times the enclosing scope as Stage of the N voxels about to be stored, charging the share of the
+// sampled ones among them (as if each had been timed on its own)
+struct MP_BLOCKTIMER {
+	MP_RECORD*	R;
+	int		Stage;
+	INT64		k,n;				// sampled voxels of the block, voxels of the block
+	INT64		t0;
+
+	MP_BLOCKTIMER( int s,int N ) :
+		Stage( s ),
+		k( ((INT64)MP_Tick+N+MP_SAMPLE-1)/MP_SAMPLE-((INT64)MP_Tick+MP_SAMPLE-1)/MP_SAMPLE ),n( N )
+	{
+		R	= k>0 ? MP_Cur : NULL;
+		t0	= R ? MP_Now() : 0;
+	}
+	~MP_BLOCKTIMER()
+	{
+		if ( !R ) return;
+		R->Ticks[Stage] += (MP_Now()-t0)*k/n;
+		R->Timed[Stage] += k;
+	}
+};
+
+// End of a voxel: count it as sampled if its stages were timed, and advance the tick
+inline void	MP_NextVoxel()
+{
+	if ( !(MP_Tick++ & (MP_SAMPLE-1)) && MP_Cur ) MP_Cur->Count[MP_SAMPLED]++;
+}
+
+#define	MP_CAT2(a,b)		a##b
+#define	MP_CAT(a,b)		MP_CAT2(a,b)
+#define	MP_SCOPE(Stage)		MP_TIMER MP_CAT(_mp_,__LINE__)( Stage,false )	// per-voxel stage (sampled)
+#define	MP_SCOPE_ALL(Stage)	MP_TIMER MP_CAT(_mp_,__LINE__)( Stage,true )	// per-tile stage (always timed)
+#define	MP_SCOPE_BLOCK(Stage,N)	MP_BLOCKTIMER MP_CAT(_mp_,__LINE__)( Stage,N )	// per-voxel stage of N voxels at once
+#define	MP_COUNT(c,n)		do { if ( MP_Cur ) MP_Cur->Count[c] += (n); } while(0)
+#define	MP_NEXTVOXEL()		MP_NextVoxel()
+#define	MP_BIND(R)			(MP_Cur = (R))
+
+#else
+
+// empty statements, so that "if ( x ) MP_COUNT(..);" keeps a body
+#define	MP_SCOPE(Stage)		do {} while(0)
+#define	MP_SCOPE_ALL(Stage)	do {} while(0)
+#define	MP_SCOPE_BLOCK(Stage,N)	do {} while(0)
+#define	MP_COUNT(c,n)		do {} while(0)
+#define	MP_NEXTVOXEL()		do {} while(0)
+#define	MP_BIND(R)			do {} while(0)
+
+#endif
@@ -0,0 +1,54 @@
+/**
+* @file ModelTable.cpp
+* @brief Table of the model entries exported by Model0.cpp ... Model6.cpp.
+*/
+
+#include	"stdafx.h"
+#include	"ModelTable.h"
+
+
+MODEL_ENTRY	M0_ModelEntry( void ),
+		M1_ModelEntry( void ),
+		M3_ModelEntry( void ),
+		M4_ModelEntry( void ),
+		M5_ModelEntry( void ),
+		M6_ModelEntry( void );
+
+
+// filled in before main(), each from its model file
+static MODEL_ENTRY	Entry[] = {	M0_ModelEntry(),M1_ModelEntry(),M3_ModelEntry(),
+					M4_ModelEntry(),M5_ModelEntry(),M6_ModelEntry() };
+
+PMODEL_ENTRY	ModelTable[] = { &Entry[0],&Entry[1],&Entry[2],&Entry[3],&Entry[4],&Entry[5] };
+
+const int	NumModelEntries = sizeof(ModelTable)/sizeof(ModelTable[0]);
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Find the entry of model "Number" (as in "0. Basic measurements"); NULL if absent.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+PMODEL_ENTRY	FindModelEntry( int Number )
+{
+	for ( int i=0; i<NumModelEntries; i++ )
+		if ( ModelTable[i]->Number==Number ) return ModelTable[i];
+
+	return NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Outputs (bit i: OP i) the model computes: those of ModelState from Init, or with NULL those of its
+// current free parameters
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+UINT32	ModelOutUsed(
+		PMODEL_ENTRY	Model,
+		PVOID			ModelState )
+{
+	if ( Model->OutUsed ) return Model->OutUsed( ModelState );
+
+	return Model->NumOutParms<32 ? BM(Model->NumOutParms)-1 : ~(UINT32)0;
+}
@@ -0,0 +1,130 @@
+/**
+* @file ModelTable.h
+* @brief Uniform descriptor of the M*_ models for map drivers.
+*
+* @details
+* Each ModelN.cpp exports an @c MN_ModelEntry() that bundles its
+* configuration arrays and entry points behind one signature, so a driver can
+* run any model without knowing which free parameters or input functions it
+* takes. It returns a zero-initialized entry with the members the model has
+* assigned by name, so a hook added here is @c NULL (0) for every model that
+* does not set it:
+*   - @c Init   — @c MN_ModelInit(), adapted to the (IFarr, NumIF) form.
+*   - @c Close  — @c MN_ModelClose().
+*   - @c Func   — @c MN_ModelFunc(), the per-voxel entry point of the
+*     framework: the outputs requested in @c ParmReq[] of one TAC, emitted
+*     through @c Write().
+*   - @c FuncBatch — @c MN_ModelFuncBatch() (see @c ModelBatch.h).
+*   - @c ScratchSize — @c MN_ModelScratch(): doubles of per-thread scratch
+*     arena the initialized model needs (see @c ScratchArena.h).
+*   - @c FuncBatchF — @c MN_ModelFuncBatchF(), the float32 compute kernel
+*     (reads @c MODEL_BATCH::SignalF); @c NULL if the model has none.
+*   - @c AirThresh — background threshold of the initialized model: a voxel
+*     whose raw TAC minimum is below it is not evaluated (@c IsAir_ByMin());
+*     @c NULL if the model does no background rejection.
+*   - @c FuncWindow — @c MN_ModelFuncWindow(): the outputs of the window of
+*     the initialized state from a prefix table (@c WindowTable.h) instead of
+*     the TACs; @c WindowParts are the table parts it reads and bit i of
+*     @c WindowOut is set if it answers OP[i]. @c NULL if the model has none.
+*   - @c FuncMoving — @c MN_ModelFuncMoving(): the @c WindowOut outputs of
+*     every window of L frames sliding over the TACs of a block, window w
+*     (frames w .. w+L-1, w <= NumTms-L) into the planes
+*     @c OutPlane[w*NumOutParms .. w*NumOutParms+NumOutParms-1];
+*     @c NULL if the model has none.
+*   - @c FoldConc — true if the initialized model evaluates raw TACs
+*     (@c MODEL_BATCH::IsConc false) that come with the linear form of their
+*     conversion (@c MODEL_BATCH::ConcOffset, @c ConcScale) at the cost of
+*     converted ones; when the conversion is linear
+*     (@c funcSigToConcLinear()) the driver then need not convert for it.
+*     @c NULL if the model never does.
+*   - @c SeriesName — a model that can evaluate a series of points of an
+*     output in the same pass (e.g. the Model 1 AUC up to several times)
+*     names that series; @c NULL if it cannot. Like @c FreeParm, the points
+*     are set before @c Init: @c *NumSeries times in @c SeriesTime, or
+*     @c MB_SERIESFRAMES for one point at every frame. The values of point k
+*     go to @c MODEL_BATCH::SeriesPlane[k].
+*   - @c FuncFrame — @c MN_ModelFuncFrame(): the outputs of the initialized
+*     state accumulated one frame at a time, for outputs that are sums over
+*     the frames (a weighted integral, moments, correlation sums). Called
+*     with t = 0 .. NumTms-1 in order, @c MODEL_BATCH::Signal holding frame t
+*     of the block (one sample per voxel), it folds the frame into the
+*     @c FrameAcc(ModelState) accumulators of each voxel at
+*     @c MODEL_BATCH::Acc (zero before frame 0); called with @c Signal
+*     @c NULL and t the number of frames folded so far, it stores the
+*     outputs of frames 0 .. t-1 from them (t = NumTms: the maps of the
+*     study). Bit i of @c FrameOut is set if it answers OP[i] with
+*     t = NumTms, bit i of @c LiveOut if it also does with t < NumTms (the
+*     provisional maps of an acquisition in progress); it returns @c false
+*     for the others. A model whose accumulators hold the samples themselves
+*     (Model 5) sets @c LiveOut only: a frame pass over a whole study would
+*     hold more than the study. @c NULL if the model has none.
+*   - @c OutUsed — the outputs (bit i: OP[i]) the model computes, when some
+*     depend on the free parameters (e.g. the states of Model 3): those of
+*     the initialized state passed, or with @c NULL those the current
+*     @c FreeParm would set up (before @c Init). The others are stored as
+*     @c VOIDVOX and a driver need not request them by default. @c NULL if
+*     the model computes all its outputs (see @c ModelOutUsed()).
+*
+* @c ModelTable[] lists all entries in model-number order.
+*/
+
+#pragma once
+
+#include	"ModelBatch.h"
+#include	"WindowTable.h"
+
+
+typedef bool	(*PMODELINIT)( PVOID* pModelState,PINPUTFUNC IFarr,int NumIF );
+typedef void	(*PMODELCLOSE)( PVOID ModelState );
+typedef bool	(*PMODELFUNC)( PVOID ModelState,PDOUBLE Signal,PIVAL OutParm );
+typedef double	(*PMODELAIR)( PVOID ModelState );
+typedef bool	(*PMODELFOLD)( PVOID ModelState );
+typedef bool	(*PMODELFUNCFRAME)( PVOID ModelState,int t,PMODEL_BATCH B );
+typedef UINT32	(*PMODELOUTUSED)( PVOID ModelState );
+
+
+enum {
+	MB_SERIESFRAMES	= -1			// *MODEL_ENTRY::NumSeries: a series point at every frame (NumTms)
+};
+
+
+struct MODEL_ENTRY {
+	int		Number;			// model number as in the UI ("0. ...", "1. ...")
+	PSTR		Name;				// M*_ModelName
+	int		NumFreeParms;		// M*_NumFreeParms
+	PDOUBLE	FreeParm;			// M*_FreeParm, read by Init
+	PSTR*		FPName;			// M*_FPName
+	int		NumOutParms;		// M*_NumOutParms
+	PSTR*		OPName;			// M*_OPName
+	int		NumIfuncs;			// M*_NumIfuncs
+	bool		RawSignal;			// TACs are passed unconverted (no funcSigToConc)
+	PMODELINIT	Init;
+	PMODELCLOSE	Close;
+	PMODELFUNC	Func;				// M*_ModelFunc: one voxel, outputs through Write()
+	PMODELFUNCBATCH	FuncBatch;
+	PMODELSCRATCH	ScratchSize;
+	PMODELFUNCBATCH	FuncBatchF;			// float32 compute mode; NULL = double only
+	PMODELAIR		AirThresh;			// background threshold; NULL = none
+	PMODELFUNCWINDOW	FuncWindow;			// window outputs from a WT_TABLE; NULL = none
+	unsigned		WindowParts;		// WT_* parts of the table FuncWindow reads
+	UINT32		WindowOut;			// bit i: OP i is answered by FuncWindow (and FuncMoving)
+	PMODELFUNCMOVING	FuncMoving;			// sliding-window outputs of a block; NULL = none
+	PMODELFOLD		FoldConc;			// raw TACs cost no conversion; NULL = never
+	PSTR			SeriesName;			// M*_SeriesName: output of a series of points; NULL = none
+	PDOUBLE		SeriesTime;			// M*_SeriesTime[DEF_MAXNUMTMS]: times of the points, read by Init
+	int*			NumSeries;			// M*_NumSeries: points set (0 = no series, or MB_SERIESFRAMES)
+	PMODELFUNCFRAME	FuncFrame;			// frame-streaming accumulation; NULL = none
+	PMODELSCRATCH	FrameAcc;			// accumulator doubles per voxel of FuncFrame
+	UINT32		FrameOut;			// bit i: OP i is answered by FuncFrame
+	UINT32		LiveOut;			// bit i: OP i is answered by FuncFrame from the first frames too
+	PMODELOUTUSED	OutUsed;			// bit i: OP i is computed with the free parameters; NULL = all
+};
+
+typedef MODEL_ENTRY*	PMODEL_ENTRY;
+
+
+extern	PMODEL_ENTRY	ModelTable[];
+extern	const int		NumModelEntries;
+
+PMODEL_ENTRY	FindModelEntry( int Number );
+UINT32		ModelOutUsed( PMODEL_ENTRY Model,PVOID ModelState = NULL );
@@ -0,0 +1,1738 @@
+/**
+* @file ParmMapDriver.cpp
+* @brief Multi-threaded parametric map driver with work stealing over voxel tiles.
+*
+* @details
+* See @c ParmMapDriver.h for the execution model. Tiles are numbered in
+* voxel order (slice by slice, rows within a slice); worker @c w initially
+* owns the contiguous run of tiles [w*T/W, (w+1)*T/W). The owner takes tiles
+* from the front of its run; a thief takes the back half of the largest run.
+* Runs are guarded by one mutex each — a tile costs far more than a lock.
+*
+* @c PM_CalcMapsSlabs() runs the same pass over successive slabs of whole
+* slices, reading the next slab on a helper thread while the current one is
+* evaluated.
+*
+* @c PM_CalcMapsFrames() reads frame t+1 on a helper thread while the
+* workers fold frame t into the accumulators, in runs of @c PM_FRAMEVOX
+* voxels taken from a shared counter.
+*
+* Tiles are gathered with the cache-blocked transpose of @c TacTranspose.h.
+* Each worker owns its TAC block, a concentration block when any model of
+* the pass takes concentration, and a scratch arena sized once from the
+* largest @c Model->ScratchSize() after init, so the voxel loop does no heap
+* traffic.
+*
+* @section ts Thread-safety
+* @c PM_CalcMap() / @c PM_CalcMaps() may be called concurrently for different maps; the model
+* must be reentrant (state passed through @c ModelState).
+*/
+
+#include	"stdafx.h"
+#include	"ParmMapDriver.h"
+
+#include	<algorithm>
+#include	<chrono>
+#include	<thread>
+#include	<mutex>
+#include	<atomic>
+#include	<vector>
+
+
+// Contiguous run of tiles owned by one worker
+struct PM_RUN {
+	std::mutex	Lock;
+	INT64		Lo,Hi;				// remaining tiles [Lo,Hi)
+};
+
+
+// Tiling of the volume into slices or bricks of whole rows
+struct PM_TILING {
+	int		Nx,Ny,Nz;
+	int		RowsPerTile;
+	int		TilesPerSlice;
+	INT64		NumTiles;
+	int		MaxTileVox;
+};
+
+
+enum {
+	PM_WINDOWVOX	= 4096,			// voxels per run of a window pass (PM_CalcMapsWindow)
+	PM_MOVINGVOX	= 1024,			// voxels per run of a sliding-window pass (PM_CalcMapsMoving)
+	PM_FRAMEVOX		= 4096			// voxels per run of a frame-streaming pass (PM_CalcMapsFrames)
+};
+
+
+// Run of consecutive voxels [V0, V0+N) of a tile, relative to the tile start
+struct PM_SPAN {
+	int		V0,N;
+};
+
+
+// Everything the workers share
+struct PM_JOB {
+	PPM_MAPREQ		Req;
+	PVOID*		ModelState;			// ModelState[i] of Req[i]
+	int			NumReq;
+	bool			AnyConc;			// some model takes concentration TACs
+	bool			AnyRaw;			// some model takes raw TACs
+	std::vector<char>	Raw;				// Raw[r]: request r gets the raw tile (RawSignal or FoldConc)
+	std::vector<char>	Desc;				// Desc[r]: request r gets the raw tile with its conversion descriptor (FoldConc)
+	bool			AnyDesc;			// some request gets the conversion descriptor
+	bool			NeedSig;			// the raw tile is gathered (not all from In->Conc)
+	bool			FillConc;			// the pass fills In->Conc and In->MinSig
+	bool			Stream;			// non-temporal stores in the TAC transpose
+	bool			Float32;			// float32 compute for models with FuncBatchF
+	bool			FloatSig,FloatConc;	// float copies of the raw / converted tile are needed
+	bool			DoubleConc;			// some model takes the converted tile in double
+	const unsigned char*	Mask;			// mask of the voxels of In; NULL = all
+	std::vector<double>	AirThresh;		// AirThresh[r]: background if the raw TAC minimum is below
+	double		ConcThresh;			// lowest AirThresh of the concentration models
+	bool			AnyAir;			// some request has a background threshold
+	std::vector<std::atomic<INT64> >	Skipped;	// Skipped[r]: background voxels of the pass
+	PMP_PROFILE		Profile;			// profile of the run; NULL = none
+	INT64			ScratchSize;		// largest per-thread arena of the models
+	PPM_INPUT		In;
+	PM_TILING		Tiling;
+	PM_RUN*		Runs;
+	int			NumRuns;
+	std::atomic<bool>	Failed;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Number of worker threads for the options (at least 1)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+int	PM_NumThreads( PPM_OPTIONS Opt )
+{
+int	N = (Opt && Opt->NumThreads>0) ? Opt->NumThreads : (int)std::thread::hardware_concurrency();
+
+	return max( N,1 );
+}
+
+
+static void	PM_SetupTiling(
+		PPM_INPUT	In,
+		PPM_OPTIONS	Opt,
+		PM_TILING*	T )
+{
+	T->Nx	= In->Nx;
+	T->Ny	= In->Ny;
+	T->Nz	= In->Nz;
+
+	T->RowsPerTile	= (Opt && Opt->TileVox>0) ? max( Opt->TileVox/In->Nx,1 ) : In->Ny;
+	T->RowsPerTile	= min( T->RowsPerTile,In->Ny );
+	T->TilesPerSlice	= (In->Ny+T->RowsPerTile-1)/T->RowsPerTile;
+	T->NumTiles		= (INT64)T->TilesPerSlice*In->Nz;
+	T->MaxTileVox	= T->RowsPerTile*In->Nx;
+}
+
+
+// Voxel range [*pV0, *pV0+*pN) of a tile
+static void	PM_TileRange(
+		const PM_TILING*	T,
+		INT64			Tile,
+		INT64*		pV0,
+		int*			pN )
+{
+INT64	z	= Tile/T->TilesPerSlice;
+int	y0	= (int)(Tile%T->TilesPerSlice)*T->RowsPerTile,
+	y1	= min( y0+T->RowsPerTile,T->Ny );
+
+	*pV0	= (z*T->Ny+y0)*T->Nx;
+	*pN	= (y1-y0)*T->Nx;
+}
+
+
+// Apply the input scaling to N samples of a gathered tile
+static void	PM_ScaleTile(
+		PDOUBLE	Sig,
+		INT64		N,
+		double	Slope,
+		double	Inter )
+{
+	for ( INT64 i=0; i<N; i++ ) Sig[i] = Sig[i]*Slope+Inter;
+}
+
+
+// Float copy of N samples of a tile
+static void	PM_NarrowTile(
+		const double*	Src,
+		INT64			N,
+		float*		Dst )
+{
+	for ( INT64 i=0; i<N; i++ ) Dst[i] = (float)Src[i];
+}
+
+
+// Convert N voxel-major TACs to concentration
+static void	PM_ConvertTile(
+		const double*	Sig,
+		int			N,
+		PDOUBLE		Conc )
+{
+	for ( int v=0; v<N; v++ )
+		funcSigToConc( (PDOUBLE)Sig+(INT64)v*NumTms,NumTms,Conc+(INT64)v*NumTms,1,NULL );
+}
+
+
+// Convert N voxel-major TACs to concentration straight into a float tile, through one TAC buffer
+static void	PM_ConvertTileF(
+		const double*	Sig,
+		int			N,
+		PDOUBLE		Buf,
+		float*		ConcF )
+{
+	for ( int v=0; v<N; v++ ) {
+		funcSigToConc( (PDOUBLE)Sig+(INT64)v*NumTms,NumTms,Buf,1,NULL );
+		PM_NarrowTile( Buf,NumTms,ConcF+(INT64)v*NumTms );
+	}
+}
+
+
+// Conversion descriptor of N voxel-major TACs for the FoldConc models: the linear form of
+// funcSigToConc() of each (funcSigToConcLinear() of its baseline)
+static void	PM_LinearTile(
+		const double*	Sig,
+		int			N,
+		PDOUBLE		Offset,
+		PDOUBLE		Scale )
+{
+int	B0,B1;
+
+	funcSigToConcBase( NumTms,&B0,&B1 );
+	for ( int v=0; v<N; v++ ) {
+		const double*	S  = Sig+(INT64)v*NumTms;
+		double		S0 = ZERO;
+
+		for ( int t=B0; t<=B1; t++ ) S0 += S[t];
+		funcSigToConcLinear( S0/(B1-B0+1),Offset+v,Scale+v );
+	}
+}
+
+
+// Spans of the N tile voxels set in Mask (the whole tile without a mask); returns their number
+static int	PM_MaskSpans(
+		const unsigned char*	Mask,
+		int				N,
+		PM_SPAN*			Sp )
+{
+int	n = 0;
+
+	if ( !Mask ) {
+		Sp[0].V0	= 0;
+		Sp[0].N	= N;
+		return N>0 ? 1 : 0;
+	}
+
+	for ( int v=0; v<N; ) {
+		while ( v<N && !Mask[v] ) v++;
+		int	v0 = v;
+		while ( v<N && Mask[v] ) v++;
+		if ( v>v0 ) { Sp[n].V0 = v0; Sp[n].N = v-v0; n++; }
+	}
+	return n;
+}
+
+
+// Minimum of every gathered TAC of the spans, as FindMinVal() finds it
+static void	PM_SpanMin(
+		const double*	Sig,
+		const PM_SPAN*	Sp,
+		int			NumSp,
+		PDOUBLE		Min )
+{
+	for ( int s=0; s<NumSp; s++ )
+		for ( int v=Sp[s].V0; v<Sp[s].V0+Sp[s].N; v++ ) {
+			const double*	Tac = Sig+(INT64)v*NumTms;
+			double		m   = Tac[0];
+
+			for ( int t=1; t<NumTms; t++ )
+				if ( Tac[t]<m ) m = Tac[t];
+			Min[v] = m;
+		}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Parts of the spans Sp whose voxels are not background for Thresh (TAC minimum not below it, as
+// IsAir_ByMin() decides); returns the number of spans written to Out
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int	PM_SelectSpans(
+		const PM_SPAN*	Sp,
+		int			NumSp,
+		const double*	Min,
+		double		Thresh,
+		PM_SPAN*		Out )
+{
+int	n = 0;
+
+	if ( Thresh==-HUGE_VAL ) {
+		std::copy( Sp,Sp+NumSp,Out );
+		return NumSp;
+	}
+
+	for ( int s=0; s<NumSp; s++ )
+		for ( int v=Sp[s].V0, e=Sp[s].V0+Sp[s].N; v<e; ) {
+			while ( v<e && Min[v]<Thresh ) v++;
+			int	v0 = v;
+			while ( v<e && !(Min[v]<Thresh) ) v++;
+			if ( v>v0 ) { Out[n].V0 = v0; Out[n].N = v-v0; n++; }
+		}
+	return n;
+}
+
+
+// Set the outputs of the N tile voxels [V0, V0+N) outside the spans to VOIDVOX; returns their number
+static int	PM_VoidGaps(
+		const MB_PLANE*	Plane,
+		int			NumOut,
+		INT64			V0,
+		int			N,
+		const PM_SPAN*	Sp,
+		int			NumSp )
+{
+int	Kept = 0;
+
+	for ( int s=0; s<NumSp; s++ ) Kept += Sp[s].N;
+	if ( Kept==N ) return 0;
+
+	for ( int i=0; i<NumOut; i++ ) {
+		if ( !Plane[i].Data ) continue;
+
+		int	v = 0;
+		for ( int s=0; s<NumSp; s++ ) {
+			MB_VoidRange( Plane+i,V0+v,Sp[s].V0-v );
+			v = Sp[s].V0+Sp[s].N;
+		}
+		MB_VoidRange( Plane+i,V0+v,N-v );
+	}
+	return N-Kept;
+}
+
+
+static bool	PM_TakeTile(
+		PM_RUN*	Run,
+		INT64*	pTile )
+{
+std::lock_guard<std::mutex>	Guard( Run->Lock );
+
+	if ( Run->Lo>=Run->Hi ) return false;
+
+	*pTile = Run->Lo++;
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Move the back half of the largest other run into run "Self"; false when no work is left
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	PM_StealRun(
+		PM_JOB*	Job,
+		int		Self )
+{
+	for (;;) {
+		int	Victim	= -1;
+		INT64	Most		= 0;
+
+		for ( int i=0; i<Job->NumRuns; i++ ) {
+			if ( i==Self ) continue;
+
+			std::lock_guard<std::mutex>	Guard( Job->Runs[i].Lock );
+			INT64	Rem = Job->Runs[i].Hi-Job->Runs[i].Lo;
+			if ( Rem>Most ) { Most = Rem; Victim = i; }
+		}
+		if ( Victim<0 ) return false;
+
+		INT64	Lo,Hi;
+		{
+		PM_RUN*	V = Job->Runs+Victim;
+		std::lock_guard<std::mutex>	Guard( V->Lock );
+
+		INT64	Rem = V->Hi-V->Lo;
+		if ( Rem<=0 ) continue;				// emptied meanwhile: look again
+
+		Hi		= V->Hi;
+		Lo		= Hi-(Rem+1)/2;
+		V->Hi	= Lo;
+		}
+
+		PM_RUN*	R = Job->Runs+Self;
+		std::lock_guard<std::mutex>	Guard( R->Lock );
+		R->Lo	= Lo;
+		R->Hi	= Hi;
+		return true;
+	}
+}
+
+
+static void	PM_Worker(
+		PM_JOB*	Job,
+		int		Self )
+{
+const PM_TILING*	T	= &Job->Tiling;
+const INT64		TileLen = (INT64)T->MaxTileVox*NumTms;
+PDOUBLE		Sig	= NULL,
+			Conc	= NULL,
+			MinTac= NULL,
+			Offset= NULL,			// conversion descriptor of the tile (Job->AnyDesc)
+			Scale	= NULL;
+float			*SigF	= NULL,
+			*ConcF	= NULL;
+PM_SPAN		*Live	= NULL,			// gathered voxels (in the mask)
+			*Sel	= NULL,			// voxels evaluated by one model
+			*Cnv	= NULL;			// voxels converted to concentration
+std::vector<INT64>	Skipped( Job->NumReq,0 );
+SCRATCH_ARENA	Scratch;
+#if defined(PARMMAP_PROFILE)
+std::vector<MP_RECORD>	Prof( Job->Profile ? Job->NumReq+1 : 0,MP_RECORD() );	// per request, then the driver
+MP_RECORD*		Pass = Job->Profile ? &Prof[Job->NumReq] : NULL;
+#endif
+
+	SA_Init( &Scratch );
+	if (	!AllocMem<double >(Sig,TileLen ) ||
+		!AllocMem<double >(MinTac,T->MaxTileVox ) ||
+		!AllocMem<PM_SPAN >(Live,T->MaxTileVox/2+1 ) ||
+		!AllocMem<PM_SPAN >(Sel,T->MaxTileVox/2+1 ) ||
+		!AllocMem<PM_SPAN >(Cnv,T->MaxTileVox/2+1 ) ||
+		(Job->AnyConc && !Job->In->Conc && !AllocMem<double >(Conc,Job->DoubleConc ? TileLen : NumTms )) ||
+		(Job->FloatSig && !AllocMem<float >(SigF,TileLen )) ||
+		(Job->FloatConc && !AllocMem<float >(ConcF,TileLen )) ||
+		(Job->AnyDesc && (!AllocMem<double >(Offset,T->MaxTileVox ) || !AllocMem<double >(Scale,T->MaxTileVox ))) ||
+		!SA_Create( &Scratch,Job->ScratchSize )) {
+		Job->Failed = true;
+		goto func_exit;
+	}
+
+	while ( !Job->Failed ) {
+		INT64	Tile;
+		if ( !PM_TakeTile( Job->Runs+Self,&Tile )) {
+			if ( !PM_StealRun( Job,Self )) break;
+			continue;
+		}
+
+		INT64	V0;
+		int	N;
+		PM_TileRange( T,Tile,&V0,&N );
+
+		MP_BIND( Pass );
+
+		const PPM_INPUT	In	= Job->In;
+		PDOUBLE		TileConc	= In->Conc ? In->Conc+V0*NumTms : Conc,	// concentration of the tile
+				TileMin	= In->Conc ? In->MinSig+V0 : MinTac;		// raw TAC minima of the tile
+
+		// voxels gathered: those in the mask, or all of them when filling the volume
+		const int	NumLive = PM_MaskSpans( Job->Mask ? Job->Mask+V0 : NULL,N,Live );
+		PM_SPAN	Whole	= { 0,N };
+		const PM_SPAN*	Gath	= Job->FillConc ? &Whole : Live;
+		const int	NumGath	= Job->FillConc ? 1 : NumLive;
+
+		if ( Job->NeedSig ) {
+		MP_SCOPE_ALL( MP_GATHER );
+		for ( int s=0; s<NumGath; s++ ) {
+			const INT64	o = (INT64)Gath[s].V0*NumTms,
+					n = (INT64)Gath[s].N*NumTms;
+
+			TT_FrameToVoxel( In->Frame,In->Type,V0+Gath[s].V0,Gath[s].N,NumTms,Sig+o,Job->Stream );
+			if ( In->Slope ) PM_ScaleTile( Sig+o,n,In->Slope,In->Inter );
+			if ( SigF ) PM_NarrowTile( Sig+o,n,SigF+o );
+			MP_COUNT( MP_BYTESIN,n*TT_SampleBytes( In->Type ));
+		}
+		}
+		if ( Job->FillConc || (Job->AnyAir && !In->ConcReady) ) {
+			MP_SCOPE_ALL( MP_CLASSIFY );
+			PM_SpanMin( Sig,Gath,NumGath,TileMin );
+		}
+
+		const int	NumCnv = Job->AnyConc ? PM_SelectSpans( Live,NumLive,TileMin,Job->ConcThresh,Cnv ) : 0;
+		if ( Job->AnyDesc ) {
+			MP_SCOPE_ALL( MP_CONVERT );
+			for ( int s=0; s<NumLive; s++ )
+				PM_LinearTile( Sig+(INT64)Live[s].V0*NumTms,Live[s].N,Offset+Live[s].V0,Scale+Live[s].V0 );
+		}
+		if ( NumCnv || Job->FillConc ) {
+		MP_SCOPE_ALL( MP_CONVERT );
+		if ( Job->FillConc ) PM_ConvertTile( Sig,N,TileConc );
+
+		for ( int s=0; s<NumCnv; s++ ) {
+			const INT64	o = (INT64)Cnv[s].V0*NumTms;
+
+			if ( In->Conc ) {
+				if ( ConcF ) PM_NarrowTile( TileConc+o,(INT64)Cnv[s].N*NumTms,ConcF+o );
+			}
+			else if ( Job->DoubleConc ) {
+				PM_ConvertTile( Sig+o,Cnv[s].N,Conc+o );
+				if ( ConcF ) PM_NarrowTile( Conc+o,(INT64)Cnv[s].N*NumTms,ConcF+o );
+			}
+			else if ( ConcF ) PM_ConvertTileF( Sig+o,Cnv[s].N,Conc,ConcF+o );
+		}
+		}
+
+		for ( int r=0; r<Job->NumReq && !Job->Failed; r++ ) {
+			PPM_MAPREQ	R = Job->Req+r;
+			bool		Raw = Job->Raw[r],
+					Flt = Job->Float32 && R->Model->FuncBatchF;
+
+			const int	NumSel = PM_SelectSpans( Live,NumLive,TileMin,Job->AirThresh[r],Sel );
+			Skipped[r] += PM_VoidGaps( R->OutPlane,R->Model->NumOutParms,V0,N,Sel,NumSel );
+			if ( R->SeriesPlane ) PM_VoidGaps( R->SeriesPlane,R->NumSeries,V0,N,Sel,NumSel );
+			MP_BIND( Pass ? &Prof[r] : NULL );
+#if defined(PARMMAP_PROFILE)
+			if ( Pass ) {
+				INT64	Kept = 0, Bytes = 0;
+				for ( int s=0; s<NumSel; s++ ) Kept += Sel[s].N;
+				for ( int i=0; i<R->Model->NumOutParms; i++ )
+					if ( R->OutPlane[i].Data ) Bytes += MB_PlaneBytes( R->OutPlane[i].Type );
+				for ( int i=0; R->SeriesPlane && i<R->NumSeries; i++ )
+					if ( R->SeriesPlane[i].Data ) Bytes += MB_PlaneBytes( R->SeriesPlane[i].Type );
+				Prof[r].Count[MP_VOXELS]	+= Kept;
+				Prof[r].Count[MP_BYTESOUT]	+= Bytes*N;	// skipped voxels are stored VOIDVOX
+			}
+#endif
+
+			for ( int s=0; s<NumSel && !Job->Failed; s++ ) {
+				const INT64	o = (INT64)Sel[s].V0*NumTms;
+
+				const bool	Desc = Job->Desc[r];
+				MODEL_BATCH	B = {};
+
+				B.Signal		= Raw ? Sig+o : ((Job->DoubleConc || In->Conc) ? TileConc+o : Conc);
+				B.NumVox		= Sel[s].N;
+				B.OutPlane		= R->OutPlane;
+				B.V0			= V0+Sel[s].V0;
+				B.Scratch		= &Scratch;
+				B.IsConc		= !Raw;
+				B.SignalF		= Flt ? (Raw ? SigF : ConcF)+o : NULL;
+				B.SeriesPlane	= R->SeriesPlane;
+				B.ConcOffset	= Desc ? Offset+Sel[s].V0 : NULL;
+				B.ConcScale		= Desc ? Scale+Sel[s].V0 : NULL;
+				if ( !(Flt ? R->Model->FuncBatchF : R->Model->FuncBatch)( Job->ModelState[r],&B )) Job->Failed = true;
+			}
+		}
+	}
+
+	for ( int r=0; r<Job->NumReq; r++ ) Job->Skipped[r] += Skipped[r];
+
+#if defined(PARMMAP_PROFILE)
+	MP_BIND( NULL );
+	if ( Job->Profile ) {
+		for ( int r=0; r<Job->NumReq; r++ ) Prof[r].Count[MP_SKIPPED] = Skipped[r];
+		MP_Merge( Job->Profile,Prof.data(),0,Job->NumReq+1 );
+	}
+#endif
+
+func_exit:
+	SA_Free( &Scratch );
+	pf_free(&Cnv);
+	pf_free(&Sel);
+	pf_free(&Live);
+	pf_free(&MinTac);
+	pf_free(&Scale);
+	pf_free(&Offset);
+	pf_free(&ConcF);
+	pf_free(&SigF);
+	pf_free(&Conc);
+	pf_free(&Sig);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Init every model of the pass once and size the per-worker buffers; false if one fails
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	PM_InitModels(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		PVOID*		ModelState,
+		PM_JOB*		Job )
+{
+	Job->Req		= Req;
+	Job->ModelState	= ModelState;
+	Job->NumReq		= NumReq;
+	Job->AnyConc	= false;
+	Job->AnyRaw		= false;
+	Job->ScratchSize	= 0;
+
+	for ( int r=0; r<NumReq; r++ ) {
+		PMODEL_ENTRY	Model = Req[r].Model;
+
+		if ( Model->NumOutParms>MB_MAXOUTPARMS ) return false;
+
+		// the requested outputs, as the framework sets them for the model being initialized
+		for ( int i=0; i<Model->NumOutParms; i++ ) ParmReq[i] = Req[r].OutPlane[i].Data!=NULL;
+		if ( !Model->Init( &ModelState[r],Req[r].IFarr,Req[r].NumIF )) return false;
+
+		Job->AnyConc	|= !Model->RawSignal;
+		Job->AnyRaw		|= Model->RawSignal;
+		Job->ScratchSize	= max( Job->ScratchSize,Model->ScratchSize( ModelState[r] ));
+		Req[r].NumSkipped	= 0;
+	}
+	return true;
+}
+
+
+// Start the profile of a run of the requests, if the options ask for one
+static void	PM_ProfileBegin(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		PPM_OPTIONS		Opt )
+{
+	if ( !Opt || !Opt->Profile ) return;
+
+	MP_Begin( Opt->Profile,NumReq );
+	for ( int r=0; r<NumReq; r++ ) {
+		Opt->Profile->Model[r]	= Req[r].Model->Number;
+		Opt->Profile->Name[r]	= Req[r].Model->Name;
+	}
+}
+
+
+static void	PM_ProfileEnd(
+		PPM_OPTIONS					Opt,
+		std::chrono::steady_clock::time_point	t0 )
+{
+	if ( !Opt || !Opt->Profile ) return;
+
+	MP_End( Opt->Profile,std::chrono::duration<double>( std::chrono::steady_clock::now()-t0 ).count() );
+}
+
+
+static void	PM_CloseModels(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		PVOID*		ModelState )
+{
+	for ( int r=0; r<NumReq; r++ )
+		if ( ModelState[r] ) Req[r].Model->Close( ModelState[r] );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Background threshold of every request of Job (model AirThresh, or Opt->AirFactor times the noise
+// level); clears the skipped-voxel counts
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void	PM_SetAirThresh(
+		PM_JOB*		Job,
+		PPM_OPTIONS		Opt )
+{
+const double	Noise = (Opt && Opt->AirFactor>0) ? Opt->AirFactor*demp_NoiseLevel : -HUGE_VAL;
+
+	Job->AirThresh.assign( Job->NumReq,-HUGE_VAL );
+	Job->ConcThresh	= HUGE_VAL;
+	Job->AnyAir		= false;
+	Job->Skipped	= std::vector<std::atomic<INT64> >( Job->NumReq );
+	for ( int r=0; r<Job->NumReq; r++ ) {
+		PMODEL_ENTRY	Model = Job->Req[r].Model;
+		double&		Th    = Job->AirThresh[r];
+
+		Th			= Model->AirThresh ? Model->AirThresh( Job->ModelState[r] ) : Noise;
+		Job->AnyAir		|= Th!=-HUGE_VAL;
+		Job->Skipped[r]	= 0;
+		if ( !Model->RawSignal ) Job->ConcThresh = min( Job->ConcThresh,Th );
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Run the initialized models of Job over the volume In, writing to the planes of Job->Req; In starts
+// at voxel VoxOffs of the study (offset into Opt->Mask)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	PM_RunPass(
+		PM_JOB*		Job,
+		PPM_INPUT		In,
+		INT64			VoxOffs,
+		PPM_OPTIONS		Opt )
+{
+	Job->In		= In;
+	Job->Mask		= (Opt && Opt->Mask) ? Opt->Mask+VoxOffs : NULL;
+	PM_SetAirThresh( Job,Opt );
+
+	Job->Stream		= Opt && Opt->StreamStores;
+	Job->Float32	= Opt && Opt->Float32;
+
+	// models that fold a linear conversion into their kernel take the raw tile and its conversion
+	// descriptor if no other one needs it converted
+double	o,s;
+	bool	Fold = !In->Conc && funcSigToConcLinear( ONE,&o,&s );
+	for ( int r=0; r<Job->NumReq; r++ ) {
+		PMODEL_ENTRY	Model = Job->Req[r].Model;
+		bool			Flt   = Job->Float32 && Model->FuncBatchF;
+
+		if ( !Model->RawSignal && (Flt || !Model->FoldConc || !Model->FoldConc( Job->ModelState[r] ))) Fold = false;
+	}
+
+	Job->FloatSig	= Job->FloatConc = Job->DoubleConc = false;
+	Job->AnyConc	= Job->AnyRaw = Job->AnyDesc = false;
+	Job->Raw.assign( Job->NumReq,false );
+	Job->Desc.assign( Job->NumReq,false );
+	for ( int r=0; r<Job->NumReq; r++ ) {
+		PMODEL_ENTRY	Model = Job->Req[r].Model;
+		bool			Flt   = Job->Float32 && Model->FuncBatchF;
+
+		Job->Raw[r]		= Model->RawSignal || Fold;
+		Job->Desc[r]	= !Model->RawSignal && Fold;
+		Job->AnyDesc	|= Job->Desc[r];
+		Job->AnyConc	|= !Job->Raw[r];
+		Job->AnyRaw		|= Job->Raw[r];
+		if		( Flt && Job->Raw[r] )	Job->FloatSig = true;
+		else if	( Flt )			Job->FloatConc = true;
+		else if	( !Job->Raw[r] )		Job->DoubleConc = true;
+	}
+	Job->FillConc	= In->Conc && !In->ConcReady;
+	Job->NeedSig	= !In->Conc || Job->FillConc || Job->AnyRaw;
+	Job->Failed		= false;
+	Job->Profile	= Opt ? Opt->Profile : NULL;
+	PM_SetupTiling( In,Opt,&Job->Tiling );
+
+const int	NumThreads = (int)min( (INT64)PM_NumThreads( Opt ),max( Job->Tiling.NumTiles,(INT64)1 ));
+
+	if ( Job->Profile ) Job->Profile->Threads = max( Job->Profile->Threads,NumThreads );
+std::vector<PM_RUN>	Runs( NumThreads );
+
+	for ( int w=0; w<NumThreads; w++ ) {
+		Runs[w].Lo	= Job->Tiling.NumTiles*w/NumThreads;
+		Runs[w].Hi	= Job->Tiling.NumTiles*(w+1)/NumThreads;
+	}
+	Job->Runs		= Runs.data();
+	Job->NumRuns	= NumThreads;
+
+std::vector<std::thread>	Workers;
+	for ( int w=1; w<NumThreads; w++ )
+		Workers.emplace_back( PM_Worker,Job,w );
+
+	PM_Worker( Job,0 );
+
+	for ( auto& W : Workers ) W.join();
+
+	for ( int r=0; r<Job->NumReq; r++ ) Job->Req[r].NumSkipped += Job->Skipped[r];
+	return !Job->Failed;
+}
+
+
+/**
+* @brief Calculate the parametric maps of several models in one fused pass.
+*
+* @param[in]  Req       @c NumReq map requests (model, input functions,
+*                       output planes of Nx*Ny*Nz voxels).
+* @param[in]  NumReq    Number of requests.
+* @param[in]  In        Frame-major 4D input with @c NumTms frames of @c In->Type samples.
+* @param[in]  Opt       Threading/tiling options (may be @c NULL).
+*
+* @return bool
+*   @c true on success; @c false if any model init, an allocation or a block
+*   evaluation fails.
+*
+* @pre  Framework globals (@c NumTms, @c AbsTarr, free parameters) are set.
+*
+* @note The concentration block is converted with the global conversion
+*       base, exactly as each model's own @c funcSigToConc() call would, so
+*       every map equals the one of a separate @c PM_CalcMap() run.
+*/
+
+bool	PM_CalcMaps(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		PPM_INPUT		In,
+		PPM_OPTIONS		Opt )
+{
+std::vector<PVOID>	ModelState( NumReq,(PVOID)NULL );
+PM_JOB	Job;
+bool		res		= false;
+const auto	t0		= std::chrono::steady_clock::now();
+
+	PM_ProfileBegin( Req,NumReq,Opt );
+	xz( PM_InitModels( Req,NumReq,ModelState.data(),&Job ));
+	xz( PM_RunPass( &Job,In,0,Opt ));
+
+	res	= true;
+func_exit:
+	PM_CloseModels( Req,NumReq,ModelState.data() );
+	PM_ProfileEnd( Opt,t0 );
+	return res;
+}
+
+
+// Frames of one slab buffer: NumTms pointers into one block of NumTms*SlabVox samples
+struct PM_SLAB {
+	char*			Mem;
+	std::vector<PVOID>	Frame;
+	int			z0,Nz;
+	bool			Ok;
+};
+
+
+static bool	PM_AllocSlab(
+		PM_SLAB*	S,
+		INT64		SlabVox,
+		int		Type )
+{
+const INT64	Bytes = SlabVox*TT_SampleBytes( Type );
+
+	S->Frame.assign( NumTms,(PVOID)NULL );
+	if ( !AllocMem<char >(S->Mem,Bytes*NumTms )) return false;
+
+	for ( int t=0; t<NumTms; t++ ) S->Frame[t] = S->Mem+t*Bytes;
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Slices per slab so that two input slabs, the output slabs (OutBytes per voxel) and the worker
+// buffers fit in Budget
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int	PM_SlabDepth(
+		PM_JOB*		Job,
+		int			Nx,
+		int			Ny,
+		int			Nz,
+		INT64			OutBytes,
+		int			Type,
+		INT64			Budget,
+		PPM_OPTIONS		Opt )
+{
+const INT64	SliceVox	= (INT64)Nx*Ny,
+		TileVox	= (Opt && Opt->TileVox>0) ? min( (INT64)max( Opt->TileVox/Nx,1 )*Nx,SliceVox ) : SliceVox,
+		Worker	= TileVox*NumTms*(Job->AnyConc ? 2 : 1)+Job->ScratchSize+
+			  ((Opt && Opt->Float32) ? TileVox*NumTms : 0),		// two float tiles at most
+		Fixed		= Worker*PM_NumThreads( Opt )*(INT64)sizeof(double),
+		PerSlice	= SliceVox*(2*NumTms*(INT64)TT_SampleBytes( Type )+OutBytes);
+
+	return (int)min( max( (Budget-Fixed)/PerSlice,(INT64)1 ),(INT64)Nz );
+}
+
+
+/**
+* @brief Calculate several maps of a study too large for memory, slab by slab.
+*
+* The volume is processed in slabs of whole slices with all frames: while
+* the models run on one slab (@c PM_CalcMaps() execution model, models
+* initialized once for the whole study), the next slab is read by
+* @c Io->Read on a helper thread; the output planes of a finished slab are
+* handed to @c Io->Write in slab order and the slab is reused. Peak memory is
+* two input slabs, one output slab per requested map and the per-worker
+* buffers, sized to stay within @p Budget bytes (at least one slice per slab).
+*
+* @param[in]     Req     @c NumReq map requests. In this mode a non-@c NULL
+*                        @c OutPlane[i].Data only marks output i as requested;
+*                        the driver keeps its own slab planes of the type and
+*                        scale given there.
+* @param[in]     NumReq  Number of requests.
+* @param[in]     Nx,Ny,Nz Spatial dimensions of the study.
+* @param[in,out] Io      Slab reader/writer and the sample type of the slabs;
+*                        @c Io->SlabZ receives the slab depth.
+* @param[in]     Budget  Memory budget in bytes for data and work buffers.
+* @param[in]     Opt     Threading/tiling options (may be @c NULL).
+*
+* @return bool
+*   @c true on success; @c false if a request has series planes, or a model
+*   init, an allocation, a slab read/write or a block evaluation fails.
+*
+* @pre  Framework globals (@c NumTms, @c AbsTarr, @c GlobalTac, noise,
+*       free parameters) describe the whole study.
+*/
+
+bool	PM_CalcMapsSlabs(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		int			Nx,
+		int			Ny,
+		int			Nz,
+		PPM_SLABIO		Io,
+		INT64			Budget,
+		PPM_OPTIONS		Opt )
+{
+std::vector<PVOID>		ModelState( NumReq,(PVOID)NULL );
+std::vector<PM_MAPREQ>		SlabReq( Req,Req+NumReq );
+std::vector<MB_PLANE>		SlabPlane;
+PM_SLAB			Slab[2];
+std::thread			Reader;
+PM_JOB			Job;
+int				NumOut	= 0,
+				SlabZ;
+INT64				SlabVox,
+				OutBytes	= 0;
+bool				res		= false;
+const auto			t0		= std::chrono::steady_clock::now();
+#if defined(PARMMAP_PROFILE)
+MP_RECORD			WriteProf	= MP_RECORD();		// slab writes, merged into the driver record
+#endif
+
+	// series planes cover the whole study, which is never in memory here
+	for ( int r=0; r<NumReq; r++ )
+		if ( Req[r].SeriesPlane ) return false;
+
+	Slab[0].Mem = Slab[1].Mem = NULL;
+
+	PM_ProfileBegin( Req,NumReq,Opt );
+	xz( PM_InitModels( Req,NumReq,ModelState.data(),&Job ));
+
+	for ( int r=0; r<NumReq; r++ ) {
+		NumOut += Req[r].Model->NumOutParms;
+		for ( int i=0; i<Req[r].Model->NumOutParms; i++ )
+			if ( Req[r].OutPlane[i].Data ) OutBytes += MB_PlaneBytes( Req[r].OutPlane[i].Type );
+	}
+	SlabPlane.assign( NumOut,MB_PLANE() );
+
+	SlabZ	= PM_SlabDepth( &Job,Nx,Ny,Nz,OutBytes,Io->Type,Budget,Opt );
+	SlabVox	= (INT64)Nx*Ny*SlabZ;
+	Io->SlabZ	= SlabZ;
+
+	xz( PM_AllocSlab( Slab+0,SlabVox,Io->Type ));
+	xz( PM_AllocSlab( Slab+1,SlabVox,Io->Type ));
+
+	// Slab planes of the requested outputs, addressed through a copy of the requests
+	{
+	PMB_PLANE	Plane = SlabPlane.data();
+	for ( int r=0; r<NumReq; r++ ) {
+		for ( int i=0; i<Req[r].Model->NumOutParms; i++ ) {
+			if ( !Req[r].OutPlane[i].Data ) continue;
+
+			char*	p = NULL;
+			Plane[i]	= Req[r].OutPlane[i];
+			xz( AllocMem<char >(p,SlabVox*MB_PlaneBytes( Plane[i].Type )));
+			Plane[i].Data = p;
+		}
+
+		SlabReq[r].OutPlane	= Plane;
+		SlabReq[r].NumSkipped	= 0;
+		Plane			+= Req[r].Model->NumOutParms;
+	}
+	}
+	Job.Req = SlabReq.data();
+
+	{
+	// with the study converted already, only models on raw signal need the frames
+	const bool	NoRead = Io->Conc && Io->ConcReady && !Job.AnyRaw;
+
+	auto	Read = [Io,NoRead]( PM_SLAB* S,int z0,int n ) {
+		S->z0	= z0;
+		S->Nz	= n;
+		S->Ok	= NoRead || Io->Read( Io->Ctx,z0,n,S->Frame.data() );
+	};
+
+	Reader = std::thread( Read,Slab+0,0,min( SlabZ,Nz ));
+
+	for ( int k=0, z0=0; z0<Nz; k^=1, z0+=SlabZ ) {
+		Reader.join();
+		PM_SLAB*	S = Slab+k;
+		xz( S->Ok );
+
+		if ( z0+SlabZ<Nz )
+			Reader = std::thread( Read,Slab+(k^1),z0+SlabZ,min( SlabZ,Nz-z0-SlabZ ));
+
+		const INT64	Offs = (INT64)Nx*Ny*z0;
+		PM_INPUT	In = {};
+
+		In.Frame	= S->Frame.data();
+		In.Nx		= Nx;
+		In.Ny		= Ny;
+		In.Nz		= S->Nz;
+		In.Type	= Io->Type;
+		In.Slope	= Io->Slope;
+		In.Inter	= Io->Inter;
+		In.Conc	= Io->Conc ? Io->Conc+Offs*NumTms : NULL;
+		In.MinSig	= Io->Conc ? Io->MinSig+Offs : NULL;
+		In.ConcReady= Io->ConcReady;
+		xz( PM_RunPass( &Job,&In,Offs,Opt ));
+
+		MP_BIND( Job.Profile ? &WriteProf : NULL );
+		for ( int r=0; r<NumReq; r++ )
+			for ( int i=0; i<Req[r].Model->NumOutParms; i++ )
+				if ( SlabReq[r].OutPlane[i].Data ) {
+					MP_SCOPE_ALL( MP_WRITE );
+					MP_COUNT( MP_BYTESOUT,(INT64)Nx*Ny*S->Nz*MB_PlaneBytes( SlabReq[r].OutPlane[i].Type ));
+					xz( Io->Write( Io->Ctx,z0,S->Nz,r,i,SlabReq[r].OutPlane+i ));
+				}
+		MP_BIND( NULL );
+	}
+	}
+
+	for ( int r=0; r<NumReq; r++ ) Req[r].NumSkipped = SlabReq[r].NumSkipped;
+
+	res	= true;
+func_exit:
+	if ( Reader.joinable() ) Reader.join();
+	PM_CloseModels( Req,NumReq,ModelState.data() );
+#if defined(PARMMAP_PROFILE)
+	MP_BIND( NULL );
+	if ( Opt && Opt->Profile ) MP_Merge( Opt->Profile,&WriteProf,NumReq,1 );
+#endif
+	PM_ProfileEnd( Opt,t0 );
+	for ( MB_PLANE& P : SlabPlane ) pf_free(&P.Data);
+	pf_free(&Slab[0].Mem);
+	pf_free(&Slab[1].Mem);
+	return res;
+}
+
+
+// Worker of PM_CalcMapsWindow(): runs of PM_WINDOWVOX voxels taken from Next until the table is done
+static void	PM_WindowWorker(
+		PM_JOB*		Job,
+		const WT_TABLE*	T,
+		std::atomic<INT64>*	Next )
+{
+std::vector<PM_SPAN>	Live( PM_WINDOWVOX/2+1 ),
+			Sel( PM_WINDOWVOX/2+1 );
+std::vector<INT64>	Skipped( Job->NumReq,0 );
+#if defined(PARMMAP_PROFILE)
+std::vector<MP_RECORD>	Prof( Job->Profile ? Job->NumReq : 0,MP_RECORD() );
+#endif
+
+	for ( INT64 V0; !Job->Failed && (V0 = Next->fetch_add( PM_WINDOWVOX ))<T->NumVox; ) {
+		const int	N	= (int)min( (INT64)PM_WINDOWVOX,T->NumVox-V0 ),
+				NumLive	= PM_MaskSpans( Job->Mask ? Job->Mask+V0 : NULL,N,Live.data() );
+
+		for ( int r=0; r<Job->NumReq && !Job->Failed; r++ ) {
+			PPM_MAPREQ	R = Job->Req+r;
+
+			const int	NumSel = PM_SelectSpans( Live.data(),NumLive,T->MinSig+V0,Job->AirThresh[r],Sel.data() );
+			Skipped[r] += PM_VoidGaps( R->OutPlane,R->Model->NumOutParms,V0,N,Sel.data(),NumSel );
+			MP_BIND( Job->Profile ? &Prof[r] : NULL );
+
+			for ( int s=0; s<NumSel && !Job->Failed; s++ ) {
+				MODEL_BATCH	B = {};
+
+				B.NumVox	= Sel[s].N;
+				B.OutPlane	= R->OutPlane;
+				B.V0		= V0+Sel[s].V0;
+				B.IsConc	= true;
+				MP_COUNT( MP_VOXELS,Sel[s].N );
+				if ( !R->Model->FuncWindow( Job->ModelState[r],T,&B )) Job->Failed = true;
+			}
+		}
+	}
+
+	for ( int r=0; r<Job->NumReq; r++ ) Job->Skipped[r] += Skipped[r];
+
+#if defined(PARMMAP_PROFILE)
+	MP_BIND( NULL );
+	if ( Job->Profile ) {
+		for ( int r=0; r<Job->NumReq; r++ ) Prof[r].Count[MP_SKIPPED] = Skipped[r];
+		MP_Merge( Job->Profile,Prof.data(),0,Job->NumReq );
+	}
+#endif
+}
+
+
+/**
+* @brief Calculate the maps of several models for their current window from a window table.
+*
+* Counterpart of @c PM_CalcMaps() for an interactive window change: the
+* models are initialized with their current free parameters (the window),
+* and every run of voxels is answered by @c MODEL_ENTRY::FuncWindow from the
+* prefix table @p T in O(1) per voxel (see @c WindowTable.h); no TAC is
+* gathered or converted. Voxels are classified as in a full pass, from
+* @c PM_OPTIONS::Mask and the background threshold of each request against
+* @c T->MinSig, so the maps equal those of @c PM_CalcMaps() on the study the
+* table was built from, to rounding of the prefix differences.
+*
+* @param[in]  Req     @c NumReq map requests; every model must have a
+*                     @c FuncWindow and request only outputs of its
+*                     @c WindowOut.
+* @param[in]  NumReq  Number of requests.
+* @param[in]  T       Table of the study, with the @c WindowParts of every model.
+* @param[in]  Opt     Threading, mask and background options (may be @c NULL).
+*
+* @return bool
+*   @c false if a model cannot answer its request from @p T, or a model init
+*   or a block fails.
+*
+* @pre  Framework globals (@c NumTms, @c AbsTarr, free parameters) are those
+*       the table was built with, except the window free parameters.
+*/
+
+bool	PM_CalcMapsWindow(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		const WT_TABLE*	T,
+		PPM_OPTIONS		Opt )
+{
+std::vector<PVOID>		ModelState( NumReq,(PVOID)NULL );
+std::vector<std::thread>	Workers;
+std::atomic<INT64>		Next( 0 );
+PM_JOB			Job;
+bool				res	= false;
+const auto			t0	= std::chrono::steady_clock::now();
+
+	PM_ProfileBegin( Req,NumReq,Opt );
+
+	for ( int r=0; r<NumReq; r++ ) {
+		PMODEL_ENTRY	Model = Req[r].Model;
+
+		xz( Model->FuncWindow && !(Model->WindowParts & ~T->Parts) && T->NumT==NumTms );
+		for ( int i=0; i<Model->NumOutParms; i++ )
+			if ( Req[r].OutPlane[i].Data ) xz( Model->WindowOut & BM(i) );
+	}
+	xz( PM_InitModels( Req,NumReq,ModelState.data(),&Job ));
+
+	Job.Mask	= (Opt && Opt->Mask) ? Opt->Mask : NULL;
+	Job.Profile	= Opt ? Opt->Profile : NULL;
+	Job.Failed	= false;
+	PM_SetAirThresh( &Job,Opt );
+
+	{
+	const int	NumThreads = (int)min( (INT64)PM_NumThreads( Opt ),max( T->NumVox/PM_WINDOWVOX,(INT64)1 ));
+
+	if ( Job.Profile ) Job.Profile->Threads = max( Job.Profile->Threads,NumThreads );
+	for ( int w=1; w<NumThreads; w++ )
+		Workers.emplace_back( PM_WindowWorker,&Job,T,&Next );
+	PM_WindowWorker( &Job,T,&Next );
+	for ( auto& W : Workers ) W.join();
+	}
+
+	for ( int r=0; r<NumReq; r++ ) Req[r].NumSkipped = Job.Skipped[r];
+	xz( !Job.Failed );
+
+	res	= true;
+func_exit:
+	PM_CloseModels( Req,NumReq,ModelState.data() );
+	PM_ProfileEnd( Opt,t0 );
+	return res;
+}
+
+
+// Worker of PM_CalcMapsMoving(): runs of PM_MOVINGVOX voxels taken from Next until the study is done
+static void	PM_MovingWorker(
+		PM_JOB*		Job,
+		const double*	Conc,
+		const double*	MinSig,
+		INT64			NumVox,
+		int			L,
+		PPM_MOVINGIO	Io,
+		std::mutex*		IoLock,
+		std::atomic<INT64>*	Next )
+{
+const int			K = NumTms-L+1;
+std::vector<std::vector<MB_PLANE> >	Plane( Job->NumReq );
+std::vector<PM_SPAN>	Live( PM_MOVINGVOX/2+1 ),
+			Sel( PM_MOVINGVOX/2+1 );
+std::vector<INT64>	Skipped( Job->NumReq,0 );
+SCRATCH_ARENA	Scratch;
+#if defined(PARMMAP_PROFILE)
+std::vector<MP_RECORD>	Prof( Job->Profile ? Job->NumReq : 0,MP_RECORD() );
+#endif
+
+	SA_Init( &Scratch );
+	if ( !SA_Create( &Scratch,Job->ScratchSize )) Job->Failed = true;
+
+	// run planes of every window of the requested outputs, reused for every run
+	for ( int r=0; r<Job->NumReq && !Job->Failed; r++ ) {
+		const int	NumOut = Job->Req[r].Model->NumOutParms;
+
+		Plane[r].assign( (size_t)NumOut*K,MB_PLANE() );
+		for ( int w=0; w<K && !Job->Failed; w++ )
+			for ( int i=0; i<NumOut; i++ ) {
+				const MB_PLANE&	P = Job->Req[r].OutPlane[i];
+				MB_PLANE&		Q = Plane[r][(size_t)w*NumOut+i];
+				char*			p = NULL;
+
+				if ( !P.Data ) continue;
+				Q = P;
+				Q.Data = AllocMem<char >(p,(INT64)PM_MOVINGVOX*MB_PlaneBytes( P.Type )) ? p : NULL;
+				if ( !Q.Data ) { Job->Failed = true; break; }
+			}
+	}
+
+	for ( INT64 V0; !Job->Failed && (V0 = Next->fetch_add( PM_MOVINGVOX ))<NumVox; ) {
+		const int	N	= (int)min( (INT64)PM_MOVINGVOX,NumVox-V0 ),
+				NumLive	= PM_MaskSpans( Job->Mask ? Job->Mask+V0 : NULL,N,Live.data() );
+
+		for ( int r=0; r<Job->NumReq && !Job->Failed; r++ ) {
+			PPM_MAPREQ	R = Job->Req+r;
+			PMB_PLANE	P = Plane[r].data();
+
+			const int	NumSel = PM_SelectSpans( Live.data(),NumLive,MinSig ? MinSig+V0 : NULL,Job->AirThresh[r],Sel.data() );
+			Skipped[r] += PM_VoidGaps( P,R->Model->NumOutParms*K,0,N,Sel.data(),NumSel );
+			MP_BIND( Job->Profile ? &Prof[r] : NULL );
+
+			for ( int s=0; s<NumSel && !Job->Failed; s++ ) {
+				MODEL_BATCH	B = {};
+
+				B.Signal	= (PDOUBLE)Conc+(V0+Sel[s].V0)*NumTms;
+				B.NumVox	= Sel[s].N;
+				B.OutPlane	= P;
+				B.V0		= Sel[s].V0;
+				B.Scratch	= &Scratch;
+				B.IsConc	= true;
+				MP_COUNT( MP_VOXELS,Sel[s].N );
+				if ( !R->Model->FuncMoving( Job->ModelState[r],L,&B )) Job->Failed = true;
+			}
+		}
+		if ( Job->Failed ) break;
+
+		std::lock_guard<std::mutex>	Hold( *IoLock );
+		for ( int r=0; r<Job->NumReq && !Job->Failed; r++ )
+			for ( size_t j=0; j<Plane[r].size(); j++ )
+				if ( Plane[r][j].Data && !Io->Write( Io->Ctx,r,(int)(j%Job->Req[r].Model->NumOutParms),
+								(int)(j/Job->Req[r].Model->NumOutParms),V0,N,&Plane[r][j] )) {
+					Job->Failed = true;
+					break;
+				}
+	}
+
+	for ( int r=0; r<Job->NumReq; r++ ) {
+		Job->Skipped[r] += Skipped[r];
+		for ( MB_PLANE& P : Plane[r] ) pf_free(&P.Data);
+	}
+	SA_Free( &Scratch );
+
+#if defined(PARMMAP_PROFILE)
+	MP_BIND( NULL );
+	if ( Job->Profile ) {
+		for ( int r=0; r<Job->NumReq; r++ ) Prof[r].Count[MP_SKIPPED] = Skipped[r];
+		MP_Merge( Job->Profile,Prof.data(),0,Job->NumReq );
+	}
+#endif
+}
+
+
+/**
+* @brief Calculate sliding-window maps of several models from the converted study.
+*
+* For every window of @p L frames sliding over the TACs (window w covers
+* frames w .. w+L-1, w = 0 .. NumTms-L) the models store their outputs
+* through @c MODEL_ENTRY::FuncMoving, which moves each window to the next
+* in O(1) per voxel. The study is taken in runs of voxels; the planes of
+* a run (one per window and requested output) are handed to @p Io->Write
+* and reused, so memory holds the runs of the workers and never the 4D
+* result. Voxels are classified as in a full pass, from
+* @c PM_OPTIONS::Mask and the background threshold of each request against
+* @p MinSig; background voxels are @c VOIDVOX in every window.
+*
+* @param[in]  Req     @c NumReq map requests; every model must have a
+*                     @c FuncMoving and request only outputs of its
+*                     @c WindowOut. A non-@c NULL @c OutPlane[i].Data only
+*                     marks output i as requested (type and scale as
+*                     given there).
+* @param[in]  NumReq  Number of requests.
+* @param[in]  Conc    Voxel-major concentration TACs of the study,
+*                     @c Conc[v*NumTms+t] (e.g. @c PM_INPUT::Conc after a
+*                     pass that filled it).
+* @param[in]  MinSig  Minimum of the raw TAC of every voxel; may be @c NULL
+*                     when no request has a background threshold.
+* @param[in]  NumVox  Voxels of the study.
+* @param[in]  L       Frames per window, 1 .. NumTms.
+* @param[in]  Io      Writer of the window planes of each run.
+* @param[in]  Opt     Threading, mask and background options (may be @c NULL).
+*
+* @return bool
+*   @c false if a model cannot answer its request, L is out of range, or a
+*   model init, an allocation, a block or a write fails.
+*
+* @pre  Framework globals (@c NumTms, @c AbsTarr, free parameters) are those
+*       of the pass that converted the study.
+*/
+
+bool	PM_CalcMapsMoving(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		const double*	Conc,
+		const double*	MinSig,
+		INT64			NumVox,
+		int			L,
+		PPM_MOVINGIO	Io,
+		PPM_OPTIONS		Opt )
+{
+std::vector<PVOID>		ModelState( NumReq,(PVOID)NULL );
+std::vector<std::thread>	Workers;
+std::atomic<INT64>		Next( 0 );
+std::mutex			IoLock;
+PM_JOB			Job;
+bool				res	= false;
+const auto			t0	= std::chrono::steady_clock::now();
+
+	PM_ProfileBegin( Req,NumReq,Opt );
+
+	xz( L>=1 && L<=NumTms );
+	for ( int r=0; r<NumReq; r++ ) {
+		PMODEL_ENTRY	Model = Req[r].Model;
+
+		xz( Model->FuncMoving );
+		for ( int i=0; i<Model->NumOutParms; i++ )
+			if ( Req[r].OutPlane[i].Data ) xz( Model->WindowOut & BM(i) );
+	}
+	xz( PM_InitModels( Req,NumReq,ModelState.data(),&Job ));
+
+	Job.Mask	= (Opt && Opt->Mask) ? Opt->Mask : NULL;
+	Job.Profile	= Opt ? Opt->Profile : NULL;
+	Job.Failed	= false;
+	PM_SetAirThresh( &Job,Opt );
+	xz( MinSig || !Job.AnyAir );
+
+	{
+	const int	NumThreads = (int)min( (INT64)PM_NumThreads( Opt ),max( NumVox/PM_MOVINGVOX,(INT64)1 ));
+
+	if ( Job.Profile ) Job.Profile->Threads = max( Job.Profile->Threads,NumThreads );
+	for ( int w=1; w<NumThreads; w++ )
+		Workers.emplace_back( PM_MovingWorker,&Job,Conc,MinSig,NumVox,L,Io,&IoLock,&Next );
+	PM_MovingWorker( &Job,Conc,MinSig,NumVox,L,Io,&IoLock,&Next );
+	for ( auto& W : Workers ) W.join();
+	}
+
+	for ( int r=0; r<NumReq; r++ ) Req[r].NumSkipped = Job.Skipped[r];
+	xz( !Job.Failed );
+
+	res	= true;
+func_exit:
+	PM_CloseModels( Req,NumReq,ModelState.data() );
+	PM_ProfileEnd( Opt,t0 );
+	return res;
+}
+
+
+// Everything the workers of a frame-streaming pass share
+struct PM_FRAMEPASS {
+	PM_JOB*		Job;
+	INT64			NumVox;
+	int			Type;				// TT_SAMPLE of the frames read
+	double		Slope,Inter;		// as in PM_INPUT
+	std::vector<PDOUBLE>	Acc;			// Acc[r]: FrameAcc doubles per voxel of request r
+	std::vector<int>	NumAcc;
+	PDOUBLE		MinSig;			// running minimum of the raw TAC of every voxel; NULL = not needed
+	PDOUBLE		S0;				// conversion baseline of every voxel; NULL = not needed
+	bool			SumBase;			// the workers sum the baseline frames into S0 (raw frames, not held)
+	int			B0,B1;			// baseline frames of funcSigToConc()
+};
+
+
+// Concentration of N samples of one frame with the baselines S0, as funcSigToConc() converts them
+static void	PM_ConvertFrame(
+		const double*	Sig,
+		const double*	S0,
+		int			N,
+		PDOUBLE		Conc )
+{
+	switch ( ConcConv.Type ) {
+	case CONCTYPE_DIFF:
+		for ( int v=0; v<N; v++ ) Conc[v] = Sig[v]-S0[v];
+		break;
+
+	case CONCTYPE_RELENH:
+		for ( int v=0; v<N; v++ ) Conc[v] = S0[v]!=ZERO ? (Sig[v]-S0[v])/S0[v] : ZERO;
+		break;
+
+	case CONCTYPE_DR2:
+		for ( int v=0; v<N; v++ )
+			Conc[v] = (S0[v]>ZERO && Sig[v]>ZERO) ? -log( Sig[v]/S0[v] )/ConcConv.TE : ZERO;
+		break;
+
+	default:
+		memcpy( Conc,Sig,N*sizeof(double) );
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Worker of PM_CalcMapsFrames(): folds frame t (Frame in the sample type of the pass, or Held, the
+// scaled doubles of the whole frame) into the accumulators, runs of PM_FRAMEVOX voxels taken from
+// Next; with neither, classifies the voxels and stores the outputs of the first t frames instead
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void	PM_FrameWorker(
+		PM_FRAMEPASS*	P,
+		int			t,
+		PVOID			Frame,
+		const double*	Held,
+		std::atomic<INT64>*	Next )
+{
+PM_JOB*		Job = P->Job;
+const bool		Final = !Frame && !Held;
+std::vector<double>	Sig( PM_FRAMEVOX ),
+			Conc( (P->S0 && !P->SumBase) ? PM_FRAMEVOX : 0 ),
+			Offset( (Final && Job->AnyDesc) ? PM_FRAMEVOX : 0 ),	// conversion descriptor of the run
+			Scale( Offset.size() );
+std::vector<PM_SPAN>	Live( PM_FRAMEVOX/2+1 ),
+			Sel( PM_FRAMEVOX/2+1 );
+std::vector<INT64>	Skipped( Job->NumReq,0 );
+#if defined(PARMMAP_PROFILE)
+std::vector<MP_RECORD>	Prof( Job->Profile ? Job->NumReq+1 : 0,MP_RECORD() );	// per request, then the driver
+MP_RECORD*		Pass = Job->Profile ? &Prof[Job->NumReq] : NULL;
+#endif
+
+	for ( INT64 V0; !Job->Failed && (V0 = Next->fetch_add( PM_FRAMEVOX ))<P->NumVox; ) {
+		const int	N	= (int)min( (INT64)PM_FRAMEVOX,P->NumVox-V0 ),
+				NumLive	= PM_MaskSpans( Job->Mask ? Job->Mask+V0 : NULL,N,Live.data() );
+		const double	*RunSig = NULL,
+				*RunConc = NULL;
+
+		MP_BIND( Pass );
+		if ( !Final ) {
+			// samples of the run: the held frame, or widened from the frame read
+			if ( Held ) RunSig = Held+V0;
+			else {
+				MP_SCOPE_ALL( MP_GATHER );
+				for ( int s=0; s<NumLive; s++ ) {
+					PDOUBLE	x = Sig.data()+Live[s].V0;
+
+					TT_FrameToVoxel( &Frame,P->Type,V0+Live[s].V0,Live[s].N,1,x,false );
+					if ( P->Slope ) PM_ScaleTile( x,Live[s].N,P->Slope,P->Inter );
+					MP_COUNT( MP_BYTESIN,(INT64)Live[s].N*TT_SampleBytes( P->Type ));
+				}
+				RunSig = Sig.data();
+			}
+
+			if ( P->MinSig ) {
+				MP_SCOPE_ALL( MP_CLASSIFY );
+				for ( int s=0; s<NumLive; s++ )
+					for ( int v=Live[s].V0; v<Live[s].V0+Live[s].N; v++ ) {
+						PDOUBLE	m = P->MinSig+V0+v;
+						if ( t==0 || RunSig[v]<*m ) *m = RunSig[v];
+					}
+			}
+
+			if ( P->SumBase && t>=P->B0 && t<=P->B1 )
+				for ( int s=0; s<NumLive; s++ )
+					for ( int v=Live[s].V0; v<Live[s].V0+Live[s].N; v++ ) P->S0[V0+v] += RunSig[v];
+
+			RunConc = RunSig;
+			if ( P->S0 && !P->SumBase ) {
+				MP_SCOPE_ALL( MP_CONVERT );
+				for ( int s=0; s<NumLive; s++ )
+					PM_ConvertFrame( RunSig+Live[s].V0,P->S0+V0+Live[s].V0,Live[s].N,Conc.data()+Live[s].V0 );
+				RunConc = Conc.data();
+			}
+		}
+		else if ( Job->AnyDesc ) {
+			MP_SCOPE_ALL( MP_CONVERT );
+			for ( int s=0; s<NumLive; s++ )
+				for ( int v=Live[s].V0; v<Live[s].V0+Live[s].N; v++ )
+					funcSigToConcLinear( P->S0 ? P->S0[V0+v] : ZERO,&Offset[v],&Scale[v] );
+		}
+
+		for ( int r=0; r<Job->NumReq && !Job->Failed; r++ ) {
+			PPM_MAPREQ	R = Job->Req+r;
+			const bool	Raw = Job->Raw[r];
+			int		NumSel = NumLive;
+			const PM_SPAN*	Sp = Live.data();
+
+			if ( Final ) {
+				NumSel = PM_SelectSpans( Live.data(),NumLive,P->MinSig ? P->MinSig+V0 : NULL,Job->AirThresh[r],Sel.data() );
+				Sp     = Sel.data();
+				Skipped[r] += PM_VoidGaps( R->OutPlane,R->Model->NumOutParms,V0,N,Sp,NumSel );
+			}
+			MP_BIND( Job->Profile ? &Prof[r] : NULL );
+
+			for ( int s=0; s<NumSel && !Job->Failed; s++ ) {
+				const double*	x = Final ? NULL : (Raw ? RunSig : RunConc)+Sp[s].V0;
+				const bool		Desc = Final && Job->Desc[r];
+				MODEL_BATCH		B = {};
+
+				B.Signal		= (PDOUBLE)x;
+				B.NumVox		= Sp[s].N;
+				B.OutPlane		= R->OutPlane;
+				B.V0			= V0+Sp[s].V0;
+				B.IsConc		= !Raw;
+				B.Acc			= P->Acc[r]+(V0+Sp[s].V0)*P->NumAcc[r];
+				B.ConcOffset	= Desc ? Offset.data()+Sp[s].V0 : NULL;
+				B.ConcScale		= Desc ? Scale.data()+Sp[s].V0 : NULL;
+				if ( Final ) MP_COUNT( MP_VOXELS,Sp[s].N );
+				if ( !R->Model->FuncFrame( Job->ModelState[r],t,&B )) Job->Failed = true;
+			}
+		}
+	}
+
+	for ( int r=0; r<Job->NumReq; r++ ) Job->Skipped[r] += Skipped[r];
+
+#if defined(PARMMAP_PROFILE)
+	MP_BIND( NULL );
+	if ( Job->Profile ) {
+		for ( int r=0; r<Job->NumReq; r++ ) Prof[r].Count[MP_SKIPPED] = Skipped[r];
+		MP_Merge( Job->Profile,Prof.data(),0,Job->NumReq+1 );
+	}
+#endif
+}
+
+
+// Run PM_FrameWorker() for frame t (or the outputs of t frames) on the threads of the options
+static bool	PM_RunFrame(
+		PM_FRAMEPASS*	P,
+		int			t,
+		PVOID			Frame,
+		const double*	Held,
+		PPM_OPTIONS		Opt )
+{
+std::vector<std::thread>	Workers;
+std::atomic<INT64>		Next( 0 );
+const int			NumThreads = (int)min( (INT64)PM_NumThreads( Opt ),max( P->NumVox/PM_FRAMEVOX,(INT64)1 ));
+
+	if ( P->Job->Profile ) P->Job->Profile->Threads = max( P->Job->Profile->Threads,NumThreads );
+	for ( int w=1; w<NumThreads; w++ )
+		Workers.emplace_back( PM_FrameWorker,P,t,Frame,Held,&Next );
+	PM_FrameWorker( P,t,Frame,Held,&Next );
+	for ( auto& W : Workers ) W.join();
+
+	return !P->Job->Failed;
+}
+
+
+// Outputs of the first n frames of a frame-streaming pass, with the background thresholds as they stand
+static bool	PM_StoreFrames(
+		PM_FRAMEPASS*	P,
+		int			n,
+		PPM_OPTIONS		Opt )
+{
+PM_JOB*	Job = P->Job;
+
+	PM_SetAirThresh( Job,Opt );
+	if ( Job->AnyAir && !P->MinSig ) return false;
+	if ( !PM_RunFrame( P,n,NULL,NULL,Opt )) return false;
+
+	for ( int r=0; r<Job->NumReq; r++ ) Job->Req[r].NumSkipped = Job->Skipped[r];
+	return true;
+}
+
+
+/**
+* @brief Calculate the maps of several models by streaming the study one frame at a time.
+*
+* The models whose outputs are sums over the frames accumulate them frame
+* by frame (@c MODEL_ENTRY::FuncFrame): @p Io->Read hands over frames
+* 0 .. NumTms-1 in acquisition order, each read exactly once (the next one on
+* a helper thread while the workers fold the current one into per-voxel
+* accumulators), and no TAC is ever gathered. Memory is two frame buffers,
+* the accumulators (@c FrameAcc doubles per voxel of each request) and the
+* output planes.
+*
+* Frames go to the models converted unless a model takes raw signal, or
+* every concentration model folds the conversion into its kernel
+* (@c MODEL_ENTRY::FoldConc), as in a full pass. A conversion needs the
+* baseline of each voxel: the frames up to the last baseline frame are then
+* held as doubles until it is known, and folded in once it is.
+*
+* Voxels outside @c PM_OPTIONS::Mask are never read into the accumulators.
+* The running minimum of each raw TAC is kept for the background
+* classification, which is made after the last frame with the thresholds
+* of that moment, so @p Io->Read may set @c demp_NoiseLevel from the frames
+* it reads (e.g. from frame 0).
+*
+* With @p Io->Update the maps are also kept up to date while the frames
+* arrive (an acquisition in progress): after every frame from which the
+* concentration can be had (the end of the baseline on), the output planes
+* are set to the outputs of the frames so far (@c MODEL_ENTRY::LiveOut),
+* background classification included, and @p Io->Update is called. The
+* conversion is then never folded into a model kernel.
+*
+* @param[in]  Req     @c NumReq map requests (output planes of Nx*Ny*Nz
+*                     voxels); every model must have a @c FuncFrame and
+*                     request only outputs of its @c FrameOut (@c LiveOut
+*                     with @p Io->Update), and no request may have series
+*                     planes.
+* @param[in]  NumReq  Number of requests.
+* @param[in]  Nx,Ny,Nz Spatial dimensions of the study.
+* @param[in]  Io      Frame reader and the sample type of the frames;
+*                     @c Io->AccBytes receives the bytes of the
+*                     accumulators, which must not exceed @c Io->Budget.
+* @param[in]  Opt     Threading, mask and background options (may be
+*                     @c NULL); the frames are evaluated in double whatever
+*                     @c PM_OPTIONS::Float32 says.
+*
+* @return bool
+*   @c false if a model cannot accumulate its request, the accumulators
+*   exceed @c Io->Budget (nothing is read then), or a model init, an
+*   allocation, a frame read, a block or @p Io->Update fails.
+*
+* @pre  Framework globals (@c NumTms, @c AbsTarr, free parameters) describe
+*       the whole study.
+*/
+
+bool	PM_CalcMapsFrames(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		int			Nx,
+		int			Ny,
+		int			Nz,
+		PPM_FRAMEIO		Io,
+		PPM_OPTIONS		Opt )
+{
+std::vector<PVOID>		ModelState( NumReq,(PVOID)NULL );
+std::vector<PDOUBLE>		Hold;
+char*				Buf[2]	= { NULL,NULL };
+bool				Ok[2]	= { false,false };
+std::thread			Reader;
+PM_FRAMEPASS		P;
+PM_JOB			Job;
+double			o,s;
+bool				Fold	= !Io->Update && funcSigToConcLinear( ONE,&o,&s ),
+				Track	= Opt && Opt->AirFactor>0;
+bool				res		= false;
+const auto			t0		= std::chrono::steady_clock::now();
+
+	P.Job		= &Job;
+	P.NumVox	= (INT64)Nx*Ny*Nz;
+	P.Type	= Io->Type;
+	P.Slope	= Io->Slope;
+	P.Inter	= Io->Inter;
+	P.MinSig	= P.S0 = NULL;
+	P.SumBase	= false;
+	P.Acc.assign( NumReq,(PDOUBLE)NULL );
+	P.NumAcc.assign( NumReq,0 );
+
+	PM_ProfileBegin( Req,NumReq,Opt );
+
+	for ( int r=0; r<NumReq; r++ ) {
+		PMODEL_ENTRY	Model = Req[r].Model;
+
+		xz( Model->FuncFrame && !Req[r].SeriesPlane );
+		for ( int i=0; i<Model->NumOutParms; i++ )
+			if ( Req[r].OutPlane[i].Data ) xz( (Io->Update ? Model->LiveOut : Model->FrameOut) & BM(i) );
+	}
+	xz( PM_InitModels( Req,NumReq,ModelState.data(),&Job ));
+
+	Job.Mask	= (Opt && Opt->Mask) ? Opt->Mask : NULL;
+	Job.Profile	= Opt ? Opt->Profile : NULL;
+	Job.Failed	= false;
+	Job.Skipped	= std::vector<std::atomic<INT64> >( NumReq );
+
+	// models that fold a linear conversion into their kernel take raw frames if no other one needs
+	// them converted, and no maps are asked for before the end; their conversion descriptor comes from
+	// the baselines summed as the frames pass
+	for ( int r=0; r<NumReq; r++ ) {
+		PMODEL_ENTRY	Model = Req[r].Model;
+
+		if ( !Model->RawSignal && (!Model->FoldConc || !Model->FoldConc( ModelState[r] ))) Fold = false;
+		Track |= Model->AirThresh!=NULL;
+	}
+	Job.AnyConc = Job.AnyDesc = false;
+	Job.Raw.assign( NumReq,false );
+	Job.Desc.assign( NumReq,false );
+	Io->AccBytes = 0;
+	for ( int r=0; r<NumReq; r++ ) {
+		Job.Raw[r]	= Req[r].Model->RawSignal || Fold;
+		Job.Desc[r]	= !Req[r].Model->RawSignal && Fold;
+		Job.AnyConc	|= !Job.Raw[r];
+		Job.AnyDesc	|= Job.Desc[r];
+		Job.Skipped[r]	= 0;
+
+		P.NumAcc[r]	= (int)Req[r].Model->FrameAcc( ModelState[r] );
+		Io->AccBytes += P.NumVox*P.NumAcc[r]*(INT64)sizeof(double);
+	}
+	xz( !Io->Budget || Io->AccBytes<=Io->Budget );
+
+	for ( int r=0; r<NumReq; r++ ) {
+		xz( AllocMem<double >(P.Acc[r],P.NumVox*P.NumAcc[r] ));
+		std::fill( P.Acc[r],P.Acc[r]+P.NumVox*P.NumAcc[r],ZERO );
+	}
+	if ( Track ) xz( AllocMem<double >(P.MinSig,P.NumVox ));
+
+	// a conversion holds the frames up to the end of the baseline; a descriptor only sums them
+	funcSigToConcBase( NumTms,&P.B0,&P.B1 );
+	P.SumBase = Job.AnyDesc;
+	if ( P.SumBase || (Job.AnyConc && ConcConv.Type!=CONCTYPE_NOCONV) ) {
+		xz( AllocMem<double >(P.S0,P.NumVox ));
+		std::fill( P.S0,P.S0+P.NumVox,ZERO );
+		if ( !P.SumBase ) Hold.assign( P.B1+1,(PDOUBLE)NULL );
+	}
+
+	{
+	const INT64	Bytes = P.NumVox*TT_SampleBytes( Io->Type );
+
+	xz( AllocMem<char >(Buf[0],Bytes ));
+	xz( AllocMem<char >(Buf[1],Bytes ));
+
+	auto	Read = [Io,&Buf,&Ok]( int t ) { Ok[t&1] = Io->Read( Io->Ctx,t,Buf[t&1] ); };
+
+	Reader = std::thread( Read,0 );
+
+	for ( int t=0; t<NumTms; t++ ) {
+		Reader.join();
+		xz( Ok[t&1] );
+		if ( t+1<NumTms ) Reader = std::thread( Read,t+1 );
+
+		if ( t>=(int)Hold.size() ) {
+			xz( PM_RunFrame( &P,t,Buf[t&1],NULL,Opt ));
+			if ( P.SumBase && t==P.B1 )
+				for ( INT64 v=0; v<P.NumVox; v++ ) P.S0[v] /= P.B1-P.B0+1;
+		}
+		else {
+			// held frame: scaled doubles of the whole frame, summed into the baselines
+			PVOID		F = Buf[t&1];
+			PDOUBLE&	H = Hold[t];
+
+			xz( AllocMem<double >(H,P.NumVox ));
+			TT_FrameToVoxel( &F,Io->Type,0,(int)P.NumVox,1,H,false );
+			if ( Io->Slope ) PM_ScaleTile( H,P.NumVox,Io->Slope,Io->Inter );
+			if ( t>=P.B0 )
+				for ( INT64 v=0; v<P.NumVox; v++ ) P.S0[v] += H[v];
+
+			if ( t<P.B1 ) continue;
+
+			for ( INT64 v=0; v<P.NumVox; v++ ) P.S0[v] /= P.B1-P.B0+1;
+			for ( int h=0; h<=P.B1; h++ ) {
+				xz( PM_RunFrame( &P,h,NULL,Hold[h],Opt ));
+				pf_free(&Hold[h]);
+			}
+		}
+
+		// provisional maps of the frames so far
+		if ( Io->Update && t+1<NumTms ) {
+			xz( PM_StoreFrames( &P,t+1,Opt ));
+			xz( Io->Update( Io->Ctx,t+1 ));
+		}
+	}
+	}
+
+	xz( PM_StoreFrames( &P,NumTms,Opt ));
+
+	res	= true;
+func_exit:
+	if ( Reader.joinable() ) Reader.join();
+	PM_CloseModels( Req,NumReq,ModelState.data() );
+	PM_ProfileEnd( Opt,t0 );
+	for ( PDOUBLE& H : Hold ) pf_free(&H);
+	for ( PDOUBLE& A : P.Acc ) pf_free(&A);
+	pf_free(&P.MinSig);
+	pf_free(&P.S0);
+	pf_free(&Buf[0]);
+	pf_free(&Buf[1]);
+	return res;
+}
+
+
+/**
+* @brief Calculate a parametric map of one model over the whole volume.
+*
+* @param[in]  Model     Model entry (see @c ModelTable.h).
+* @param[in]  IFarr     Input functions passed to the model's @c Init.
+* @param[in]  NumIF     Number of input functions.
+* @param[in]  In        Frame-major 4D input with @c NumTms frames of @c In->Type samples.
+* @param[out] OutPlane  @c Model->NumOutParms typed planes of Nx*Ny*Nz voxels;
+*                       @c Data @c NULL for outputs not requested.
+* @param[in]  Opt       Threading/tiling options (may be @c NULL).
+*
+* @return bool
+*   @c true on success; @c false if model init, an allocation or a block
+*   evaluation fails.
+*
+* @pre  Framework globals (@c NumTms, @c AbsTarr, free parameters) are set.
+*/
+
+bool	PM_CalcMap(
+		PMODEL_ENTRY	Model,
+		PINPUTFUNC		IFarr,
+		int			NumIF,
+		PPM_INPUT		In,
+		PMB_PLANE		OutPlane,
+		PPM_OPTIONS		Opt )
+{
+PM_MAPREQ	Req = {};
+
+	Req.Model	= Model;
+	Req.IFarr	= IFarr;
+	Req.NumIF	= NumIF;
+	Req.OutPlane= OutPlane;
+	return PM_CalcMaps( &Req,1,In,Opt );
+}
@@ -0,0 +1,243 @@
+/**
+* @file ParmMapDriver.h
+* @brief Multi-threaded parametric map driver over voxel tiles.
+*
+* @details
+* Runs one model over a whole 4D study:
+*   1) @c Init of the model entry is called **once** (one shared state),
+*      with @c ParmReq[] set to the requested outputs (non-@c NULL planes),
+*      so a model can pick kernels that compute only those.
+*   2) The volume is cut into tiles — whole slices, or bricks of full x-rows
+*      when @c PM_OPTIONS::TileVox is set — and the tiles are dealt out to
+*      the worker threads in contiguous runs.
+*   3) Each worker gathers the TACs of its tile into a voxel-major block and
+*      calls @c FuncBatch; results go straight into the typed output planes
+*      (@c MB_PLANE: double, float, or int16 with a scale) at the voxel
+*      index. A worker whose run is exhausted steals the back half of
+*      the largest remaining run, so cheap regions (e.g. air voxels rejected
+*      early by Model 6) do not leave cores idle.
+*   4) @c Close is called once.
+*
+* @c PM_CalcMaps() runs several models in one fused pass: each tile is
+* gathered once and converted to concentration once (@c funcSigToConc() with
+* the global conversion base), and the converted block is handed to every
+* model that takes concentration (@c MODEL_BATCH::IsConc); models flagged
+* @c RawSignal get the raw block. The 4D data is thus streamed through memory
+* once instead of once per model. When every concentration model of the pass
+* can fold the conversion into its kernel (@c MODEL_ENTRY::FoldConc, e.g.
+* the Model 1 AUC) and the conversion is linear, they get the raw block as
+* well, with the offset and scale of each voxel (@c funcSigToConcLinear(),
+* @c MODEL_BATCH::ConcOffset) in place of the converted one, and the tile is
+* not converted at all.
+*
+* @c PM_CalcMapsSlabs() handles studies larger than memory: the models are
+* initialized once, then the pass runs slab by slab (whole slices, all
+* frames) through caller-supplied read/write callbacks, with the slab depth
+* chosen so that data and work buffers stay within a memory budget.
+*
+* A request may also ask for the series of its model
+* (@c MODEL_ENTRY::SeriesName): @c PM_MAPREQ::SeriesPlane holds one plane
+* per point, filled in the same pass as the other outputs. The planes cover
+* the whole study, so @c PM_CalcMapsSlabs() refuses such requests.
+*
+* With @c PM_OPTIONS::Float32 the models that have a float32 kernel
+* (@c MODEL_ENTRY::FuncBatchF) get a float copy of each converted tile and
+* run that kernel (double accumulators, see @c TacKernels.h); the others
+* run in double as usual.
+*
+* The frames keep their native sample type (int16, uint16, float or double,
+* @c PM_INPUT::Type): samples are widened to double, and scaled, while a
+* tile is gathered, so a double copy of the study is never made.
+*
+* @c PM_INPUT::Conc hands the driver the whole study already converted,
+* voxel-major (a concentration cache mapped from disk): the concentration
+* models then read their TACs in place, nothing is converted, and the raw
+* frames are not gathered at all unless a @c RawSignal model needs them
+* (the background classification uses @c PM_INPUT::MinSig). With
+* @c ConcReady false the pass fills @c Conc and @c MinSig for every voxel
+* instead, mask or not, so a later run can use them.
+*
+* Background voxels are classified once per tile, before any conversion or
+* model work: a voxel is skipped if @c PM_OPTIONS::Mask excludes it, or, for
+* a model with a background threshold (@c MODEL_ENTRY::AirThresh, or
+* @c PM_OPTIONS::AirFactor * @c demp_NoiseLevel for the others), if the
+* minimum of its raw TAC is below that threshold (@c IsAir_ByMin()). The
+* models are called on the runs of remaining voxels only, and the outputs
+* of the skipped voxels are set to @c VOIDVOX in bulk. Voxels outside the
+* mask are not even gathered.
+*
+* With @c PM_OPTIONS::Profile set (and the build defining @c PARMMAP_PROFILE)
+* the driver times its own stages per tile (gather, classification,
+* conversion, slab writes) and binds each worker's profile record to the
+* request whose model is running, so the models' stage timers and counters
+* are attributed per map; see @c ModelProfile.h.
+*
+* @c PM_CalcMapsWindow() recomputes the maps of models 0 and 1 for a new
+* Start Index/Length from a prefix table of the study built once
+* (@c WT_Build() from the @c PM_INPUT::Conc a pass filled, see
+* @c WindowTable.h): O(1) per voxel whatever the window, with the same mask
+* and background classification as a full pass.
+*
+* @c PM_CalcMapsMoving() evaluates the outputs of every window of L frames
+* sliding over the TACs of the converted study (@c MODEL_ENTRY::FuncMoving),
+* a time series per voxel. The voxels are taken in runs; the series of a
+* run are handed to a writer callback window by window and the run buffers
+* reused, so the 4D result is never held in memory.
+*
+* @c PM_CalcMapsFrames() computes the maps of the models whose outputs are
+* sums over the frames (@c MODEL_ENTRY::FuncFrame: moments, AUC, parity
+* statistics, reference distance) from the frames alone, read one at a
+* time in acquisition order into per-voxel accumulators: no TAC is
+* gathered, and memory is two frames plus the accumulators instead of the
+* study. The frames of a conversion baseline are held until it is known.
+* With @c PM_FRAMEIO::Update it also gives the maps of the frames received
+* after each one (@c MODEL_ENTRY::LiveOut), for maps updated live during an
+* acquisition.
+*
+* Every voxel is evaluated by the same code on the same TAC, whichever
+* thread runs it, so the output is identical to serial execution.
+*/
+
+#pragma once
+
+#include	"ModelTable.h"
+#include	"TacTranspose.h"
+
+
+// 4D input in frame-major (scanner) layout, in its native sample type
+struct PM_INPUT {
+	PVOID*	Frame;			// Frame[t][v], t < NumTms, v < Nx*Ny*Nz
+	int		Nx,Ny,Nz;			// spatial dimensions (x fastest)
+	int		Type;				// TT_SAMPLE of the frames (0 = double)
+	double	Slope,Inter;		// value = sample*Slope+Inter; Slope 0 = unscaled
+	PDOUBLE	Conc;				// voxel-major concentration TACs of the volume, Conc[v*NumTms+t]
+						// (e.g. a mapped cache); NULL = converted per tile
+	PDOUBLE	MinSig;			// with Conc: minimum of the raw TAC of every voxel
+	bool		ConcReady;			// Conc and MinSig hold the study; false = the pass fills them
+};
+
+typedef PM_INPUT*	PPM_INPUT;
+
+
+struct PM_OPTIONS {
+	int	NumThreads;				// worker threads; 0 = all hardware threads
+	int	TileVox;				// voxels per tile (rounded to whole rows); 0 = one slice
+	bool	StreamStores;			// non-temporal stores when gathering tiles (large tiles only)
+	bool	Float32;				// float32 compute mode for models with FuncBatchF
+	const unsigned char*	Mask;		// Nx*Ny*Nz voxels, nonzero = evaluate; NULL = all voxels
+	double	AirFactor;				// threshold AirFactor*demp_NoiseLevel for models without
+						// their own AirThresh; 0 = no background rejection
+	PMP_PROFILE	Profile;			// out: stage timers and counters of the run; NULL = none
+};
+
+typedef PM_OPTIONS*	PPM_OPTIONS;
+
+
+// One map of a fused pass
+struct PM_MAPREQ {
+	PMODEL_ENTRY	Model;
+	PINPUTFUNC		IFarr;			// input functions passed to Model->Init
+	int			NumIF;
+	PMB_PLANE		OutPlane;			// Model->NumOutParms planes; Data NULL = not requested
+	PMB_PLANE		SeriesPlane;		// NumSeries planes of the points of Model->SeriesName; NULL = none
+	int			NumSeries;			// points set in the model's series (NumTms for MB_SERIESFRAMES)
+	INT64			NumSkipped;			// out: voxels classified as background (set to VOIDVOX)
+};
+
+typedef PM_MAPREQ*	PPM_MAPREQ;
+
+
+// Slab reader/writer for PM_CalcMapsSlabs()
+struct PM_SLABIO {
+	PVOID		Ctx;
+	// fill Frame[t] (t < NumTms) with the Nx*Ny*Nz voxels of slices [z0,z0+Nz), samples of Type
+	bool		(*Read)( PVOID Ctx,int z0,int Nz,PVOID* Frame );
+	// store output Op of request Req for slices [z0,z0+Nz) (Nx*Ny*Nz samples of Plane); called in slab order
+	bool		(*Write)( PVOID Ctx,int z0,int Nz,int Req,int Op,const MB_PLANE* Plane );
+	int		SlabZ;			// out: slices per slab
+	int		Type;				// TT_SAMPLE of the slab frames
+	double	Slope,Inter;		// scaling as in PM_INPUT
+	PDOUBLE	Conc,MinSig;		// as in PM_INPUT, for the whole study
+	bool		ConcReady;
+};
+
+typedef PM_SLABIO*	PPM_SLABIO;
+
+
+// Writer of PM_CalcMapsMoving()
+struct PM_MOVINGIO {
+	PVOID		Ctx;
+	// store window w of output Op of request Req for voxels [V0,V0+N) (N samples of Plane);
+	// calls are serialized, in no particular voxel order
+	bool		(*Write)( PVOID Ctx,int Req,int Op,int w,INT64 V0,int N,const MB_PLANE* Plane );
+};
+
+typedef PM_MOVINGIO*	PPM_MOVINGIO;
+
+
+// Frame reader of PM_CalcMapsFrames()
+struct PM_FRAMEIO {
+	PVOID		Ctx;
+	// fill Frame with the Nx*Ny*Nz samples of frame t; called for t = 0 .. NumTms-1 in order
+	bool		(*Read)( PVOID Ctx,int t,PVOID Frame );
+	// the output planes hold the maps of frames 0 .. n-1 (n < NumTms); NULL = maps at the end only
+	bool		(*Update)( PVOID Ctx,int n );
+	int		Type;				// TT_SAMPLE of the frames
+	double	Slope,Inter;		// scaling as in PM_INPUT
+	INT64		Budget;			// bytes the accumulators of the requests may take; 0 = no limit
+	INT64		AccBytes;			// out: bytes of the accumulators of the requests
+};
+
+typedef PM_FRAMEIO*	PPM_FRAMEIO;
+
+
+bool	PM_CalcMap(
+		PMODEL_ENTRY	Model,
+		PINPUTFUNC		IFarr,
+		int			NumIF,
+		PPM_INPUT		In,
+		PMB_PLANE		OutPlane,
+		PPM_OPTIONS		Opt );
+
+bool	PM_CalcMaps(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		PPM_INPUT		In,
+		PPM_OPTIONS		Opt );
+
+bool	PM_CalcMapsSlabs(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		int			Nx,
+		int			Ny,
+		int			Nz,
+		PPM_SLABIO		Io,
+		INT64			Budget,
+		PPM_OPTIONS		Opt );
+
+bool	PM_CalcMapsWindow(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		const WT_TABLE*	T,
+		PPM_OPTIONS		Opt );
+
+bool	PM_CalcMapsMoving(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		const double*	Conc,
+		const double*	MinSig,
+		INT64			NumVox,
+		int			L,
+		PPM_MOVINGIO	Io,
+		PPM_OPTIONS		Opt );
+
+bool	PM_CalcMapsFrames(
+		PPM_MAPREQ		Req,
+		int			NumReq,
+		int			Nx,
+		int			Ny,
+		int			Nz,
+		PPM_FRAMEIO		Io,
+		PPM_OPTIONS		Opt );
+
+int	PM_NumThreads( PPM_OPTIONS Opt );
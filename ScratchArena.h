@@ -0,0 +1,94 @@
+/**
+* @file ScratchArena.h
+* @brief Per-thread bump allocator for the models' per-voxel work buffers.
+*
+* @details
+* @c M*_ModelInit() computes how many doubles one voxel needs
+* (@c M*_ModelScratch()); a driver creates one arena of that size per worker
+* thread and passes it in @c MODEL_BATCH::Scratch. For each voxel the model
+* calls @c SA_Reset() and carves its buffers with @c SA_Alloc(), so the hot
+* loop never touches the heap. Buffers are 64-byte aligned.
+*
+* When a caller passes no arena (e.g. the per-voxel @c M*_ModelFunc()),
+* the batch function creates a block-local one with @c SA_Create().
+*
+* @section ts Thread-safety
+* An arena belongs to one thread at a time.
+*/
+
+#pragma once
+
+
+enum {
+	SA_ALIGN	= 8				// allocation granularity in doubles (64 bytes)
+};
+
+
+struct SCRATCH_ARENA {
+	PDOUBLE	Mem;				// raw allocation
+	PDOUBLE	Base;				// Mem rounded up to SA_ALIGN doubles
+	INT64		Size;				// usable doubles from Base
+	INT64		Used;				// doubles handed out since the last reset
+};
+
+typedef SCRATCH_ARENA*	PSCRATCH_ARENA;
+
+
+// Doubles reserved by SA_Alloc(N)
+inline INT64	SA_Need( INT64 N )
+{
+	return (N+SA_ALIGN-1)/SA_ALIGN*SA_ALIGN;
+}
+
+
+inline void	SA_Init( PSCRATCH_ARENA A )
+{
+	A->Mem	= A->Base = NULL;
+	A->Size	= A->Used = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Allocate an arena of Size doubles; false if the allocation fails
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+inline bool	SA_Create(
+		PSCRATCH_ARENA	A,
+		INT64			Size )
+{
+	SA_Init( A );
+	if ( !AllocMem<double >(A->Mem,Size+SA_ALIGN )) return false;
+
+	A->Base	= (PDOUBLE)(((size_t)A->Mem+SA_ALIGN*sizeof(double)-1) & ~(size_t)(SA_ALIGN*sizeof(double)-1));
+	A->Size	= Size;
+	return true;
+}
+
+
+inline void	SA_Free( PSCRATCH_ARENA A )
+{
+	pf_free(&A->Mem);
+	SA_Init( A );
+}
+
+
+inline void	SA_Reset( PSCRATCH_ARENA A )
+{
+	A->Used = 0;
+}
+
+
+// N doubles from the arena; NULL if the arena was sized too small
+inline PDOUBLE	SA_Alloc(
+		PSCRATCH_ARENA	A,
+		INT64			N )
+{
+INT64	Need = SA_Need( N );
+
+	if ( A->Used+Need>A->Size ) return NULL;
+
+PDOUBLE	p = A->Base+A->Used;
+	A->Used += Need;
+	return p;
+}
@@ -0,0 +1,479 @@
+/**
+* @file TacKernels.h
+* @brief TAC reductions templated on the sample type, with double accumulators.
+*
+* @details
+* Counterparts of the framework's @c PR_CalculateIntegral(),
+* @c PR_IntegrateDiffL1_PWL(), @c PR_IntegrateDiffL2_PWL(),
+* @c PR_Correlation(), @c PR_ArrStats() and of the ROI statistics of
+* @c VA_VolCalcRoiInfo(), for TACs of @c float or @c double samples. They are
+* the kernels of the float32 compute mode (@c MODEL_ENTRY::FuncBatchF).
+* @c TK_Gemv() applies one weight vector to a block of TACs at once (the
+* trapezoid AUC of Model 1); @c TK_StateStats() the statistics of several
+* series interleaved in one TAC (Model 3), read in place.
+*
+* The per-sample arithmetic (differences, sums of neighbours, deviations for
+* the correlation) is done in the sample type; every sum, moment and
+* integral is accumulated in double. Sums are split over @c TK_LANES
+* independent accumulators, added up at the end, so the compiler can keep
+* them in vector registers: the results differ from the framework functions
+* by the summation order only.
+*/
+
+#pragma once
+
+#include	<algorithm>
+#include	<cmath>
+
+
+enum {
+	TK_LANES	= 8,				// independent partial sums per reduction
+	TK_GEMVROWS	= 4,				// rows sharing the weight loads of TK_Gemv()
+	TK_GEMVLANES	= 2				// partial sums per row in TK_Gemv()
+};
+
+
+// Sum of the partial sums
+inline double	TK_Sum( const double* Acc )
+{
+double	S = ZERO;
+
+	for ( int k=0; k<TK_LANES; k++ ) S += Acc[k];
+	return S;
+}
+
+
+// Trapezoid integral of Y over X
+template<class T>
+inline double	TK_Integral(
+		const T*		Y,
+		const double*	X,
+		int			N )
+{
+double	Acc[TK_LANES] = { 0 };
+int		i = 1;
+
+	for ( ; i+TK_LANES<=N; i+=TK_LANES )
+		for ( int k=0; k<TK_LANES; k++ )
+			Acc[k] += (X[i+k]-X[i+k-1])*(double)(Y[i+k]+Y[i+k-1]);
+
+	for ( ; i<N; i++ )
+		Acc[0] += (X[i]-X[i-1])*(double)(Y[i]+Y[i-1]);
+
+	return TK_Sum( Acc )*0.5;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Integral of |A-B| over X for piecewise-linear A, B (see PR_IntegrateDiffL1_PWL): a segment where
+// the difference changes sign contributes (d0^2+d1^2)/(|d0|+|d1|) instead of |d0+d1|
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+inline double	TK_L1Segment(
+		T		d0,
+		T		d1,
+		double	h )
+{
+const T	a = std::abs( d0+d1 ),
+		m = std::abs( d0 )+std::abs( d1 );
+
+	return h*(double)(d0*d1>=0 ? a : (d0*d0+d1*d1)/(m>0 ? m : 1));
+}
+
+template<class T>
+inline double	TK_IntegrateDiffL1(
+		const T*		A,
+		const T*		B,
+		const double*	X,
+		int			N )
+{
+double	Acc[TK_LANES] = { 0 };
+int		i = 1;
+
+	for ( ; i+TK_LANES<=N; i+=TK_LANES )
+		for ( int k=0; k<TK_LANES; k++ )
+			Acc[k] += TK_L1Segment<T>( A[i+k-1]-B[i+k-1],A[i+k]-B[i+k],X[i+k]-X[i+k-1] );
+
+	for ( ; i<N; i++ )
+		Acc[0] += TK_L1Segment<T>( A[i-1]-B[i-1],A[i]-B[i],X[i]-X[i-1] );
+
+	return TK_Sum( Acc )*0.5;
+}
+
+
+// Integral of (A-B)^2 over X for piecewise-linear A, B
+template<class T>
+inline double	TK_IntegrateDiffL2(
+		const T*		A,
+		const T*		B,
+		const double*	X,
+		int			N )
+{
+double	Acc[TK_LANES] = { 0 };
+int		i = 1;
+
+	for ( ; i+TK_LANES<=N; i+=TK_LANES )
+		for ( int k=0; k<TK_LANES; k++ ) {
+			T	d0 = A[i+k-1]-B[i+k-1],
+				d1 = A[i+k]-B[i+k];
+			Acc[k] += (X[i+k]-X[i+k-1])*(double)(d0*d0+d0*d1+d1*d1);
+		}
+
+	for ( ; i<N; i++ ) {
+		T	d0 = A[i-1]-B[i-1],
+			d1 = A[i]-B[i];
+		Acc[0] += (X[i]-X[i-1])*(double)(d0*d0+d0*d1+d1*d1);
+	}
+	return TK_Sum( Acc )/3;
+}
+
+
+// Sum of N samples X[0], X[Stride], ...
+template<class T>
+inline double	TK_ArrSum(
+		const T*	X,
+		int		N,
+		int		Stride )
+{
+double	Acc[TK_LANES] = { 0 };
+int		i = 0;
+
+	for ( ; i+TK_LANES<=N; i+=TK_LANES )
+		for ( int k=0; k<TK_LANES; k++ ) Acc[k] += X[(INT64)(i+k)*Stride];
+
+	for ( ; i<N; i++ ) Acc[0] += X[(INT64)i*Stride];
+	return TK_Sum( Acc );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Y[r] = sum of W[t]*X[r*Ld+t], t < N, for the NumRows rows of X (a matrix-vector product). Rows are
+// taken TK_GEMVROWS at a time, so that every weight loaded serves all of them.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+inline void	TK_Gemv(
+		const T*		X,
+		INT64			Ld,
+		int			NumRows,
+		const double*	W,
+		int			N,
+		double*		Y )
+{
+int	r = 0;
+
+	for ( ; r+TK_GEMVROWS<=NumRows; r+=TK_GEMVROWS ) {
+		const T*	Row = X+r*Ld;
+		double	Acc[TK_GEMVROWS][TK_GEMVLANES] = {{ 0 }};
+		int		i = 0;
+
+		for ( ; i+TK_GEMVLANES<=N; i+=TK_GEMVLANES )
+			for ( int j=0; j<TK_GEMVROWS; j++ )
+				for ( int k=0; k<TK_GEMVLANES; k++ ) Acc[j][k] += W[i+k]*(double)Row[j*Ld+i+k];
+
+		for ( ; i<N; i++ )
+			for ( int j=0; j<TK_GEMVROWS; j++ ) Acc[j][0] += W[i]*(double)Row[j*Ld+i];
+
+		for ( int j=0; j<TK_GEMVROWS; j++ ) {
+			double	S = ZERO;
+			for ( int k=0; k<TK_GEMVLANES; k++ ) S += Acc[j][k];
+			Y[r+j] = S;
+		}
+	}
+
+	for ( ; r<NumRows; r++ ) {
+		const T*	Row = X+r*Ld;
+		double	Acc[TK_LANES] = { 0 };
+		int		i = 0;
+
+		for ( ; i+TK_LANES<=N; i+=TK_LANES )
+			for ( int k=0; k<TK_LANES; k++ ) Acc[k] += W[i+k]*(double)Row[i+k];
+
+		for ( ; i<N; i++ ) Acc[0] += W[i]*(double)Row[i];
+		Y[r] = TK_Sum( Acc );
+	}
+}
+
+
+// Pearson correlation of X and Y
+template<class T>
+inline double	TK_Correlation(
+		const T*	X,
+		const T*	Y,
+		int		N )
+{
+const T	mx = (T)(TK_ArrSum( X,N,1 )/N),
+		my = (T)(TK_ArrSum( Y,N,1 )/N);
+double	Sxx[TK_LANES] = { 0 },
+		Syy[TK_LANES] = { 0 },
+		Sxy[TK_LANES] = { 0 };
+int		i = 0;
+
+	for ( ; i+TK_LANES<=N; i+=TK_LANES )
+		for ( int k=0; k<TK_LANES; k++ ) {
+			T	dx = X[i+k]-mx,
+				dy = Y[i+k]-my;
+			Sxx[k] += (double)(dx*dx);
+			Syy[k] += (double)(dy*dy);
+			Sxy[k] += (double)(dx*dy);
+		}
+
+	for ( ; i<N; i++ ) {
+		T	dx = X[i]-mx,
+			dy = Y[i]-my;
+		Sxx[0] += (double)(dx*dx);
+		Syy[0] += (double)(dy*dy);
+		Sxy[0] += (double)(dx*dy);
+	}
+
+const double	xx = TK_Sum( Sxx ),
+			yy = TK_Sum( Syy );
+	return (xx>ZERO && yy>ZERO) ? TK_Sum( Sxy )/sqrt( xx*yy ) : ZERO;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Mean of N samples Arr[0], Arr[Stride], ...; *pStdev (if given) receives the sample standard
+// deviation (two passes: the sum, then the squared deviations from the mean)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+inline double	TK_ArrStats(
+		const T*	Arr,
+		int		N,
+		int		Stride,
+		PDOUBLE	pStdev )
+{
+	if ( N<=0 ) { if ( pStdev ) *pStdev = ZERO; return ZERO; }
+
+const double	Mean = TK_ArrSum( Arr,N,Stride )/N;
+
+	if ( pStdev ) {
+		double	Acc[TK_LANES] = { 0 };
+		int		i = 0;
+
+		for ( ; i+TK_LANES<=N; i+=TK_LANES )
+			for ( int k=0; k<TK_LANES; k++ ) {
+				double	d = Arr[(INT64)(i+k)*Stride]-Mean;
+				Acc[k] += d*d;
+			}
+		for ( ; i<N; i++ ) {
+			double	d = Arr[(INT64)i*Stride]-Mean;
+			Acc[0] += d*d;
+		}
+		*pStdev = N>1 ? sqrt( TK_Sum( Acc )/(N-1) ) : ZERO;
+	}
+	return Mean;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Means and sample standard deviations of the K series interleaved in X[0..N-1] (series k: X[k],
+// X[k+K], ...), K <= TK_LANES: K strided TK_ArrStats() calls up to the summation order. The lanes are L,
+// a multiple of K, consecutive samples, so lane j always holds series j%K: each pass reads X once, in
+// order, in vector loads of consecutive samples, and the series are only told apart when the lanes are added up.
+// KC is K at compile time (2 and 4 fill whole vector registers), or 0 to take K at run time.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<int KC,class T>
+inline void	TK_StateStats(
+		const T*	X,
+		int		N,
+		int		K,
+		PDOUBLE	Mean,
+		PDOUBLE	Stdev )
+{
+	if ( KC ) K = KC;
+
+const int	L = K*max( 1,TK_LANES/K );
+double	Acc[TK_LANES] = { 0 },
+		M[TK_LANES];
+int		i = 0;
+
+	for ( ; i+L<=N; i+=L )
+		for ( int j=0; j<L; j++ ) Acc[j] += X[i+j];
+	for ( ; i<N; i++ ) Acc[i%L] += X[i];
+
+	for ( int k=0; k<K; k++ ) {
+		const int	n = (N-k+K-1)/K;			// samples of series k
+		double	S = ZERO;
+		for ( int j=k; j<L; j+=K ) S += Acc[j];
+		Mean[k] = n>0 ? S/n : ZERO;
+	}
+
+	for ( int j=0; j<L; j++ ) { Acc[j] = ZERO; M[j] = Mean[j%K]; }
+	for ( i=0; i+L<=N; i+=L )
+		for ( int j=0; j<L; j++ ) {
+			double	d = X[i+j]-M[j];
+			Acc[j] += d*d;
+		}
+	for ( ; i<N; i++ ) {
+		double	d = X[i]-M[i%L];
+		Acc[i%L] += d*d;
+	}
+
+	for ( int k=0; k<K; k++ ) {
+		const int	n = (N-k+K-1)/K;
+		double	S = ZERO;
+		for ( int j=k; j<L; j+=K ) S += Acc[j];
+		Stdev[k] = n>1 ? sqrt( S/(n-1) ) : ZERO;
+	}
+}
+
+
+// Stages of TK_Stats(), selected at compile time; a stage computes only its fields
+enum {
+	TK_MINMAX	= 0x01,			// Min, Max
+	TK_MEDIAN	= 0x02,			// Median (selection in a copy)
+	TK_MEAN	= 0x04,			// Mean
+	TK_STDDEV	= 0x08,			// StdDev (needs TK_MEAN)
+	TK_SHAPE	= 0x10,			// Skewness, Kurtosis (need TK_STDDEV)
+	TK_QUANTILE	= 0x20,			// P10, P25, P75, P90 (selection in the same copy)
+	TK_ALLSTATS	= 0x3F
+};
+
+
+// Need with the stages the selected ones depend on
+inline unsigned	TK_StatsClosure( unsigned Need )
+{
+	if ( Need & TK_SHAPE )	Need |= TK_STDDEV;
+	if ( Need & TK_STDDEV )	Need |= TK_MEAN;
+	return Need;
+}
+
+
+// Summary statistics of a TAC segment (the fields of VA_ROIINFO that Model 0 reports)
+struct TK_STATS {
+	double	Min,Max;
+	double	Mean;
+	double	StdDev;				// sample standard deviation
+	double	Skewness;
+	double	Kurtosis;			// excess kurtosis
+	double	Median;
+	double	P10,P25,P75,P90;		// percentiles, interpolated between order statistics
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Percentiles Q[0..NQ-1] (fractions P[], ascending) of Work[0..N-1], which is reordered in place.
+// Q = (1-f)*x(k)+f*x(k+1) over the order statistics x(0..N-1), with k = floor(h), f = h-k and
+// h = (N-1)*P, so the 50th percentile is the usual median. Each x(k) is selected (introselect) from
+// the part of Work above the previous one and x(k+1) is the minimum of the part above x(k): O(N) per
+// percentile, less as the remaining part shrinks, instead of the O(N log N) sort.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+inline void	TK_Quantiles(
+		T*			Work,
+		int			N,
+		const double*	P,
+		int			NQ,
+		double*		Q )
+{
+int		First = 0;
+
+	for ( int q=0; q<NQ; q++ ) {
+		const double	h  = (N-1)*P[q];
+		const int		Lo = min( (int)h,N-1 );
+		const double	f  = h-Lo;
+
+		if ( Lo>=First ) {
+			std::nth_element( Work+First,Work+Lo,Work+N );
+			First = Lo+1;
+		}
+		Q[q] = Work[Lo];
+		if ( f>ZERO && Lo+1<N )
+			Q[q] = (1-f)*Q[q]+f*(double)*std::min_element( Work+Lo+1,Work+N );
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Statistics of X[0..N-1] as computed by VA_VolCalcRoiInfo(), for the stages in Need (a closure, see
+// TK_StatsClosure()); the other fields are zero. Work holds N samples, reordered by the selections of
+// TK_MEDIAN and TK_QUANTILE (one copy of X serves both).
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<unsigned Need,class T>
+inline void	TK_Stats(
+		const T*	X,
+		int		N,
+		T*		Work,
+		TK_STATS*	St )
+{
+	*St = TK_STATS();
+
+	if ( Need & TK_MINMAX ) {
+		T	Lo = X[0],
+			Hi = X[0];
+		for ( int i=1; i<N; i++ ) {
+			Lo = min( Lo,X[i] );
+			Hi = max( Hi,X[i] );
+		}
+		St->Min	= Lo;
+		St->Max	= Hi;
+	}
+
+	if ( Need & TK_MEAN ) {
+		const double	Mean = TK_ArrSum( X,N,1 )/N;
+		St->Mean	= Mean;
+
+		if ( Need & TK_STDDEV ) {
+			double	M2[TK_LANES] = { 0 },
+					M3[TK_LANES] = { 0 },
+					M4[TK_LANES] = { 0 };
+			int		i = 0;
+
+			// deviations in double: the higher moments amplify any rounding of d
+			for ( ; i+TK_LANES<=N; i+=TK_LANES )
+				for ( int k=0; k<TK_LANES; k++ ) {
+					double	d = X[i+k]-Mean, d2 = d*d;
+					M2[k] += d2;
+					if ( Need & TK_SHAPE ) { M3[k] += d2*d; M4[k] += d2*d2; }
+				}
+			for ( ; i<N; i++ ) {
+				double	d = X[i]-Mean, d2 = d*d;
+				M2[0] += d2;
+				if ( Need & TK_SHAPE ) { M3[0] += d2*d; M4[0] += d2*d2; }
+			}
+
+			double	m2 = TK_Sum( M2 );
+			St->StdDev	= N>1 ? sqrt( m2/(N-1) ) : ZERO;
+
+			if ( Need & TK_SHAPE ) {
+				double	m3 = TK_Sum( M3 )/N,
+						m4 = TK_Sum( M4 )/N;
+				m2 /= N;
+				St->Skewness	= m2>ZERO ? m3/pow( m2,1.5 ) : ZERO;
+				St->Kurtosis	= m2>ZERO ? m4/(m2*m2)-3 : ZERO;
+			}
+		}
+	}
+
+	if ( Need & (TK_MEDIAN|TK_QUANTILE) ) {
+		static const double	P[] = { 0.10,0.25,0.50,0.75,0.90 };
+		double			Q[5];
+
+		std::copy( X,X+N,Work );
+		if ( Need & TK_QUANTILE ) {
+			TK_Quantiles( Work,N,P,5,Q );
+			St->P10	= Q[0];
+			St->P25	= Q[1];
+			St->Median	= Q[2];
+			St->P75	= Q[3];
+			St->P90	= Q[4];
+		}
+		else {
+			TK_Quantiles( Work,N,P+2,1,Q );
+			St->Median	= Q[0];
+		}
+		if ( !(Need & TK_MEDIAN) ) St->Median = ZERO;
+	}
+}
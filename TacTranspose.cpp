@@ -0,0 +1,188 @@
+/**
+* @file TacTranspose.cpp
+* @brief Cache-blocked frame-major to voxel-major TAC transpose (see @c TacTranspose.h).
+*/
+
+#include	"stdafx.h"
+#include	"TacTranspose.h"
+
+#if defined(__AVX__)
+#include	<immintrin.h>
+#define	TT_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#include	<emmintrin.h>
+#define	TT_SSE2
+#endif
+
+
+int	TT_SampleBytes( int Type )
+{
+	switch ( Type ) {
+	case TT_FLOAT32:	return sizeof(float);
+	case TT_INT16:
+	case TT_UINT16:	return sizeof(short);
+	}
+	return sizeof(double);
+}
+
+
+#if defined(TT_AVX)
+
+// 4 consecutive samples widened to double
+static inline __m256d	TT_Load4( const double* p )	{ return _mm256_loadu_pd( p ); }
+static inline __m256d	TT_Load4( const float* p )	{ return _mm256_cvtps_pd( _mm_loadu_ps( p )); }
+static inline __m256d	TT_Load4( const int16_t* p )	{ return _mm256_cvtepi32_pd( _mm_cvtepi16_epi32( _mm_loadl_epi64( (const __m128i*)p ))); }
+static inline __m256d	TT_Load4( const uint16_t* p )	{ return _mm256_cvtepi32_pd( _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)p ))); }
+
+static inline void	TT_Store4(
+		PDOUBLE	p,
+		__m256d	x,
+		bool		Stream )
+{
+	if ( Stream && !((size_t)p & 31) )	_mm256_stream_pd( p,x );
+	else						_mm256_storeu_pd( p,x );
+}
+
+#elif defined(TT_SSE2)
+
+// 2 consecutive samples widened to double
+static inline __m128d	TT_Load2( const double* p )	{ return _mm_loadu_pd( p ); }
+static inline __m128d	TT_Load2( const float* p )	{ return _mm_cvtps_pd( _mm_castsi128_ps( _mm_loadl_epi64( (const __m128i*)p ))); }
+template<class T>
+static inline __m128d	TT_Load2( const T* p )		{ return _mm_set_pd( p[1],p[0] ); }
+
+static inline void	TT_Store2(
+		PDOUBLE	p,
+		__m128d	x,
+		bool		Stream )
+{
+	if ( Stream && !((size_t)p & 15) )	_mm_stream_pd( p,x );
+	else						_mm_storeu_pd( p,x );
+}
+
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// 4 frames x 4 voxels: F[k][j] -> D[j*NumT+k]
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+static inline void	TT_Kernel4x4(
+		const T*	F0,
+		const T*	F1,
+		const T*	F2,
+		const T*	F3,
+		PDOUBLE	D,
+		int		NumT,
+		bool		Stream )
+{
+#if defined(TT_AVX)
+__m256d	r0 = TT_Load4( F0 ),
+		r1 = TT_Load4( F1 ),
+		r2 = TT_Load4( F2 ),
+		r3 = TT_Load4( F3 );
+__m256d	t0 = _mm256_unpacklo_pd( r0,r1 ),		// F0[0] F1[0] F0[2] F1[2]
+		t1 = _mm256_unpackhi_pd( r0,r1 ),		// F0[1] F1[1] F0[3] F1[3]
+		t2 = _mm256_unpacklo_pd( r2,r3 ),
+		t3 = _mm256_unpackhi_pd( r2,r3 );
+
+	TT_Store4( D,		_mm256_permute2f128_pd( t0,t2,0x20 ),Stream );
+	TT_Store4( D+NumT,	_mm256_permute2f128_pd( t1,t3,0x20 ),Stream );
+	TT_Store4( D+2*NumT,	_mm256_permute2f128_pd( t0,t2,0x31 ),Stream );
+	TT_Store4( D+3*NumT,	_mm256_permute2f128_pd( t1,t3,0x31 ),Stream );
+
+#elif defined(TT_SSE2)
+	for ( int j=0; j<4; j+=2 ) {
+		__m128d	a = TT_Load2( F0+j ),
+				b = TT_Load2( F1+j ),
+				c = TT_Load2( F2+j ),
+				d = TT_Load2( F3+j );
+
+		TT_Store2( D+j*NumT,		_mm_unpacklo_pd( a,b ),Stream );
+		TT_Store2( D+j*NumT+2,		_mm_unpacklo_pd( c,d ),Stream );
+		TT_Store2( D+(j+1)*NumT,	_mm_unpackhi_pd( a,b ),Stream );
+		TT_Store2( D+(j+1)*NumT+2,	_mm_unpackhi_pd( c,d ),Stream );
+	}
+
+#else
+	for ( int j=0; j<4; j++ ) {
+		PDOUBLE	p = D+j*NumT;
+		p[0] = F0[j]; p[1] = F1[j]; p[2] = F2[j]; p[3] = F3[j];
+	}
+#endif
+}
+
+
+template<class T>
+static void	TT_FrameToVoxelT(
+		const PVOID*	Frame,
+		INT64			V0,
+		int			N,
+		int			NumT,
+		PDOUBLE		Sig,
+		bool			Stream )
+{
+	for ( int vb=0; vb<N; vb+=TT_VBLOCK ) {
+		const int	nv = min( (int)TT_VBLOCK,N-vb );
+		PDOUBLE	D  = Sig+(INT64)vb*NumT;
+
+		int	t = 0;
+		for ( ; t+4<=NumT; t+=4 ) {
+			const T	*F0 = (const T*)Frame[t]+V0+vb,
+					*F1 = (const T*)Frame[t+1]+V0+vb,
+					*F2 = (const T*)Frame[t+2]+V0+vb,
+					*F3 = (const T*)Frame[t+3]+V0+vb;
+
+			int	v = 0;
+			for ( ; v+4<=nv; v+=4 )
+				TT_Kernel4x4<T>( F0+v,F1+v,F2+v,F3+v,D+(INT64)v*NumT+t,NumT,Stream );
+
+			for ( ; v<nv; v++ ) {
+				PDOUBLE	p = D+(INT64)v*NumT+t;
+				p[0] = F0[v]; p[1] = F1[v]; p[2] = F2[v]; p[3] = F3[v];
+			}
+		}
+
+		for ( ; t<NumT; t++ ) {
+			const T*	F = (const T*)Frame[t]+V0+vb;
+			for ( int v=0; v<nv; v++ )
+				D[(INT64)v*NumT+t] = F[v];
+		}
+	}
+
+#if defined(TT_AVX) || defined(TT_SSE2)
+	if ( Stream ) _mm_sfence();
+#endif
+}
+
+
+/**
+* @brief Gather @p N voxel TACs starting at voxel @p V0 into a voxel-major block.
+*
+* @param[in]  Frame   @p NumT frame pointers (frame-major input) of samples of @p Type.
+* @param[in]  Type    Sample type (@c TT_SAMPLE); samples are widened to double.
+* @param[in]  V0      First voxel index.
+* @param[in]  N       Number of voxels.
+* @param[in]  NumT    Samples per TAC.
+* @param[out] Sig     @p N x @p NumT block: Sig[v*NumT+t] = Frame[t][V0+v].
+* @param[in]  Stream  Use non-temporal stores where the destination is aligned.
+*/
+
+void	TT_FrameToVoxel(
+		const PVOID*	Frame,
+		int			Type,
+		INT64			V0,
+		int			N,
+		int			NumT,
+		PDOUBLE		Sig,
+		bool			Stream )
+{
+	switch ( Type ) {
+	case TT_FLOAT32:	TT_FrameToVoxelT<float   >( Frame,V0,N,NumT,Sig,Stream );	break;
+	case TT_INT16:	TT_FrameToVoxelT<int16_t >( Frame,V0,N,NumT,Sig,Stream );	break;
+	case TT_UINT16:	TT_FrameToVoxelT<uint16_t>( Frame,V0,N,NumT,Sig,Stream );	break;
+	default:		TT_FrameToVoxelT<double  >( Frame,V0,N,NumT,Sig,Stream );	break;
+	}
+}
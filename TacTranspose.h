@@ -0,0 +1,50 @@
+/**
+* @file TacTranspose.h
+* @brief Cache-blocked frame-major to voxel-major TAC transpose.
+*
+* @details
+* Scanner data is frame-major (@c Frame[t][v]); the models want one
+* contiguous TAC per voxel (@c Sig[v*NumTms+t]). A naive gather walks
+* @c NumTms separate volumes per voxel and misses the cache and the TLB on
+* every sample. @c TT_FrameToVoxel() instead moves a block of
+* @c TT_VBLOCK voxels at a time: for each group of 4 frames it reads 4
+* contiguous runs and writes 4x4 tiles transposed in registers (AVX when
+* compiled with it, SSE2 otherwise, scalar as a fallback), so each frame
+* page is touched once per block and the destination block stays in L2.
+*
+* The input may stay in its native sample type (@c TT_SAMPLE): samples are
+* widened to double in the transpose kernel, so only the cache-resident tile
+* is ever double and the 4D data keeps its 2 or 4 bytes per sample.
+*
+* Optional non-temporal stores (@c Stream) bypass the cache for the
+* destination; they pay off only when the block is not read back right away
+* (e.g. the tile is larger than the last-level cache).
+*/
+
+#pragma once
+
+
+enum {
+	TT_VBLOCK	= 256				// voxels per cache block
+};
+
+
+// Sample type of frame-major input
+enum TT_SAMPLE {
+	TT_FLOAT64	= 0,
+	TT_FLOAT32,
+	TT_INT16,
+	TT_UINT16
+};
+
+
+int	TT_SampleBytes( int Type );
+
+void	TT_FrameToVoxel(
+		const PVOID*	Frame,
+		int			Type,
+		INT64			V0,
+		int			N,
+		int			NumT,
+		PDOUBLE		Sig,
+		bool			Stream );
@@ -0,0 +1,199 @@
+/**
+* @file WindowTable.cpp
+* @brief Building the per-voxel prefix tables of @c WindowTable.h.
+*
+* @details
+* Voxels are processed in blocks of @c WT_BLOCK: the running sums of a block
+* live in a small array and each frame boundary writes one contiguous run of
+* every table plane, so the frame-major table is filled sequentially while
+* the voxel-major TACs of the block stay in cache.
+*/
+
+#include	"stdafx.h"
+#include	"WindowTable.h"
+
+#include	<algorithm>
+#include	<atomic>
+#include	<thread>
+#include	<vector>
+
+
+enum {
+	WT_BLOCK	= 64				// voxels whose running sums are kept together
+};
+
+
+void	WT_Init( PWT_TABLE T )
+{
+	T->NumVox	= 0;
+	T->NumT	= 0;
+	T->Parts	= 0;
+	T->Shift	= T->Pow = T->Auc = T->MinSig = NULL;
+}
+
+
+// Table bytes for NumVox voxels of NumTms frames
+INT64	WT_Bytes(
+		INT64		NumVox,
+		unsigned	Parts )
+{
+INT64	PerVox = 1;						// raw TAC minimum
+
+	if ( Parts & WT_MOMENTS )	PerVox += 1+(INT64)(NumTms+1)*WT_NUMPOW;
+	if ( Parts & WT_AUC )	PerVox += NumTms;
+	return PerVox*NumVox*(INT64)sizeof(double);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Allocate the Parts of a table of NumVox voxels of NumTms frames; false if an allocation fails
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool	WT_Create(
+		PWT_TABLE	T,
+		INT64		NumVox,
+		unsigned	Parts )
+{
+bool	res = false;
+
+	WT_Init( T );
+	T->NumVox	= NumVox;
+	T->NumT	= NumTms;
+	T->Parts	= Parts;
+
+	xz( AllocMem<double >(T->MinSig,NumVox ));
+	if ( Parts & WT_MOMENTS ) {
+		xz( AllocMem<double >(T->Shift,NumVox ));
+		xz( AllocMem<double >(T->Pow,(INT64)(NumTms+1)*NumVox*WT_NUMPOW ));
+	}
+	if ( Parts & WT_AUC ) xz( AllocMem<double >(T->Auc,(INT64)NumTms*NumVox ));
+
+	res	= true;
+func_exit:
+	if ( !res ) WT_Free( T );
+	return res;
+}
+
+
+void	WT_Free( PWT_TABLE T )
+{
+	pf_free(&T->Shift);
+	pf_free(&T->Pow);
+	pf_free(&T->Auc);
+	pf_free(&T->MinSig);
+	WT_Init( T );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Table rows of the N voxel-major concentration TACs Conc (NumT samples each), voxels V0 .. V0+N-1.
+// Disjoint voxel ranges may be added from different threads.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+void	WT_AddTacs(
+		PWT_TABLE		T,
+		const double*	Conc,
+		INT64			V0,
+		int			N )
+{
+const int	NumT = T->NumT;
+const INT64	NumVox = T->NumVox;
+
+	for ( int b=0; b<N; b+=WT_BLOCK ) {
+		const int		n   = min( N-b,(int)WT_BLOCK );
+		const double*	Tac = Conc+(INT64)b*NumT;
+		const INT64		v0  = V0+b;
+
+		if ( T->Parts & WT_MOMENTS ) {
+			double	Sum[WT_BLOCK*WT_NUMPOW] = { 0 };
+			PDOUBLE	Shift = T->Shift+v0;
+
+			for ( int i=0; i<n; i++ ) Shift[i] = TK_ArrSum( Tac+(INT64)i*NumT,NumT,1 )/NumT;
+
+			std::fill( T->Pow+v0*WT_NUMPOW,T->Pow+(v0+n)*WT_NUMPOW,ZERO );
+			for ( int t=0; t<NumT; t++ ) {
+				PDOUBLE	Row = T->Pow+((INT64)(t+1)*NumVox+v0)*WT_NUMPOW;
+
+				for ( int i=0; i<n; i++ ) {
+					double*	s = Sum+i*WT_NUMPOW;
+					double	d = Tac[(INT64)i*NumT+t]-Shift[i], d2 = d*d;
+
+					s[0] += d;
+					s[1] += d2;
+					s[2] += d2*d;
+					s[3] += d2*d2;
+					std::copy( s,s+WT_NUMPOW,Row+i*WT_NUMPOW );
+				}
+			}
+		}
+
+		if ( T->Parts & WT_AUC ) {
+			double	Sum[WT_BLOCK] = { 0 };
+
+			std::fill( T->Auc+v0,T->Auc+v0+n,ZERO );
+			for ( int t=1; t<NumT; t++ ) {
+				PDOUBLE		Row = T->Auc+(INT64)t*NumVox+v0;
+				const double	h   = (AbsTarr[t]-AbsTarr[t-1])*0.5;
+
+				for ( int i=0; i<n; i++ ) {
+					const double*	c = Tac+(INT64)i*NumT;
+					Sum[i] += h*(c[t]+c[t-1]);
+					Row[i]  = Sum[i];
+				}
+			}
+		}
+	}
+}
+
+
+/**
+* @brief Build the window table of a converted study.
+*
+* @param[out] T        Table, created here (release with @c WT_Free()).
+* @param[in]  Conc     Voxel-major concentration TACs of the study,
+*                      @c Conc[v*NumTms+t] (e.g. @c PM_INPUT::Conc after a
+*                      pass that filled it).
+* @param[in]  MinSig   Minimum of the raw TAC of every voxel, kept for the
+*                      background classification; may be @c NULL (then no
+*                      voxel is background).
+* @param[in]  NumVox   Voxels of the study.
+* @param[in]  Parts    @c WT_MOMENTS and/or @c WT_AUC.
+* @param[in]  NumThreads Threads sharing the voxels.
+*
+* @return bool @c false if the table cannot be allocated.
+*
+* @pre  @c NumTms and @c AbsTarr describe the study.
+*
+* @complexity O(NumVox*NumTms) once; every later window is O(NumVox).
+*/
+
+bool	WT_Build(
+		PWT_TABLE		T,
+		const double*	Conc,
+		const double*	MinSig,
+		INT64			NumVox,
+		unsigned		Parts,
+		int			NumThreads )
+{
+const INT64			Chunk = 1024;
+std::atomic<INT64>	Next( 0 );
+std::vector<std::thread>	Workers;
+
+	if ( !WT_Create( T,NumVox,Parts )) return false;
+
+	if ( MinSig )	std::copy( MinSig,MinSig+NumVox,T->MinSig );
+	else		std::fill( T->MinSig,T->MinSig+NumVox,HUGE_VAL );
+
+	auto	Work = [&]() {
+		for ( INT64 v; (v = Next.fetch_add( Chunk ))<NumVox; )
+			WT_AddTacs( T,Conc+v*NumTms,v,(int)min( Chunk,NumVox-v ));
+	};
+
+	for ( int w=1; w<NumThreads; w++ ) Workers.emplace_back( Work );
+	Work();
+	for ( auto& W : Workers ) W.join();
+
+	return true;
+}
@@ -0,0 +1,167 @@
+/**
+* @file WindowTable.h
+* @brief Per-voxel prefix tables answering "Start Index"/"Length" windows in constant time.
+*
+* @details
+* Models 0 and 1 evaluate a window [Start, End] of the TAC chosen by their
+* free parameters. When the window is changed interactively, recomputing the
+* maps from the TACs costs O(N) per voxel for every change. A @c WT_TABLE
+* built once from the converted study holds, for every voxel and every frame
+* boundary t = 0..NumT:
+*   - @c WT_MOMENTS: the prefix sums of d, d^2, d^3 and d^4 over frames
+*     [0, t), with d = c - @c Shift[v] (the mean of the whole TAC, so that
+*     the central moments of a window do not cancel catastrophically);
+*   - @c WT_AUC: the trapezoid integral of c over @c AbsTarr[0..t]
+*     (t < NumT), which is additive over frames.
+* Any window is then the difference of two table rows: @c WT_Stats() gives
+* the mean, standard deviation, skewness and kurtosis of Model 0 and
+* @c WT_Integral() the AUC of Model 1, in O(1) per voxel. Order statistics
+* (max, spread, median) cannot be answered from sums and still need the TACs.
+*
+* The table is frame-major with the powers of a voxel side by side
+* (@c Pow[((INT64)t*NumVox+v)*WT_NUMPOW+k]), so a window query over a run of
+* voxels reads two contiguous streams of the table.
+*
+* A model answers windows through @c MODEL_ENTRY::FuncWindow, called with a
+* block whose @c Signal is @c NULL: it stores the outputs of the window of its
+* initialized state for the table rows @c B->V0 .. @c B->V0+B->NumVox-1.
+*
+* A window of L frames sliding over the whole TAC (a moving mean or standard
+* deviation for drift and stability checks) does not need the table: the
+* power sums of the next window are those of the current one plus the
+* frame entering it and minus the frame leaving it, O(1) per step.
+* @c MODEL_ENTRY::FuncMoving does this along each TAC of a block, and
+* @c WT_SumStats() turns the sums into statistics in both cases.
+*
+* Memory: 4*(NumT+1) doubles per voxel for @c WT_MOMENTS and NumT for
+* @c WT_AUC, on top of one double (the shift) and one raw TAC minimum.
+* Window results agree with the TAC kernels to rounding of the prefix
+* differences.
+*/
+
+#pragma once
+
+#include	"ModelBatch.h"
+#include	"TacKernels.h"
+
+
+enum {
+	WT_MOMENTS	= 0x01,			// prefix power sums (Model 0 moments)
+	WT_AUC	= 0x02,			// cumulative trapezoid integral (Model 1)
+	WT_NUMPOW	= 4				// powers of d in WT_MOMENTS
+};
+
+
+struct WT_TABLE {
+	INT64		NumVox;
+	int		NumT;				// frames of the TACs the table was built from
+	unsigned	Parts;			// WT_MOMENTS | WT_AUC
+	PDOUBLE	Shift;			// Shift[v]: mean of the TAC of voxel v (WT_MOMENTS)
+	PDOUBLE	Pow;				// Pow[(t*NumVox+v)*WT_NUMPOW+k]: sum of d^(k+1) over frames [0,t), t <= NumT
+	PDOUBLE	Auc;				// Auc[t*NumVox+v]: integral of the TAC over AbsTarr[0..t], t < NumT
+	PDOUBLE	MinSig;			// minimum of the raw TAC of every voxel (background classification)
+};
+
+typedef WT_TABLE*	PWT_TABLE;
+
+typedef bool	(*PMODELFUNCWINDOW)( PVOID ModelState,const WT_TABLE* T,PMODEL_BATCH B );
+typedef bool	(*PMODELFUNCMOVING)( PVOID ModelState,int L,PMODEL_BATCH B );
+
+
+void	WT_Init( PWT_TABLE T );
+
+bool	WT_Create(
+		PWT_TABLE	T,
+		INT64		NumVox,
+		unsigned	Parts );
+
+void	WT_Free( PWT_TABLE T );
+
+void	WT_AddTacs(
+		PWT_TABLE		T,
+		const double*	Conc,
+		INT64			V0,
+		int			N );
+
+bool	WT_Build(
+		PWT_TABLE		T,
+		const double*	Conc,
+		const double*	MinSig,
+		INT64			NumVox,
+		unsigned		Parts,
+		int			NumThreads );
+
+INT64	WT_Bytes(
+		INT64		NumVox,
+		unsigned	Parts );
+
+
+// Integral of the TAC of voxel v over AbsTarr[Start..End]
+inline double	WT_Integral(
+		const WT_TABLE*	T,
+		INT64			v,
+		int			Start,
+		int			End )
+{
+	return T->Auc[(INT64)End*T->NumVox+v]-T->Auc[(INT64)Start*T->NumVox+v];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Mean, StdDev, Skewness and Kurtosis (as TK_Stats() defines them) of N samples x from the sums S[k]
+// of d^(k+1), d = x-Shift, for the stages in Need (TK_MEAN, TK_STDDEV, TK_SHAPE; a closure); the
+// other fields are zero
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+inline void	WT_SumStats(
+		double		Shift,
+		int			N,
+		const double*	S,
+		unsigned		Need,
+		TK_STATS*		St )
+{
+const double	S1 = S[0],
+			S2 = S[1],
+			m  = S1/N;						// window mean of d
+
+	*St = TK_STATS();
+	if ( !(Need & TK_MEAN) ) return;
+
+	St->Mean = Shift+m;
+	if ( !(Need & TK_STDDEV) ) return;
+
+	// central sums of the window from the raw sums of d
+const double	C2 = max( S2-m*S1,ZERO );
+
+	St->StdDev = N>1 ? sqrt( C2/(N-1) ) : ZERO;
+	if ( !(Need & TK_SHAPE) ) return;
+
+const double	S3 = S[2],
+			S4 = S[3],
+			m2 = m*m,
+			C3 = S3-3*m*S2+2*m2*S1,
+			C4 = S4-4*m*S3+6*m2*S2-3*m2*m*S1,
+			M2 = C2/N;
+
+	St->Skewness	= M2>ZERO ? (C3/N)/(M2*sqrt( M2 )) : ZERO;
+	St->Kurtosis	= M2>ZERO ? (C4/N)/(M2*M2)-3 : ZERO;
+}
+
+
+// WT_SumStats() of frames [Start, End] of voxel v
+inline void	WT_Stats(
+		const WT_TABLE*	T,
+		INT64			v,
+		int			Start,
+		int			End,
+		unsigned		Need,
+		TK_STATS*		St )
+{
+const double*	P0 = T->Pow+((INT64)Start*T->NumVox+v)*WT_NUMPOW;
+const double*	P1 = T->Pow+((INT64)(End+1)*T->NumVox+v)*WT_NUMPOW;
+double		S[WT_NUMPOW] = { ZERO };
+
+	for ( int k=0; k<WT_NUMPOW; k++ ) S[k] = P1[k]-P0[k];
+	WT_SumStats( T->Shift[v],End-Start+1,S,Need,St );
+}
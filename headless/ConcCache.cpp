@@ -0,0 +1,220 @@
+/**
+* @file ConcCache.cpp
+* @brief Memory-mapped concentration cache (see @c ConcCache.h), POSIX file mapping.
+*/
+
+#include	"stdafx.h"
+#include	"ConcCache.h"
+
+#include	<stdio.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
+
+
+static const char	CC_Magic[8] = "FVCONC1";
+
+
+static inline uint64_t	CC_Mix( uint64_t h,uint64_t w )
+{
+	h ^= w*0x9E3779B97F4A7C15ull;
+	h  = (h<<31 | h>>33)*0xBF58476D1CE4E5B9ull;
+	return h;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Hash h continued over Bytes bytes of Data: four independent lanes of 8-byte words, so a frame
+// hashes at memory speed; successive calls chain (h of the previous frame in, next frame's out)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t	CC_Hash(
+		uint64_t		h,
+		const void*		Data,
+		INT64			Bytes )
+{
+const unsigned char*	p = (const unsigned char*)Data;
+const INT64		n = Bytes/32;
+uint64_t		L[4] = { h,h+1,h+2,h+3 };
+
+	for ( INT64 i=0; i<n; i++, p+=32 )
+		for ( int k=0; k<4; k++ ) {
+			uint64_t	w;
+			memcpy( &w,p+8*k,8 );
+			L[k] = CC_Mix( L[k],w );
+		}
+
+	for ( INT64 i=n*32; i<Bytes; i++, p++ ) L[0] = CC_Mix( L[0],*p );
+
+	for ( int k=1; k<4; k++ ) L[0] = CC_Mix( L[0],L[k] );
+	return CC_Mix( L[0],(uint64_t)Bytes );
+}
+
+
+// Key of the study hashed to Hash, with the current conversion settings
+void	CC_MakeKey(
+		CC_HEADER*	Key,
+		uint64_t	Hash,
+		int		Nx,
+		int		Ny,
+		int		Nz,
+		int		Nt )
+{
+	memset( Key,0,sizeof(*Key) );
+	memcpy( Key->Magic,CC_Magic,sizeof(Key->Magic) );
+
+	Key->Hash		= Hash;
+	Key->Nx		= Nx;
+	Key->Ny		= Ny;
+	Key->Nz		= Nz;
+	Key->Nt		= Nt;
+	Key->ConcType	= ConcConv.Type;
+
+	// the baseline as funcSigToConc() applies it
+	funcSigToConcBase( Nt,&Key->BaseStart,&Key->BaseEnd );
+	Key->TE		= ConcConv.Type==CONCTYPE_DR2 ? ConcConv.TE : ZERO;
+}
+
+
+static INT64	CC_FileBytes( const CC_HEADER* Key )
+{
+const INT64	NumVox = (INT64)Key->Nx*Key->Ny*Key->Nz;
+
+	return CC_DATAOFFS+NumVox*(Key->Nt+1)*(INT64)sizeof(double);
+}
+
+
+// <Dir>/conc_<hash of the key>.fvc
+static std::string	CC_FileName(
+		const char*		Dir,
+		const CC_HEADER*	Key )
+{
+char	Name[40];
+
+	snprintf( Name,sizeof(Name),"conc_%016llx.fvc",(unsigned long long)CC_Hash( 0,Key,sizeof(*Key) ));
+	return std::string( Dir )+"/"+Name;
+}
+
+
+static bool	CC_Map(
+		PCC_FILE		C,
+		const CC_HEADER*	Key,
+		int			Prot )
+{
+	C->Map = mmap( NULL,(size_t)C->Bytes,Prot,MAP_SHARED,C->fd,0 );
+	if ( C->Map==MAP_FAILED ) { C->Map = NULL; return false; }
+
+	C->MinSig	= (PDOUBLE)((char*)C->Map+CC_DATAOFFS);
+	C->Conc	= C->MinSig+(INT64)Key->Nx*Key->Ny*Key->Nz;
+	return true;
+}
+
+
+void	CC_Init( PCC_FILE C )
+{
+	C->fd		= -1;
+	C->Map	= NULL;
+	C->Bytes	= 0;
+	C->MinSig	= NULL;
+	C->Conc	= NULL;
+	C->Ready	= false;
+	C->Path.clear();
+	C->TmpPath.clear();
+}
+
+
+/**
+* @brief Map the cache of @p Key from @p Dir, read-only.
+*
+* @return bool @c false if there is none, or the file does not hold exactly
+*              that key and size (a different study with a colliding name).
+*/
+
+bool	CC_Open(
+		const char*		Dir,
+		const CC_HEADER*	Key,
+		PCC_FILE		C )
+{
+struct stat	St;
+
+	CC_Init( C );
+	C->Path	= CC_FileName( Dir,Key );
+	C->Bytes	= CC_FileBytes( Key );
+
+	if ( (C->fd = open( C->Path.c_str(),O_RDONLY ))<0 ) return false;
+
+	if ( fstat( C->fd,&St )!=0 || St.st_size!=C->Bytes || !CC_Map( C,Key,PROT_READ ) ||
+	     memcmp( C->Map,Key,sizeof(*Key) )!=0 ) {
+		CC_Close( C );
+		return false;
+	}
+
+	C->Ready	= true;
+	return true;
+}
+
+
+/**
+* @brief Create and map (read/write) a cache file for @p Key in @p Dir, to be
+*        filled by a map pass and then published with @c CC_Commit().
+*
+* @return bool @c false if the file cannot be created or sized.
+*/
+
+bool	CC_Create(
+		const char*		Dir,
+		const CC_HEADER*	Key,
+		PCC_FILE		C )
+{
+bool	res	= false;
+
+	CC_Init( C );
+	C->Path	= CC_FileName( Dir,Key );
+	C->TmpPath	= C->Path+"."+std::to_string( (long long)getpid() )+".tmp";
+	C->Bytes	= CC_FileBytes( Key );
+
+	if ( (C->fd = open( C->TmpPath.c_str(),O_RDWR|O_CREAT|O_TRUNC,0644 ))<0 )	xmsg( "Cannot create the concentration cache" );
+	if ( ftruncate( C->fd,C->Bytes )!=0 )						xmsg( "Cannot size the concentration cache" );
+	if ( pwrite( C->fd,Key,sizeof(*Key),0 )!=(ssize_t)sizeof(*Key) )		xmsg( "Cannot write the concentration cache" );
+	if ( !CC_Map( C,Key,PROT_READ|PROT_WRITE ))						xmsg( "Cannot map the concentration cache" );
+
+	res	= true;
+func_exit:
+	if ( !res ) CC_Close( C );
+	return res;
+}
+
+
+// Flush a filled cache and move it into place; false (and the file removed) if that fails
+bool	CC_Commit( PCC_FILE C )
+{
+	if ( C->Ready ) return true;
+	if ( C->TmpPath.empty() || !C->Map ) return false;
+
+	if ( msync( C->Map,(size_t)C->Bytes,MS_SYNC )!=0 || rename( C->TmpPath.c_str(),C->Path.c_str() )!=0 ) {
+		CC_Close( C );
+		return false;
+	}
+
+	C->TmpPath.clear();
+	C->Ready	= true;
+	return true;
+}
+
+
+// Unmap; a cache that was created but not committed is deleted
+void	CC_Close( PCC_FILE C )
+{
+	if ( C->Map ) munmap( C->Map,(size_t)C->Bytes );
+	if ( C->fd>=0 ) close( C->fd );
+	if ( !C->TmpPath.empty() ) unlink( C->TmpPath.c_str() );
+
+	C->fd		= -1;
+	C->Map	= NULL;
+	C->MinSig	= NULL;
+	C->Conc	= NULL;
+	C->Ready	= false;
+	C->TmpPath.clear();
+}
@@ -0,0 +1,71 @@
+/**
+* @file ConcCache.h
+* @brief Persistent, memory-mapped cache of the concentration volume of a study.
+*
+* @details
+* Converting a study to concentration (@c funcSigToConc()) is the same work
+* for every run of every model as long as the data and the conversion
+* settings do not change, e.g. while sweeping free parameters. The cache
+* keeps the converted study in a file, voxel-major and in double, with the
+* minimum of every raw TAC for the background classification:
+* @code
+*   [ CC_HEADER, padded to CC_DATAOFFS ][ MinSig[NumVox] ][ Conc[NumVox*Nt] ]
+* @endcode
+* The file is mapped, so the map driver hands its TACs to the models in
+* place (@c PM_INPUT::Conc) and the OS pages them in on demand.
+*
+* A cache is identified by its key (@c CC_HEADER): a hash of the study's
+* samples (@c CC_Hash(), over the frames as read, i.e. after the NIfTI
+* scaling), the grid, the conversion type, the baseline frames as
+* @c funcSigToConc() clamps them, and the echo time for @c CONCTYPE_DR2. The
+* file name is derived from the key, so any run over the same data and
+* settings finds it, whatever the path of the study.
+*
+* @c CC_Create() maps a new file under a temporary name, for a map pass to
+* fill (@c PM_INPUT::ConcReady false); @c CC_Commit() flushes it and renames
+* it into place, so a cache that exists is always complete.
+*/
+
+#pragma once
+
+#include	<stdint.h>
+#include	<string>
+
+
+enum {
+	CC_DATAOFFS	= 4096				// MinSig starts one page into the file
+};
+
+
+// Key of a cache, stored at the start of the file
+struct CC_HEADER {
+	char		Magic[8];				// "FVCONC1"
+	uint64_t	Hash;					// of the study samples
+	int		Nx,Ny,Nz,Nt;
+	int		ConcType;				// CONCTYPE_*
+	int		BaseStart,BaseEnd;		// baseline frames as applied
+	double	TE;					// CONCTYPE_DR2 only, else 0
+};
+
+
+struct CC_FILE {
+	int		fd;
+	void*		Map;
+	INT64		Bytes;
+	PDOUBLE	MinSig;				// NumVox minima of the raw TACs
+	PDOUBLE	Conc;					// NumVox*Nt concentration samples, voxel-major
+	bool		Ready;				// holds a complete volume (opened, or committed)
+	std::string	Path,TmpPath;			// TmpPath: being filled
+};
+
+typedef CC_FILE*	PCC_FILE;
+
+
+uint64_t	CC_Hash( uint64_t h,const void* Data,INT64 Bytes );
+void		CC_MakeKey( CC_HEADER* Key,uint64_t Hash,int Nx,int Ny,int Nz,int Nt );
+
+void		CC_Init( PCC_FILE C );
+bool		CC_Open( const char* Dir,const CC_HEADER* Key,PCC_FILE C );
+bool		CC_Create( const char* Dir,const CC_HEADER* Key,PCC_FILE C );
+bool		CC_Commit( PCC_FILE C );
+void		CC_Close( PCC_FILE C );
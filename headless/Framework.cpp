@@ -0,0 +1,542 @@
+/**
+* @file Framework.cpp
+* @brief Headless implementations of the framework utilities used by the models.
+*
+* @details
+* Plain reference versions of the DEMP routines declared in @c stdafx.h.
+* Conventions follow the model sources: TACs are in time order, time arrays
+* are in seconds, integrals are piecewise linear (trapezoid) over the given
+* time base, and functions that allocate return memory the caller releases
+* with @c pf_free().
+*/
+
+#include	"stdafx.h"
+
+#include	<stdio.h>
+#include	<algorithm>
+#include	<mutex>
+
+
+int		NumTms		= 0;
+PDOUBLE	AbsTarr		= NULL;
+BOOL		ParmReq[MAX_PARMREQ];
+double	demp_NoiseLevel	= 0;
+PDOUBLE	GlobalTac		= NULL;
+PDOUBLE*	RoiTacArr		= NULL;
+int		NumRoiTac		= 0;
+
+PR_CONCCONV	ConcConv	= { CONCTYPE_NOCONV,0,0,ONE };
+
+const char	msgIncorrectIfunc[]		= "Input function length does not match the number of frames";
+const char	msgSpecifyL1orL2metric[]	= "Specify L-norm 1 or 2";
+const char	msgInvalidTimeIndex[]		= "Invalid time index";
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Report an error (serialized: models may fail on several worker threads at once)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+void	PR_ErrorMsg( const char* Msg )
+{
+static std::mutex	Lock;
+std::lock_guard<std::mutex>	Guard( Lock );
+
+	fprintf( stderr,"error: %s\n",Msg );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Baseline frames [*pB0,*pB1] of funcSigToConc() for TACs of N samples: [ConcConv.BaseStart,
+// ConcConv.BaseEnd] clamped to the TAC; the baseline S0 of a TAC is the mean of these frames
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+void	funcSigToConcBase(
+		int	N,
+		int*	pB0,
+		int*	pB1 )
+{
+	*pB0 = min( max( ConcConv.BaseStart,0 ),N-1 );
+	*pB1 = min( max( ConcConv.BaseEnd,*pB0 ),N-1 );
+}
+
+
+/**
+* @brief funcSigToConc() of a TAC of baseline @p S0 as a linear map, C[t] = (S[t]-Offset)*Scale.
+*
+* Lets a model fold the conversion into a linear kernel (e.g. the
+* trapezoid weights of the Model 1 AUC) and a driver hand it raw TACs with
+* the @p Offset and @p Scale of each.
+*
+* @return bool @c false if the conversion is not linear in the signal
+*              (@c CONCTYPE_DR2); the outputs are then not set.
+*/
+
+bool	funcSigToConcLinear(
+		double	S0,
+		double*	pOffset,
+		double*	pScale )
+{
+	switch ( ConcConv.Type ) {
+	case CONCTYPE_DIFF:
+		*pOffset	= S0;
+		*pScale	= ONE;
+		return true;
+
+	case CONCTYPE_RELENH:
+		*pOffset	= S0;
+		*pScale	= S0!=ZERO ? ONE/S0 : ZERO;
+		return true;
+
+	case CONCTYPE_DR2:
+		return false;
+
+	default:
+		*pOffset	= ZERO;
+		*pScale	= ONE;
+		return true;
+	}
+}
+
+
+/**
+* @brief Convert @p NumTac consecutive TACs of @p N samples to concentration.
+*
+* The baseline @c S0 of each TAC is the mean of frames
+* [@c ConcConv.BaseStart, @c ConcConv.BaseEnd] of that TAC (see
+* @c funcSigToConcBase()). With @c CONCTYPE_NOCONV the TAC is copied.
+*
+* @param[in]  Sig        Signal TACs, @p NumTac x @p N.
+* @param[out] Conc       Concentration TACs (may not alias @p Sig).
+* @param[out] pConvBase  Receives the baseline of the last TAC (may be @c NULL).
+*/
+
+void	funcSigToConc(
+		PDOUBLE			Sig,
+		int				N,
+		PDOUBLE			Conc,
+		int				NumTac,
+		PR_CONCCONVBASE*		pConvBase )
+{
+int	B0,B1;
+
+	funcSigToConcBase( N,&B0,&B1 );
+
+	for ( int k=0; k<NumTac; k++ ) {
+		const double*	S = Sig+(INT64)k*N;
+		PDOUBLE		C = Conc+(INT64)k*N;
+
+		double	S0 = ZERO;
+		for ( int t=B0; t<=B1; t++ ) S0 += S[t];
+		S0 /= B1-B0+1;
+
+		switch ( ConcConv.Type ) {
+		case CONCTYPE_DIFF:
+			for ( int t=0; t<N; t++ ) C[t] = S[t]-S0;
+			break;
+
+		case CONCTYPE_RELENH:
+			for ( int t=0; t<N; t++ ) C[t] = S0!=ZERO ? (S[t]-S0)/S0 : ZERO;
+			break;
+
+		case CONCTYPE_DR2:
+			for ( int t=0; t<N; t++ )
+				C[t] = (S0>ZERO && S[t]>ZERO) ? -log( S[t]/S0 )/ConcConv.TE : ZERO;
+			break;
+
+		default:
+			memcpy( C,S,N*sizeof(double) );
+		}
+
+		if ( pConvBase ) pConvBase->S0 = S0;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Active segment [*pStart,*pEnd] (0-based, inclusive) from "Start Index" and "Length (0=all remaining)"
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+void	GetStartEndInx(
+		int	Start,
+		int	Length,
+		int*	pStart,
+		int*	pEnd )
+{
+	Start	= min( max( Start,0 ),NumTms-1 );
+
+	*pStart	= Start;
+	*pEnd		= Length>0 ? min( Start+Length-1,NumTms-1 ) : NumTms-1;
+}
+
+
+PDOUBLE	PR_MakeRelativeArr(
+		PDOUBLE	Arr,
+		int		N )
+{
+PDOUBLE	R = NULL;
+
+	if ( !AllocMem<double >(R,N )) return NULL;
+
+	for ( int i=0; i<N; i++ ) R[i] = Arr[i]-Arr[0];
+	return R;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Relative time array after checking that the study has at least MinNumTms increasing frame times
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+PDOUBLE	PrepareAndCheckTimeArr( int MinNumTms )
+{
+	if ( NumTms<MinNumTms ) { PR_ErrorMsg( "Too few time points" ); return NULL; }
+
+	for ( int t=1; t<NumTms; t++ )
+		if ( AbsTarr[t]<=AbsTarr[t-1] ) { PR_ErrorMsg( "Frame times are not increasing" ); return NULL; }
+
+	return PR_MakeRelativeArr( AbsTarr,NumTms );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Input function resampled (linearly, held constant outside its range) onto the time base Tarr
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+PDOUBLE	PR_PrepareInputFunc(
+		PINPUTFUNC	IF,
+		PDOUBLE	Tarr,
+		int		N )
+{
+PDOUBLE	R = NULL;
+
+	if ( !AllocMem<double >(R,N )) return NULL;
+
+	if ( !IF->Tarr ) {
+		for ( int t=0; t<N; t++ ) R[t] = IF->Val[min( t,IF->n-1 )];
+		return R;
+	}
+
+	for ( int t=0, j=0; t<N; t++ ) {
+		const double	x = Tarr[t];
+		while ( j<IF->n-2 && IF->Tarr[j+1]<x ) j++;
+
+		if		( x<=IF->Tarr[0] )		R[t] = IF->Val[0];
+		else if	( x>=IF->Tarr[IF->n-1] )	R[t] = IF->Val[IF->n-1];
+		else {
+			double	w = (x-IF->Tarr[j])/(IF->Tarr[j+1]-IF->Tarr[j]);
+			R[t] = IF->Val[j]+w*(IF->Val[j+1]-IF->Val[j]);
+		}
+	}
+	return R;
+}
+
+
+// Trapezoid integral of Y over X
+double	PR_CalculateIntegral(
+		PDOUBLE	Y,
+		PDOUBLE	X,
+		int		N )
+{
+double	S = ZERO;
+
+	for ( int i=1; i<N; i++ )
+		S += (X[i]-X[i-1])*(Y[i]+Y[i-1]);
+	return S*0.5;
+}
+
+
+double	CalculateIntegral(
+		PDOUBLE	Y,
+		PDOUBLE	X,
+		int		N )
+{
+	return PR_CalculateIntegral( Y,X,N );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Integral of |A-B| over X for piecewise-linear A, B (sign changes inside a segment are split)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+double	PR_IntegrateDiffL1_PWL(
+		PDOUBLE	A,
+		PDOUBLE	B,
+		PDOUBLE	X,
+		int		N )
+{
+double	S = ZERO;
+
+	for ( int i=1; i<N; i++ ) {
+		double	d0 = A[i-1]-B[i-1],
+				d1 = A[i]-B[i],
+				h  = X[i]-X[i-1];
+
+		if ( d0*d1>=ZERO )	S += h*fabs( d0+d1 )*0.5;
+		else				S += h*(d0*d0+d1*d1)/(fabs( d0 )+fabs( d1 ))*0.5;
+	}
+	return S;
+}
+
+
+// Integral of (A-B)^2 over X for piecewise-linear A, B
+double	PR_IntegrateDiffL2_PWL(
+		PDOUBLE	A,
+		PDOUBLE	B,
+		PDOUBLE	X,
+		int		N )
+{
+double	S = ZERO;
+
+	for ( int i=1; i<N; i++ ) {
+		double	d0 = A[i-1]-B[i-1],
+				d1 = A[i]-B[i];
+		S += (X[i]-X[i-1])*(d0*d0+d0*d1+d1*d1)/3;
+	}
+	return S;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Mean of Arr; *pStdev (if given) receives the sample standard deviation
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+double	PR_ArrStats(
+		PDOUBLE	Arr,
+		int		N,
+		PDOUBLE	pStdev )
+{
+double	Mean = ZERO,
+		M2   = ZERO;
+
+	for ( int i=0; i<N; i++ ) {
+		double	d = Arr[i]-Mean;
+		Mean	+= d/(i+1);
+		M2	+= d*(Arr[i]-Mean);
+	}
+	if ( pStdev ) *pStdev = N>1 ? sqrt( M2/(N-1) ) : ZERO;
+	return Mean;
+}
+
+
+// Pearson correlation of X and Y
+double	PR_Correlation(
+		PDOUBLE	X,
+		PDOUBLE	Y,
+		int		N )
+{
+double	Mx = ZERO,
+		My = ZERO,
+		Sxx = ZERO,
+		Syy = ZERO,
+		Sxy = ZERO;
+
+	for ( int i=0; i<N; i++ ) { Mx += X[i]; My += Y[i]; }
+	Mx /= N;
+	My /= N;
+
+	for ( int i=0; i<N; i++ ) {
+		double	dx = X[i]-Mx,
+				dy = Y[i]-My;
+		Sxx += dx*dx;
+		Syy += dy*dy;
+		Sxy += dx*dy;
+	}
+	return (Sxx>ZERO && Syy>ZERO) ? Sxy/sqrt( Sxx*Syy ) : ZERO;
+}
+
+
+void	PR_GetArrMinMax(
+		PDOUBLE	Arr,
+		int		N,
+		PDOUBLE	pMin,
+		PDOUBLE	pMax )
+{
+double	Lo = Arr[0],
+		Hi = Arr[0];
+
+	for ( int i=1; i<N; i++ ) {
+		Lo = min( Lo,Arr[i] );
+		Hi = max( Hi,Arr[i] );
+	}
+	*pMin = Lo;
+	*pMax = Hi;
+}
+
+
+// Largest value of Arr; *pInx (if given) receives its first index
+double	FindMaxVal(
+		PDOUBLE	Arr,
+		int		N,
+		INT64*	pInx )
+{
+INT64	k = 0;
+
+	for ( int i=1; i<N; i++ )
+		if ( Arr[i]>Arr[k] ) k = i;
+
+	if ( pInx ) *pInx = k;
+	return Arr[k];
+}
+
+
+double	FindMinVal(
+		PDOUBLE	Arr,
+		int		N,
+		INT64*	pInx )
+{
+INT64	k = 0;
+
+	for ( int i=1; i<N; i++ )
+		if ( Arr[i]<Arr[k] ) k = i;
+
+	if ( pInx ) *pInx = k;
+	return Arr[k];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Time at which Y first crosses Thr (upwards if Rising), interpolated on X; VOIDVOX if never
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+double	FindThresholdTime(
+		PDOUBLE	Y,
+		int		N,
+		double	Thr,
+		bool		Rising,
+		PDOUBLE	X )
+{
+	if ( N<1 ) return VOIDVOX;
+
+	if ( Rising ? Y[0]>=Thr : Y[0]<=Thr ) return X[0];
+
+	for ( int i=1; i<N; i++ ) {
+		bool	Cross = Rising ? Y[i]>=Thr : Y[i]<=Thr;
+		if ( !Cross ) continue;
+
+		double	w = (Thr-Y[i-1])/(Y[i]-Y[i-1]);
+		return X[i-1]+w*(X[i]-X[i-1]);
+	}
+	return VOIDVOX;
+}
+
+
+// Background voxel: the TAC drops below Thresh
+bool	IsAir_ByMin(
+		PDOUBLE	Tac,
+		double	Thresh )
+{
+	return FindMinVal( Tac,NumTms,NULL )<Thresh;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Volume holding a copy of Data (only 64-bit double voxels are supported)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+PFRAME	VA_CreateVol(
+		PDOUBLE	Data,
+		int		Bits,
+		DIM3D*	pDim )
+{
+PFRAME	V	= NULL;
+INT64		N	= (INT64)pDim->x*pDim->y*pDim->z;
+
+	if ( Bits!=64 ) { PR_ErrorMsg( "Unsupported voxel type" ); return NULL; }
+
+	if ( !AllocMem<FRAME >(V,1 )) return NULL;
+	V->Dim = *pDim;
+
+	if ( !AllocMem<double >(V->Data,N )) { pf_free(&V); return NULL; }
+	memcpy( V->Data,Data,N*sizeof(double) );
+
+	return V;
+}
+
+
+void	PR_FrameDelete( PFRAME* pV )
+{
+	if ( !*pV ) return;
+
+	pf_free(&(*pV)->Data);
+	pf_free(pV);
+}
+
+
+/**
+* @brief Statistics of the voxels of @p V with values in [@p Vmin, @p Vmax].
+*
+* Mean, sample standard deviation, median (mean of the two middle values for
+* an even count), skewness m3/m2^1.5 and excess kurtosis m4/m2^2-3 with
+* population central moments. The headless engine has no ROI masks, so the
+* mask, ROI number, flag and histogram arguments are ignored.
+*
+* @return bool @c false if no voxel lies in the range or memory runs out.
+*/
+
+bool	VA_VolCalcRoiInfo(
+		bool		/*UseMask*/,
+		PFRAME	V,
+		int		/*RoiNum*/,
+		PVOID		/*Mask*/,
+		int		/*Flags*/,
+		double	Vmin,
+		double	Vmax,
+		bool		UseVoid,
+		double	VoidVal,
+		int		/*NumBins*/,
+		VA_ROIINFO*	pInfo )
+{
+const INT64	N	= (INT64)V->Dim.x*V->Dim.y*V->Dim.z;
+PDOUBLE	Sel	= NULL;
+INT64		n	= 0;
+bool		res	= false;
+
+	xz( AllocMem<double >(Sel,N ));
+
+	for ( INT64 i=0; i<N; i++ ) {
+		double	x = V->Data[i];
+		if ( x<Vmin || x>Vmax )			continue;
+		if ( UseVoid && x==VoidVal )		continue;
+		Sel[n++] = x;
+	}
+	xz( n );
+
+	{
+	double	Mean = ZERO;
+	for ( INT64 i=0; i<n; i++ ) Mean += Sel[i];
+	Mean /= n;
+
+	double	M2 = ZERO, M3 = ZERO, M4 = ZERO;
+	for ( INT64 i=0; i<n; i++ ) {
+		double	d = Sel[i]-Mean, d2 = d*d;
+		M2 += d2;
+		M3 += d2*d;
+		M4 += d2*d2;
+	}
+
+	pInfo->NumVox	= n;
+	pInfo->AvgSi	= Mean;
+	pInfo->StdDev	= n>1 ? sqrt( M2/(n-1) ) : ZERO;
+	M2 /= n; M3 /= n; M4 /= n;
+	pInfo->Skewness	= M2>ZERO ? M3/pow( M2,1.5 ) : ZERO;
+	pInfo->Kurtosis	= M2>ZERO ? M4/(M2*M2)-3 : ZERO;
+
+	std::sort( Sel,Sel+n );
+	pInfo->RoiMinVox	= Sel[0];
+	pInfo->RoiMaxVox	= Sel[n-1];
+	pInfo->Median	= (n&1) ? Sel[n/2] : (Sel[n/2-1]+Sel[n/2])*0.5;
+	}
+
+	res	= true;
+func_exit:
+	pf_free(&Sel);
+	return res;
+}
@@ -0,0 +1,384 @@
+/**
+* @file Nifti.cpp
+* @brief Minimal streaming NIfTI-1 reader and writer (see @c Nifti.h).
+*/
+
+#include	"stdafx.h"
+#include	"Nifti.h"
+
+
+static int	NII_BytesPerVox( int DataType )
+{
+	switch ( DataType ) {
+	case NII_UINT8:	return 1;
+	case NII_INT16:
+	case NII_UINT16:	return 2;
+	case NII_INT32:
+	case NII_FLOAT32:	return 4;
+	case NII_FLOAT64:	return 8;
+	}
+	return 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Header of an Nx*Ny*Nz grid with 1 mm voxels and frame spacing Dt seconds (for NII_Create)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+void	NII_InitHeader(
+		NII_HEADER*	Hdr,
+		int		Nx,
+		int		Ny,
+		int		Nz,
+		double	Dt )
+{
+	memset( Hdr,0,sizeof(*Hdr) );
+
+	Hdr->sizeof_hdr	= 348;
+	Hdr->dim[1]		= (short)Nx;
+	Hdr->dim[2]		= (short)Ny;
+	Hdr->dim[3]		= (short)Nz;
+	for ( int i=0; i<8; i++ ) Hdr->pixdim[i] = 1;
+	Hdr->pixdim[4]	= (float)Dt;
+	Hdr->xyzt_units	= 2|8;				// mm, s
+	memcpy( Hdr->magic,"n+1",4 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Open a .nii file and read its header; false (with a message) if unsupported
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool	NII_Open(
+		const char*	Path,
+		PNII_FILE	F )
+{
+bool	res	= false;
+
+	memset( F,0,sizeof(*F) );
+
+	if ( !(F->f = fopen( Path,"rb" )))							xmsg( "Cannot open the input file" );
+	if ( fread( &F->Hdr,sizeof(F->Hdr),1,F->f )!=1 )				xmsg( "Cannot read the NIfTI header" );
+	if ( F->Hdr.sizeof_hdr!=348 || memcmp( F->Hdr.magic,"n+1",4 ))	xmsg( "Not a single-file NIfTI-1 image" );
+	if ( !(F->BytesPerVox = NII_BytesPerVox( F->Hdr.datatype )))		xmsg( "Unsupported NIfTI data type" );
+
+	F->Nx	= F->Hdr.dim[1];
+	F->Ny	= max( (int)F->Hdr.dim[2],1 );
+	F->Nz	= F->Hdr.dim[0]>=3 ? max( (int)F->Hdr.dim[3],1 ) : 1;
+	F->Nt	= F->Hdr.dim[0]>=4 ? max( (int)F->Hdr.dim[4],1 ) : 1;
+	F->NumVox	= (INT64)F->Nx*F->Ny*F->Nz;
+
+	F->Slope	= F->Hdr.scl_slope!=0 ? F->Hdr.scl_slope : ONE;
+	F->Inter	= F->Hdr.scl_slope!=0 ? F->Hdr.scl_inter : ZERO;
+
+	res	= true;
+func_exit:
+	if ( !res ) NII_Close( F );
+	return res;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Create a .nii file with the geometry of "Like", Nt volumes of DataType stored as value =
+// sample*Slope+Inter, and write its header
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool	NII_Create(
+		const char*		Path,
+		const NII_HEADER*	Like,
+		int			Nt,
+		int			DataType,
+		PNII_FILE		F,
+		double		Slope,
+		double		Inter )
+{
+bool	res	= false;
+char	Pad[4] = { 0,0,0,0 };
+
+	memset( F,0,sizeof(*F) );
+
+	F->Hdr			= *Like;
+	F->Hdr.dim[0]		= Nt>1 ? 4 : 3;
+	F->Hdr.dim[4]		= (short)Nt;
+	for ( int i=5; i<8; i++ ) F->Hdr.dim[i] = 1;
+	F->Hdr.datatype		= (short)DataType;
+	F->BytesPerVox		= NII_BytesPerVox( DataType );
+	F->Hdr.bitpix		= (short)(8*F->BytesPerVox);
+	F->Hdr.vox_offset		= 352;
+	F->Hdr.scl_slope		= (float)Slope;
+	F->Hdr.scl_inter		= (float)Inter;
+	F->Hdr.cal_min		= F->Hdr.cal_max = 0;
+	F->Hdr.intent_code	= 0;
+
+	F->Nx	= F->Hdr.dim[1];
+	F->Ny	= max( (int)F->Hdr.dim[2],1 );
+	F->Nz	= max( (int)F->Hdr.dim[3],1 );
+	F->Nt	= Nt;
+	F->NumVox	= (INT64)F->Nx*F->Ny*F->Nz;
+	F->Slope	= Slope;
+	F->Inter	= Inter;
+
+	if ( !(F->f = fopen( Path,"wb" )))							xmsg( "Cannot create an output file" );
+	if (	fwrite( &F->Hdr,sizeof(F->Hdr),1,F->f )!=1 ||
+		fwrite( Pad,4,1,F->f )!=1 )							xmsg( "Cannot write an output file" );
+
+	res	= true;
+func_exit:
+	if ( !res ) NII_Close( F );
+	return res;
+}
+
+
+void	NII_Close( PNII_FILE F )
+{
+	if ( F->f ) fclose( F->f );
+	F->f = NULL;
+}
+
+
+// Seconds per unit of pixdim[4]
+double	NII_FrameTimeScale( const NII_HEADER* Hdr )
+{
+	switch ( Hdr->xyzt_units & 0x38 ) {
+	case 16:	return 1e-3;			// msec
+	case 24:	return 1e-6;			// usec
+	}
+	return ONE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Convert N raw samples to double with the file's scaling
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+static void	NII_ConvertT(
+		const void*	Raw,
+		INT64		N,
+		double	Slope,
+		double	Inter,
+		PDOUBLE	Vol )
+{
+const T*	p = (const T*)Raw;
+
+	for ( INT64 i=0; i<N; i++ ) Vol[i] = p[i]*Slope+Inter;
+}
+
+
+static void	NII_Convert(
+		PNII_FILE	F,
+		const void*	Raw,
+		INT64		N,
+		PDOUBLE	Vol )
+{
+	switch ( F->Hdr.datatype ) {
+	case NII_UINT8:	NII_ConvertT<uint8_t >( Raw,N,F->Slope,F->Inter,Vol );	break;
+	case NII_INT16:	NII_ConvertT<int16_t >( Raw,N,F->Slope,F->Inter,Vol );	break;
+	case NII_UINT16:	NII_ConvertT<uint16_t>( Raw,N,F->Slope,F->Inter,Vol );	break;
+	case NII_INT32:	NII_ConvertT<int32_t >( Raw,N,F->Slope,F->Inter,Vol );	break;
+	case NII_FLOAT32:	NII_ConvertT<float   >( Raw,N,F->Slope,F->Inter,Vol );	break;
+	case NII_FLOAT64:	NII_ConvertT<double  >( Raw,N,F->Slope,F->Inter,Vol );	break;
+	}
+}
+
+
+// Raw bytes of voxels [V0,V0+N) of frame t
+static bool	NII_ReadRaw(
+		PNII_FILE	F,
+		int		t,
+		INT64		V0,
+		INT64		N,
+		char*		Raw )
+{
+const INT64	Offs = ((INT64)t*F->NumVox+V0)*F->BytesPerVox,
+		Bytes = N*F->BytesPerVox;
+
+	if ( fseeko( F->f,(off_t)F->Hdr.vox_offset+(off_t)Offs,SEEK_SET ))	return false;
+	return fread( Raw,1,(size_t)Bytes,F->f )==(size_t)Bytes;
+}
+
+
+// Read voxels [V0,V0+N) of frame t into Vol
+bool	NII_ReadVoxels(
+		PNII_FILE	F,
+		int		t,
+		INT64		V0,
+		INT64		N,
+		PDOUBLE	Vol )
+{
+char*	Raw	= NULL;
+bool	res	= false;
+
+	xz( AllocMem<char >(Raw,N*F->BytesPerVox ));
+	if ( !NII_ReadRaw( F,t,V0,N,Raw )) xmsg( "Cannot read the input volume" );
+
+	NII_Convert( F,Raw,N,Vol );
+
+	res	= true;
+func_exit:
+	pf_free(&Raw);
+	return res;
+}
+
+
+// Read the raw samples of voxels [V0,V0+N) of frame t into Raw (N*BytesPerVox bytes)
+bool	NII_ReadRawVoxels(
+		PNII_FILE	F,
+		int		t,
+		INT64		V0,
+		INT64		N,
+		PVOID		Raw )
+{
+	if ( NII_ReadRaw( F,t,V0,N,(char*)Raw )) return true;
+
+	PR_ErrorMsg( "Cannot read the input volume" );
+	return false;
+}
+
+
+// Read frame t into Vol (NumVox doubles)
+bool	NII_ReadVolume(
+		PNII_FILE	F,
+		int		t,
+		PDOUBLE	Vol )
+{
+	return NII_ReadVoxels( F,t,0,F->NumVox,Vol );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Append N voxels, converted in fixed-size chunks
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool	NII_WriteVoxels(
+		PNII_FILE		F,
+		const double*	Vol,
+		INT64			N )
+{
+enum { CHUNK = 1<<16 };
+char		Buf[CHUNK*8];
+
+	for ( INT64 i0=0; i0<N; i0+=CHUNK ) {
+		const int	n = (int)min( (INT64)CHUNK,N-i0 );
+
+		if ( F->Hdr.datatype==NII_FLOAT32 ) {
+			float*	p = (float*)Buf;
+			for ( int i=0; i<n; i++ ) p[i] = (float)Vol[i0+i];
+		}
+		else	memcpy( Buf,Vol+i0,n*sizeof(double) );
+
+		if ( fwrite( Buf,F->BytesPerVox,n,F->f )!=(size_t)n ) {
+			PR_ErrorMsg( "Cannot write an output file" );
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// Append N samples already in the file's sample type
+bool	NII_WriteRawVoxels(
+		PNII_FILE	F,
+		const void*	Raw,
+		INT64		N )
+{
+	if ( fwrite( Raw,F->BytesPerVox,(size_t)N,F->f )!=(size_t)N ) {
+		PR_ErrorMsg( "Cannot write an output file" );
+		return false;
+	}
+	return true;
+}
+
+
+// Store N samples already in the file's sample type as voxels [V0,V0+N) of frame t
+bool	NII_WriteRawVoxelsAt(
+		PNII_FILE	F,
+		int		t,
+		INT64		V0,
+		const void*	Raw,
+		INT64		N )
+{
+const INT64	Offs = ((INT64)t*F->NumVox+V0)*F->BytesPerVox;
+
+	if (	fseeko( F->f,(off_t)F->Hdr.vox_offset+(off_t)Offs,SEEK_SET ) ||
+		fwrite( Raw,F->BytesPerVox,(size_t)N,F->f )!=(size_t)N ) {
+		PR_ErrorMsg( "Cannot write an output file" );
+		return false;
+	}
+	return true;
+}
+
+
+// Append one volume (NumVox doubles)
+bool	NII_WriteVolume(
+		PNII_FILE		F,
+		const double*	Vol )
+{
+	return NII_WriteVoxels( F,Vol,F->NumVox );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Start reading frame 0 on the helper thread
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool	NII_StartReader(
+		PNII_FILE		F,
+		PNII_FRAMEREADER	R )
+{
+const INT64	Bytes = F->NumVox*F->BytesPerVox;
+
+	R->F		= F;
+	R->Next	= 0;
+	R->Raw[0]	= R->Raw[1] = NULL;
+
+	if (	!AllocMem<char >(R->Raw[0],Bytes ) ||
+		!AllocMem<char >(R->Raw[1],Bytes )) {
+		NII_StopReader( R );
+		return false;
+	}
+
+	R->Io = std::thread( [R]() { R->Ok[0] = NII_ReadRaw( R->F,0,0,R->F->NumVox,R->Raw[0] ); } );
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Wait for the next frame, start reading the one after it, and convert it into Vol;
+// the raw samples are also copied to Raw unless it is NULL
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool	NII_NextFrame(
+		PNII_FRAMEREADER	R,
+		PDOUBLE		Vol,
+		PVOID			Raw )
+{
+const int	t	= R->Next++,
+		b	= t&1;
+
+	R->Io.join();
+	if ( !R->Ok[b] ) { PR_ErrorMsg( "Cannot read the input volume" ); return false; }
+
+	if ( t+1<R->F->Nt )
+		R->Io = std::thread( [R,t]() { R->Ok[(t+1)&1] = NII_ReadRaw( R->F,t+1,0,R->F->NumVox,R->Raw[(t+1)&1] ); } );
+
+	NII_Convert( R->F,R->Raw[b],R->F->NumVox,Vol );
+	if ( Raw ) memcpy( Raw,R->Raw[b],(size_t)(R->F->NumVox*R->F->BytesPerVox) );
+	return true;
+}
+
+
+void	NII_StopReader( PNII_FRAMEREADER R )
+{
+	if ( R->Io.joinable() ) R->Io.join();
+
+	pf_free(&R->Raw[0]);
+	pf_free(&R->Raw[1]);
+}
@@ -0,0 +1,122 @@
+/**
+* @file Nifti.h
+* @brief Minimal streaming NIfTI-1 (.nii) reader and writer for the headless engine.
+*
+* @details
+* Single-file, uncompressed NIfTI-1 only. A 4D input is read one 3D frame at
+* a time: @c NII_FrameReader reads frame t+1 from disk on a helper thread
+* while the caller converts frame t to double, so I/O overlaps the
+* conversion; @c NII_ReadVoxels() reads a voxel range (e.g. a slab of
+* slices) of one frame. Outputs are written as 3D volumes, or appended a
+* slab at a time, through a fixed-size conversion buffer, never as a
+* full-size copy of the map.
+*
+* Supported sample types: uint8, int16, uint16, int32, float32, float64
+* (with @c scl_slope/@c scl_inter applied on read). @c NII_ReadRawVoxels()
+* and the @c Raw argument of @c NII_NextFrame() give the unconverted samples,
+* for callers that keep the data in its native type; @c NII_WriteRawVoxels()
+* appends samples that are already in the file's type (e.g. int16 maps, with
+* the scaling given to @c NII_Create()); @c NII_WriteRawVoxelsAt() stores
+* them at a voxel range of one frame instead, so a 4D output can be filled
+* in any order.
+*/
+
+#pragma once
+
+#include	<stdio.h>
+#include	<thread>
+
+
+enum {
+	NII_UINT8		= 2,
+	NII_INT16		= 4,
+	NII_INT32		= 8,
+	NII_FLOAT32		= 16,
+	NII_FLOAT64		= 64,
+	NII_UINT16		= 512
+};
+
+
+#pragma pack(push,1)
+struct NII_HEADER {
+	int		sizeof_hdr;
+	char		data_type[10];
+	char		db_name[18];
+	int		extents;
+	short		session_error;
+	char		regular;
+	char		dim_info;
+	short		dim[8];
+	float		intent_p1,intent_p2,intent_p3;
+	short		intent_code;
+	short		datatype;
+	short		bitpix;
+	short		slice_start;
+	float		pixdim[8];
+	float		vox_offset;
+	float		scl_slope;
+	float		scl_inter;
+	short		slice_end;
+	char		slice_code;
+	char		xyzt_units;
+	float		cal_max,cal_min;
+	float		slice_duration;
+	float		toffset;
+	int		glmax,glmin;
+	char		descrip[80];
+	char		aux_file[24];
+	short		qform_code;
+	short		sform_code;
+	float		quatern_b,quatern_c,quatern_d;
+	float		qoffset_x,qoffset_y,qoffset_z;
+	float		srow_x[4];
+	float		srow_y[4];
+	float		srow_z[4];
+	char		intent_name[16];
+	char		magic[4];
+};
+#pragma pack(pop)
+
+
+struct NII_FILE {
+	FILE*		f;
+	NII_HEADER	Hdr;
+	int		Nx,Ny,Nz,Nt;
+	INT64		NumVox;			// Nx*Ny*Nz
+	int		BytesPerVox;
+	double	Slope,Inter;		// scaling applied on read
+};
+
+typedef NII_FILE*	PNII_FILE;
+
+
+void	NII_InitHeader( NII_HEADER* Hdr,int Nx,int Ny,int Nz,double Dt );
+bool	NII_Open( const char* Path,PNII_FILE F );
+bool	NII_Create( const char* Path,const NII_HEADER* Like,int Nt,int DataType,PNII_FILE F,double Slope = ONE,double Inter = ZERO );
+void	NII_Close( PNII_FILE F );
+
+double	NII_FrameTimeScale( const NII_HEADER* Hdr );
+
+bool	NII_ReadVolume( PNII_FILE F,int t,PDOUBLE Vol );
+bool	NII_ReadVoxels( PNII_FILE F,int t,INT64 V0,INT64 N,PDOUBLE Vol );
+bool	NII_ReadRawVoxels( PNII_FILE F,int t,INT64 V0,INT64 N,PVOID Raw );
+bool	NII_WriteVolume( PNII_FILE F,const double* Vol );
+bool	NII_WriteVoxels( PNII_FILE F,const double* Vol,INT64 N );
+bool	NII_WriteRawVoxels( PNII_FILE F,const void* Raw,INT64 N );
+bool	NII_WriteRawVoxelsAt( PNII_FILE F,int t,INT64 V0,const void* Raw,INT64 N );
+
+
+// Reads frames 0..Nt-1 in order, one frame ahead on a helper thread
+struct NII_FRAMEREADER {
+	PNII_FILE	F;
+	char*		Raw[2];			// double buffer of raw frame bytes
+	int		Next;				// next frame handed out by NII_NextFrame()
+	bool		Ok[2];
+	std::thread	Io;
+};
+
+typedef NII_FRAMEREADER*	PNII_FRAMEREADER;
+
+bool	NII_StartReader( PNII_FILE F,PNII_FRAMEREADER R );
+bool	NII_NextFrame( PNII_FRAMEREADER R,PDOUBLE Vol,PVOID Raw = NULL );
+void	NII_StopReader( PNII_FRAMEREADER R );
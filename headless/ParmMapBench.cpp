@@ -0,0 +1,886 @@
+/**
+* @file ParmMapBench.cpp
+* @brief Per-model throughput benchmark on synthetic phantoms.
+*
+* @details
+* Usage:
+* @code
+*   parmbench [-m 0,1,3,4,5,6] [-s 64x64x16] [-T 30,60,120] [-t 1,2,4,0] [-r 3] [--tile N] [--nt]
+*             [--sample f64|f32|i16|u16] [--float] [--air X] [--profile] [--csv]
+*   parmbench --validate [float|frames|sweep|moving|series|states|voxel|threads] [--tol X] [-m 0,1,3,4] [-s 64x64x16] [-T 30,60,120]
+*   parmbench --phantom dce|dsc|interleaved|rise [-s NxxNyxNz] [-T N] --write phantom.nii
+* @endcode
+* For every frame count in @c -T, a phantom shaped for each model
+* (@c PH_KindForModel()) is generated in memory and the model's map is
+* computed with @c PM_CalcMap() for every thread count in @c -t (0 = all
+* hardware threads). The best of @c -r repetitions is reported as
+*   - voxels per second,
+*   - ns per voxel per frame (time / (voxels * NumTms)),
+*   - peak RSS of the run (VmHWM, reset before each run where the kernel
+*     allows it, so it includes the resident phantom).
+*
+* @c --tile and @c --nt set the tile size and non-temporal gather stores
+* (@c PM_OPTIONS) to compare gather variants.
+*
+* @c --sample keeps the phantom in memory as float64 (default), float32,
+* int16 or uint16 samples (@c PM_INPUT::Type), rounded from the generated
+* values, to measure the native input paths.
+*
+* @c --float runs the models that have one in float32 compute mode
+* (@c PM_OPTIONS::Float32). @c --air sets @c PM_OPTIONS::AirFactor, so the
+* models without their own background threshold skip the phantom's air
+* border as well. @c --profile attaches a stage profile to every run
+* (@c PM_OPTIONS::Profile), to measure the cost of the instrumentation of a
+* @c PARMMAP_PROFILE build. @c --validate instead computes every map of the
+* models with a float32 kernel both ways on the phantoms and reports, per
+* output, the largest absolute deviation of the float32 map from the double
+* map and that deviation relative to the largest |value| of the double map.
+* @c --validate @c frames compares the maps of @c PM_CalcMapsFrames() with
+* those of a full pass the same way, for the outputs the models answer frame
+* by frame; @c --validate @c sweep compares the maps of
+* @c PM_CalcMapsWindow() with full passes for a few windows, for the outputs
+* the models answer from the window table. @c --validate @c moving compares
+* the sliding windows of @c PM_CalcMapsMoving() (windows of 4 frames, and of
+* half the study) with a full pass for each window, across several re-basings
+* of the running sums. @c --validate @c series compares the AUC series of
+* Model 1 (@c MODEL_ENTRY::SeriesName), the curve at every frame and points
+* within frames, for two windows, with full passes up to each point plus
+* the trapezoid of the part frame. @c --validate @c states compares the
+* interleaved states of Model 3, K = 2, 3, 4 and 8, with @c PR_ArrStats() on
+* each state's frames copied out (for K = 2 the former odd/even kernel); a
+* frame count that K does not divide (61) leaves the first states one frame
+* more. @c --validate @c voxel compares
+* the per-voxel entry point of every model (@c MODEL_ENTRY::Func, as the
+* framework calls it) with its batch on the TACs of the phantom.
+* @c --validate @c threads runs every map with each thread count of @c -t,
+* with one slice per tile and with tiles of a few rows (or @c --tile), and
+* requires the planes to be byte-identical to a serial pass, whatever
+* @c --tol. With @c --air, or for Model 6, background voxels are skipped,
+* so the tiles cost unevenly and the workers steal from each other. With @c --tol the run fails if an
+* output deviates by more than X relative to the reference map, or is void
+* in one map only (the CTest checks of the build run these on a small
+* phantom).
+*
+* The last form writes a phantom as float32 NIfTI for use with @c parmmap.
+*/
+
+#include	"stdafx.h"
+#include	"ParmMapDriver.h"
+#include	"Phantom.h"
+#include	"Nifti.h"
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<chrono>
+#include	<memory>
+#include	<string>
+#include	<vector>
+#include	<limits>
+
+
+enum BENCH_CHECK {
+	BC_NONE	= 0,
+	BC_FLOAT,					// float32 compute mode against double
+	BC_FRAMES,					// PM_CalcMapsFrames() against a full pass
+	BC_SWEEP,					// PM_CalcMapsWindow() against full passes
+	BC_MOVING,					// PM_CalcMapsMoving() against a full pass per window
+	BC_SERIES,					// series points against full passes up to each point
+	BC_STATES,					// Model 3 states against PR_ArrStats() on each state
+	BC_VOXEL,					// MODEL_ENTRY::Func voxel by voxel against FuncBatch
+	BC_THREADS					// threaded passes against a serial one, byte for byte
+};
+
+
+struct BENCH_ARGS {
+	std::vector<int>	Models,NumTms,Threads;
+	int			Nx,Ny,Nz;
+	int			Repeats;
+	int			TileVox;
+	int			Type;				// TT_SAMPLE of the in-memory phantom
+	double		Air;				// PM_OPTIONS::AirFactor
+	bool			Csv,Stream,Float,Profile;
+	BENCH_CHECK		Validate;
+	double		Tol;				// --validate: largest relative deviation that passes; 0 = report only
+	int			Failed;			// --validate: outputs beyond Tol
+	std::string		WritePath;
+	PH_KIND		Kind;
+};
+
+
+static std::vector<int>	BENCH_ParseList( const char* s )
+{
+std::vector<int>	L;
+
+	while ( *s ) {
+		char*	e;
+		L.push_back( (int)strtol( s,&e,10 ));
+		if ( e==s ) break;
+		s = *e==',' ? e+1 : e;
+	}
+	return L;
+}
+
+
+static bool	BENCH_ParseArgs(
+		int		argc,
+		char**	argv,
+		BENCH_ARGS*	A )
+{
+	A->Models	= { 0,1,3,4,5,6 };
+	A->NumTms	= { 30,60,120 };
+	A->Threads	= { 1,2,4,0 };
+	A->Nx		= 64;
+	A->Ny		= 64;
+	A->Nz		= 16;
+	A->Repeats	= 3;
+	A->TileVox	= 0;
+	A->Type	= TT_FLOAT64;
+	A->Air	= ZERO;
+	A->Csv	= false;
+	A->Stream	= false;
+	A->Float	= false;
+	A->Validate	= BC_NONE;
+	A->Tol	= ZERO;
+	A->Failed	= 0;
+	A->Profile	= false;
+	A->Kind	= PH_DCE;
+
+	for ( int i=1; i<argc; i++ ) {
+		std::string	a = argv[i];
+		const char*	v = i+1<argc ? argv[i+1] : "";
+
+		if		( a=="--csv" )	{ A->Csv = true; continue; }
+		else if	( a=="--nt" )		{ A->Stream = true; continue; }
+		else if	( a=="--float" )	{ A->Float = true; continue; }
+		else if	( a=="--validate" ) {
+			std::string	s = v;
+			A->Validate = BC_FLOAT;
+			if		( s=="float" )	i++;
+			else if	( s=="frames" )	{ A->Validate = BC_FRAMES; i++; }
+			else if	( s=="sweep" )	{ A->Validate = BC_SWEEP; i++; }
+			else if	( s=="moving" )	{ A->Validate = BC_MOVING; i++; }
+			else if	( s=="series" )	{ A->Validate = BC_SERIES; i++; }
+			else if	( s=="states" )	{ A->Validate = BC_STATES; i++; }
+			else if	( s=="voxel" )	{ A->Validate = BC_VOXEL; i++; }
+			else if	( s=="threads" )	{ A->Validate = BC_THREADS; i++; }
+			continue;
+		}
+		else if	( a=="--profile" )	{ A->Profile = true; continue; }
+		else if	( a=="--tile" )	A->TileVox	= atoi( v );
+		else if	( a=="--air" )	A->Air	= atof( v );
+		else if	( a=="--tol" )	A->Tol	= atof( v );
+		else if	( a=="-m" )		A->Models	= BENCH_ParseList( v );
+		else if	( a=="-T" )		A->NumTms	= BENCH_ParseList( v );
+		else if	( a=="-t" )		A->Threads	= BENCH_ParseList( v );
+		else if	( a=="-r" )		A->Repeats	= max( atoi( v ),1 );
+		else if	( a=="--write" )	A->WritePath= v;
+		else if	( a=="--sample" ) {
+			std::string	s = v;
+			if		( s=="f64" )	A->Type = TT_FLOAT64;
+			else if	( s=="f32" )	A->Type = TT_FLOAT32;
+			else if	( s=="i16" )	A->Type = TT_INT16;
+			else if	( s=="u16" )	A->Type = TT_UINT16;
+			else				return false;
+		}
+		else if	( a=="--phantom" ) {
+			if ( !PH_ParseKind( v,&A->Kind )) return false;
+		}
+		else if	( a=="-s" ) {
+			if ( sscanf( v,"%dx%dx%d",&A->Nx,&A->Ny,&A->Nz )!=3 ) return false;
+		}
+		else	return false;
+		i++;
+	}
+
+	for ( int m : A->Models )
+		if ( !FindModelEntry( m )) return false;
+
+	return A->Nx>0 && A->Ny>0 && A->Nz>0 && !A->NumTms.empty();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Peak resident set size (MB) since the last BENCH_ResetPeakRss()
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void	BENCH_ResetPeakRss()
+{
+FILE*	f = fopen( "/proc/self/clear_refs","w" );
+
+	if ( f ) { fputs( "5",f ); fclose( f ); }
+}
+
+static double	BENCH_PeakRssMB()
+{
+FILE*	f = fopen( "/proc/self/status","r" );
+char	Line[256];
+long	kB = 0;
+
+	if ( !f ) return ZERO;
+
+	while ( fgets( Line,sizeof(Line),f ))
+		if ( sscanf( Line,"VmHWM: %ld kB",&kB )==1 ) break;
+	fclose( f );
+	return kB/1024.0;
+}
+
+
+// Store N generated values as samples of type T (rounded and clamped for integers); sum of the stored values
+template<class T>
+static double	BENCH_StoreFrame(
+		const double*	Vol,
+		INT64			N,
+		PVOID			Frame )
+{
+T*		p = (T*)Frame;
+double	S = ZERO;
+
+	for ( INT64 i=0; i<N; i++ ) {
+		double	x = Vol[i];
+		if ( std::numeric_limits<T>::is_integer )
+			x = floor( min( max( x,(double)std::numeric_limits<T>::min() ),(double)std::numeric_limits<T>::max() )+0.5 );
+		p[i]	= (T)x;
+		S	+= p[i];
+	}
+	return S;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Phantom of Spec in memory as samples of Type, with the study globals (NumTms, AbsTarr, GlobalTac,
+// noise) set from it
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	BENCH_MakeStudy(
+		PPH_SPEC		Spec,
+		int			Type,
+		std::vector<PVOID>*	Frame )
+{
+const INT64	NumVox = (INT64)Spec->Nx*Spec->Ny*Spec->Nz;
+PDOUBLE	Vol	= NULL;
+bool		res	= false;
+
+	NumTms		= Spec->NumTms;
+	demp_NoiseLevel	= Spec->Noise;
+
+	pf_free(&AbsTarr);
+	pf_free(&GlobalTac);
+	Frame->assign( NumTms,(PVOID)NULL );
+	xz( AllocMem<double >(AbsTarr,NumTms ));
+	xz( AllocMem<double >(GlobalTac,NumTms+GLOBALTAC_PAD ));
+	xz( AllocMem<double >(Vol,NumVox ));
+
+	for ( int t=0; t<NumTms; t++ ) {
+		char*		p = NULL;
+		double	S;
+
+		xz( AllocMem<char >(p,NumVox*TT_SampleBytes( Type )));
+		(*Frame)[t] = p;
+		PH_Frame( Spec,t,Vol );
+
+		switch ( Type ) {
+		case TT_FLOAT32:	S = BENCH_StoreFrame<float   >( Vol,NumVox,p );	break;
+		case TT_INT16:	S = BENCH_StoreFrame<int16_t >( Vol,NumVox,p );	break;
+		case TT_UINT16:	S = BENCH_StoreFrame<uint16_t>( Vol,NumVox,p );	break;
+		default:		S = BENCH_StoreFrame<double  >( Vol,NumVox,p );	break;
+		}
+
+		AbsTarr[t]	= t*Spec->Dt;
+		GlobalTac[t]	= S/NumVox;
+	}
+	for ( int t=NumTms; t<NumTms+GLOBALTAC_PAD; t++ ) GlobalTac[t] = GlobalTac[NumTms-1];
+
+	res	= true;
+func_exit:
+	pf_free(&Vol);
+	return res;
+}
+
+
+static void	BENCH_FreeStudy( std::vector<PVOID>* Frame )
+{
+	for ( PVOID& F : *Frame ) pf_free(&F);
+	Frame->clear();
+}
+
+
+// Write the phantom of Spec as a float32 4D NIfTI
+static bool	BENCH_WritePhantom(
+		PPH_SPEC		Spec,
+		const char*		Path )
+{
+NII_HEADER	Hdr;
+NII_FILE	F;
+PDOUBLE	Vol	= NULL;
+bool		res	= false;
+
+	NII_InitHeader( &Hdr,Spec->Nx,Spec->Ny,Spec->Nz,Spec->Dt );
+	xz( NII_Create( Path,&Hdr,Spec->NumTms,NII_FLOAT32,&F ));
+	xz( AllocMem<double >(Vol,F.NumVox ));
+
+	for ( int t=0; t<Spec->NumTms; t++ ) {
+		PH_Frame( Spec,t,Vol );
+		xz( NII_WriteVolume( &F,Vol ));
+	}
+
+	res	= true;
+func_exit:
+	NII_Close( &F );
+	pf_free(&Vol);
+	return res;
+}
+
+
+// Double output planes over Data for PM_CalcMap(); NULL for the outputs the model does not compute or
+// that are not in Out
+static std::vector<MB_PLANE>	BENCH_Planes(
+		PMODEL_ENTRY			Model,
+		const std::vector<PDOUBLE>&	Data,
+		UINT32				Out = ~(UINT32)0 )
+{
+const UINT32			Used = ModelOutUsed( Model ) & Out;
+std::vector<MB_PLANE>	P( Data.size() );
+
+	for ( size_t i=0; i<Data.size(); i++ ) P[i] = { Used & BM(i) ? Data[i] : NULL,MB_FLOAT64,ONE,ZERO };
+	return P;
+}
+
+
+// One line per output of Out: the largest deviation of the maps X from the reference maps R, also
+// relative to the largest |value| of R, and the voxels void in one map only; Suffix follows the
+// output name. R[o] and X[o] may hold NumMaps maps end to end (one line for all of them). Outputs
+// beyond --tol (--validate threads: not byte-identical) are counted in A->Failed.
+static void	BENCH_Compare(
+		BENCH_ARGS*				A,
+		PMODEL_ENTRY			Model,
+		PPH_SPEC				Spec,
+		UINT32				Out,
+		const std::vector<PDOUBLE>&	R,
+		const std::vector<PDOUBLE>&	X,
+		const std::string&		Suffix,
+		int					NumMaps = 1 )
+{
+const INT64		NumVox = (INT64)Spec->Nx*Spec->Ny*Spec->Nz*NumMaps;
+
+	for ( int o=0; o<Model->NumOutParms; o++ ) {
+		double	Dev = ZERO, Range = ZERO;
+		INT64		Mismatch = 0;				// voxels void in one map only
+
+		if ( !(ModelOutUsed( Model ) & Out & BM(o)) ) continue;
+
+		for ( INT64 i=0; i<NumVox; i++ ) {
+			double	d = R[o][i], f = X[o][i];
+			if ( (d==VOIDVOX) != (f==VOIDVOX) ) { Mismatch++; continue; }
+			if ( d==VOIDVOX ) continue;
+
+			Dev	= max( Dev,fabs( f-d ));
+			Range	= max( Range,fabs( d ));
+		}
+
+		const double	Rel  = Range>ZERO ? Dev/Range : ZERO;
+		const bool		Bad  = A->Validate==BC_THREADS ? memcmp( R[o],X[o],NumVox*sizeof(double) )!=0
+						     : A->Tol>ZERO && (Rel>A->Tol || Mismatch);
+		const std::string	Name = Model->OPName[o]+Suffix;
+
+		printf( A->Csv ? "%d,%s,%d,%s,%.6g,%.6g,%lld%s\n"
+			         : "%5d  %-12s %7d  %-26s %12.4g %12.4g %8lld%s\n",
+			Model->Number,PH_KindName( Spec->Kind ),Spec->NumTms,Name.c_str(),
+			Dev,Rel,(long long)Mismatch,Bad ? (A->Csv ? ",fail" : "  FAIL") : "" );
+		A->Failed += Bad;
+	}
+	fflush( stdout );
+}
+
+
+// PM_CalcMapsFrames() reader of an in-memory study
+struct BENCH_FRAMES {
+	const std::vector<PVOID>*	Frame;
+	INT64				Bytes;		// bytes of a frame
+};
+
+static bool	BENCH_ReadFrame(
+		PVOID		Ctx,
+		int		t,
+		PVOID		Frame )
+{
+BENCH_FRAMES*	F = (BENCH_FRAMES*)Ctx;
+
+	memcpy( Frame,(*F->Frame)[t],F->Bytes );
+	return true;
+}
+
+
+// PM_CalcMapsMoving() writer into planes of all windows end to end
+struct BENCH_WINDOWS {
+	const std::vector<PDOUBLE>*	Plane;
+	INT64				NumVox;		// voxels of a map
+};
+
+static bool	BENCH_WriteWindow(
+		PVOID			Ctx,
+		int			/*Req*/,
+		int			Op,
+		int			w,
+		INT64			V0,
+		int			N,
+		const MB_PLANE*	Plane )
+{
+BENCH_WINDOWS*	W = (BENCH_WINDOWS*)Ctx;
+const double*	P = (const double*)Plane->Data;
+
+	std::copy( P,P+N,(*W->Plane)[Op]+w*W->NumVox+V0 );
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// --validate for Model on the study In (frames Frame): the maps of the checked path against the
+// reference maps, one line per output; models the check does not apply to are skipped
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	BENCH_Validate(
+		BENCH_ARGS*			A,
+		PMODEL_ENTRY		Model,
+		PPH_SPEC			Spec,
+		PINPUTFUNC			Ifunc,
+		PPM_INPUT			In,
+		const std::vector<PVOID>&	Frame )
+{
+const INT64		NumVox = (INT64)Spec->Nx*Spec->Ny*Spec->Nz;
+const int		NumOut = Model->NumOutParms;
+std::vector<PDOUBLE>	D( NumOut,(PDOUBLE)NULL ),
+			F( NumOut,(PDOUBLE)NULL );
+PM_OPTIONS		Opt = {};
+PDOUBLE		Conc	= NULL,
+			MinSig= NULL;
+PVOID			State	= NULL;
+WT_TABLE		T;
+double		FP0	= Model->FreeParm ? Model->FreeParm[0] : ZERO,
+			FP1	= Model->FreeParm ? Model->FreeParm[1] : ZERO;
+const int		NS	= Model->NumSeries ? *Model->NumSeries : 0;
+bool			res	= false;
+
+	WT_Init( &T );
+	Opt.NumThreads	= A->Threads[0];
+	Opt.TileVox		= A->TileVox;
+	if ( A->Validate==BC_FLOAT  && !Model->FuncBatchF ) return true;
+	if ( A->Validate==BC_FRAMES && !(Model->FuncFrame && Model->FrameOut) ) return true;
+	if ( A->Validate==BC_SWEEP  && !Model->FuncWindow ) return true;
+	if ( A->Validate==BC_MOVING && !Model->FuncMoving ) return true;
+	if ( A->Validate==BC_SERIES && !Model->SeriesName ) return true;
+	if ( A->Validate==BC_STATES && Model->Number!=3 ) return true;
+	if ( A->Validate==BC_VOXEL  && !Model->Func ) return true;
+
+	for ( int o=0; o<NumOut; o++ ) {
+		xz( AllocMem<double >(D[o],NumVox ));
+		xz( AllocMem<double >(F[o],NumVox ));
+	}
+
+	switch ( A->Validate ) {
+	case BC_FLOAT:
+		xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,In,BENCH_Planes( Model,D ).data(),&Opt ));
+		Opt.Float32 = true;
+		xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,In,BENCH_Planes( Model,F ).data(),&Opt ));
+		BENCH_Compare( A,Model,Spec,~(UINT32)0,D,F,"" );
+		break;
+
+	case BC_FRAMES: {
+		std::vector<MB_PLANE>	P  = BENCH_Planes( Model,F,Model->FrameOut );
+		PM_MAPREQ			Req = {};
+		BENCH_FRAMES		Ctx = { &Frame,NumVox*TT_SampleBytes( In->Type ) };
+		PM_FRAMEIO			Io  = { &Ctx,BENCH_ReadFrame,NULL,In->Type,In->Slope,In->Inter,0,0 };
+
+		Req.Model	= Model;
+		Req.IFarr	= Ifunc;
+		Req.NumIF	= Model->NumIfuncs;
+		Req.OutPlane= P.data();
+		xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,In,BENCH_Planes( Model,D ).data(),&Opt ));
+		xz( PM_CalcMapsFrames( &Req,1,Spec->Nx,Spec->Ny,Spec->Nz,&Io,&Opt ));
+		BENCH_Compare( A,Model,Spec,Model->FrameOut,D,F,"" );
+		break;
+	}
+
+	case BC_SWEEP: {
+		// the pass of the default window fills the converted study the table is built from
+		PM_INPUT			Full = *In;
+		std::vector<MB_PLANE>	P    = BENCH_Planes( Model,F,Model->WindowOut );
+		PM_MAPREQ			Req  = {};
+		const int			Win[][2] = { { 0,0 },{ 2,NumTms/2 },{ NumTms/3,NumTms/3 },{ NumTms-5,0 } };
+
+		Req.Model	= Model;
+		Req.IFarr	= Ifunc;
+		Req.NumIF	= Model->NumIfuncs;
+		Req.OutPlane= P.data();
+		xz( AllocMem<double >(Conc,NumVox*NumTms ));
+		xz( AllocMem<double >(MinSig,NumVox ));
+		Full.Conc	= Conc;
+		Full.MinSig	= MinSig;
+		Full.ConcReady= false;
+		xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,&Full,BENCH_Planes( Model,D ).data(),&Opt ));
+		xz( WT_Build( &T,Conc,MinSig,NumVox,Model->WindowParts,PM_NumThreads( &Opt )));
+
+		for ( const auto& W : Win ) {
+			Model->FreeParm[0] = W[0];
+			Model->FreeParm[1] = W[1];
+			xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,In,BENCH_Planes( Model,D ).data(),&Opt ));
+			xz( PM_CalcMapsWindow( &Req,1,&T,&Opt ));
+			BENCH_Compare( A,Model,Spec,Model->WindowOut,D,F,"@"+std::to_string( W[0] )+"+"+std::to_string( W[1] ));
+		}
+		break;
+	}
+
+	case BC_MOVING: {
+		// every window of L frames against a full pass with Start Index w and Length L; short windows
+		// re-base the running sums many times, long ones carry the updates furthest. Not 3 frames: the
+		// first window would be the conversion baseline, of mean 0 but for rounding, and so of no CV
+		PM_INPUT			Full = *In;
+		PM_MAPREQ			Req  = {};
+		std::vector<PDOUBLE>	DW( NumOut,(PDOUBLE)NULL ),
+					FW( NumOut,(PDOUBLE)NULL );
+		const int			Len[] = { 4,max( NumTms/2,1 ) };
+
+		xz( AllocMem<double >(Conc,NumVox*NumTms ));
+		xz( AllocMem<double >(MinSig,NumVox ));
+		Full.Conc	= Conc;
+		Full.MinSig	= MinSig;
+		Full.ConcReady= false;
+		xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,&Full,BENCH_Planes( Model,D ).data(),&Opt ));
+
+		for ( int L : Len ) {
+			const int			K  = NumTms-L+1;
+			std::vector<MB_PLANE>	P  = BENCH_Planes( Model,F,Model->WindowOut );
+			BENCH_WINDOWS		Ctx = { &FW,NumVox };
+			PM_MOVINGIO			Io  = { &Ctx,BENCH_WriteWindow };
+			bool				Ok  = true;
+
+			if ( K<1 ) continue;
+			for ( int o=0; o<NumOut && Ok; o++ )
+				Ok = AllocMem<double >(DW[o],NumVox*K ) && AllocMem<double >(FW[o],NumVox*K );
+
+			Req.Model	= Model;
+			Req.IFarr	= Ifunc;
+			Req.NumIF	= Model->NumIfuncs;
+			Req.OutPlane= P.data();
+			Ok = Ok && PM_CalcMapsMoving( &Req,1,Conc,MinSig,NumVox,L,&Io,&Opt );
+
+			for ( int w=0; w<K && Ok; w++ ) {
+				Model->FreeParm[0] = w;
+				Model->FreeParm[1] = L;
+				Ok = PM_CalcMap( Model,Ifunc,Model->NumIfuncs,In,BENCH_Planes( Model,D ).data(),&Opt );
+				for ( int o=0; o<NumOut && Ok; o++ ) std::copy( D[o],D[o]+NumVox,DW[o]+w*NumVox );
+			}
+			if ( Ok ) BENCH_Compare( A,Model,Spec,Model->WindowOut,DW,FW,"@L"+std::to_string( L ),K );
+
+			for ( int o=0; o<NumOut; o++ ) { pf_free(&DW[o]); pf_free(&FW[o]); }
+			xz( Ok );
+		}
+		break;
+	}
+
+	case BC_SERIES: {
+		// points at every frame, and at times within frames, of the whole TAC and of a window: the
+		// reference of a point is a full pass from Start Index up to its last whole frame j, plus the
+		// trapezoid from frame j to the point over the converted TAC the first pass leaves
+		PM_INPUT			Full = *In;
+		const int			Win[][2] = { { 0,0 },{ 3,NumTms/2 } };
+		std::vector<PDOUBLE>	SR( 1,(PDOUBLE)NULL ),
+					SX( 1,(PDOUBLE)NULL );
+
+		xz( AllocMem<double >(Conc,NumVox*NumTms ));
+		xz( AllocMem<double >(MinSig,NumVox ));
+		Full.Conc	= Conc;
+		Full.MinSig	= MinSig;
+		Full.ConcReady= false;
+		xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,&Full,BENCH_Planes( Model,D ).data(),&Opt ));
+
+		for ( const auto& W : Win )
+		for ( int Times=0; Times<2; Times++ ) {
+			const int			NumPt = Times ? 8 : NumTms;
+			std::vector<MB_PLANE>	P = BENCH_Planes( Model,F ),
+						SP( NumPt );
+			std::vector<double>	E( NumPt );
+			PM_MAPREQ			Req = {};
+			int				Start,End;
+			bool				Ok;
+
+			GetStartEndInx( W[0],W[1],&Start,&End );
+			const double	t0 = AbsTarr[Start],
+					t1 = AbsTarr[End];
+
+			// the last time points fall after the window and are clamped to its end
+			for ( int k=0; k<NumPt; k++ ) {
+				E[k] = Times ? t0+(t1-t0)*k/6.3 : AbsTarr[k];
+				if ( Times ) Model->SeriesTime[k] = E[k]-t0;
+				E[k] = min( max( E[k],t0 ),t1 );
+			}
+
+			Ok = AllocMem<double >(SR[0],NumVox*NumPt ) && AllocMem<double >(SX[0],NumVox*NumPt );
+			for ( int k=0; k<NumPt && Ok; k++ ) SP[k] = { SX[0]+k*NumVox,MB_FLOAT64,ONE,ZERO };
+
+			Model->FreeParm[0]	= W[0];
+			Model->FreeParm[1]	= W[1];
+			*Model->NumSeries	= Times ? NumPt : MB_SERIESFRAMES;
+			Req.Model		= Model;
+			Req.IFarr		= Ifunc;
+			Req.NumIF		= Model->NumIfuncs;
+			Req.OutPlane	= P.data();
+			Req.SeriesPlane	= SP.data();
+			Req.NumSeries	= NumPt;
+			Ok = Ok && PM_CalcMaps( &Req,1,In,&Opt );
+			*Model->NumSeries	= 0;
+
+			for ( int k=0; k<NumPt && Ok; k++ ) {
+				int	j = Start;
+				while ( j<End && AbsTarr[j+1]<=E[k] ) j++;
+
+				const double	d = E[k]-AbsTarr[j];
+				PDOUBLE		R = SR[0]+k*NumVox;
+
+				Model->FreeParm[0] = Start;
+				Model->FreeParm[1] = j-Start+1;
+				Ok = PM_CalcMap( Model,Ifunc,Model->NumIfuncs,In,BENCH_Planes( Model,D ).data(),&Opt );
+
+				for ( INT64 v=0; v<NumVox && Ok; v++ ) {
+					const double*	c  = Conc+v*NumTms;
+					const double	cE = d>ZERO ? c[j]+d/(AbsTarr[j+1]-AbsTarr[j])*(c[j+1]-c[j]) : c[j];
+
+					R[v] = D[0][v]==VOIDVOX ? VOIDVOX : D[0][v]+d*(c[j]+cE)*0.5;
+				}
+			}
+			if ( Ok ) BENCH_Compare( A,Model,Spec,BM(0),SR,SX,
+				(Times ? "/times@" : "/frames@")+std::to_string( W[0] )+"+"+std::to_string( W[1] ),NumPt );
+
+			pf_free(&SR[0]);
+			pf_free(&SX[0]);
+			xz( Ok );
+		}
+		break;
+	}
+
+	case BC_STATES: {
+		// state k of K holds frames k, k+K, ... (0-based): copied out, as ExtractEven() and ExtractOdd()
+		// did for K = 2, and given to PR_ArrStats(), from the converted TACs the first pass leaves
+		PM_INPUT			Full = *In;
+		std::vector<double>	Arr( NumTms );
+
+		xz( AllocMem<double >(Conc,NumVox*NumTms ));
+		xz( AllocMem<double >(MinSig,NumVox ));
+		Full.Conc	= Conc;
+		Full.MinSig	= MinSig;
+		Full.ConcReady= false;
+		xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,&Full,BENCH_Planes( Model,D ).data(),&Opt ));
+
+		for ( int K : { 2,3,4,8 } ) {
+			if ( 2*K>NumOut ) continue;
+			Model->FreeParm[0] = K;
+			xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,In,BENCH_Planes( Model,F ).data(),&Opt ));
+
+			for ( INT64 v=0; v<NumVox; v++ )
+				for ( int k=0; k<K; k++ ) {
+					int	N = 0;
+					for ( int t=k; t<NumTms; t+=K ) Arr[N++] = Conc[v*NumTms+t];
+
+					D[2*k][v] = PR_ArrStats( Arr.data(),N,D[2*k+1]+v );
+				}
+			BENCH_Compare( A,Model,Spec,(UINT32)BM(2*K)-1,D,F,"@K"+std::to_string( K ));
+		}
+		break;
+	}
+
+	case BC_VOXEL: {
+		// the framework calls Func with raw TACs; the batch gets them as the driver hands them over,
+		// converted unless the model takes raw signal
+		std::vector<MB_PLANE>	P = BENCH_Planes( Model,D );
+		std::unique_ptr<bool[]>	VoxOk( new bool[NumVox] );
+		MODEL_BATCH			B = {};
+
+		xz( AllocMem<double >(Conc,NumVox*NumTms ));
+		xz( AllocMem<double >(MinSig,NumVox*NumTms ));		// the raw TACs
+		TT_FrameToVoxel( Frame.data(),In->Type,0,(int)NumVox,NumTms,MinSig,false );
+		for ( INT64 v=0; v<NumVox; v++ )
+			if ( Model->RawSignal )	std::copy( MinSig+v*NumTms,MinSig+(v+1)*NumTms,Conc+v*NumTms );
+			else				funcSigToConc( MinSig+v*NumTms,NumTms,Conc+v*NumTms,1,NULL );
+
+		xz( Model->Init( &State,Ifunc,Model->NumIfuncs ));
+
+		B.Signal	= Conc;
+		B.NumVox	= (int)NumVox;
+		B.OutPlane	= P.data();
+		B.VoxOk	= VoxOk.get();
+		B.IsConc	= !Model->RawSignal;
+		xz( Model->FuncBatch( State,&B ));
+
+		for ( int o=0; o<NumOut; o++ ) ParmReq[o] = TRUE;
+		for ( INT64 v=0; v<NumVox; v++ ) {
+			double	Val[MB_MAXOUTPARMS];
+			PIVAL		Out = Val;
+
+			if ( !Model->Func( State,MinSig+v*NumTms,Out )) std::fill( Val,Val+NumOut,VOIDVOX );
+			for ( int o=0; o<NumOut; o++ ) F[o][v] = Val[o];
+		}
+		BENCH_Compare( A,Model,Spec,~(UINT32)0,D,F,"" );
+		break;
+	}
+
+	case BC_THREADS: {
+		// serial reference: one thread, one slice per tile; then slices and bricks of a few rows, which
+		// the workers take from a shared counter as they finish
+		const int	Tile[2] = { 0,A->TileVox>0 ? A->TileVox : 3*Spec->Nx };
+
+		Opt.AirFactor	= A->Air;
+		Opt.NumThreads	= 1;
+		Opt.TileVox		= 0;
+		xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,In,BENCH_Planes( Model,D ).data(),&Opt ));
+
+		for ( int Th : A->Threads )
+		for ( int Tv : Tile ) {
+			Opt.NumThreads	= Th;
+			Opt.TileVox		= Tv;
+			if ( PM_NumThreads( &Opt )==1 && !Tv ) continue;
+
+			xz( PM_CalcMap( Model,Ifunc,Model->NumIfuncs,In,BENCH_Planes( Model,F ).data(),&Opt ));
+			BENCH_Compare( A,Model,Spec,~(UINT32)0,D,F,
+				"@t"+std::to_string( PM_NumThreads( &Opt ))+(Tv ? "/tile"+std::to_string( Tv ) : std::string()) );
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	res	= true;
+func_exit:
+	if ( State ) Model->Close( State );
+	if ( Model->FreeParm ) {
+		Model->FreeParm[0] = FP0;
+		Model->FreeParm[1] = FP1;
+	}
+	if ( Model->NumSeries ) *Model->NumSeries = NS;
+	WT_Free( &T );
+	pf_free(&MinSig);
+	pf_free(&Conc);
+	for ( int o=0; o<NumOut; o++ ) { pf_free(&D[o]); pf_free(&F[o]); }
+	return res;
+}
+
+
+int	main(
+		int		argc,
+		char**	argv )
+{
+BENCH_ARGS	A;
+
+	if ( !BENCH_ParseArgs( argc,argv,&A )) {
+		fprintf( stderr,
+			"usage: parmbench [-m 0,1,3,4,5,6] [-s 64x64x16] [-T 30,60,120] [-t 1,2,4,0] [-r 3] [--tile N] [--nt]\n"
+			"                 [--sample f64|f32|i16|u16] [--float] [--air X] [--profile] [--csv]\n"
+			"       parmbench --validate [float|frames|sweep|moving|series|states|voxel|threads] [--tol X] [-m 0,1,3,4] [-s 64x64x16] [-T 30,60,120]\n"
+			"       parmbench --phantom dce|dsc|interleaved|rise [-s NxxNyxNz] [-T N] --write phantom.nii\n" );
+		return 2;
+	}
+
+	if ( !A.WritePath.empty() ) {
+		PH_SPEC	Spec;
+		PH_DefaultSpec( A.Kind,A.Nx,A.Ny,A.Nz,A.NumTms[0],&Spec );
+		return BENCH_WritePhantom( &Spec,A.WritePath.c_str() ) ? 0 : 1;
+	}
+
+	ConcConv.Type		= CONCTYPE_DIFF;
+	ConcConv.BaseStart	= 0;
+	ConcConv.BaseEnd		= 2;
+
+const INT64	NumVox = (INT64)A.Nx*A.Ny*A.Nz;
+
+	if ( A.Validate )
+		printf( A.Csv ? "model,phantom,NumTms,output,max_abs_dev,max_rel_dev,void_mismatch\n"
+				  : A.Validate==BC_FLOAT  ? "model  phantom       NumTms  output                      max|f32-f64|  rel. to max  void-mism\n"
+				  : A.Validate==BC_FRAMES ? "model  phantom       NumTms  output                      max|frm-full| rel. to max  void-mism\n"
+				  : A.Validate==BC_VOXEL  ? "model  phantom       NumTms  output                      max|vox-batch| rel. to max  void-mism\n"
+				  : A.Validate==BC_THREADS? "model  phantom       NumTms  output@threads/tile         max|thr-serial| rel. to max void-mism\n"
+				  : A.Validate==BC_MOVING ? "model  phantom       NumTms  output@window length        max|mov-full| rel. to max  void-mism\n"
+				  : A.Validate==BC_SERIES ? "model  phantom       NumTms  output/points@start+length  max|ser-full| rel. to max  void-mism\n"
+				  : A.Validate==BC_STATES ? "model  phantom       NumTms  output@states               max|K-extract| rel. to max void-mism\n"
+				  :                         "model  phantom       NumTms  output@start+length         max|win-full| rel. to max  void-mism\n" );
+	else
+		printf( A.Csv ? "model,phantom,NumTms,threads,voxels,seconds,voxels_per_s,ns_per_voxel_frame,peak_rss_mb\n"
+				  : "model  phantom       NumTms  threads     voxels   seconds    Mvox/s  ns/vox/frame  peakRSS(MB)\n" );
+
+	for ( int T : A.NumTms )
+	for ( int m : A.Models ) {
+		PMODEL_ENTRY		Model = FindModelEntry( m );
+		PH_SPEC			Spec;
+		std::vector<PVOID>	Frame;
+		std::vector<PDOUBLE>	Plane( Model->NumOutParms );
+		std::vector<MB_PLANE>	Out;
+		std::vector<double>	Ref( T );
+		INPUTFUNC			Ifunc = { T,NULL,Ref.data() };
+		bool				Ok	= true;
+
+		PH_DefaultSpec( PH_KindForModel( m ),A.Nx,A.Ny,A.Nz,T,&Spec );
+		PH_ReferenceCurve( &Spec,Ref.data() );
+
+		Ok = BENCH_MakeStudy( &Spec,A.Type,&Frame );
+		for ( PDOUBLE& P : Plane ) Ok = Ok && AllocMem<double >(P,NumVox );
+		Out = BENCH_Planes( Model,Plane );
+
+		PM_INPUT	In = {};
+
+		In.Frame	= Frame.data();
+		In.Nx		= A.Nx;
+		In.Ny		= A.Ny;
+		In.Nz		= A.Nz;
+		In.Type	= A.Type;
+
+		if ( A.Validate && Ok )
+			Ok = BENCH_Validate( &A,Model,&Spec,&Ifunc,&In,Frame );
+
+		for ( int Th : A.Threads ) {
+			if ( A.Validate ) break;
+			if ( !Ok ) break;
+
+			MP_PROFILE	Prof;
+			PM_OPTIONS	Opt = {};
+			double	Best = 1e300;
+
+			Opt.NumThreads	= Th;
+			Opt.TileVox		= A.TileVox;
+			Opt.StreamStores	= A.Stream;
+			Opt.Float32		= A.Float;
+			Opt.AirFactor	= A.Air;
+			Opt.Profile		= A.Profile ? &Prof : NULL;
+
+			BENCH_ResetPeakRss();
+			for ( int r=0; r<A.Repeats && Ok; r++ ) {
+				auto	T0 = std::chrono::steady_clock::now();
+				Ok = PM_CalcMap( Model,&Ifunc,Model->NumIfuncs,&In,Out.data(),&Opt );
+				Best = min( Best,std::chrono::duration<double>( std::chrono::steady_clock::now()-T0 ).count() );
+			}
+			if ( !Ok ) break;
+
+			printf( A.Csv ? "%d,%s,%d,%d,%lld,%.6f,%.0f,%.3f,%.1f\n"
+				        : "%5d  %-12s %7d %8d %10lld %9.4f %9.2f %13.3f %12.1f\n",
+				m,PH_KindName( Spec.Kind ),T,PM_NumThreads( &Opt ),(long long)NumVox,Best,
+				A.Csv ? NumVox/Best : NumVox/Best*1e-6,Best*1e9/((double)NumVox*T),BENCH_PeakRssMB() );
+			fflush( stdout );
+		}
+
+		for ( PDOUBLE& P : Plane ) pf_free(&P);
+		BENCH_FreeStudy( &Frame );
+
+		if ( !Ok ) { fprintf( stderr,"error: model %d failed\n",m ); return 1; }
+	}
+
+	pf_free(&AbsTarr);
+	pf_free(&GlobalTac);
+
+	if ( A.Failed ) {
+		if ( A.Validate==BC_THREADS )	fprintf( stderr,"error: %d output(s) differ from the serial pass\n",A.Failed );
+		else					fprintf( stderr,"error: %d output(s) beyond --tol %g\n",A.Failed,A.Tol );
+		return 1;
+	}
+	return 0;
+}
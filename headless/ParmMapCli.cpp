@@ -0,0 +1,1131 @@
+/**
+* @file ParmMapCli.cpp
+* @brief Headless command-line engine: 4D NIfTI in, parametric maps out.
+*
+* @details
+* Usage:
+* @code
+*   parmmap -i study.nii -o out/prefix [options] -m N [-p FP0,FP1,...] [-r OP,OP,...] [-f ifunc.txt] [-q S,S,...] [-s T,T,...|all] [-m N ...]
+* @endcode
+* Each @c -m starts a map request; the @c -p, @c -r, @c -f, @c -q and @c -s
+* that follow it belong to that model (free parameters in FP order, requested
+* outputs by OP index — default all —, the input-function file for models
+* that take one, int16 output scales: value = sample*S, one S per OP in
+* OP order or one for all, and the points of the model's series output).
+* All requests run in one fused pass (@c PM_CalcMaps()).
+*
+* @c -s asks a model with a series output (@c MODEL_ENTRY::SeriesName,
+* Model 1: the AUC from the Start Index frame up to T seconds after it) for
+* the values at times T, or at every frame with @c all, computed in the same
+* pass. They go to the frames of the 4D map
+* @c <prefix>_m<N>_<series name>.nii, of the type (and first -q scale) of
+* the other outputs; not with @c --mem.
+*
+* Options:
+*   - @c -t N           worker threads (default: all hardware threads)
+*   - @c --tile N       voxels per tile (default: one slice)
+*   - @c --nt           non-temporal stores when gathering tiles (pays off
+*                       for tiles larger than the last-level cache)
+*   - @c --times FILE   frame start times in seconds, one per line (default:
+*                       pixdim[4] spacing of the input)
+*   - @c --conc TYPE    none | diff | relenh | dr2 (default: none)
+*   - @c --base A,B     baseline frames for the conversion (default: 0,0)
+*   - @c --te X         echo time for dr2 (default: 1)
+*   - @c --noise X      background noise SD (default: estimated from frame 0)
+*   - @c --roi FILE     3D mask whose mean TAC is the white-matter ROI (Model 6)
+*   - @c --mask FILE    3D mask of the voxels to evaluate (nonzero); the others
+*                       are set to VOIDVOX without being read or converted
+*   - @c --air X        skip voxels whose raw TAC minimum is below X times the
+*                       noise SD, for the models without their own background
+*                       threshold (Model 6 uses its FP0); default: off
+*   - @c --f64          write float64 maps (default: float32)
+*
+* The output planes have the type of the file (@c MB_PLANE): float32 by
+* default, float64 with @c --f64, int16 with @c -q (void voxels are stored
+* as -32768); the models store into them directly.
+*   - @c --float        float32 compute mode for the models that have one
+*                       (0, 1, 3, 4; sums and moments stay in double)
+*   - @c --mem MB       out-of-core mode: process the study in slabs of whole
+*                       slices so data and work buffers stay within MB
+*                       megabytes (@c PM_CalcMapsSlabs()); with @c --frames
+*                       or @c --watch, the largest size of the per-voxel
+*                       accumulators instead (@c PM_FRAMEIO::Budget)
+*   - @c --cache DIR    keep the converted study in a concentration cache in
+*                       DIR (@c ConcCache.h): the first run with these data
+*                       and conversion settings writes it, later runs of any
+*                       model read it in place instead of converting
+*   - @c --profile FILE write per-model stage times and voxel/byte counts of
+*                       the run as JSON (builds with @c PARMMAP_PROFILE; see
+*                       @c ModelProfile.h)
+*   - @c --sweep FILE   after the maps of the -p windows, recompute them for
+*                       every "Start Length" line of FILE from a prefix table
+*                       of the study (@c WindowTable.h), in O(1) per voxel;
+*                       window k goes to @c <prefix>_w<k>_m<N>_<OP name>.nii.
+*                       Models 0 (moment outputs) and 1 only; not with
+*                       @c --mem
+*   - @c --moving L     after the maps, the outputs of every window of L
+*                       frames sliding over the TACs as a 4D map of
+*                       NumTms-L+1 frames (frame w: frames w .. w+L-1),
+*                       written run by run (@c PM_CalcMapsMoving()) to
+*                       @c <prefix>_mov<L>_m<N>_<OP name>.nii. Model 0
+*                       (moment outputs) only; not with @c --mem
+*   - @c --frames       stream the study one frame at a time into per-voxel
+*                       accumulators (@c PM_CalcMapsFrames()): two frames
+*                       in memory instead of the study, each read once.
+*                       Models 0 (all but the order statistics), 1, 3 and
+*                       4 only (Model 5 keeps its TACs: @c --watch); not with
+*                       @c --cache, @c --sweep, @c --moving or @c -s
+*   - @c --watch DIR N  live maps of an acquisition in progress, in place of
+*                       @c -i: the N frames are the 3D .nii files appearing
+*                       in DIR, taken in name order once complete, and
+*                       streamed as with @c --frames. After each frame the
+*                       maps of the frames so far replace the output files
+*                       (header description "live: n of N frames"), so a
+*                       viewer always reads whole maps. Models 0 (as with
+*                       @c --frames), 1, 3 and 5 only. Model 5 keeps every
+*                       sample of each voxel received (NumTms+4 doubles per
+*                       voxel): a rise that goes on until the last frame
+*                       can move its low crossing to any frame since the
+*                       first one, so no bounded state gives the exact
+*                       TAR. It needs @c --mem MB large enough for that.
+*   - @c --wait S       with @c --watch, give up if no new frame is complete
+*                       within S seconds (default: 60); the maps then hold
+*                       the frames received
+*
+* int16, uint16, float32 and float64 studies stay in their native sample type
+* in memory (@c PM_INPUT::Type) and are widened tile by tile during the pass;
+* other types are converted to double on read. Frames are streamed from disk
+* with read-ahead; each
+* output is written as soon as the pass completes and its plane released.
+* In out-of-core mode a first streaming pass over the frames builds the
+* global and ROI TACs, then each slab is read with all frames, evaluated and
+* appended to the output files. Every map goes to
+* @c <prefix>_m<N>_<OP name>.nii.
+*
+* An input-function file holds one sample per line (frame times) or
+* "time value" pairs in seconds relative to the first frame.
+*/
+
+#include	"stdafx.h"
+#include	"ParmMapDriver.h"
+#include	"Nifti.h"
+#include	"ConcCache.h"
+
+#include	<stdio.h>
+#include	<dirent.h>
+#include	<sys/stat.h>
+#include	<algorithm>
+#include	<chrono>
+#include	<string>
+#include	<vector>
+
+
+// One -m block of the command line
+struct CLI_MAP {
+	PMODEL_ENTRY		Model;
+	std::vector<double>	FreeParm;			// -p; empty = model defaults
+	std::vector<int>		OutReq;			// -r; empty = all outputs
+	std::string			IfuncPath;			// -f
+	std::vector<double>	Quant;			// -q; empty = float outputs
+	std::vector<double>	Series;			// -s times
+	bool				SeriesFrames;		// -s all
+	std::vector<MB_PLANE>	SeriesPlane;
+	INPUTFUNC			Ifunc;
+	std::vector<double>	IfTarr,IfVal;
+	std::vector<MB_PLANE>	OutPlane;
+	std::vector<NII_FILE>	OutFile;			// out-of-core mode: open output files
+};
+
+
+struct CLI_ARGS {
+	std::string			InPath,OutPrefix,TimesPath,RoiPath,MaskPath,ProfilePath,CacheDir,SweepPath;
+	int				MovingL;			// --moving window length; 0 = none
+	bool				Frames;			// --frames: stream the study frame by frame
+	std::string			WatchDir;			// --watch: directory of the frame files; empty = -i
+	int				WatchFrames;		// --watch: frames of the acquisition
+	double			WatchWait;			// --wait: seconds to wait for the next frame
+	std::vector<CLI_MAP>	Maps;
+	PM_OPTIONS			Opt;
+	double			Noise;			// <0: estimate
+	bool				F64;
+	INT64				MemBudget;			// --mem in bytes; 0 = whole study in memory
+};
+
+
+static double	CLI_SlabMark;				// OutPlane data of a requested out-of-core map
+
+static const int	CLI_WATCHPOLL = 50;			// milliseconds between directory scans of --watch
+
+
+// Callback context of the out-of-core and frame-streaming passes
+struct CLI_SLABCTX {
+	PNII_FILE	In;
+	CLI_ARGS*	A;
+	bool		Native;			// read raw samples (else converted to double)
+};
+
+
+static void	CLI_Usage()
+{
+	fprintf( stderr,
+		"usage: parmmap -i study.nii -o prefix [-t N] [--tile N] [--nt] [--times FILE]\n"
+		"               [--conc none|diff|relenh|dr2] [--base A,B] [--te X] [--noise X]\n"
+		"               [--roi mask.nii] [--mask mask.nii] [--air X] [--f64] [--float] [--mem MB]\n"
+		"               [--cache DIR] [--profile out.json] [--sweep windows.txt] [--moving L]\n"
+		"               [--frames] [--watch DIR N [--wait S]]\n"
+		"               -m N [-p FP0,FP1,...] [-r OP,OP,...] [-f ifunc.txt] [-q S,S,...] [-s T,T,...|all] [-m N ...]\n"
+		"models:\n" );
+
+	for ( int i=0; i<NumModelEntries; i++ )
+		fprintf( stderr,"  %d  %s\n",ModelTable[i]->Number,ModelTable[i]->Name );
+}
+
+
+// Comma-separated list of numbers
+static std::vector<double>	CLI_ParseList( const char* s )
+{
+std::vector<double>	L;
+
+	while ( *s ) {
+		char*	e;
+		L.push_back( strtod( s,&e ));
+		if ( e==s ) break;
+		s = *e==',' ? e+1 : e;
+	}
+	return L;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Parse the command line; false (after printing usage or a message) if it is invalid
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	CLI_ParseArgs(
+		int		argc,
+		char**	argv,
+		CLI_ARGS*	A )
+{
+	A->Opt.NumThreads	= 0;
+	A->Opt.TileVox	= 0;
+	A->Opt.StreamStores	= false;
+	A->Opt.Float32	= false;
+	A->Opt.Mask		= NULL;
+	A->Opt.AirFactor	= ZERO;
+	A->Opt.Profile	= NULL;
+	A->Noise		= -1;
+	A->F64		= false;
+	A->MemBudget	= 0;
+	A->MovingL		= 0;
+	A->Frames		= false;
+	A->WatchFrames	= 0;
+	A->WatchWait	= 60;
+
+	for ( int i=1; i<argc; i++ ) {
+		std::string	a	= argv[i];
+		const char*	v	= i+1<argc ? argv[i+1] : NULL;
+		bool		Flag	= a=="--f64" || a=="--nt" || a=="--float" || a=="--frames";
+
+		if ( !Flag && !v ) { CLI_Usage(); return false; }
+		if ( !Flag ) i++;
+
+		if		( a=="-i" )		A->InPath	= v;
+		else if	( a=="-o" )		A->OutPrefix= v;
+		else if	( a=="-t" )		A->Opt.NumThreads	= atoi( v );
+		else if	( a=="--tile" )	A->Opt.TileVox	= atoi( v );
+		else if	( a=="--times" )	A->TimesPath= v;
+		else if	( a=="--roi" )	A->RoiPath	= v;
+		else if	( a=="--mask" )	A->MaskPath	= v;
+		else if	( a=="--profile" )	A->ProfilePath	= v;
+		else if	( a=="--cache" )	A->CacheDir	= v;
+		else if	( a=="--sweep" )	A->SweepPath	= v;
+		else if	( a=="--moving" )	A->MovingL	= atoi( v );
+		else if	( a=="--wait" )	A->WatchWait	= atof( v );
+		else if	( a=="--watch" ) {
+			if ( i+1>=argc ) { CLI_Usage(); return false; }
+			A->WatchDir		= v;
+			A->WatchFrames	= atoi( argv[++i] );
+			A->Frames		= true;
+		}
+		else if	( a=="--air" )	A->Opt.AirFactor	= atof( v );
+		else if	( a=="--noise" )	A->Noise	= atof( v );
+		else if	( a=="--te" )		ConcConv.TE	= atof( v );
+		else if	( a=="--mem" )	A->MemBudget= (INT64)(atof( v )*1024*1024);
+		else if	( a=="--f64" )	A->F64	= true;
+		else if	( a=="--nt" )		A->Opt.StreamStores	= true;
+		else if	( a=="--float" )	A->Opt.Float32	= true;
+		else if	( a=="--frames" )	A->Frames	= true;
+		else if	( a=="--base" ) {
+			std::vector<double>	L = CLI_ParseList( v );
+			if ( L.size()!=2 ) { CLI_Usage(); return false; }
+			ConcConv.BaseStart	= (int)L[0];
+			ConcConv.BaseEnd	= (int)L[1];
+		}
+		else if	( a=="--conc" ) {
+			std::string	c = v;
+			if		( c=="none" )	ConcConv.Type = CONCTYPE_NOCONV;
+			else if	( c=="diff" )	ConcConv.Type = CONCTYPE_DIFF;
+			else if	( c=="relenh" )	ConcConv.Type = CONCTYPE_RELENH;
+			else if	( c=="dr2" )	ConcConv.Type = CONCTYPE_DR2;
+			else					{ CLI_Usage(); return false; }
+		}
+		else if	( a=="-m" ) {
+			CLI_MAP	M;
+			M.SeriesFrames = false;
+			if ( !(M.Model = FindModelEntry( atoi( v )))) {
+				fprintf( stderr,"error: unknown model %s\n",v );
+				return false;
+			}
+			A->Maps.push_back( M );
+		}
+		else if	( A->Maps.empty() ) { CLI_Usage(); return false; }
+		else if	( a=="-p" )		A->Maps.back().FreeParm	= CLI_ParseList( v );
+		else if	( a=="-f" )		A->Maps.back().IfuncPath	= v;
+		else if	( a=="-q" )		A->Maps.back().Quant	= CLI_ParseList( v );
+		else if	( a=="-s" ) {
+			CLI_MAP&	M = A->Maps.back();
+			M.SeriesFrames	= !strcmp( v,"all" );
+			M.Series		= M.SeriesFrames ? std::vector<double>() : CLI_ParseList( v );
+			if ( !M.Model->SeriesName ) {
+				fprintf( stderr,"error: model %d has no series output\n",M.Model->Number );
+				return false;
+			}
+			if ( !M.SeriesFrames && (M.Series.empty() || M.Series.size()>DEF_MAXNUMTMS) ) { CLI_Usage(); return false; }
+		}
+		else if	( a=="-r" ) {
+			for ( double x : CLI_ParseList( v )) A->Maps.back().OutReq.push_back( (int)x );
+		}
+		else	{ CLI_Usage(); return false; }
+	}
+
+	if ( A->InPath.empty()==A->WatchDir.empty() || A->OutPrefix.empty() || A->Maps.empty() ) { CLI_Usage(); return false; }
+
+	for ( const CLI_MAP& M : A->Maps )
+		if ( M.SeriesFrames || !M.Series.empty() ) {
+			if ( A->MemBudget>0 ) { fprintf( stderr,"error: -s needs the study in memory (no --mem)\n" ); return false; }
+			if ( !A->SweepPath.empty() || A->MovingL ) { fprintf( stderr,"error: -s is not available with --sweep or --moving\n" ); return false; }
+		}
+	if ( !A->SweepPath.empty() ) {
+		if ( A->MemBudget>0 ) { fprintf( stderr,"error: --sweep needs the study in memory (no --mem)\n" ); return false; }
+		for ( const CLI_MAP& M : A->Maps )
+			if ( !M.Model->FuncWindow ) {
+				fprintf( stderr,"error: model %d cannot sweep windows\n",M.Model->Number );
+				return false;
+			}
+	}
+	if ( A->MovingL ) {
+		if ( A->MovingL<1 )	{ CLI_Usage(); return false; }
+		if ( A->MemBudget>0 ) { fprintf( stderr,"error: --moving needs the study in memory (no --mem)\n" ); return false; }
+		for ( const CLI_MAP& M : A->Maps )
+			if ( !M.Model->FuncMoving ) {
+				fprintf( stderr,"error: model %d has no sliding-window outputs\n",M.Model->Number );
+				return false;
+			}
+	}
+	if ( A->Frames ) {
+		if ( !A->CacheDir.empty() || !A->SweepPath.empty() || A->MovingL ) {
+			fprintf( stderr,"error: --frames is not available with --cache, --sweep or --moving\n" );
+			return false;
+		}
+		for ( const CLI_MAP& M : A->Maps ) {
+			if ( !M.Model->FuncFrame ) {
+				fprintf( stderr,"error: model %d cannot accumulate frame by frame\n",M.Model->Number );
+				return false;
+			}
+			if ( !A->WatchDir.empty() && !M.Model->LiveOut ) {
+				fprintf( stderr,"error: model %d has no maps before the end of the study\n",M.Model->Number );
+				return false;
+			}
+			if ( A->WatchDir.empty() && !M.Model->FrameOut ) {
+				fprintf( stderr,"error: model %d keeps its TACs and is streamed with --watch only\n",M.Model->Number );
+				return false;
+			}
+			if ( !M.Model->FrameOut && A->MemBudget<=0 ) {
+				fprintf( stderr,"error: model %d keeps the TAC of every voxel for its live maps; "
+					"give --mem MB to allow that much memory\n",M.Model->Number );
+				return false;
+			}
+			if ( M.SeriesFrames || !M.Series.empty() ) { fprintf( stderr,"error: -s is not available with --frames\n" ); return false; }
+		}
+	}
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Numbers of a text file, N per line kept in Col[0..N-1]; false if the file cannot be read
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	CLI_ReadColumns(
+		const char*			Path,
+		std::vector<double>*	Col0,
+		std::vector<double>*	Col1 )
+{
+FILE*	f = fopen( Path,"r" );
+char	Line[256];
+
+	if ( !f ) { fprintf( stderr,"error: cannot open %s\n",Path ); return false; }
+
+	while ( fgets( Line,sizeof(Line),f )) {
+		double	a,b;
+		int		n = sscanf( Line,"%lf %lf",&a,&b );
+		if ( n<1 ) continue;
+
+		if ( n==1 )	Col1->push_back( a );
+		else		{ Col0->push_back( a ); Col1->push_back( b ); }
+	}
+	fclose( f );
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Background noise SD estimate: spread of the frame-0 voxels below 5% of its maximum
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static double	CLI_EstimateNoise(
+		const double*	F,
+		INT64			N )
+{
+double	Hi = F[0];
+	for ( INT64 i=1; i<N; i++ ) Hi = max( Hi,F[i] );
+
+const double	Thr = Hi*0.05;
+double	S = ZERO, S2 = ZERO;
+INT64		n = 0;
+
+	for ( INT64 i=0; i<N; i++ )
+		if ( F[i]<Thr ) { S += F[i]; S2 += F[i]*F[i]; n++; }
+
+	if ( n<2 ) return ZERO;
+
+	S /= n;
+	return sqrt( max( S2/n-S*S,ZERO ));
+}
+
+
+// Sample type in which the frames of F are kept; false if they are converted to double
+static bool	CLI_NativeType(
+		PNII_FILE	F,
+		int*		Type )
+{
+	switch ( F->Hdr.datatype ) {
+	case NII_INT16:	*Type = TT_INT16;		return true;
+	case NII_UINT16:	*Type = TT_UINT16;	return true;
+	case NII_FLOAT32:	*Type = TT_FLOAT32;	return true;
+	case NII_FLOAT64:	*Type = TT_FLOAT64;	return true;
+	}
+	*Type = TT_FLOAT64;
+	return false;
+}
+
+
+// NIfTI data type of an output plane
+static int	CLI_NiiType( const MB_PLANE* P )
+{
+	return P->Type==MB_INT16 ? NII_INT16 : P->Type==MB_FLOAT64 ? NII_FLOAT64 : NII_FLOAT32;
+}
+
+
+// Output file name: <prefix>_m<N>_<OP name with non-alphanumerics as '_'>.nii
+static std::string	CLI_OutName(
+		const std::string&	Prefix,
+		PMODEL_ENTRY		Model,
+		const char*			Name )
+{
+std::string	s = Prefix+"_m"+std::to_string( Model->Number )+"_";
+
+	for ( const char* p=Name; *p; p++ )
+		s += isalnum( (unsigned char)*p ) ? *p : '_';
+	return s+".nii";
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Out-of-core pass callbacks: read slices [z0,z0+Nz) of every frame, write an output slab there
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	CLI_ReadSlab(
+		PVOID		Ctx,
+		int		z0,
+		int		Nz,
+		PVOID*	Frame )
+{
+CLI_SLABCTX*	C	= (CLI_SLABCTX*)Ctx;
+PNII_FILE		In	= C->In;
+const INT64		SliceVox = (INT64)In->Nx*In->Ny;
+
+	for ( int t=0; t<NumTms; t++ )
+		if ( !(C->Native ? NII_ReadRawVoxels( In,t,z0*SliceVox,Nz*SliceVox,Frame[t] )
+				     : NII_ReadVoxels( In,t,z0*SliceVox,Nz*SliceVox,(PDOUBLE)Frame[t] ))) return false;
+
+	return true;
+}
+
+
+// Frame t of the study from frame tF of In; frame 0 also gives the noise level unless --noise set it
+static bool	CLI_GetFrame(
+		CLI_SLABCTX*	C,
+		PNII_FILE		In,
+		int			tF,
+		int			t,
+		PVOID			Frame )
+{
+PDOUBLE		F	= NULL;
+bool			res	= false;
+
+	if ( !(C->Native ? NII_ReadRawVoxels( In,tF,0,In->NumVox,Frame )
+			     : NII_ReadVoxels( In,tF,0,In->NumVox,(PDOUBLE)Frame ))) return false;
+	if ( t>0 || C->A->Noise>=0 ) {
+		if ( t==0 ) demp_NoiseLevel = C->A->Noise;
+		return true;
+	}
+
+	// the estimate takes the scaled frame
+	if ( C->Native ) {
+		xz( AllocMem<double >(F,In->NumVox ));
+		xz( NII_ReadVoxels( In,tF,0,In->NumVox,F ));
+	}
+	demp_NoiseLevel = CLI_EstimateNoise( F ? F : (PDOUBLE)Frame,In->NumVox );
+
+	res	= true;
+func_exit:
+	pf_free(&F);
+	return res;
+}
+
+
+// PM_CalcMapsFrames() reader of -i: frame t of the study
+static bool	CLI_ReadFrame(
+		PVOID		Ctx,
+		int		t,
+		PVOID		Frame )
+{
+CLI_SLABCTX*	C = (CLI_SLABCTX*)Ctx;
+
+	return CLI_GetFrame( C,C->In,t,t,Frame );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// --watch: open the k-th .nii file of the directory (name order, hidden files skipped) once all its
+// voxels are written; false if none is within A->WatchWait seconds
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	CLI_WaitFrame(
+		CLI_ARGS*	A,
+		int		k,
+		PNII_FILE	F )
+{
+const auto	t0 = std::chrono::steady_clock::now();
+
+	memset( F,0,sizeof(*F) );
+	for ( ;; ) {
+		std::vector<std::string>	Names;
+		DIR*				D = opendir( A->WatchDir.c_str() );		// NULL until the feed creates it
+
+		if ( D ) {
+			while ( dirent* e = readdir( D )) {
+				std::string	n = e->d_name;
+				if ( n[0]!='.' && n.size()>4 && !n.compare( n.size()-4,4,".nii" )) Names.push_back( n );
+			}
+			closedir( D );
+		}
+		std::sort( Names.begin(),Names.end() );
+
+		if ( (int)Names.size()>k ) {
+			std::string	Path = A->WatchDir+"/"+Names[k];
+			struct stat	St;
+
+			// the header may be written before the voxels: wait for the size it announces
+			if ( NII_Open( Path.c_str(),F ) && fstat( fileno( F->f ),&St )==0 &&
+			     St.st_size>=(INT64)F->Hdr.vox_offset+F->NumVox*F->BytesPerVox ) return true;
+			NII_Close( F );
+		}
+
+		if ( std::chrono::duration<double>( std::chrono::steady_clock::now()-t0 ).count()>A->WatchWait ) {
+			fprintf( stderr,"error: no frame %d in %s after %g s\n",k,A->WatchDir.c_str(),A->WatchWait );
+			return false;
+		}
+		std::this_thread::sleep_for( std::chrono::milliseconds( CLI_WATCHPOLL ));
+	}
+}
+
+
+// PM_CalcMapsFrames() reader of --watch: frame t from the t-th frame file, which must match the first
+static bool	CLI_WatchFrame(
+		PVOID		Ctx,
+		int		t,
+		PVOID		Frame )
+{
+CLI_SLABCTX*	C	= (CLI_SLABCTX*)Ctx;
+NII_FILE		F;
+bool			res	= false;
+
+	xz( CLI_WaitFrame( C->A,t,&F ));
+	if ( F.Hdr.datatype!=C->In->Hdr.datatype || F.NumVox!=C->In->NumVox || F.Slope!=C->In->Slope || F.Inter!=C->In->Inter )
+		xmsg( "A frame file does not match the grid, type or scaling of the first" );
+	xz( CLI_GetFrame( C,&F,0,t,Frame ));
+
+	res	= true;
+func_exit:
+	NII_Close( &F );
+	return res;
+}
+
+
+// PM_CalcMapsFrames() update of --watch: the maps of the first n frames replace the output files
+static bool	CLI_LiveUpdate(
+		PVOID		Ctx,
+		int		n )
+{
+CLI_SLABCTX*	C	= (CLI_SLABCTX*)Ctx;
+NII_HEADER		Hdr	= C->In->Hdr;
+
+	snprintf( Hdr.descrip,sizeof(Hdr.descrip),"live: %d of %d frames",n,NumTms );
+	for ( CLI_MAP& M : C->A->Maps )
+		for ( int o=0; o<M.Model->NumOutParms; o++ ) {
+			const MB_PLANE&	P = M.OutPlane[o];
+			if ( !P.Data ) continue;
+
+			// written aside, then renamed over the output
+			const std::string	Name = CLI_OutName( C->A->OutPrefix,M.Model,M.Model->OPName[o] ),
+						Part = Name+".part";
+			NII_FILE		Out;
+			if ( !NII_Create( Part.c_str(),&Hdr,1,CLI_NiiType( &P ),&Out,P.Scale,P.Offset )) return false;
+			bool	Ok = NII_WriteRawVoxels( &Out,P.Data,C->In->NumVox );
+			NII_Close( &Out );
+			if ( !Ok || rename( Part.c_str(),Name.c_str() )) return false;
+		}
+
+	fprintf( stderr,"frame %d of %d: maps updated\n",n,NumTms );
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Write every requested map to <Prefix>_m<N>_<OP name>.nii; with Release, free each plane once written
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	CLI_WriteMaps(
+		CLI_ARGS*			A,
+		PNII_FILE			In,
+		const std::string&	Prefix,
+		bool				Release )
+{
+	for ( CLI_MAP& M : A->Maps )
+		for ( int o=0; o<M.Model->NumOutParms; o++ ) {
+			MB_PLANE&	P = M.OutPlane[o];
+			if ( !P.Data ) continue;
+
+			NII_FILE	Out;
+			if ( !NII_Create( CLI_OutName( Prefix,M.Model,M.Model->OPName[o] ).c_str(),&In->Hdr,1,CLI_NiiType( &P ),&Out,P.Scale,P.Offset )) return false;
+			bool	Ok = NII_WriteRawVoxels( &Out,P.Data,In->NumVox );
+			NII_Close( &Out );
+			if ( !Ok ) return false;
+
+			if ( Release ) pf_free(&P.Data);
+		}
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Write every series to the frames of <Prefix>_m<N>_<series name>.nii, freeing each plane once written
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	CLI_WriteSeries(
+		CLI_ARGS*			A,
+		PNII_FILE			In )
+{
+	for ( CLI_MAP& M : A->Maps ) {
+		if ( M.SeriesPlane.empty() ) continue;
+
+		const MB_PLANE&	P0 = M.SeriesPlane[0];
+		NII_FILE		Out;
+		bool			Ok;
+
+		if ( !NII_Create( CLI_OutName( A->OutPrefix,M.Model,M.Model->SeriesName ).c_str(),&In->Hdr,(int)M.SeriesPlane.size(),
+				CLI_NiiType( &P0 ),&Out,P0.Scale,P0.Offset )) return false;
+
+		Ok = true;
+		for ( MB_PLANE& P : M.SeriesPlane ) {
+			Ok = Ok && NII_WriteRawVoxels( &Out,P.Data,In->NumVox );
+			pf_free(&P.Data);
+		}
+		NII_Close( &Out );
+		if ( !Ok ) return false;
+	}
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// --sweep: build the window table from the converted study, then the maps of every window of the file
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	CLI_Sweep(
+		CLI_ARGS*			A,
+		PNII_FILE			In,
+		std::vector<PM_MAPREQ>*	Req,
+		const double*		Conc,
+		const double*		MinSig )
+{
+std::vector<double>	Start,Length;
+WT_TABLE		T;
+unsigned		Parts	= 0;
+bool			res	= false;
+
+	WT_Init( &T );
+	if ( !Conc ) xmsg( "The converted study is not available for the sweep" );
+	xz( CLI_ReadColumns( A->SweepPath.c_str(),&Start,&Length ));
+	if ( Start.size()!=Length.size() ) xmsg( "The sweep file must list \"Start Length\" per line" );
+
+	for ( const CLI_MAP& M : A->Maps ) Parts |= M.Model->WindowParts;
+
+	{
+	auto		T0 = std::chrono::steady_clock::now();
+	if ( !WT_Build( &T,Conc,MinSig,In->NumVox,Parts,PM_NumThreads( &A->Opt ))) xmsg( "The window table cannot be allocated" );
+	double	Sec = std::chrono::duration<double>( std::chrono::steady_clock::now()-T0 ).count();
+	fprintf( stderr,"window table: %.1f MB in %.3f s\n",WT_Bytes( In->NumVox,Parts )/1048576.0,Sec );
+	}
+
+	for ( size_t k=0; k<Start.size(); k++ ) {
+		for ( CLI_MAP& M : A->Maps ) {
+			M.Model->FreeParm[0] = Start[k];
+			M.Model->FreeParm[1] = Length[k];
+		}
+
+		auto	T0 = std::chrono::steady_clock::now();
+		if ( !PM_CalcMapsWindow( Req->data(),(int)Req->size(),&T,&A->Opt )) xmsg( "A window of the sweep cannot be computed" );
+		double	Sec = std::chrono::duration<double>( std::chrono::steady_clock::now()-T0 ).count();
+		fprintf( stderr,"window %d (start %g, length %g): %.4f s\n",(int)k+1,Start[k],Length[k],Sec );
+
+		xz( CLI_WriteMaps( A,In,A->OutPrefix+"_w"+std::to_string( k+1 ),false ));
+	}
+
+	res	= true;
+func_exit:
+	WT_Free( &T );
+	return res;
+}
+
+
+// PM_CalcMapsMoving() writer: window w of a run into frame w of the 4D output
+static bool	CLI_WriteWindow(
+		PVOID			Ctx,
+		int			Req,
+		int			Op,
+		int			w,
+		INT64			V0,
+		int			N,
+		const MB_PLANE*	Plane )
+{
+	return NII_WriteRawVoxelsAt( &((CLI_ARGS*)Ctx)->Maps[Req].OutFile[Op],w,V0,Plane->Data,N );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// --moving: the outputs of every window of A->MovingL frames from the converted study, as 4D maps
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool	CLI_Moving(
+		CLI_ARGS*			A,
+		PNII_FILE			In,
+		std::vector<PM_MAPREQ>*	Req,
+		const double*		Conc,
+		const double*		MinSig )
+{
+const int		K	= NumTms-A->MovingL+1;
+const std::string	Prefix = A->OutPrefix+"_mov"+std::to_string( A->MovingL );
+PM_MOVINGIO		Io	= { A,CLI_WriteWindow };
+bool			res	= false;
+
+	if ( !Conc ) xmsg( "The converted study is not available for the sliding windows" );
+
+	for ( CLI_MAP& M : A->Maps )
+		for ( int o=0; o<M.Model->NumOutParms; o++ ) {
+			const MB_PLANE&	P = M.OutPlane[o];
+			if ( P.Data ) xz( NII_Create( CLI_OutName( Prefix,M.Model,M.Model->OPName[o] ).c_str(),&In->Hdr,K,CLI_NiiType( &P ),&M.OutFile[o],P.Scale,P.Offset ));
+		}
+
+	{
+	auto		T0 = std::chrono::steady_clock::now();
+	if ( !PM_CalcMapsMoving( Req->data(),(int)Req->size(),Conc,MinSig,In->NumVox,A->MovingL,&Io,&A->Opt ))
+		xmsg( "The sliding-window maps cannot be computed" );
+	double	Sec = std::chrono::duration<double>( std::chrono::steady_clock::now()-T0 ).count();
+	fprintf( stderr,"%d windows of %d frames: %.3f s\n",K,A->MovingL,Sec );
+	}
+
+	res	= true;
+func_exit:
+	for ( CLI_MAP& M : A->Maps )
+		for ( NII_FILE& F : M.OutFile ) NII_Close( &F );
+	return res;
+}
+
+
+static bool	CLI_WriteSlab(
+		PVOID			Ctx,
+		int			z0,
+		int			Nz,
+		int			Req,
+		int			Op,
+		const MB_PLANE*	Plane )
+{
+CLI_SLABCTX*	C = (CLI_SLABCTX*)Ctx;
+const INT64	SliceVox = (INT64)C->In->Nx*C->In->Ny;
+
+	// at the place of slices [z0,z0+Nz) of the map, whatever order the slabs come in
+	return NII_WriteRawVoxelsAt( &C->A->Maps[Req].OutFile[Op],0,z0*SliceVox,Plane->Data,Nz*SliceVox );
+}
+
+
+int	main(
+		int		argc,
+		char**	argv )
+{
+CLI_ARGS			A;
+NII_FILE			In,Roi;
+NII_FRAMEREADER		Rd;
+std::vector<PVOID>	Frame;
+PDOUBLE			Scan		= NULL;
+std::vector<double>	Times,TimesY,Tac;
+std::vector<PM_MAPREQ>	Req;
+std::vector<unsigned char>	Mask;
+MP_PROFILE			Prof;
+CC_FILE			Cache;
+PDOUBLE			SweepConc	= NULL,			// --sweep/--moving without a cache: the converted study
+				SweepMin	= NULL;
+uint64_t			Hash		= 0;			// of the frames, for the cache key
+bool				AnyRaw	= false;
+PDOUBLE			RoiMask	= NULL,
+				RoiTac	= NULL;
+bool				res		= false;
+
+	memset( &In,0,sizeof(In) );
+	memset( &Roi,0,sizeof(Roi) );
+	Rd.Raw[0] = Rd.Raw[1] = NULL;
+	CC_Init( &Cache );
+
+	xz( CLI_ParseArgs( argc,argv,&A ));
+	if ( A.WatchDir.empty() )	xz( NII_Open( A.InPath.c_str(),&In ));
+	else				xz( CLI_WaitFrame( &A,0,&In ));			// geometry and times from the first frame
+	if ( !A.ProfilePath.empty() ) A.Opt.Profile = &Prof;
+
+	{
+	const bool	Slab = A.MemBudget>0 && !A.Frames;
+	int		Type;
+	const bool	Native = CLI_NativeType( &In,&Type );
+	// scaling of native samples, applied by the driver (Slope 0 = none)
+	const bool	Scaled = Native && (In.Slope!=ONE || In.Inter!=ZERO);
+	const double	Slope	= Scaled ? In.Slope : ZERO,
+			Inter	= Scaled ? In.Inter : ZERO;
+
+	NumTms = A.WatchDir.empty() ? In.Nt : A.WatchFrames;
+	if ( NumTms<2 || NumTms>DEF_MAXNUMTMS ) xmsg( "The input must have 2..DEF_MAXNUMTMS frames" );
+	if ( A.MovingL>NumTms ) xmsg( "The --moving window is longer than the study" );
+
+	// Frame times
+	xz( AllocMem<double >(AbsTarr,NumTms ));
+	if ( !A.TimesPath.empty() ) {
+		xz( CLI_ReadColumns( A.TimesPath.c_str(),&Times,&TimesY ));
+		if ( (int)TimesY.size()!=NumTms ) xmsg( "The times file must list one time per frame" );
+		for ( int t=0; t<NumTms; t++ ) AbsTarr[t] = TimesY[t];
+	}
+	else {
+		double	dt = In.Hdr.pixdim[4]>0 ? In.Hdr.pixdim[4]*NII_FrameTimeScale( &In.Hdr ) : ONE;
+		for ( int t=0; t<NumTms; t++ ) AbsTarr[t] = In.Hdr.toffset+t*dt;
+	}
+
+	// ROI mask for the white-matter TAC
+	if ( !A.RoiPath.empty() ) {
+		xz( NII_Open( A.RoiPath.c_str(),&Roi ));
+		if ( Roi.NumVox!=In.NumVox ) xmsg( "The ROI mask does not match the input grid" );
+		xz( AllocMem<double >(RoiMask,Roi.NumVox ));
+		xz( NII_ReadVolume( &Roi,0,RoiMask ));
+		xz( AllocMem<double >(RoiTac,NumTms ));
+		RoiTacArr	= &RoiTac;
+		NumRoiTac	= 1;
+	}
+
+	// Mask of the voxels to evaluate
+	if ( !A.MaskPath.empty() ) {
+		NII_FILE	M;
+		PDOUBLE	V = NULL;
+		bool		Ok;
+
+		memset( &M,0,sizeof(M) );
+		Ok = NII_Open( A.MaskPath.c_str(),&M ) && M.NumVox==In.NumVox && AllocMem<double >(V,M.NumVox ) &&
+		     NII_ReadVolume( &M,0,V );
+		if ( Ok ) {
+			Mask.resize( M.NumVox );
+			for ( INT64 i=0; i<M.NumVox; i++ ) Mask[i] = V[i]!=ZERO;
+			A.Opt.Mask = Mask.data();
+		}
+		pf_free(&V);
+		NII_Close( &M );
+		if ( !Ok ) xmsg( "The mask cannot be read or does not match the input grid" );
+	}
+
+	// Stream the frames in, building the global and ROI TACs on the way
+	// (native frames are kept raw and scanned through one double buffer;
+	// out-of-core: the data is read again by slabs; --frames: the pass
+	// reads them, and its models need neither TAC)
+	if ( !A.Frames ) {
+		xz( AllocMem<double >(GlobalTac,NumTms+GLOBALTAC_PAD ));
+		Frame.assign( NumTms,(PVOID)NULL );
+		if ( Slab || Native ) xz( AllocMem<double >(Scan,In.NumVox ));
+		xz( NII_StartReader( &In,&Rd ));
+
+		for ( int t=0; t<NumTms; t++ ) {
+			if ( !Slab ) {
+				char*	p = NULL;
+				xz( AllocMem<char >(p,In.NumVox*TT_SampleBytes( Type )));
+				Frame[t] = p;
+			}
+
+			PDOUBLE	F = (Slab || Native) ? Scan : (PDOUBLE)Frame[t];
+			xz( NII_NextFrame( &Rd,F,(Native && !Slab) ? Frame[t] : NULL ));
+			if ( !A.CacheDir.empty() ) Hash = CC_Hash( Hash,F,In.NumVox*(INT64)sizeof(double) );
+
+			double	S = ZERO, SR = ZERO;
+			INT64		nR = 0;
+			for ( INT64 i=0; i<In.NumVox; i++ ) {
+				S += F[i];
+				if ( RoiMask && RoiMask[i]>0 ) { SR += F[i]; nR++; }
+			}
+			GlobalTac[t] = S/In.NumVox;
+			if ( RoiTac ) RoiTac[t] = nR ? SR/nR : ZERO;
+
+			if ( t==0 ) demp_NoiseLevel = A.Noise>=0 ? A.Noise : CLI_EstimateNoise( F,In.NumVox );
+		}
+		for ( int t=NumTms; t<NumTms+GLOBALTAC_PAD; t++ ) GlobalTac[t] = GlobalTac[NumTms-1];
+
+		NII_StopReader( &Rd );
+		pf_free(&Scan);
+	}
+
+	// Map requests: free parameters, input functions and output planes
+	for ( CLI_MAP& M : A.Maps ) {
+		PMODEL_ENTRY	E = M.Model;
+
+		if ( (int)M.FreeParm.size()>E->NumFreeParms ) xmsg( "Too many free parameters for the model" );
+		for ( size_t k=0; k<M.FreeParm.size(); k++ ) E->FreeParm[k] = M.FreeParm[k];
+
+		if ( E->SeriesName ) {
+			*E->NumSeries = M.SeriesFrames ? MB_SERIESFRAMES : (int)M.Series.size();
+			std::copy( M.Series.begin(),M.Series.end(),E->SeriesTime );
+		}
+
+		if ( E->NumIfuncs>0 ) {
+			if ( M.IfuncPath.empty() ) xmsg( "The model needs an input function (-f)" );
+			xz( CLI_ReadColumns( M.IfuncPath.c_str(),&M.IfTarr,&M.IfVal ));
+			M.Ifunc.n		= (int)M.IfVal.size();
+			M.Ifunc.Tarr	= M.IfTarr.empty() ? NULL : M.IfTarr.data();
+			M.Ifunc.Val		= M.IfVal.data();
+		}
+
+		if ( M.Quant.size()>1 && (int)M.Quant.size()!=E->NumOutParms ) xmsg( "-q needs one scale, or one per output" );
+
+		const UINT32	Used = ModelOutUsed( E );
+
+		M.OutPlane.assign( E->NumOutParms,MB_PLANE() );
+		M.OutFile.assign( E->NumOutParms,NII_FILE() );
+		for ( int o=0; o<E->NumOutParms; o++ ) {
+			bool	Want = M.OutReq.empty();
+			for ( int r : M.OutReq ) Want |= r==o;
+			if ( !(Used & BM(o)) ) {
+				if ( !M.OutReq.empty() && Want ) xmsg( "The output is not computed with these free parameters (-p)" );
+				Want = false;
+			}
+			if ( (!A.SweepPath.empty() || A.MovingL) && !(E->WindowOut & BM(o)) ) {
+				if ( !M.OutReq.empty() && Want ) xmsg( "The output has no window form (order statistics need the TACs)" );
+				Want = false;
+			}
+			if ( A.Frames && !((A.WatchDir.empty() ? E->FrameOut : E->LiveOut) & BM(o)) ) {
+				if ( !M.OutReq.empty() && Want ) xmsg( "The output cannot be accumulated frame by frame (order statistics need the TACs)" );
+				Want = false;
+			}
+			if ( !Want ) continue;
+
+			MB_PLANE&	P = M.OutPlane[o];
+			P.Type	= M.Quant.empty() ? (A.F64 ? MB_FLOAT64 : MB_FLOAT32) : MB_INT16;
+			P.Scale	= M.Quant.empty() ? ONE : M.Quant[M.Quant.size()>1 ? o : 0];
+			P.Offset	= ZERO;
+			if ( P.Scale<=ZERO ) xmsg( "-q scales must be positive" );
+
+			if ( Slab ) {
+				// the driver keeps slab planes; a non-NULL entry marks the output requested
+				xz( NII_Create( CLI_OutName( A.OutPrefix,E,E->OPName[o] ).c_str(),&In.Hdr,1,CLI_NiiType( &P ),&M.OutFile[o],P.Scale,P.Offset ));
+				P.Data = &CLI_SlabMark;
+			}
+			else {
+				char*	p = NULL;
+				xz( AllocMem<char >(p,In.NumVox*MB_PlaneBytes( P.Type )));
+				P.Data = p;
+			}
+		}
+
+		// series: one plane per point, typed like the outputs
+		if ( M.SeriesFrames || !M.Series.empty() ) {
+			M.SeriesPlane.assign( M.SeriesFrames ? NumTms : M.Series.size(),MB_PLANE() );
+			for ( MB_PLANE& P : M.SeriesPlane ) {
+				char*	p = NULL;
+				P.Type	= M.Quant.empty() ? (A.F64 ? MB_FLOAT64 : MB_FLOAT32) : MB_INT16;
+				P.Scale	= M.Quant.empty() ? ONE : M.Quant[0];
+				P.Offset	= ZERO;
+				xz( AllocMem<char >(p,In.NumVox*MB_PlaneBytes( P.Type )));
+				P.Data	= p;
+			}
+		}
+
+		PM_MAPREQ	R = {};
+
+		R.Model		= E;
+		R.IFarr		= E->NumIfuncs ? &M.Ifunc : NULL;
+		R.NumIF		= E->NumIfuncs;
+		R.OutPlane		= M.OutPlane.data();
+		R.SeriesPlane	= M.SeriesPlane.empty() ? NULL : M.SeriesPlane.data();
+		R.NumSeries		= (int)M.SeriesPlane.size();
+		Req.push_back( R );
+		AnyRaw |= E->RawSignal;
+	}
+
+	// Concentration cache of these data and conversion settings: map it, or create it for the pass to fill
+	if ( !A.CacheDir.empty() ) {
+		CC_HEADER	Key;
+		CC_MakeKey( &Key,Hash,In.Nx,In.Ny,In.Nz,NumTms );
+
+		if ( CC_Open( A.CacheDir.c_str(),&Key,&Cache ))
+			fprintf( stderr,"concentration cache %s\n",Cache.Path.c_str() );
+		else if ( !CC_Create( A.CacheDir.c_str(),&Key,&Cache ))
+			fprintf( stderr,"warning: running without the concentration cache\n" );
+
+		// the models read the cache; the frames are only needed for raw signal
+		if ( Cache.Ready && !AnyRaw )
+			for ( PVOID& F : Frame ) pf_free(&F);
+	}
+
+	// a sweep or sliding windows start from the converted study: keep it in memory if there is no cache
+	if ( (!A.SweepPath.empty() || A.MovingL) && !Cache.Conc ) {
+		xz( AllocMem<double >(SweepConc,In.NumVox*NumTms ));
+		xz( AllocMem<double >(SweepMin,In.NumVox ));
+	}
+
+	if ( A.Frames ) {
+		CLI_SLABCTX	Ctx = { &In,&A,Native };
+		const bool	Live = !A.WatchDir.empty();
+		PM_FRAMEIO	Io  = { &Ctx,Live ? CLI_WatchFrame : CLI_ReadFrame,Live ? CLI_LiveUpdate : NULL,Type,Slope,Inter,A.MemBudget,0 };
+		auto		T0  = std::chrono::steady_clock::now();
+
+		if ( !PM_CalcMapsFrames( Req.data(),(int)Req.size(),In.Nx,In.Ny,In.Nz,&Io,&A.Opt )) {
+			if ( Io.Budget && Io.AccBytes>Io.Budget )
+				fprintf( stderr,"error: the accumulators of the maps take %.1f MB, more than --mem\n",Io.AccBytes/(1024.*1024) );
+			goto func_exit;
+		}
+
+		double	Sec = std::chrono::duration<double>( std::chrono::steady_clock::now()-T0 ).count();
+		fprintf( stderr,"%lld voxels x %d frames, %d map(s), %d thread(s), %s: %.3f s\n",
+			(long long)In.NumVox,NumTms,(int)Req.size(),PM_NumThreads( &A.Opt ),Live ? "live" : "frame by frame",Sec );
+	}
+	else if ( Slab ) {
+		CLI_SLABCTX	Ctx = { &In,&A,Native };
+		PM_SLABIO	Io  = { &Ctx,CLI_ReadSlab,CLI_WriteSlab,0,Type,Slope,Inter,Cache.Conc,Cache.MinSig,Cache.Ready };
+		auto		T0  = std::chrono::steady_clock::now();
+
+		xz( PM_CalcMapsSlabs( Req.data(),(int)Req.size(),In.Nx,In.Ny,In.Nz,&Io,A.MemBudget,&A.Opt ));
+
+		double	Sec = std::chrono::duration<double>( std::chrono::steady_clock::now()-T0 ).count();
+		fprintf( stderr,"%lld voxels x %d frames, %d map(s), %d thread(s), %d-slice slabs: %.3f s\n",
+			(long long)In.NumVox,NumTms,(int)Req.size(),PM_NumThreads( &A.Opt ),Io.SlabZ,Sec );
+
+		for ( CLI_MAP& M : A.Maps ) {
+			for ( NII_FILE& F : M.OutFile ) NII_Close( &F );
+			M.OutPlane.assign( M.OutPlane.size(),MB_PLANE() );
+		}
+	}
+	else {
+		PM_INPUT	Inp = {};
+		auto		T0  = std::chrono::steady_clock::now();
+
+		Inp.Frame	= Frame.data();
+		Inp.Nx	= In.Nx;
+		Inp.Ny	= In.Ny;
+		Inp.Nz	= In.Nz;
+		Inp.Type	= Type;
+		Inp.Slope	= Slope;
+		Inp.Inter	= Inter;
+		Inp.Conc	= SweepConc ? SweepConc : Cache.Conc;
+		Inp.MinSig	= SweepConc ? SweepMin : Cache.MinSig;
+		Inp.ConcReady= Cache.Ready;
+
+		xz( PM_CalcMaps( Req.data(),(int)Req.size(),&Inp,&A.Opt ));
+
+		double	Sec = std::chrono::duration<double>( std::chrono::steady_clock::now()-T0 ).count();
+		fprintf( stderr,"%lld voxels x %d frames, %d map(s), %d thread(s): %.3f s\n",
+			(long long)In.NumVox,NumTms,(int)Req.size(),PM_NumThreads( &A.Opt ),Sec );
+	}
+
+	if ( Cache.Map && !Cache.Ready ) {
+		if ( CC_Commit( &Cache ))	fprintf( stderr,"concentration cache written to %s\n",Cache.Path.c_str() );
+		else				fprintf( stderr,"warning: the concentration cache could not be written\n" );
+	}
+
+	if ( A.Opt.Profile ) {
+		FILE*	f  = fopen( A.ProfilePath.c_str(),"w" );
+		bool	Ok = f && MP_WriteJson( &Prof,f );
+		if ( f ) fclose( f );
+		if ( !Ok ) xmsg( "The profile cannot be written" );
+#if !defined(PARMMAP_PROFILE)
+		fprintf( stderr,"note: built without PARMMAP_PROFILE, the profile holds no stage data\n" );
+#endif
+	}
+
+	for ( const PM_MAPREQ& R : Req )
+		if ( R.NumSkipped )
+			fprintf( stderr,"model %d: %lld background voxel(s) skipped\n",R.Model->Number,(long long)R.NumSkipped );
+	}
+
+	// Frames are no longer needed: release them before writing
+	for ( PVOID& F : Frame ) pf_free(&F);
+
+	xz( CLI_WriteMaps( &A,&In,A.OutPrefix,A.SweepPath.empty() && !A.MovingL ));
+	xz( CLI_WriteSeries( &A,&In ));
+
+	if ( !A.SweepPath.empty() )
+		xz( CLI_Sweep( &A,&In,&Req,SweepConc ? SweepConc : Cache.Conc,SweepConc ? SweepMin : Cache.MinSig ));
+
+	if ( A.MovingL )
+		xz( CLI_Moving( &A,&In,&Req,SweepConc ? SweepConc : Cache.Conc,SweepConc ? SweepMin : Cache.MinSig ));
+
+	res	= true;
+func_exit:
+	NII_StopReader( &Rd );
+	for ( PVOID& F : Frame ) pf_free(&F);
+	for ( CLI_MAP& M : A.Maps ) {
+		if ( A.MemBudget>0 && !A.Frames ) M.OutPlane.clear();
+		for ( MB_PLANE& P : M.OutPlane ) pf_free(&P.Data);
+		for ( MB_PLANE& P : M.SeriesPlane ) pf_free(&P.Data);
+		for ( NII_FILE& F : M.OutFile ) NII_Close( &F );
+	}
+	pf_free(&Scan);
+	pf_free(&SweepConc);
+	pf_free(&SweepMin);
+	CC_Close( &Cache );
+	NII_Close( &In );
+	NII_Close( &Roi );
+	pf_free(&RoiMask);
+	pf_free(&RoiTac);
+	pf_free(&GlobalTac);
+	pf_free(&AbsTarr);
+	return res ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+/**
+* @file Phantom.cpp
+* @brief Synthetic dynamic phantoms (see @c Phantom.h).
+*/
+
+#include	"stdafx.h"
+#include	"Phantom.h"
+
+
+static const char*	PH_Names[PH_NUMKINDS] = { "dce","dsc","interleaved","rise" };
+
+
+void	PH_DefaultSpec(
+		PH_KIND	Kind,
+		int		Nx,
+		int		Ny,
+		int		Nz,
+		int		NumTms,
+		PPH_SPEC	Spec )
+{
+	Spec->Kind		= Kind;
+	Spec->Nx		= Nx;
+	Spec->Ny		= Ny;
+	Spec->Nz		= Nz;
+	Spec->NumTms	= NumTms;
+	Spec->Dt		= 2.0;
+	Spec->S0		= Kind==PH_DSC ? 400 : 100;
+	Spec->Noise		= 2.0;
+	Spec->AirFrac	= 0.15;
+	Spec->Seed		= 1;
+}
+
+
+const char*	PH_KindName( PH_KIND Kind )
+{
+	return PH_Names[Kind];
+}
+
+
+bool	PH_ParseKind(
+		const char*	Name,
+		PH_KIND*	pKind )
+{
+	for ( int k=0; k<PH_NUMKINDS; k++ )
+		if ( !strcmp( Name,PH_Names[k] )) { *pKind = (PH_KIND)k; return true; }
+
+	return false;
+}
+
+
+// Phantom shaped for the model "Number"
+PH_KIND	PH_KindForModel( int ModelNumber )
+{
+	switch ( ModelNumber ) {
+	case 3:	return PH_INTERLEAVED;
+	case 5:	return PH_RISE;
+	case 6:	return PH_DSC;
+	}
+	return PH_DCE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Counter-based random numbers: uniform in [0,1) and standard normal from (seed, voxel, frame)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint64_t	PH_Hash( uint64_t x )
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x  = (x^(x>>30))*0xBF58476D1CE4E5B9ull;
+	x  = (x^(x>>27))*0x94D049BB133111EBull;
+	return x^(x>>31);
+}
+
+static inline double	PH_Uniform( uint64_t Key )
+{
+	return (PH_Hash( Key )>>11)*(1.0/9007199254740992.0);
+}
+
+static inline double	PH_Gauss( uint64_t Key )
+{
+double	u1 = max( PH_Uniform( Key ),1e-300 ),
+		u2 = PH_Uniform( Key^0x5851F42D4C957F2Dull );
+
+	return sqrt( -2*log( u1 ))*cos( 2*M_PI*u2 );
+}
+
+
+// Gamma-variate bolus shape, peak 1 at t0+Tau
+static inline double	PH_Bolus(
+		double	t,
+		double	t0,
+		double	Tau )
+{
+	if ( t<=t0 ) return ZERO;
+
+double	x = (t-t0)/Tau;
+	return x*exp( 1-x );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Noise-free signal of a tissue voxel at time t; a, b in [0,1) vary the curve across the volume
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+static double	PH_Tissue(
+		PPH_SPEC	Spec,
+		int		t,
+		double	a,
+		double	b )
+{
+const double	T	= Spec->NumTms*Spec->Dt,
+			tt	= t*Spec->Dt,
+			t0	= 0.1*T;
+
+	switch ( Spec->Kind ) {
+	case PH_DCE:
+		return Spec->S0*(1+(0.5+2*a)*PH_Bolus( tt,t0,(0.05+0.1*b)*T ));
+
+	case PH_DSC:
+		return Spec->S0*exp( -(0.3+0.5*a)*PH_Bolus( tt,t0+0.1*b*T,0.05*T ));
+
+	case PH_INTERLEAVED:
+		return Spec->S0*((t&1) ? 1+0.5*a : 1+0.2*b)*(1+0.1*tt/T);
+
+	case PH_RISE:
+		return Spec->S0*(1+(0.5+a)/(1+exp( -(tt-(0.2+0.4*b)*T)/(0.03*T) )));
+
+	default:
+		return Spec->S0;
+	}
+}
+
+
+/**
+* @brief Generate frame @p t of the phantom.
+*
+* @param[in]  Spec   Phantom description.
+* @param[in]  t      Frame index, 0 <= t < @c Spec->NumTms.
+* @param[out] Frame  Nx*Ny*Nz voxels, x fastest.
+*/
+
+void	PH_Frame(
+		PPH_SPEC	Spec,
+		int		t,
+		PDOUBLE	Frame )
+{
+const int	Bx = (int)(Spec->AirFrac*Spec->Nx),
+		By = (int)(Spec->AirFrac*Spec->Ny);
+INT64		v  = 0;
+
+	for ( int z=0; z<Spec->Nz; z++ )
+	for ( int y=0; y<Spec->Ny; y++ )
+	for ( int x=0; x<Spec->Nx; x++, v++ ) {
+		const uint64_t	Key = ((uint64_t)Spec->Seed<<48)^((uint64_t)v<<16)^(uint64_t)t;
+		const double		n   = Spec->Noise*PH_Gauss( Key );
+
+		if ( x<Bx || x>=Spec->Nx-Bx || y<By || y>=Spec->Ny-By ) {
+			Frame[v] = fabs( n );
+			continue;
+		}
+
+		double	a = (double)x/Spec->Nx,
+				b = (double)(y+Spec->Ny*z)/((INT64)Spec->Ny*Spec->Nz);
+		Frame[v] = PH_Tissue( Spec,t,a,b )+n;
+	}
+}
+
+
+// Noise-free curve of a mid-volume tissue voxel (reference curve for Model 4)
+void	PH_ReferenceCurve(
+		PPH_SPEC	Spec,
+		PDOUBLE	Ref )
+{
+	for ( int t=0; t<Spec->NumTms; t++ )
+		Ref[t] = PH_Tissue( Spec,t,0.5,0.5 );
+}
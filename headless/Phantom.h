@@ -0,0 +1,52 @@
+/**
+* @file Phantom.h
+* @brief Synthetic dynamic phantoms for benchmarking the models.
+*
+* @details
+* A phantom is a 4D study in frame-major layout (one 3D frame per time point)
+* whose voxel TACs have the shape a model expects:
+*   - @c PH_DCE         — gamma-variate enhancement on a baseline (Models 0, 1, 4).
+*   - @c PH_DSC         — signal drop of a bolus passage (Model 6).
+*   - @c PH_INTERLEAVED — two alternating states (Model 3).
+*   - @c PH_RISE        — noisy sigmoid rise (Model 5).
+*
+* Curve parameters vary smoothly across the volume, a border of
+* @c PH_SPEC::AirFrac of the in-plane extent holds background noise only, and
+* Gaussian noise of @c PH_SPEC::Noise is added everywhere. Voxel values depend
+* only on the spec and the (voxel, frame) index, so a phantom is reproducible
+* and frames can be generated in any order.
+*/
+
+#pragma once
+
+
+enum PH_KIND {
+	PH_DCE	= 0,
+	PH_DSC,
+	PH_INTERLEAVED,
+	PH_RISE,
+	PH_NUMKINDS
+};
+
+
+struct PH_SPEC {
+	PH_KIND	Kind;
+	int		Nx,Ny,Nz;
+	int		NumTms;
+	double	Dt;				// frame spacing (s)
+	double	S0;				// tissue baseline signal
+	double	Noise;			// noise SD
+	double	AirFrac;			// in-plane border fraction of background voxels
+	UINT32	Seed;
+};
+
+typedef PH_SPEC*	PPH_SPEC;
+
+
+void		PH_DefaultSpec( PH_KIND Kind,int Nx,int Ny,int Nz,int NumTms,PPH_SPEC Spec );
+const char*	PH_KindName( PH_KIND Kind );
+bool		PH_ParseKind( const char* Name,PH_KIND* pKind );
+PH_KIND	PH_KindForModel( int ModelNumber );
+
+void		PH_Frame( PPH_SPEC Spec,int t,PDOUBLE Frame );
+void		PH_ReferenceCurve( PPH_SPEC Spec,PDOUBLE Ref );
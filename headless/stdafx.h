@@ -0,0 +1,289 @@
+/**
+* @file stdafx.h
+* @brief Headless stand-in for the FireVoxel/DEMP framework header.
+*
+* @details
+* The model sources include "stdafx.h" for the framework types, macros,
+* globals and utility functions. Inside FireVoxel that is the application's
+* precompiled header; this one supplies the same names for the headless
+* engine (see @c Framework.cpp for the implementations and @c ParmMapCli.cpp
+* for the executable). Only what the models and drivers use is declared.
+*
+* @section ts Thread-safety
+* The globals are set by the engine before @c M*_ModelInit() and only read
+* while maps are computed; every function here is reentrant.
+*/
+
+#pragma once
+
+#include	<stddef.h>
+#include	<stdint.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<math.h>
+
+
+typedef int64_t		INT64;
+typedef uint32_t		UINT32;
+typedef int			BOOL;
+typedef char*		PSTR;
+typedef void*		PVOID;
+typedef double*		PDOUBLE;
+typedef double*		PIVAL;			// output cursor advanced by Write()
+
+#ifndef TRUE
+#define	TRUE	1
+#define	FALSE	0
+#endif
+
+#define	BM(b)		(1u<<(b))
+
+const double	ONE		= 1.0;
+const double	ZERO		= 0.0;
+const double	VOIDVOX	= -1e30;			// value of a voxel the model could not evaluate
+const double	VOIDVAL	= VOIDVOX;
+
+enum {
+	DEF_MAXNUMTMS	= 4096			// upper bound of NumTms (stack TAC buffers)
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Model descriptors (only meaningful to the GUI; kept so the model tables compile)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+enum {
+	MCLASS_MR	= 0,
+	MCLASS_CT,
+	MCLASS_PET,
+	MCLASS_NM
+};
+const UINT32	MCLASS_MSK_ALL	= 0xFFFFFFFF;
+
+enum {
+	DYNDIM_TIME	= 0,
+	DYNDIM_OTHER
+};
+const UINT32	DYNDIM_MSK_ALL	= 0xFFFFFFFF;
+
+enum {
+	VA_OPTIM_NONE	= 0
+};
+
+enum PR_CLRMAP {
+	PR_CLRMAP_GRAY	= 0,
+	PR_CLRMAP_RAINBOW
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Signal to concentration conversion
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+enum {
+	CONCTYPE_NOCONV	= 0,			// C = S
+	CONCTYPE_DIFF,				// C = S-S0
+	CONCTYPE_RELENH,				// C = (S-S0)/S0
+	CONCTYPE_DR2,				// C = -ln(S/S0)/TE
+	CONCTYPE_NUM
+};
+const UINT32	CONCTYPE_MSK_ALL	= 0xFFFFFFFF;
+
+// Conversion settings of the study
+struct PR_CONCCONV {
+	int		Type;				// CONCTYPE_*
+	int		BaseStart,			// baseline frames [BaseStart,BaseEnd], 0-based inclusive
+			BaseEnd;
+	double	TE;				// echo time for CONCTYPE_DR2
+};
+
+// Baseline used for one TAC
+struct PR_CONCCONVBASE {
+	double	S0;
+};
+
+extern	PR_CONCCONV	ConcConv;
+
+void	funcSigToConc(
+		PDOUBLE			Sig,
+		int				N,
+		PDOUBLE			Conc,
+		int				NumTac,
+		PR_CONCCONVBASE*		pConvBase );
+
+void	funcSigToConcBase(
+		int				N,
+		int*				pB0,
+		int*				pB1 );
+
+bool	funcSigToConcLinear(
+		double			S0,
+		double*			pOffset,
+		double*			pScale );
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Error handling: jump to the function's func_exit label
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+#define	xz(e)		do { if ( !(e) ) goto func_exit; } while(0)
+#define	xnz(e)	do { if ( (e) ) goto func_exit; } while(0)
+#define	xmsg(m)	do { PR_ErrorMsg( m ); goto func_exit; } while(0)
+
+void	PR_ErrorMsg( const char* Msg );
+
+extern	const char	msgIncorrectIfunc[];
+extern	const char	msgSpecifyL1orL2metric[];
+extern	const char	msgInvalidTimeIndex[];
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Small helpers
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T> inline T	min( T a,T b )	{ return a<b ? a : b; }
+template<class T> inline T	max( T a,T b )	{ return a>b ? a : b; }
+
+inline int	iround( double x )			{ return (int)floor( x+0.5 ); }
+
+template<class T> inline bool	in_interval( T x,T Lo,T Hi )	{ return x>=Lo && x<=Hi; }
+
+inline bool	IsEqual( double a,double b )	{ return fabs( a-b )<=1e-12*max( fabs(a),fabs(b) ); }
+
+inline void	Write( PIVAL& OutParm,double Val )	{ *OutParm++ = Val; }
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Memory
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<class T>
+inline bool	AllocMem(
+		T*&		p,
+		INT64		N )
+{
+	p = (T*)calloc( (size_t)max( N,(INT64)1 ),sizeof(T) );
+	if ( !p ) PR_ErrorMsg( "Out of memory" );
+	return p!=NULL;
+}
+
+template<class T>
+inline void	pf_free( T** p )
+{
+	free( *p );
+	*p = NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Study globals (set by the engine before model init)
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+extern	int		NumTms;			// frames per TAC
+extern	PDOUBLE	AbsTarr;			// absolute frame times (s), NumTms
+extern	BOOL		ParmReq[];			// requested outputs of the current model
+extern	double	demp_NoiseLevel;		// background noise standard deviation
+extern	PDOUBLE	GlobalTac;			// mean TAC of the study (NumTms + padding)
+extern	PDOUBLE*	RoiTacArr;			// ROI mean TACs
+extern	int		NumRoiTac;
+
+enum {
+	MAX_PARMREQ		= 64,
+	GLOBALTAC_PAD	= 8			// samples after GlobalTac[NumTms-1] (repeat the last one)
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Input functions
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct INPUTFUNC {
+	int		n;				// number of samples
+	PDOUBLE	Tarr;				// sample times (s, relative to the first frame); NULL = frame times
+	PDOUBLE	Val;				// samples
+};
+
+typedef INPUTFUNC*	PINPUTFUNC;
+
+PDOUBLE	PR_PrepareInputFunc(
+		PINPUTFUNC	IF,
+		PDOUBLE	Tarr,
+		int		N );
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Time arrays and TAC utilities
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+void		GetStartEndInx( int Start,int Length,int* pStart,int* pEnd );
+PDOUBLE	PR_MakeRelativeArr( PDOUBLE Arr,int N );
+PDOUBLE	PrepareAndCheckTimeArr( int MinNumTms );
+
+double	PR_CalculateIntegral( PDOUBLE Y,PDOUBLE X,int N );
+double	CalculateIntegral( PDOUBLE Y,PDOUBLE X,int N );
+double	PR_IntegrateDiffL1_PWL( PDOUBLE A,PDOUBLE B,PDOUBLE X,int N );
+double	PR_IntegrateDiffL2_PWL( PDOUBLE A,PDOUBLE B,PDOUBLE X,int N );
+
+double	PR_ArrStats( PDOUBLE Arr,int N,PDOUBLE pStdev );
+double	PR_Correlation( PDOUBLE X,PDOUBLE Y,int N );
+void		PR_GetArrMinMax( PDOUBLE Arr,int N,PDOUBLE pMin,PDOUBLE pMax );
+double	FindMaxVal( PDOUBLE Arr,int N,INT64* pInx );
+double	FindMinVal( PDOUBLE Arr,int N,INT64* pInx );
+double	FindThresholdTime( PDOUBLE Y,int N,double Thr,bool Rising,PDOUBLE X );
+bool		IsAir_ByMin( PDOUBLE Tac,double Thresh );
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Volumes and ROI statistics
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct DIM3D {
+	int	x,y,z,c;
+
+	DIM3D( int X=0,int Y=0,int Z=0,int C=1 ) : x(X),y(Y),z(Z),c(C) {}
+};
+
+struct FRAME {
+	DIM3D		Dim;
+	PDOUBLE	Data;				// x*y*z voxels
+};
+
+typedef FRAME*	PFRAME;
+
+struct VA_ROIINFO {
+	INT64		NumVox;
+	double	RoiMinVox,
+			RoiMaxVox,
+			AvgSi,
+			StdDev,
+			Median,
+			Skewness,
+			Kurtosis;
+
+	double	CoeffOfVariation() const	{ return AvgSi!=ZERO ? StdDev/AvgSi : ZERO; }
+};
+
+PFRAME	VA_CreateVol( PDOUBLE Data,int Bits,DIM3D* pDim );
+void		PR_FrameDelete( PFRAME* pV );
+
+bool		VA_VolCalcRoiInfo(
+		bool		UseMask,
+		PFRAME	V,
+		int		RoiNum,
+		PVOID		Mask,
+		int		Flags,
+		double	Vmin,
+		double	Vmax,
+		bool		UseVoid,
+		double	VoidVal,
+		int		NumBins,
+		VA_ROIINFO*	pInfo );
@@ -0,0 +1,13 @@
+# Memory budget of frame streaming: parmmap --watch refuses Model 5, which keeps the TAC of every voxel,
+# without --mem, and --frames refuses accumulators larger than --mem before reading a frame
+#   cmake -DPARMBENCH=... -DPARMMAP=... -DWORK=dir -P CheckBudget.cmake
+
+include(${CMAKE_CURRENT_LIST_DIR}/CheckCommon.cmake)
+
+check_phantom(${WORK} dce 32x32x8 40)
+
+check_refused("keeps the TAC of every voxel" ${PARMMAP} --watch ${WORK}/feed 40 -o ${WORK}/live -m 5 --wait 1)
+
+# Models 0 and 1 take about 10 doubles per voxel here: 0.6 MB
+check_refused("more than --mem" ${PARMMAP} -i ${WORK}/dce.nii --frames -o ${WORK}/small -m 0 -m 1 --mem 0.1)
+check_run(Log ${PARMMAP} -i ${WORK}/dce.nii --frames -o ${WORK}/frames -m 0 -m 1 --mem 4)
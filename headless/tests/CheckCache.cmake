@@ -0,0 +1,33 @@
+# parmmap --cache DIR run twice: the second run reuses the concentration cache of the first and gives
+# the same maps, which also match a run without cache; another conversion type makes a new cache key
+#   cmake -DPARMBENCH=... -DPARMMAP=... -DWORK=dir -P CheckCache.cmake
+
+include(${CMAKE_CURRENT_LIST_DIR}/CheckCommon.cmake)
+
+check_phantom(${WORK} dce 32x32x8 40)
+set(Cache ${WORK}/cache)
+file(MAKE_DIRECTORY ${Cache})
+set(Maps --base 0,4 -m 0 -m 1 -m 3 -m 5)
+
+check_run(Log ${PARMMAP} -i ${WORK}/dce.nii -o ${WORK}/first --cache ${Cache} --conc relenh ${Maps})
+if(NOT Log MATCHES "concentration cache written to ([^\n]*conc_[0-9a-f]+\\.fvc)")
+	message(FATAL_ERROR "the first run writes no cache:\n${Log}")
+endif()
+set(File ${CMAKE_MATCH_1})
+
+check_run(Log ${PARMMAP} -i ${WORK}/dce.nii -o ${WORK}/second --cache ${Cache} --conc relenh ${Maps})
+if(Log MATCHES "cache written" OR NOT Log MATCHES "concentration cache ${File}\n")
+	message(FATAL_ERROR "the second run does not reuse ${File}:\n${Log}")
+endif()
+check_same_maps(${WORK} first second)
+
+check_run(Log ${PARMMAP} -i ${WORK}/dce.nii -o ${WORK}/nocache --conc relenh ${Maps})
+check_same_maps(${WORK} nocache first)
+
+check_run(Log ${PARMMAP} -i ${WORK}/dce.nii -o ${WORK}/diff --cache ${Cache} --conc diff ${Maps})
+file(GLOB Keys ${Cache}/conc_*.fvc)
+list(LENGTH Keys NumKeys)
+if(NOT Log MATCHES "concentration cache written to" OR NOT NumKeys EQUAL 2)
+	message(FATAL_ERROR "--conc diff does not make a second cache key (${NumKeys} in ${Cache}):\n${Log}")
+endif()
+message(STATUS "${NumKeys} cache keys")
@@ -0,0 +1,45 @@
+# Helpers of the command-line checks (cmake -P scripts run by ctest)
+
+# Run a command; fail the check if it fails. The stderr of the command goes to the variable Log.
+function(check_run Log)
+	execute_process(COMMAND ${ARGN} RESULT_VARIABLE Rc OUTPUT_QUIET ERROR_VARIABLE Err)
+	if(NOT Rc EQUAL 0)
+		string(REPLACE ";" " " Cmd "${ARGN}")
+		message(FATAL_ERROR "${Cmd} failed (${Rc}):\n${Err}")
+	endif()
+	set(${Log} "${Err}" PARENT_SCOPE)
+endfunction()
+
+# Run a command that must fail with an error matching Pattern
+function(check_refused Pattern)
+	execute_process(COMMAND ${ARGN} RESULT_VARIABLE Rc OUTPUT_QUIET ERROR_VARIABLE Err)
+	string(REPLACE ";" " " Cmd "${ARGN}")
+	if(Rc EQUAL 0 OR NOT Err MATCHES "${Pattern}")
+		message(FATAL_ERROR "${Cmd} should fail with \"${Pattern}\" (${Rc}):\n${Err}")
+	endif()
+	message(STATUS "refused: ${Err}")
+endfunction()
+
+# Fail the check unless every map <Dir>/<A>_*.nii exists as <Dir>/<B>_*.nii with the same bytes
+function(check_same_maps Dir A B)
+	file(GLOB Maps RELATIVE ${Dir} ${Dir}/${A}_*.nii)
+	if(NOT Maps)
+		message(FATAL_ERROR "no maps ${Dir}/${A}_*.nii")
+	endif()
+	foreach(M ${Maps})
+		string(REGEX REPLACE "^${A}_" "${B}_" N ${M})
+		execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${Dir}/${M} ${Dir}/${N} RESULT_VARIABLE Rc)
+		if(NOT Rc EQUAL 0)
+			message(FATAL_ERROR "${N} differs from ${M}")
+		endif()
+	endforeach()
+	list(LENGTH Maps Num)
+	message(STATUS "${Num} maps of ${B} identical to ${A}")
+endfunction()
+
+# A fresh work directory holding the phantom <Work>/<Kind>.nii
+function(check_phantom Work Kind Size Frames)
+	file(REMOVE_RECURSE ${Work})
+	file(MAKE_DIRECTORY ${Work})
+	check_run(Log ${PARMBENCH} --phantom ${Kind} -s ${Size} -T ${Frames} --write ${Work}/${Kind}.nii)
+endfunction()
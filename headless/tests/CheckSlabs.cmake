@@ -0,0 +1,22 @@
+# parmmap --mem (out-of-core slabs) against a full in-memory pass: every map byte for byte, with a
+# budget that cuts the 24-slice phantom into at least three slabs (five, the last one short)
+#   cmake -DPARMBENCH=... -DPARMMAP=... -DWORK=dir -P CheckSlabs.cmake
+
+include(${CMAKE_CURRENT_LIST_DIR}/CheckCommon.cmake)
+
+check_phantom(${WORK} dce 32x32x24 40)
+set(Maps --conc relenh --base 0,4 -m 0 -m 1 -m 3 -m 5)
+
+check_run(Log ${PARMMAP} -i ${WORK}/dce.nii -o ${WORK}/full -t 3 ${Maps})
+check_run(Log ${PARMMAP} -i ${WORK}/dce.nii -o ${WORK}/slab -t 3 --mem 4 ${Maps})
+
+if(NOT Log MATCHES "([0-9]+)-slice slabs")
+	message(FATAL_ERROR "the --mem run reports no slabs:\n${Log}")
+endif()
+math(EXPR NumSlabs "(24+${CMAKE_MATCH_1}-1)/${CMAKE_MATCH_1}")
+if(NumSlabs LESS 3)
+	message(FATAL_ERROR "--mem 4 gives ${NumSlabs} slab(s) of ${CMAKE_MATCH_1} slices; the check needs 3 or more")
+endif()
+message(STATUS "${NumSlabs} slabs of ${CMAKE_MATCH_1} slices")
+
+check_same_maps(${WORK} full slab)